@@ -28,6 +28,10 @@
 #include <gcrypt.h>
 #include <unistd.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define LCA_SHA256_DLEN 32
 
 enum LCA_LOG_LEVEL
@@ -196,6 +200,32 @@ lca_xor_buffers (const struct lca_octet_buffer lhs,
 unsigned int
 lca_c2b (char c) __attribute__ ((const));
 
+/**
+ * Encodes binary data as upper case ASCII hex.  Uses SSSE3 or AVX2
+ * when the CPU supports it.
+ *
+ * @param in The data to encode.
+ * @param len The length of the data.
+ * @param out The destination, which must hold 2 * len characters.  It
+ * is not null terminated.
+ */
+void
+lca_hex_encode (const uint8_t *in, size_t len, char *out);
+
+/**
+ * Decodes ASCII hex, upper or lower case, into binary.  Uses SSSE3 or
+ * AVX2 when the CPU supports it.
+ *
+ * @param in The hex characters, not necessarily null terminated.
+ * @param len The number of characters, which must be even.
+ * @param out The destination, which must hold len / 2 bytes.
+ *
+ * @return 0 on success, otherwise -1 if len is odd or a non-hex
+ * character was found.  The contents of out are undefined on error.
+ */
+int
+lca_hex_decode (const char *in, size_t len, uint8_t *out);
+
 /* CRC Functions */
 
 /**
@@ -277,6 +307,32 @@ unsigned int
 lca_serialize_command (struct Command_ATSHA204 *c,
                         uint8_t **serialized);
 
+/**
+ * Sends a command frame, laid out as lca_serialize_command does, and
+ * reads a fixed size response.  Unlike lca_send_and_receive this
+ * keeps the library's state about the device: the TempKey digest
+ * used by the verification cache is forgotten, or recorded for a
+ * pass through nonce, and a private key GenKey drops the slot's
+ * cached public key and ECDH secrets.  Writes, locks and DeriveKey
+ * should use their own calls, which also keep the zone caches.
+ *
+ * @param fd The open file descriptor.
+ * @param frame The frame.
+ * @param frame_len Its length.
+ * @param rec_buf The response buffer.
+ * @param recv_len The expected response length.
+ * @param wait_time The command execution time.
+ *
+ * @return The response status.
+ */
+enum LCA_STATUS_RESPONSE
+lca_send_frame (int fd,
+                const uint8_t *frame,
+                unsigned int frame_len,
+                uint8_t *rec_buf,
+                unsigned int recv_len,
+                struct timespec *wait_time);
+
 enum LCA_STATUS_RESPONSE
 lca_read_and_validate (int fd,
                         uint8_t *buf,
@@ -301,6 +357,56 @@ lca_send_and_get_rsp (int fd,
 struct lca_octet_buffer
 lca_sha256 (FILE *fp);
 
+/**
+ * How lca_sha256_fd reads a file.  AUTO maps regular files and reads
+ * anything else, such as pipes, in large blocks.  OVERLAP reads on a
+ * second thread while the caller hashes, which helps when both the
+ * disk and the hash are slow.
+ */
+enum LCA_HASH_FILE_MODE
+  {
+    LCA_HASH_FILE_AUTO = 0,
+    LCA_HASH_FILE_MMAP,
+    LCA_HASH_FILE_READ,
+    LCA_HASH_FILE_OVERLAP
+  };
+
+/**
+ * SHA256s a file from its current offset to the end, leaving the
+ * offset at the end.  Files that cannot be mapped are read instead.
+ *
+ * @param fd The file descriptor.
+ * @param mode How to read it.
+ * @param digest The LCA_SHA256_DLEN byte result.
+ *
+ * @return False on a read error.
+ */
+bool
+lca_sha256_fd (int fd, enum LCA_HASH_FILE_MODE mode, uint8_t *digest);
+
+/* One file for lca_sha256_files */
+struct lca_file_digest
+{
+  const char *path;
+  uint8_t digest[LCA_SHA256_DLEN];
+  bool ok;
+};
+
+/**
+ * SHA256s many files in parallel, as for signing a release.
+ *
+ * @param files The paths to hash, each of which gets its digest and
+ * whether it could be read.
+ * @param count The number of files.
+ * @param workers The number of threads, counting the caller, or 0 for
+ * one per online CPU.
+ *
+ * @return The number of files hashed.
+ */
+unsigned int
+lca_sha256_files (struct lca_file_digest *files, unsigned int count,
+                  unsigned int workers);
+
 /**
  * SHA256s a file and returns the gcrypt digest
  *
@@ -322,6 +428,31 @@ lca_hash_file (FILE *fp, gcry_sexp_t *digest);
 struct lca_octet_buffer
 lca_sha256_buffer (struct lca_octet_buffer data);
 
+enum LCA_SHA256_IMPL
+  {
+    LCA_SHA256_AUTO = 0,        /* Native when the CPU has it */
+    LCA_SHA256_PORTABLE,        /* Plain C only */
+    LCA_SHA256_NATIVE,          /* SHA-NI or the ARMv8 crypto extensions */
+    LCA_SHA256_GCRYPT,          /* gcrypt for one shot digests */
+    LCA_SHA256_CROSSCHECK       /* Both, asserting they agree */
+  };
+
+/**
+ * Selects how the library hashes small fixed size messages, such as
+ * the MAC and HMAC layouts, nonces and lca_sha256_buffer input.  By
+ * default the built-in SHA-256 uses the SHA-NI instructions on x86 or
+ * the crypto extensions on ARMv8 when the CPU has them.  Keyed HMAC
+ * contexts always use the built-in compression function, since they
+ * need its midstates.
+ *
+ * @param impl The implementation.
+ *
+ * @return False if LCA_SHA256_NATIVE was asked for and the CPU lacks
+ * it, in which case nothing changes.
+ */
+bool
+lca_sha256_select (enum LCA_SHA256_IMPL impl);
+
 /**
  * Performs an offline verification of a MAC using the default settings.
  *
@@ -369,6 +500,223 @@ lca_soft_hmac256_defaults(struct lca_octet_buffer challenge,
                           struct lca_octet_buffer key,
                           uint8_t key_slot);
 
+/* An HMAC-SHA256 key schedule: the hash states after absorbing the
+   inner and outer padded key.  It may be kept per device key and
+   shared between threads, since computing with it does not modify
+   it. */
+struct lca_hmac_ctx
+{
+  uint32_t inner[8];
+  uint32_t outer[8];
+};
+
+/**
+ * Precomputes the HMAC-SHA256 pads for a key.
+ *
+ * @param ctx The context to set up.
+ * @param key The key.
+ * @param key_len The key length, keys longer than 64 bytes are hashed
+ * first.
+ */
+void
+lca_hmac_init (struct lca_hmac_ctx *ctx, const uint8_t *key, size_t key_len);
+
+/**
+ * Wipes the key schedule.
+ *
+ * @param ctx The context.
+ */
+void
+lca_hmac_wipe (struct lca_hmac_ctx *ctx);
+
+/**
+ * HMAC-SHA256s a message without allocating.
+ *
+ * @param ctx The keyed context.
+ * @param msg The message.
+ * @param len The message length.
+ * @param mac The LCA_SHA256_DLEN byte result.
+ */
+void
+lca_hmac_compute (const struct lca_hmac_ctx *ctx, const uint8_t *msg,
+                  size_t len, uint8_t *mac);
+
+/**
+ * Checks an HMAC-SHA256 in constant time.
+ *
+ * @param ctx The keyed context.
+ * @param msg The message.
+ * @param len The message length.
+ * @param mac The LCA_SHA256_DLEN byte HMAC to check.
+ *
+ * @return True if matched.
+ */
+bool
+lca_hmac_verify (const struct lca_hmac_ctx *ctx, const uint8_t *msg,
+                 size_t len, const uint8_t *mac);
+
+/**
+ * Computes the device's response to an HMAC command with the default
+ * settings, as lca_soft_hmac256_defaults does.
+ *
+ * @param ctx The context keyed with the 32 byte slot key.
+ * @param challenge The 32 byte challenge.
+ * @param key_slot The key slot (0-15).
+ * @param mac The LCA_SHA256_DLEN byte result.
+ */
+void
+lca_hmac_defaults (const struct lca_hmac_ctx *ctx, const uint8_t *challenge,
+                   uint8_t key_slot, uint8_t *mac);
+
+/**
+ * Verifies the device's response to an HMAC command with the default
+ * settings, as lca_verify_hmac_defaults does.
+ *
+ * @param ctx The context keyed with the 32 byte slot key.
+ * @param challenge The 32 byte challenge.
+ * @param response The 32 byte response.
+ * @param key_slot The key slot (0-15).
+ *
+ * @return True if matched.
+ */
+bool
+lca_hmac_verify_defaults (const struct lca_hmac_ctx *ctx,
+                          const uint8_t *challenge, const uint8_t *response,
+                          uint8_t key_slot);
+
+/* A device MAC response to check, see lca_verify_hash_defaults */
+struct lca_mac_item
+{
+  const uint8_t *challenge;
+  const uint8_t *response;
+  const uint8_t *key;
+  uint8_t key_slot;
+};
+
+/* A device HMAC response to check, see lca_hmac_verify_defaults */
+struct lca_hmac_item
+{
+  const struct lca_hmac_ctx *ctx;
+  const uint8_t *challenge;
+  const uint8_t *response;
+  uint8_t key_slot;
+};
+
+/**
+ * Verifies many MAC responses made with the default settings at once.
+ * The messages are hashed side by side with AVX2 or AVX-512 when the
+ * CPU has them.
+ *
+ * @param items The responses to check, each with its 32 byte
+ * challenge, response and key.
+ * @param count The number of items.
+ * @param results A bitmap of (count + 7) / 8 bytes; bit i, counting
+ * from the least significant bit of the first byte, is set if item i
+ * matched.
+ *
+ * @return The number of items that matched.
+ */
+unsigned int
+lca_verify_mac_batch (const struct lca_mac_item *items, unsigned int count,
+                      uint8_t *results);
+
+/**
+ * Verifies many HMAC responses made with the default settings at
+ * once, as lca_verify_mac_batch does for MACs.
+ *
+ * @param items The responses to check.
+ * @param count The number of items.
+ * @param results A bitmap of (count + 7) / 8 bytes.
+ *
+ * @return The number of items that matched.
+ */
+unsigned int
+lca_verify_hmac_batch (const struct lca_hmac_item *items, unsigned int count,
+                       uint8_t *results);
+
+/* MAC and HMAC command mode bits */
+#define LCA_MAC_MODE_CHALLENGE_TEMPKEY 0x01 /* MAC: TempKey, not challenge */
+#define LCA_MAC_MODE_KEY_TEMPKEY 0x02       /* MAC: TempKey, not the slot */
+#define LCA_MAC_MODE_SOURCE_FLAG 0x04       /* TempKey.SourceFlag */
+#define LCA_MAC_MODE_OTP88 0x10             /* Include OTP[0:10] */
+#define LCA_MAC_MODE_OTP64 0x20             /* Include OTP[0:7] */
+#define LCA_MAC_MODE_SN 0x40                /* Include SN[2:7] */
+
+/* A device's MAC or HMAC message with everything that does not change
+   per challenge laid out in advance.  Build one per device, key and
+   mode with lca_mac_template_init. */
+struct lca_mac_template
+{
+  uint8_t opcode;
+  uint8_t mode;
+  uint8_t key[32];
+  /* The padded last block of the message */
+  uint8_t last[64];
+  /* HMAC: the key schedule */
+  struct lca_hmac_ctx hmac;
+};
+
+/**
+ * Prepares a template for computing a device's MAC or HMAC responses
+ * on the host, for any combination of mode bits.
+ *
+ * @param t The template to fill.
+ * @param opcode COMMAND_MAC (0x08) or COMMAND_HMAC (0x11).
+ * @param mode The mode byte, from the LCA_MAC_MODE bits.
+ * @param key_slot The key slot (0-15).
+ * @param key The 32 byte slot key, or NULL for a MAC that takes both
+ * inputs from TempKey.
+ * @param otp The first 11 bytes of the OTP zone, or NULL if the mode
+ * does not include them.
+ * @param serial The LCA_SERIAL_NUM_LEN byte serial number, or NULL if
+ * the mode does not include it.
+ *
+ * @return False if the mode is not valid for the opcode or an input it
+ * needs is missing.
+ */
+bool
+lca_mac_template_init (struct lca_mac_template *t, uint8_t opcode,
+                       uint8_t mode, uint8_t key_slot, const uint8_t *key,
+                       const uint8_t *otp, const uint8_t *serial);
+
+/**
+ * Wipes a template.
+ *
+ * @param t The template.
+ */
+void
+lca_mac_template_wipe (struct lca_mac_template *t);
+
+/**
+ * Computes the response the device gives for a template.  Only the
+ * first block of the message, and for HMAC the outer block, are hashed
+ * per call.
+ *
+ * @param t The template.
+ * @param challenge The 32 byte challenge, used by a MAC unless the mode
+ * takes it from TempKey.
+ * @param tempkey The 32 byte TempKey contents, used when the mode or
+ * an HMAC calls for it, otherwise may be NULL.
+ * @param mac The LCA_SHA256_DLEN byte result.
+ */
+void
+lca_mac_compute (const struct lca_mac_template *t, const uint8_t *challenge,
+                 const uint8_t *tempkey, uint8_t *mac);
+
+/**
+ * Verifies a device response in constant time.
+ *
+ * @param t The template.
+ * @param challenge See lca_mac_compute.
+ * @param tempkey See lca_mac_compute.
+ * @param response The 32 byte response.
+ *
+ * @return True if matched.
+ */
+bool
+lca_mac_verify (const struct lca_mac_template *t, const uint8_t *challenge,
+                const uint8_t *tempkey, const uint8_t *response);
+
 /* I2C Functions */
 
 /**
@@ -406,6 +754,28 @@ lca_read(int fd, unsigned char *buf, unsigned int len);
 bool
 lca_idle(int fd);
 
+/**
+ * Takes the device's lock.  Each command, wake, idle and sleep takes
+ * it for its own exchange, and the library's multi command sessions,
+ * such as the entropy pool's refills and lca_ecc_sign_batch, hold it
+ * from wake to idle.  A caller whose commands must run back to back,
+ * e.g. a nonce and the sign that uses TempKey, holds it around them
+ * so other threads using fd wait rather than interleave.  The lock is
+ * recursive and is per file descriptor.
+ *
+ * @param fd The open file descriptor.
+ */
+void
+lca_device_lock (int fd);
+
+/**
+ * Releases a lca_device_lock.
+ *
+ * @param fd The open file descriptor.
+ */
+void
+lca_device_unlock (int fd);
+
 /**
  * Sets up the device for communication.
  *
@@ -439,171 +809,1000 @@ lca_ecdsa_p256_verify (struct lca_octet_buffer pub_key,
                         struct lca_octet_buffer signature,
                         struct lca_octet_buffer sha256_digest);
 
+/* Host Crypto Backends */
+
 /**
- * Adds the uncompressed point format tag (0x04) to the Public Key
- *
- * @param q The 64 byte P-256 public key
- *
- * @return A new malloc'd buffer with 65 bytes, starting with
- * 0x04. The original buffer will be free'd
+ * The host side digests, HMACs and P-256 operations run on one of
+ * these.  The default is chosen with --with-crypto-backend at
+ * configure time; OpenSSL is only available if it was found.
  */
-struct lca_octet_buffer
-lca_add_uncompressed_point_tag (struct lca_octet_buffer q);
+enum LCA_BACKEND
+  {
+    LCA_BACKEND_GCRYPT = 0,
+    LCA_BACKEND_OPENSSL,
+    LCA_BACKEND_BUILTIN
+  };
 
 /**
- * Prints out the sexp to the logging facility.
+ * Reports whether a backend was compiled in.
  *
- * @param to_print The sexp to print.
+ * @param b The backend.
+ *
+ * @return True if it can be selected.
  */
-void
-lca_print_sexp (gcry_sexp_t to_print);
+bool
+lca_backend_available (enum LCA_BACKEND b);
 
 /**
- * Creates an ECDSA P256 Key pair in software.
+ * Switches the host crypto backend for the whole process.
  *
- * @param key Pointer to key storage
+ * @param b The backend.
  *
- * @return libgcrypt result code
+ * @return False if it is not available or failed to initialize.
  */
-int
-lca_gen_soft_keypair (gcry_sexp_t *key);
+bool
+lca_backend_select (enum LCA_BACKEND b);
 
-int
-lca_soft_sign (gcry_sexp_t *key_pair, struct lca_octet_buffer hash,
-               gcry_sexp_t  *sig_out);
+enum LCA_BACKEND
+lca_backend_current (void);
 
 /**
- * Load an ECDSA private key from a file.
+ * Returns a backend's name for logs.
  *
- * @param keyfile The file to load.
- * @param key The gcrypt key struct to fill in
+ * @param b The backend.
  *
- * @return 0 on success
+ * @return The name, or NULL if not available.
  */
-int
-lca_load_signing_key (const char *keyfile, gcry_sexp_t *key);
-
-int
-lca_ssig2buffer (const gcry_sexp_t *sig, struct lca_octet_buffer *r_out,
-                 struct lca_octet_buffer *s_out);
-
-struct lca_octet_buffer
-lca_sig2buf (const gcry_sexp_t *sig);
-
-/* ATECCX08 Commands */
+const char *
+lca_backend_name (enum LCA_BACKEND b);
 
 /**
- * Generates a private or public key in the specified slot. If private
-* is true, it will generate a new private key. If false, it will
- * return the *public* key from the *existing* private key in that slot.
+ * Verifies a P-256 ECDSA signature on the selected backend.
  *
- * @param fd The open file descriptor.
- * @param key_id The key ID on which to operate.
- * @param private True if a new private key is desired, otherwise false.
+ * @param pub_key The 64 byte public key, x || y without the tag.
+ * @param digest The 32 byte digest.
+ * @param signature The 64 byte r || s signature.
  *
- * @return In either case, this will return the *public* key of the
- * specified key slot. The caller should check if the pointer is null,
- * which signifies an error.
+ * @return True if valid.
  */
-struct lca_octet_buffer
-lca_gen_ecc_key (int fd,
-                      uint8_t key_id,
-                      bool private);
+bool
+lca_p256_verify (const uint8_t *pub_key, const uint8_t *digest,
+                 const uint8_t *signature);
 
 /**
- * Performs an ECC signature over the data loaded in tempkey
- * register. You must run the load nonce command first to populate
- * this register.
+ * Signs a digest with a P-256 private key on the selected backend.
  *
- * @param fd The open file descriptor.
- * @param key_id The key ID for the key you want to use.
+ * @param priv_key The 32 byte private key.
+ * @param digest The 32 byte digest.
+ * @param signature The 64 byte r || s result.
  *
- * @return The signature as one buffer: R + S.
+ * @return True if successful.
  */
-struct lca_octet_buffer
-lca_ecc_sign (int fd,
-                   uint8_t key_id);
+bool
+lca_p256_sign (const uint8_t *priv_key, const uint8_t *digest,
+               uint8_t *signature);
 
 /**
- * Verifies an ECDSA Signature. Requires that the data, which was
- * signed, was first loaded with the nonce command.
+ * Generates a P-256 key pair on the selected backend.
  *
- * @param fd The open file descriptor.
- * @param pub_key The Public Key matching the private key that signed
- * the data.
- * @param signature The resultant signature.
+ * @param priv_key The 32 byte private key result.
+ * @param pub_key The 64 byte public key result.
  *
- * @return True if the signature is valid otherwise false
+ * @return True if successful.
  */
 bool
-lca_ecc_verify (int fd,
-                     struct lca_octet_buffer pub_key,
-                     struct lca_octet_buffer signature);
+lca_p256_keygen (uint8_t *priv_key, uint8_t *pub_key);
 
 /**
- * Compute the master secret from ECDH between the passed in public
- * key and the key stored in slot @slot.
+ * Computes a P-256 ECDH shared secret on the selected backend, the x
+ * coordinate of the shared point as the device's ECDH command returns.
  *
- * @param fd The open fd for the device.
- * @param slot The slot which should contain an ECDSA Private Key.
- * @param x The x component of the corresponding key to do the exchange.
- * @param y Like param x, but the y component.
+ * @param priv_key The 32 byte private key.
+ * @param pub_key The 64 byte peer public key.
+ * @param secret The 32 byte result.
  *
- * @return The buffer containing the master secret which will be 32
- * bytes or the buffer will indicate 0 bytes on failure.
+ * @return False if a key is invalid.
  */
-struct lca_octet_buffer
-lca_ecdh (int fd, uint8_t slot,
-          struct lca_octet_buffer x, struct lca_octet_buffer y);
-
-/* ATSHA204 Commands */
+bool
+lca_p256_ecdh (const uint8_t *priv_key, const uint8_t *pub_key,
+               uint8_t *secret);
 
-enum DATA_ZONE
-  {
-    CONFIG_ZONE = 0,
-    OTP_ZONE = 1,
-    DATA_ZONE = 2
-  };
+/* P-256 Public Key Objects */
 
-/* Random Commands */
+/**
+ * A public key imported once for verifying many signatures.  Import
+ * validates the point and precomputes multiples of it, about 60 KiB,
+ * so each verify is a few times faster than lca_p256_verify.  Keys
+ * always use the built-in arithmetic, whatever the selected backend,
+ * and may be shared between threads.
+ */
+struct lca_p256_key;
 
-struct Command_ATSHA204
-lca_build_random_cmd (bool update_seed);
+/* A digest and its 64 byte r || s signature */
+struct lca_p256_sig_item
+{
+  const uint8_t *digest;
+  const uint8_t *signature;
+};
 
 /**
- * Get 32 bytes of random data from the device
+ * Imports a public key.
  *
- * @param fd The open file descriptor
- * @param update_seed True updates the seed.  Do this sparingly.
+ * @param pub_key The 65 byte key in the tagged form from
+ * lca_add_uncompressed_point_tag.
  *
- * @return A malloc'ed buffer with random data.
+ * @return A new key to free with lca_p256_key_free, or NULL if the
+ * point is invalid.
  */
-struct lca_octet_buffer
-lca_get_random (int fd, bool update_seed);
+struct lca_p256_key *
+lca_p256_key_import (const uint8_t *pub_key);
 
+void
+lca_p256_key_free (struct lca_p256_key *key);
 
 /**
- * Builds the command structure for a read4 command.
+ * Verifies a signature with an imported key.
  *
- * @param zone The zone from which to read.
- * @param addr The desired read address.
+ * @param key The key.
+ * @param digest The 32 byte digest.
+ * @param signature The 64 byte r || s signature.
  *
- * @return The populated command structure.
+ * @return True if valid.
  */
-struct Command_ATSHA204
-lca_build_read4_cmd (enum DATA_ZONE zone, uint8_t addr);
+bool
+lca_p256_key_verify (const struct lca_p256_key *key, const uint8_t *digest,
+                     const uint8_t *signature);
 
 /**
- * Builds the command structure for the write 4 command.
+ * Verifies many signatures under one key at once, cheaper per
+ * signature than lca_p256_key_verify.
  *
- * @param zone The zone to which to write.
- * @param addr The address to which to write.
- * @param buf The 4 byte buffer, which will be written.
+ * @param key The key.
+ * @param items The digests and signatures.
+ * @param count The number of items.
+ * @param results A bitmap of (count + 7) / 8 bytes, bit x set if item
+ * x is valid.
  *
- * @return The populated command struct.
+ * @return The number of valid signatures.
  */
-struct Command_ATSHA204
-lca_build_write4_cmd (enum DATA_ZONE zone, uint8_t addr, uint32_t buf);
+unsigned int
+lca_p256_key_verify_batch (const struct lca_p256_key *key,
+                           const struct lca_p256_sig_item *items,
+                           unsigned int count, uint8_t *results);
+
+/* Verification Thread Pools */
+
+/**
+ * A fixed set of threads for verifying large batches of signatures,
+ * such as signed log or telemetry records, under imported keys.
+ */
+struct lca_verify_pool;
+
+/* One signature to check */
+struct lca_verify_job
+{
+  const struct lca_p256_key *key;
+  const uint8_t *digest;
+  const uint8_t *signature;
+};
+
+/**
+ * Starts a pool.
+ *
+ * @param workers The number of threads, counting the caller of
+ * lca_verify_pool_run, or 0 for one per online CPU.
+ *
+ * @return The pool, or NULL if the threads could not be started.
+ */
+struct lca_verify_pool *
+lca_verify_pool_new (unsigned int workers);
+
+/**
+ * Stops the threads and frees the pool.
+ *
+ * @param pool The pool, which must not be running.
+ */
+void
+lca_verify_pool_free (struct lca_verify_pool *pool);
+
+unsigned int
+lca_verify_pool_workers (const struct lca_verify_pool *pool);
+
+/**
+ * Verifies a batch of jobs across the pool and returns when all are
+ * done.  Runs of consecutive jobs under the same key are verified
+ * together as lca_p256_key_verify_batch does, so grouping jobs by key
+ * is faster.  Concurrent runs on one pool take turns.
+ *
+ * @param pool The pool.
+ * @param jobs The jobs; their keys must stay alive until this returns.
+ * @param count The number of jobs.
+ * @param valid The count results, valid[x] set if job x verified.
+ *
+ * @return The number of valid signatures.
+ */
+unsigned int
+lca_verify_pool_run (struct lca_verify_pool *pool,
+                     const struct lca_verify_job *jobs, unsigned int count,
+                     bool *valid);
+
+/* Merkle Batch Signing */
+
+/**
+ * The device takes tens of milliseconds per signature, so a busy
+ * signer collects the digests that arrive in a short window, builds a
+ * Merkle tree over them and signs only the root.  Each caller gets the
+ * root signature plus the sibling hashes from its leaf up, which a
+ * verifier needs along with the public key.
+ */
+#define LCA_MERKLE_MAX_DEPTH 16
+#define LCA_MERKLE_MAX_LEAVES (1u << LCA_MERKLE_MAX_DEPTH)
+
+struct lca_merkle_proof
+{
+  uint8_t signature[64];
+  uint32_t index;
+  uint32_t count;
+  unsigned int depth;
+  uint8_t path[LCA_MERKLE_MAX_DEPTH][LCA_SHA256_DLEN];
+};
+
+/**
+ * Builds a Merkle tree over digests.  Leaves are SHA-256 (0x00 ||
+ * digest), nodes SHA-256 (0x01 || left || right) and the last node of
+ * an odd level moves up unchanged.
+ *
+ * @param digests The 32 byte leaves.
+ * @param count The number of leaves, 1 to LCA_MERKLE_MAX_LEAVES.
+ * @param root The 32 byte root result.
+ * @param proofs NULL, or count proofs to fill in without signatures.
+ *
+ * @return True if count is in range.
+ */
+bool
+lca_merkle_build (const uint8_t (*digests)[LCA_SHA256_DLEN],
+                  unsigned int count, uint8_t *root,
+                  struct lca_merkle_proof *proofs);
+
+/**
+ * Recomputes the root a proof leads to from its digest.
+ *
+ * @param digest The 32 byte digest.
+ * @param proof The proof.
+ * @param root The 32 byte root result.
+ *
+ * @return False if the proof is malformed.
+ */
+bool
+lca_merkle_root (const uint8_t *digest, const struct lca_merkle_proof *proof,
+                 uint8_t *root);
+
+/**
+ * Verifies a digest signed in a batch.
+ *
+ * @param pub_key The 64 byte public key, x || y without the tag.
+ * @param digest The 32 byte digest.
+ * @param proof Its proof.
+ *
+ * @return True if the proof leads to a root the signature covers.
+ */
+bool
+lca_merkle_verify (const uint8_t *pub_key, const uint8_t *digest,
+                   const struct lca_merkle_proof *proof);
+
+struct lca_merkle_signer;
+
+/**
+ * Starts a batching signer on its own thread.  The signer wakes the
+ * device for each root and idles it afterwards, holding
+ * lca_device_lock on fd in between.
+ *
+ * @param fd The open device.
+ * @param key_slot The slot of the signing key.
+ * @param window_us How long to collect digests after the first.
+ * @param max_batch The most digests per root, at most
+ * LCA_MERKLE_MAX_LEAVES.
+ *
+ * @return The signer, or NULL if its thread could not start.
+ */
+struct lca_merkle_signer *
+lca_merkle_signer_new (int fd, uint8_t key_slot, unsigned int window_us,
+                       unsigned int max_batch);
+
+/**
+ * Signs what is queued, stops the thread and frees the signer.
+ *
+ * @param signer The signer, with no callers left in lca_merkle_sign.
+ */
+void
+lca_merkle_signer_free (struct lca_merkle_signer *signer);
+
+/**
+ * Queues a digest and waits for its batch to be signed.  Safe to call
+ * from many threads.
+ *
+ * @param signer The signer.
+ * @param digest The 32 byte digest.
+ * @param proof The proof result.
+ *
+ * @return True if the batch's root was signed.
+ */
+bool
+lca_merkle_sign (struct lca_merkle_signer *signer, const uint8_t *digest,
+                 struct lca_merkle_proof *proof);
+
+/* Verification Result Cache */
+
+/**
+ * Successful results of lca_ecdsa_p256_verify and lca_ecc_verify are
+ * remembered, keyed by a hash of the public key, digest and
+ * signature, so repeated verification of the same triple is free.
+ * For lca_ecc_verify the digest is the one loaded by load_nonce.
+ * Failures are never cached.
+ *
+ * The cache is shared by all threads and devices and is safe to use
+ * from any of them, including while lca_verify_cache_resize runs.
+ */
+struct lca_verify_cache_stats
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t inserts;
+  uint64_t evictions;
+};
+
+/**
+ * Drops all remembered results.
+ *
+ */
+void
+lca_verify_cache_flush (void);
+
+/**
+ * Sets the number of remembered results, dropping the current ones.
+ * The default is 64.
+ *
+ * @param entries_max The new size.  Zero disables the cache.
+ */
+void
+lca_verify_cache_resize (unsigned int entries_max);
+
+/**
+ * Returns the cache counters.
+ *
+ * @param out Receives the counters.
+ */
+void
+lca_verify_cache_get_stats (struct lca_verify_cache_stats *out);
+
+/* Fleet Inventory Index */
+
+#define LCA_SERIAL_NUM_LEN 9
+#define LCA_TAGGED_PUB_KEY_LEN 65
+
+/**
+ * One device public key, as stored in an inventory index.  The
+ * public key is in the tagged form from
+ * lca_add_uncompressed_point_tag.
+ */
+struct lca_inventory_entry
+{
+  uint8_t serial[LCA_SERIAL_NUM_LEN];
+  uint8_t slot;
+  uint8_t pub_key[LCA_TAGGED_PUB_KEY_LEN];
+};
+
+/* An open, read only inventory index */
+struct lca_inventory;
+
+/**
+ * Writes an inventory index mapping device serial numbers and slots
+ * to public keys.  The file is replaced atomically.
+ *
+ * @param path The index file to write.
+ * @param entries The entries, which are sorted in place.
+ * @param count The number of entries.
+ *
+ * @return 0 on success, -2 if a serial number and slot appear twice,
+ * -1 on other errors.
+ */
+int
+lca_inventory_write (const char *path,
+                     struct lca_inventory_entry *entries, size_t count);
+
+/**
+ * Maps an inventory index.  Nothing is parsed or copied, so opening
+ * is constant time regardless of the fleet size.
+ *
+ * @param path The index file.
+ *
+ * @return The open index, or NULL if the file is missing or not an
+ * index.  Close it with lca_inventory_close.
+ */
+struct lca_inventory *
+lca_inventory_open (const char *path);
+
+/**
+ * Unmaps an inventory index.
+ *
+ * @param inv The index, may be NULL.
+ */
+void
+lca_inventory_close (struct lca_inventory *inv);
+
+/**
+ * Returns the number of keys in the index.
+ *
+ * @param inv The open index.
+ */
+uint32_t
+lca_inventory_size (const struct lca_inventory *inv);
+
+/**
+ * Finds the public key of a device slot.
+ *
+ * @param inv The open index.
+ * @param serial The LCA_SERIAL_NUM_LEN byte serial number, as
+ * returned by get_serial_num.
+ * @param slot The key slot.
+ *
+ * @return A pointer to the LCA_TAGGED_PUB_KEY_LEN byte key inside
+ * the index, valid until it is closed, or NULL if not found.
+ */
+const uint8_t *
+lca_inventory_lookup (const struct lca_inventory *inv,
+                      const uint8_t *serial, uint8_t slot);
+
+/**
+ * Verifies a signature from a device slot against its indexed key.
+ *
+ * @param inv The open index.
+ * @param serial The device serial number.
+ * @param slot The key slot that signed.
+ * @param signature The 64 byte signature, R + S.
+ * @param sha256_digest The signed digest.
+ *
+ * @return True if the device is known and the signature is valid.
+ */
+bool
+lca_inventory_verify (const struct lca_inventory *inv,
+                      const uint8_t *serial, uint8_t slot,
+                      struct lca_octet_buffer signature,
+                      struct lca_octet_buffer sha256_digest);
+
+/**
+ * Adds the uncompressed point format tag (0x04) to the Public Key
+ *
+ * @param q The 64 byte P-256 public key
+ *
+ * @return A new malloc'd buffer with 65 bytes, starting with
+ * 0x04. The original buffer will be free'd
+ */
+struct lca_octet_buffer
+lca_add_uncompressed_point_tag (struct lca_octet_buffer q);
+
+/**
+ * Prints out the sexp to the logging facility.
+ *
+ * @param to_print The sexp to print.
+ */
+void
+lca_print_sexp (gcry_sexp_t to_print);
+
+/**
+ * Creates an ECDSA P256 Key pair in software.
+ *
+ * @param key Pointer to key storage
+ *
+ * @return libgcrypt result code
+ */
+int
+lca_gen_soft_keypair (gcry_sexp_t *key);
+
+int
+lca_soft_sign (gcry_sexp_t *key_pair, struct lca_octet_buffer hash,
+               gcry_sexp_t  *sig_out);
+
+/**
+ * Load an ECDSA private key from a file.
+ *
+ * @param keyfile The file to load.
+ * @param key The gcrypt key struct to fill in
+ *
+ * @return 0 on success
+ */
+int
+lca_load_signing_key (const char *keyfile, gcry_sexp_t *key);
+
+int
+lca_ssig2buffer (const gcry_sexp_t *sig, struct lca_octet_buffer *r_out,
+                 struct lca_octet_buffer *s_out);
+
+struct lca_octet_buffer
+lca_sig2buf (const gcry_sexp_t *sig);
+
+/* ATECCX08 Commands */
+
+/**
+ * Generates a private or public key in the specified slot. If gen_private
+ * is true, it will generate a new private key. If false, it will
+ * return the *public* key from the *existing* private key in that slot.
+ *
+ * @param fd The open file descriptor.
+ * @param key_id The key ID on which to operate.
+ * @param gen_private True if a new private key is desired, otherwise false.
+ *
+ * @return In either case, this will return the *public* key of the
+ * specified key slot. The caller should check if the pointer is null,
+ * which signifies an error.
+ */
+struct lca_octet_buffer
+lca_gen_ecc_key (int fd,
+                      uint8_t key_id,
+                      bool gen_private);
+
+/**
+ * Performs an ECC signature over the data loaded in tempkey
+ * register. You must run the load nonce command first to populate
+ * this register.
+ *
+ * @param fd The open file descriptor.
+ * @param key_id The key ID for the key you want to use.
+ *
+ * @return The signature as one buffer: R + S.
+ */
+struct lca_octet_buffer
+lca_ecc_sign (int fd,
+                   uint8_t key_id);
+
+/* One digest for lca_ecc_sign_batch */
+struct lca_sign_item
+{
+  const uint8_t *digest;
+  uint8_t signature[64];
+  bool ok;
+};
+
+/**
+ * Signs many 32 byte digests with one key, running the pass through
+ * nonce and sign pairs back to back in one wake session.  The device
+ * is idled and woken again between pairs before its watchdog would
+ * expire, and after any failure, and is left idle at the end.
+ * lca_device_lock is held throughout.
+ *
+ * @param fd The open file descriptor.
+ * @param key_id The slot of the signing key.
+ * @param items The digests, with each signature and ok set on return.
+ * @param count The number of items.
+ *
+ * @return The number of digests signed.
+ */
+unsigned int
+lca_ecc_sign_batch (int fd, uint8_t key_id, struct lca_sign_item *items,
+                    unsigned int count);
+
+/**
+ * Verifies an ECDSA Signature. Requires that the data, which was
+ * signed, was first loaded with the nonce command.
+ *
+ * @param fd The open file descriptor.
+ * @param pub_key The Public Key matching the private key that signed
+ * the data.
+ * @param signature The resultant signature.
+ *
+ * @return True if the signature is valid otherwise false
+ */
+bool
+lca_ecc_verify (int fd,
+                     struct lca_octet_buffer pub_key,
+                     struct lca_octet_buffer signature);
+
+/**
+ * Compute the master secret from ECDH between the passed in public
+ * key and the key stored in slot @slot.
+ *
+ * @param fd The open fd for the device.
+ * @param slot The slot which should contain an ECDSA Private Key.
+ * @param x The x component of the corresponding key to do the exchange.
+ * @param y Like param x, but the y component.
+ *
+ * @return The buffer containing the master secret which will be 32
+ * bytes or the buffer will indicate 0 bytes on failure.
+ */
+struct lca_octet_buffer
+lca_ecdh (int fd, uint8_t slot,
+          struct lca_octet_buffer x, struct lca_octet_buffer y);
+
+/**
+ * Enables a cache of ECDH results in front of lca_ecdh.  Entries are
+ * keyed by a hash of the device, slot and peer public key, held in
+ * locked memory and wiped when they expire, are evicted, or when
+ * lca_gen_ecc_key generates a new key in the slot.  Calling it again
+ * replaces the cache.  The cache is shared by all threads and devices.
+ *
+ * @param entries_max The maximum number of cached secrets.
+ * @param ttl_seconds How long a secret may be reused.
+ *
+ * @return True if enabled, false if the memory could not be locked.
+ */
+bool
+lca_ecdh_cache_enable (unsigned int entries_max, unsigned int ttl_seconds);
+
+/**
+ * Wipes all cached ECDH results.
+ *
+ */
+void
+lca_ecdh_cache_flush (void);
+
+/**
+ * Wipes and disables the ECDH cache.
+ *
+ */
+void
+lca_ecdh_cache_disable (void);
+
+/* ATSHA204 Commands */
+
+enum DATA_ZONE
+  {
+    CONFIG_ZONE = 0,
+    OTP_ZONE = 1,
+    DATA_ZONE = 2
+  };
+
+/* Symmetric Key Commands
+
+   Each command has a builder, like lca_build_random_cmd, and a call
+   that sends it.  Responses can be checked on the host with
+   lca_mac_template_init and lca_mac_verify, and TempKey and derived
+   keys followed with lca_nonce_compute, lca_gen_dig_compute and
+   lca_derive_key_compute. */
+
+/* CheckMac data: the client challenge, client response and other data */
+#define LCA_CHECK_MAC_OTHER_LEN 13
+#define LCA_CHECK_MAC_DATA_LEN (32 + 32 + LCA_CHECK_MAC_OTHER_LEN)
+
+/* DeriveKey mode bit, which must match TempKey.SourceFlag */
+#define LCA_DERIVE_KEY_MODE_RANDOM 0x04
+
+/**
+ * Builds a MAC command.
+ *
+ * @param mode The mode byte, from the LCA_MAC_MODE bits.
+ * @param key_slot The key slot.
+ * @param challenge The 32 byte challenge, or NULL if the mode takes it
+ * from TempKey.  It must outlive the command.
+ */
+struct Command_ATSHA204
+lca_build_mac_cmd (uint8_t mode, uint8_t key_slot, const uint8_t *challenge);
+
+/**
+ * Has the device MAC a challenge with a slot key, which the host
+ * checks with lca_mac_verify in a fraction of the time of an ECDSA
+ * sign and verify.
+ *
+ * @param fd The open file descriptor.
+ * @param mode The mode byte, from the LCA_MAC_MODE bits.
+ * @param key_slot The key slot.
+ * @param challenge See lca_build_mac_cmd.
+ * @param response The 32 byte result.
+ *
+ * @return True if successful.
+ */
+bool
+lca_mac (int fd, uint8_t mode, uint8_t key_slot, const uint8_t *challenge,
+         uint8_t *response);
+
+/**
+ * Builds a CheckMac command.
+ *
+ * @param mode The mode byte: LCA_MAC_MODE_CHALLENGE_TEMPKEY,
+ * LCA_MAC_MODE_KEY_TEMPKEY, LCA_MAC_MODE_SOURCE_FLAG and
+ * LCA_MAC_MODE_OTP64 apply.
+ * @param key_slot The key slot.
+ * @param data The LCA_CHECK_MAC_DATA_LEN bytes of data, which must
+ * outlive the command.
+ */
+struct Command_ATSHA204
+lca_build_check_mac_cmd (uint8_t mode, uint8_t key_slot, const uint8_t *data);
+
+/**
+ * Has the device check a response made from one of its keys, as
+ * lca_check_mac_compute makes them.
+ *
+ * @param fd The open file descriptor.
+ * @param mode See lca_build_check_mac_cmd.
+ * @param key_slot The key slot.
+ * @param challenge The 32 byte client challenge, or NULL if the mode
+ * takes it from TempKey.
+ * @param response The 32 byte client response.
+ * @param other_data The LCA_CHECK_MAC_OTHER_LEN bytes of other data.
+ *
+ * @return True if the device matched the response.
+ */
+bool
+lca_check_mac (int fd, uint8_t mode, uint8_t key_slot,
+               const uint8_t *challenge, const uint8_t *response,
+               const uint8_t *other_data);
+
+/**
+ * Builds an HMAC command.
+ *
+ * @param mode The mode byte: LCA_MAC_MODE_SOURCE_FLAG,
+ * LCA_MAC_MODE_OTP88, LCA_MAC_MODE_OTP64 and LCA_MAC_MODE_SN apply.
+ * @param key_slot The key slot.
+ */
+struct Command_ATSHA204
+lca_build_hmac_cmd (uint8_t mode, uint8_t key_slot);
+
+/**
+ * Has the device HMAC TempKey, loaded by a nonce, with a slot key.
+ *
+ * @param fd The open file descriptor.
+ * @param mode See lca_build_hmac_cmd.
+ * @param key_slot The key slot.
+ * @param response The 32 byte result.
+ *
+ * @return True if successful.
+ */
+bool
+lca_hmac (int fd, uint8_t mode, uint8_t key_slot, uint8_t *response);
+
+/**
+ * Builds a GenDig command.
+ *
+ * @param zone The zone of the data.
+ * @param key_id The slot, or for the config and OTP zones the block.
+ */
+struct Command_ATSHA204
+lca_build_gen_dig_cmd (enum DATA_ZONE zone, uint8_t key_id);
+
+/**
+ * Has the device hash data from a zone into TempKey, see
+ * lca_gen_dig_compute.
+ *
+ * @param fd The open file descriptor.
+ * @param zone The zone of the data.
+ * @param key_id The slot, or for the config and OTP zones the block.
+ *
+ * @return True if successful.
+ */
+bool
+lca_gen_dig (int fd, enum DATA_ZONE zone, uint8_t key_id);
+
+/**
+ * Builds a DeriveKey command.
+ *
+ * @param mode 0 or LCA_DERIVE_KEY_MODE_RANDOM.
+ * @param target_key The slot to write.
+ * @param mac The 32 byte authorizing MAC, see lca_derive_key_mac, or
+ * NULL if the slot does not require one.  It must outlive the command.
+ */
+struct Command_ATSHA204
+lca_build_derive_key_cmd (uint8_t mode, uint8_t target_key,
+                          const uint8_t *mac);
+
+/**
+ * Has the device replace a slot key with one derived from TempKey, see
+ * lca_derive_key_compute.  Cached data and keys of the slot are
+ * dropped.
+ *
+ * @param fd The open file descriptor.
+ * @param mode See lca_build_derive_key_cmd.
+ * @param target_key The slot to write.
+ * @param mac See lca_build_derive_key_cmd.
+ *
+ * @return True if successful.
+ */
+bool
+lca_derive_key (int fd, uint8_t mode, uint8_t target_key, const uint8_t *mac);
+
+/* The NumIn of a random nonce */
+#define LCA_NONCE_NUM_IN_LEN 20
+
+/**
+ * Computes TempKey after a random nonce.
+ *
+ * @param rand_out The 32 bytes the device returned.
+ * @param num_in The LCA_NONCE_NUM_IN_LEN bytes sent.
+ * @param mode The nonce mode, 0 or 1.
+ * @param tempkey The 32 byte result.
+ */
+void
+lca_nonce_compute (const uint8_t *rand_out, const uint8_t *num_in,
+                   uint8_t mode, uint8_t *tempkey);
+
+/**
+ * Computes TempKey after a GenDig.
+ *
+ * @param data The 32 bytes of the slot or block.
+ * @param zone Its zone.
+ * @param key_id Its slot or block.
+ * @param serial The LCA_SERIAL_NUM_LEN byte serial number, or NULL for
+ * the fixed bytes.
+ * @param tempkey TempKey before.
+ * @param new_tempkey The 32 byte result.
+ */
+void
+lca_gen_dig_compute (const uint8_t *data, enum DATA_ZONE zone,
+                     uint8_t key_id, const uint8_t *serial,
+                     const uint8_t *tempkey, uint8_t *new_tempkey);
+
+/**
+ * Computes the key a DeriveKey writes.
+ *
+ * @param parent_key The target key when rolling, otherwise the key
+ * its WriteKey names.
+ * @param mode See lca_build_derive_key_cmd.
+ * @param target_key The slot written.
+ * @param serial See lca_gen_dig_compute.
+ * @param tempkey TempKey before.
+ * @param new_key The 32 byte result.
+ */
+void
+lca_derive_key_compute (const uint8_t *parent_key, uint8_t mode,
+                        uint8_t target_key, const uint8_t *serial,
+                        const uint8_t *tempkey, uint8_t *new_key);
+
+/**
+ * Computes the MAC authorizing a DeriveKey.
+ *
+ * @param parent_key See lca_derive_key_compute.
+ * @param mode See lca_build_derive_key_cmd.
+ * @param target_key The slot written.
+ * @param serial See lca_gen_dig_compute.
+ * @param mac The 32 byte result.
+ */
+void
+lca_derive_key_mac (const uint8_t *parent_key, uint8_t mode,
+                    uint8_t target_key, const uint8_t *serial, uint8_t *mac);
+
+/**
+ * Computes a client response for lca_check_mac.
+ *
+ * @param first The 32 byte key, or TempKey if the mode says so.
+ * @param second The 32 byte challenge, or TempKey if the mode says so.
+ * @param mode See lca_build_check_mac_cmd.
+ * @param other_data The LCA_CHECK_MAC_OTHER_LEN bytes of other data.
+ * @param otp The first 8 bytes of the OTP zone, or NULL if the mode
+ * does not include them.
+ * @param serial See lca_gen_dig_compute.
+ * @param response The 32 byte result.
+ */
+void
+lca_check_mac_compute (const uint8_t *first, const uint8_t *second,
+                       uint8_t mode, const uint8_t *other_data,
+                       const uint8_t *otp, const uint8_t *serial,
+                       uint8_t *response);
+
+/* Random Commands */
+
+struct Command_ATSHA204
+lca_build_random_cmd (bool update_seed);
+
+/**
+ * Get 32 bytes of random data from the device
+ *
+ * @param fd The open file descriptor
+ * @param update_seed True updates the seed.  Do this sparingly.
+ *
+ * @return A malloc'ed buffer with random data.
+ */
+struct lca_octet_buffer
+lca_get_random (int fd, bool update_seed);
+
+/* Entropy Pool */
+
+/**
+ * A background thread keeps a ring of device Random output topped up,
+ * waking the device for a burst of commands at a time and never
+ * updating its EEPROM seed.  An HMAC_DRBG (SP 800-90A, SHA-256) is
+ * seeded from the ring on first use and reseeded from it on a byte
+ * count, so lca_random_bytes serves any length at memory speed.  The
+ * pool is process wide and does not survive fork.
+ */
+enum LCA_RANDOM_MODE
+  {
+    /* DRBG output */
+    LCA_RANDOM_DRBG = 0,
+    /* Device output straight from the ring, at the device's rate */
+    LCA_RANDOM_RAW
+  };
+
+/* Counters of the continuous health tests run on each 32 byte block of
+   device output before it enters the pool.  Failing output is dropped,
+   and after three failed refills in a row the breaker trips: the ring
+   is emptied and every read fails until a later refill passes, which
+   also makes the DRBG instantiate afresh. */
+struct lca_health_stats
+{
+  uint64_t blocks;
+  /* SP 800-90B repetition count test */
+  uint64_t repetition_failures;
+  /* SP 800-90B adaptive proportion test */
+  uint64_t proportion_failures;
+  /* Blocks repeating the one before, or a known failure response */
+  uint64_t stuck_failures;
+  uint64_t trips;
+  bool tripped;
+};
+
+/**
+ * Starts the pool.  Each refill holds lca_device_lock on fd from its
+ * wake to its idle, so other threads may keep using fd; their own
+ * multi command sessions should hold the lock too.
+ *
+ * @param fd The open file descriptor.
+ * @param pool_size The ring size in bytes, or 0 for 4 KiB.
+ * @param reseed_bytes The DRBG output between reseeds, or 0 for 1 MiB.
+ *
+ * @return False if already running or the thread could not start.
+ */
+bool
+lca_entropy_start (int fd, size_t pool_size, size_t reseed_bytes);
+
+/**
+ * Stops the thread and wipes the ring and the DRBG.  Calls waiting for
+ * device output return false.
+ */
+void
+lca_entropy_stop (void);
+
+bool
+lca_entropy_running (void);
+
+/**
+ * Returns the health test counters since lca_entropy_start.
+ *
+ * @param out Receives the counters.
+ */
+void
+lca_entropy_get_health (struct lca_health_stats *out);
+
+/**
+ * Fills buf with random bytes, waiting for the device only when the
+ * DRBG needs seed or, in raw mode, while the ring is empty.
+ *
+ * @param buf The result.
+ * @param len Its length.
+ * @param mode Where the bytes come from.
+ *
+ * @return False if the pool is not running, the breaker has tripped or
+ * the device is failing.
+ */
+bool
+lca_random_bytes_mode (uint8_t *buf, size_t len, enum LCA_RANDOM_MODE mode);
+
+/**
+ * lca_random_bytes_mode with LCA_RANDOM_DRBG.
+ */
+bool
+lca_random_bytes (uint8_t *buf, size_t len);
+
+
+/**
+ * Builds the command structure for a read4 command.
+ *
+ * @param zone The zone from which to read.
+ * @param addr The desired read address.
+ *
+ * @return The populated command structure.
+ */
+struct Command_ATSHA204
+lca_build_read4_cmd (enum DATA_ZONE zone, uint8_t addr);
+
+/**
+ * Builds the command structure for the write 4 command.
+ *
+ * @param zone The zone to which to write.
+ * @param addr The address to which to write.
+ * @param buf The 4 byte buffer, which will be written.
+ *
+ * @return The populated command struct.
+ */
+struct Command_ATSHA204
+lca_build_write4_cmd (enum DATA_ZONE zone, uint8_t addr, uint32_t buf);
 
 /**
  * Builds the command structure for the write 32 command.
@@ -639,6 +1838,101 @@ lca_write32_cmd (const int fd,
                   const struct lca_octet_buffer buf,
                   const struct lca_octet_buffer *mac);
 
+/* Data Zone Blobs */
+
+/**
+ * Returns the offset of a data slot in the data zone, where the
+ * slots are laid end to end as on the ATECC108.
+ *
+ * @param slot The slot, or 16 for the size of the data zone.
+ *
+ * @return The byte offset for lca_data_read and lca_data_write.
+ */
+unsigned int
+lca_data_slot_offset (uint8_t slot);
+
+/**
+ * Returns the size of a data slot in bytes.
+ *
+ * @param slot The slot.
+ *
+ * @return The size.
+ */
+unsigned int
+lca_data_slot_size (uint8_t slot);
+
+/**
+ * Reads an arbitrary byte range of the data zone, which may span
+ * slots.  The range is covered with the fewest 32 and 4 byte reads,
+ * sent back to back.  Slots that read in clear text are cached, so
+ * reading them again is free until the library writes to them.
+ *
+ * @param fd The open file descriptor.
+ * @param offset The byte offset, see lca_data_slot_offset.
+ * @param buf Receives len bytes.
+ * @param len The number of bytes to read.
+ *
+ * @return True if successful.
+ */
+bool
+lca_data_read (int fd, unsigned int offset, uint8_t *buf, unsigned int len);
+
+/**
+ * Writes an arbitrary byte range of the data zone in clear text.
+ * Whole blocks are written with 32 byte writes and the rest a word
+ * at a time; bytes sharing a word with the range are preserved.
+ * When every slot in the range is readable the range is read back
+ * once at the end and compared.
+ *
+ * @param fd The open file descriptor.
+ * @param offset The byte offset, see lca_data_slot_offset.
+ * @param buf The bytes to write.
+ * @param len The number of bytes to write.
+ *
+ * @return True if successful and, where possible, verified.
+ */
+bool
+lca_data_write (int fd, unsigned int offset, const uint8_t *buf,
+                unsigned int len);
+
+/* A byte range of a zone to be read into dst */
+struct lca_read_request
+{
+  enum DATA_ZONE zone;
+  unsigned int offset;
+  unsigned int len;
+  uint8_t *dst;
+};
+
+/**
+ * Reads several byte ranges, of any zones, in as few commands as
+ * possible.  The words covered by the requests are coalesced per zone
+ * into 32 byte and 4 byte reads, which are issued back to back, and
+ * the results are scattered into each request's dst.  Cached config,
+ * OTP and public data words are served without touching the device.
+ *
+ * @param fd The open file descriptor.
+ * @param reqs The requests.
+ * @param count The number of requests.
+ *
+ * @return True if every range was read.
+ */
+bool
+lca_read_ranges (int fd, const struct lca_read_request *reqs,
+                 unsigned int count);
+
+/**
+ * Returns the number of read commands lca_read_ranges would issue for
+ * the requests on a cold cache.
+ *
+ * @param reqs The requests.
+ * @param count The number of requests.
+ *
+ * @return The number of commands.
+ */
+unsigned int
+lca_plan_read_ranges (const struct lca_read_request *reqs, unsigned int count);
+
 /**
  *
  *
@@ -665,7 +1959,7 @@ lca_is_data_locked (int fd);
  * @param fd The open file descriptor
  *
  * @return A malloc'ed buffer containing the entire configuration
- * zone.
+ * zone, or a buffer with a NULL ptr if the zone could not be read.
  */
 struct lca_octet_buffer
 get_config_zone (int fd);
@@ -675,7 +1969,8 @@ get_config_zone (int fd);
  *
  * @param fd The open file descriptor.
  *
- * @return A malloc'ed buffer containing the entire OTP zone.
+ * @return A malloc'ed buffer containing the entire OTP zone, or a
+ * buffer with a NULL ptr if the zone could not be read.
  */
 struct lca_octet_buffer
 get_otp_zone (int fd);
@@ -742,6 +2037,57 @@ lca_is_config_locked (int fd);
 bool
 lca_is_data_locked (int fd);
 
+/**
+ * Drops the cached config and OTP zone images for the device.  The
+ * library caches both zones after the first read and only keeps them
+ * across writes once the zone is locked.  Call this if the device
+ * was modified outside of this library.  The caches of all devices
+ * are shared by all threads, and a zone is read with the device's
+ * lca_device_lock held.
+ *
+ * @param fd The open file descriptor.
+ */
+void
+lca_flush_zone_cache (int fd);
+
+/**
+ * Opens, or creates, a persistent device store.  The store is a
+ * memory mapped file that keeps the config zone, OTP zone and slot
+ * public keys of each device, keyed by serial number, so that short
+ * lived processes do not have to read them from the device again.
+ * A file that is not a valid store is reinitialized.  Only one
+ * store is open at a time.
+ *
+ * @param path The path of the store file.
+ *
+ * @return True if the store is ready.
+ */
+bool
+lca_devstore_open (const char *path);
+
+/**
+ * Closes the device store and detaches all devices.
+ *
+ */
+void
+lca_devstore_close (void);
+
+/**
+ * Attaches a device to the open store.  Reads the serial number and
+ * lock bytes from the device and, if a matching record exists, the
+ * stored zones seed the zone cache and public keys are returned by
+ * lca_gen_ecc_key without a GenKey.  Zone images are only used when
+ * the zone is locked.  While attached, changes made through this
+ * library are written back to the store.  Devices are detached in
+ * lca_atmel_teardown.
+ *
+ * @param fd The open file descriptor.
+ *
+ * @return True if the device is attached.
+ */
+bool
+lca_devstore_attach (int fd);
+
 /* Command Utilities */
 /**
  * Print the command structure to the debug log source.
@@ -781,8 +2127,105 @@ lca_config2bin(const char *docname, struct lca_octet_buffer *out);
 int
 lca_burn_config_zone (int fd, struct lca_octet_buffer cz);
 
+/* Decoded Configuration Zone */
+
+#define LCA_KEY_TYPE_P256 4
+
+/**
+ * The access policy of one data slot, decoded from its SlotConfig
+ * and KeyConfig words.
+ */
+struct lca_slot_policy
+{
+  uint16_t slot_config;   /* Raw SlotConfig */
+  uint16_t key_config;    /* Raw KeyConfig */
+  uint8_t read_key;       /* For ECC private keys, the sign/ECDH bits */
+  uint8_t write_key;
+  uint8_t write_config;
+  uint8_t key_type;       /* LCA_KEY_TYPE_P256 for P256 keys */
+  bool is_secret;
+  bool encrypt_read;
+  bool is_private;        /* Slot holds an ECC private key */
+  bool slot_locked;       /* Individually locked (SlotLocked bit clear) */
+};
+
+/**
+ * An immutable, decoded view of the 128 byte configuration zone.
+ */
+struct lca_config_view
+{
+  uint8_t serial[9];
+  bool config_locked;
+  bool data_locked;
+  bool otp_read_only;
+  struct lca_slot_policy slots[16];
+};
+
+/**
+ * Decodes a configuration zone image, as returned by get_config_zone
+ * or lca_config2bin.
+ *
+ * @param config The 128 byte configuration zone.
+ * @param view The view to populate.
+ *
+ * @return True if config is a complete configuration zone.
+ */
+bool
+lca_decode_config (struct lca_octet_buffer config,
+                   struct lca_config_view *view);
+
+/**
+ * Returns true if the slot may create signatures of external
+ * messages with lca_ecc_sign.
+ *
+ * @param view The decoded configuration zone.
+ * @param slot The key slot.
+ *
+ * @return True if permitted.
+ */
+bool
+lca_slot_can_sign (const struct lca_config_view *view, uint8_t slot);
+
+/**
+ * Returns true if the slot may be used with lca_ecdh.
+ *
+ * @param view The decoded configuration zone.
+ * @param slot The key slot.
+ *
+ * @return True if permitted.
+ */
+bool
+lca_slot_can_ecdh (const struct lca_config_view *view, uint8_t slot);
+
+/**
+ * Returns true if a clear text read of the address is permitted.
+ *
+ * @param view The decoded configuration zone.
+ * @param zone The zone to read.
+ * @param addr The word address, as passed to read32.
+ *
+ * @return True if permitted.
+ */
+bool
+lca_zone_can_read (const struct lca_config_view *view,
+                   enum DATA_ZONE zone, uint8_t addr);
+
+/**
+ * Returns true if a write to the address is permitted.
+ *
+ * @param view The decoded configuration zone.
+ * @param zone The zone to write.
+ * @param addr The word address, as passed to lca_write32_cmd.
+ * @param encrypted True if the write carries a MAC.
+ *
+ * @return True if permitted.
+ */
+bool
+lca_zone_can_write (const struct lca_config_view *view,
+                    enum DATA_ZONE zone, uint8_t addr, bool encrypted);
+
 int
-lca_lock_config_zone (int fd, const struct lca_octet_buffer template);
+lca_lock_config_zone (int fd, const struct lca_octet_buffer tmpl);
 
 
 /* OTP zone functions */
@@ -808,6 +2251,109 @@ lca_hkdf_256_expand(const uint8_t prk[ ], int prk_len,
                     const unsigned char *info, int info_len,
                     uint8_t okm[ ], int okm_len);
 
+/* The most HKDF-SHA256 can expand one PRK into for one label */
+#define LCA_HKDF_MAX_LEN (255 * LCA_SHA256_DLEN)
+
+/* An HKDF-SHA256 PRK, keyed once for any number of expansions.  Like
+   lca_hmac_ctx it is not modified by use. */
+struct lca_hkdf_ctx
+{
+  struct lca_hmac_ctx prk;
+};
+
+/* One expansion of a PRK, read in pieces of any size */
+struct lca_hkdf_stream
+{
+  const struct lca_hkdf_ctx *ctx;
+  const uint8_t *info;
+  size_t info_len;
+  uint8_t block[LCA_SHA256_DLEN];
+  unsigned int counter;
+  unsigned int used;
+};
+
+/* One labelled output of lca_hkdf_expand_batch */
+struct lca_hkdf_item
+{
+  const uint8_t *info;
+  size_t info_len;
+  uint8_t *okm;
+  size_t len;
+};
+
+/**
+ * Extracts a PRK and keys a context with it.
+ *
+ * @param ctx The context.
+ * @param salt The salt, or NULL for HashLen zeros.
+ * @param salt_len The salt length.
+ * @param ikm The input keying material.
+ * @param ikm_len Its length.
+ */
+void
+lca_hkdf_init (struct lca_hkdf_ctx *ctx, const uint8_t *salt, size_t salt_len,
+               const uint8_t *ikm, size_t ikm_len);
+
+/**
+ * Keys a context with an existing PRK.
+ *
+ * @param ctx The context.
+ * @param prk The PRK.
+ * @param prk_len Its length.
+ */
+void
+lca_hkdf_init_prk (struct lca_hkdf_ctx *ctx, const uint8_t *prk,
+                   size_t prk_len);
+
+void
+lca_hkdf_wipe (struct lca_hkdf_ctx *ctx);
+
+/**
+ * Starts an expansion.
+ *
+ * @param s The stream.
+ * @param ctx The keyed context, which must outlive the stream.
+ * @param info The label, which must outlive the stream.
+ * @param info_len The label length.
+ */
+void
+lca_hkdf_start (struct lca_hkdf_stream *s, const struct lca_hkdf_ctx *ctx,
+                const uint8_t *info, size_t info_len);
+
+/**
+ * Reads the next bytes of an expansion.  Reads may be any size and
+ * need not line up with the hash blocks.
+ *
+ * @param s The stream.
+ * @param out The destination.
+ * @param len The number of bytes.
+ *
+ * @return False, having read nothing, if the stream would pass
+ * LCA_HKDF_MAX_LEN bytes.
+ */
+bool
+lca_hkdf_read (struct lca_hkdf_stream *s, uint8_t *out, size_t len);
+
+void
+lca_hkdf_stream_wipe (struct lca_hkdf_stream *s);
+
+/**
+ * Derives many labelled outputs from one PRK, such as the keys and IVs
+ * of a connection.  Labels of up to 22 bytes are hashed side by side
+ * on the multi-lane SHA-256 kernels.  The outputs must not overlap the
+ * labels.
+ *
+ * @param ctx The keyed context.
+ * @param items The labels and their outputs.
+ * @param count The number of items.
+ *
+ * @return False, having written nothing, if an output is longer than
+ * LCA_HKDF_MAX_LEN.
+ */
+bool
+lca_hkdf_expand_batch (const struct lca_hkdf_ctx *ctx,
+                       const struct lca_hkdf_item *items, unsigned int count);
+
 /*
  *  hkdf
  *
@@ -850,4 +2396,8 @@ lca_hkdf(const unsigned char *salt, int salt_len,
          const unsigned char *info, int info_len,
          uint8_t okm[ ], int okm_len);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // LIBCRYPTOAUTH_H_
@@ -0,0 +1,641 @@
+/* -*- mode: c++; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2015 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Header only C++17 binding for libcryptoauth.
+ *
+ * Inputs are taken as lca::bytes views so nothing is copied at the
+ * language boundary, fixed size results come back as std::array and
+ * library allocated buffers are owned by the move-only lca::buffer,
+ * which wipes on destruction.  Errors are reported with lca::error.
+ */
+
+#ifndef LIBCRYPTOAUTH_HPP_
+#define LIBCRYPTOAUTH_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+#include "libcryptoauth.h"
+
+namespace lca
+{
+
+class error : public std::runtime_error
+{
+public:
+  using std::runtime_error::runtime_error;
+};
+
+#if defined(__cpp_lib_span)
+
+template <class T>
+using span = std::span<T>;
+
+#else
+
+/* Minimal stand in for std::span, which is C++20. */
+template <class T>
+class span
+{
+public:
+  using element_type = T;
+  using value_type = typename std::remove_cv<T>::type;
+
+  constexpr span () noexcept : ptr_ (nullptr), len_ (0) {}
+  constexpr span (T *ptr, std::size_t len) noexcept : ptr_ (ptr), len_ (len) {}
+
+  template <std::size_t N>
+  constexpr span (T (&arr)[N]) noexcept : ptr_ (arr), len_ (N) {}
+
+  template <std::size_t N>
+  constexpr span (std::array<value_type, N> &arr) noexcept
+    : ptr_ (arr.data ()), len_ (N) {}
+
+  template <std::size_t N,
+            class U = T,
+            class = typename std::enable_if<std::is_const<U>::value>::type>
+  constexpr span (const std::array<value_type, N> &arr) noexcept
+    : ptr_ (arr.data ()), len_ (N) {}
+
+  span (std::vector<value_type> &v) noexcept
+    : ptr_ (v.data ()), len_ (v.size ()) {}
+
+  template <class U = T,
+            class = typename std::enable_if<std::is_const<U>::value>::type>
+  span (const std::vector<value_type> &v) noexcept
+    : ptr_ (v.data ()), len_ (v.size ()) {}
+
+  constexpr T *data () const noexcept { return ptr_; }
+  constexpr std::size_t size () const noexcept { return len_; }
+  constexpr bool empty () const noexcept { return 0 == len_; }
+  constexpr T *begin () const noexcept { return ptr_; }
+  constexpr T *end () const noexcept { return ptr_ + len_; }
+  constexpr T &operator[] (std::size_t i) const noexcept { return ptr_[i]; }
+
+private:
+  T *ptr_;
+  std::size_t len_;
+};
+
+#endif
+
+using bytes = span<const std::uint8_t>;
+
+using public_key = std::array<std::uint8_t, 64>;
+using signature = std::array<std::uint8_t, 64>;
+using digest = std::array<std::uint8_t, LCA_SHA256_DLEN>;
+using serial_number = std::array<std::uint8_t, 9>;
+using block = std::array<std::uint8_t, 32>;
+
+/* Zeroes memory in a way the optimizer won't elide. */
+inline void
+secure_wipe (void *p, std::size_t len) noexcept
+{
+  volatile std::uint8_t *v = static_cast<volatile std::uint8_t *> (p);
+  while (len--)
+    *v++ = 0;
+}
+
+/* A fixed size array for secrets, wiped on destruction. */
+template <std::size_t N>
+struct secret : std::array<std::uint8_t, N>
+{
+  ~secret () { secure_wipe (this->data (), N); }
+};
+
+/* Views a byte range as an octet buffer for the C API, without
+   copying.  The C functions this is passed to only read the data. */
+inline lca_octet_buffer
+as_octet_buffer (bytes b) noexcept
+{
+  lca_octet_buffer o;
+  o.ptr = const_cast<unsigned char *> (b.data ());
+  o.len = static_cast<unsigned int> (b.size ());
+  return o;
+}
+
+/* Owns a library allocated lca_octet_buffer.  Move only; the memory
+   is wiped and freed on destruction. */
+class buffer
+{
+public:
+  buffer () noexcept { buf_.ptr = nullptr; buf_.len = 0; }
+
+  /* Takes ownership of b, which must come from the library. */
+  explicit buffer (lca_octet_buffer b) noexcept : buf_ (b) {}
+
+  explicit buffer (std::size_t len) : buf_ (lca_make_buffer (len)) {}
+
+  buffer (const buffer &) = delete;
+  buffer &operator= (const buffer &) = delete;
+
+  buffer (buffer &&other) noexcept : buf_ (other.release ()) {}
+
+  buffer &
+  operator= (buffer &&other) noexcept
+  {
+    if (this != &other)
+      {
+        reset ();
+        buf_ = other.release ();
+      }
+    return *this;
+  }
+
+  ~buffer () { reset (); }
+
+  void
+  reset () noexcept
+  {
+    if (nullptr != buf_.ptr)
+      lca_free_octet_buffer (buf_);
+    buf_.ptr = nullptr;
+    buf_.len = 0;
+  }
+
+  /* Gives up ownership.  The caller must lca_free_octet_buffer it. */
+  lca_octet_buffer
+  release () noexcept
+  {
+    lca_octet_buffer b = buf_;
+    buf_.ptr = nullptr;
+    buf_.len = 0;
+    return b;
+  }
+
+  const lca_octet_buffer &get () const noexcept { return buf_; }
+
+  std::uint8_t *data () noexcept { return buf_.ptr; }
+  const std::uint8_t *data () const noexcept { return buf_.ptr; }
+  std::size_t size () const noexcept { return buf_.len; }
+  bool empty () const noexcept { return nullptr == buf_.ptr || 0 == buf_.len; }
+  explicit operator bool () const noexcept { return nullptr != buf_.ptr; }
+
+  std::uint8_t *begin () noexcept { return buf_.ptr; }
+  std::uint8_t *end () noexcept { return buf_.ptr + buf_.len; }
+  const std::uint8_t *begin () const noexcept { return buf_.ptr; }
+  const std::uint8_t *end () const noexcept { return buf_.ptr + buf_.len; }
+
+  operator bytes () const noexcept { return bytes (buf_.ptr, buf_.len); }
+
+private:
+  lca_octet_buffer buf_;
+};
+
+/* Compile time command frames.
+ *
+ * These mirror lca_serialize_command for the I2C transport: word
+ * address, count, opcode, param1, param2 (little endian), data and
+ * the CRC.  Frames with constant arguments are fully assembled by the
+ * compiler.  They do not apply to USE_KERNEL builds, which send the
+ * command without the framing bytes.
+ */
+namespace frame
+{
+
+/* Opcodes and execution times, in nanoseconds, from command_util.h */
+constexpr std::uint8_t OP_NONCE = 0x16;
+constexpr std::uint8_t OP_RANDOM = 0x1B;
+constexpr std::uint8_t OP_READ = 0x02;
+constexpr std::uint8_t OP_GEN_KEY = 0x40;
+constexpr std::uint8_t OP_ECC_SIGN = 0x41;
+
+constexpr long NONCE_EXEC = 22000000;
+constexpr long RANDOM_EXEC = 11000000;
+constexpr long READ_EXEC = 400000;
+constexpr long GEN_KEY_EXEC = 9000000;
+constexpr long ECC_SIGN_EXEC = 38000000;
+
+constexpr std::uint8_t
+reverse_bits (std::uint8_t b)
+{
+  std::uint8_t r = 0;
+  for (int i = 0; i < 8; i++)
+    if (b & (1u << i))
+      r |= static_cast<std::uint8_t> (0x80u >> i);
+  return r;
+}
+
+/* Same result as lca_calculate_crc16, returned in wire byte order
+   (first byte in the low half). */
+constexpr std::uint16_t
+crc16 (const std::uint8_t *p, std::size_t len)
+{
+  std::uint16_t crc = 0;
+
+  for (std::size_t i = 0; i < len; i++)
+    {
+      crc ^= p[i];
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc & 1) ? static_cast<std::uint16_t> ((crc >> 1) ^ 0xA001)
+                        : static_cast<std::uint16_t> (crc >> 1);
+    }
+
+  return static_cast<std::uint16_t>
+    (reverse_bits (static_cast<std::uint8_t> (crc >> 8))
+     | reverse_bits (static_cast<std::uint8_t> (crc & 0xFF)) << 8);
+}
+
+template <std::size_t N>
+struct command
+{
+  static constexpr std::size_t HEADER_LEN = 6;
+  static constexpr std::size_t SIZE = HEADER_LEN + N + 2;
+
+  std::array<std::uint8_t, SIZE> bytes;
+  long exec_ns;
+
+  constexpr const std::uint8_t *data () const { return bytes.data (); }
+  constexpr std::size_t size () const { return SIZE; }
+};
+
+template <std::size_t N>
+constexpr command<N>
+build (std::uint8_t opcode, std::uint8_t param1, std::uint16_t param2,
+       const std::array<std::uint8_t, N> &data, long exec_ns)
+{
+  command<N> c{};
+
+  c.bytes[0] = 0x03;
+  c.bytes[1] = static_cast<std::uint8_t> (command<N>::SIZE - 1);
+  c.bytes[2] = opcode;
+  c.bytes[3] = param1;
+  c.bytes[4] = static_cast<std::uint8_t> (param2 & 0xFF);
+  c.bytes[5] = static_cast<std::uint8_t> (param2 >> 8);
+  for (std::size_t i = 0; i < N; i++)
+    c.bytes[command<N>::HEADER_LEN + i] = data[i];
+
+  std::uint16_t crc = crc16 (c.bytes.data () + 1, command<N>::SIZE - 3);
+  c.bytes[command<N>::SIZE - 2] = static_cast<std::uint8_t> (crc & 0xFF);
+  c.bytes[command<N>::SIZE - 1] = static_cast<std::uint8_t> (crc >> 8);
+  c.exec_ns = exec_ns;
+
+  return c;
+}
+
+constexpr command<0>
+build (std::uint8_t opcode, std::uint8_t param1, std::uint16_t param2,
+       long exec_ns)
+{
+  return build<0> (opcode, param1, param2, std::array<std::uint8_t, 0>{},
+                   exec_ns);
+}
+
+constexpr command<0>
+random (bool update_seed)
+{
+  return build (OP_RANDOM, update_seed ? 0 : 1, 0, RANDOM_EXEC);
+}
+
+constexpr command<0>
+read4 (enum DATA_ZONE zone, std::uint8_t addr)
+{
+  return build (OP_READ, static_cast<std::uint8_t> (zone == DATA_ZONE ? 2
+                                                    : zone == OTP_ZONE ? 1
+                                                    : 0),
+                addr, READ_EXEC);
+}
+
+constexpr command<0>
+read32 (enum DATA_ZONE zone, std::uint8_t addr)
+{
+  return build (OP_READ, static_cast<std::uint8_t> (0x80 |
+                                                    (zone == DATA_ZONE ? 2
+                                                     : zone == OTP_ZONE ? 1
+                                                     : 0)),
+                addr, READ_EXEC);
+}
+
+constexpr command<0>
+gen_public_key (std::uint8_t slot)
+{
+  return build (OP_GEN_KEY, 0x00, slot, GEN_KEY_EXEC);
+}
+
+constexpr command<0>
+gen_private_key (std::uint8_t slot)
+{
+  return build (OP_GEN_KEY, 0x04, slot, GEN_KEY_EXEC);
+}
+
+/* Pass-through nonce: loads 32 bytes into TempKey. */
+constexpr command<32>
+load_nonce (const std::array<std::uint8_t, 32> &value)
+{
+  return build<32> (OP_NONCE, 0x03, 0, value, NONCE_EXEC);
+}
+
+/* Signs the external message in TempKey. */
+constexpr command<0>
+ecc_sign (std::uint8_t slot)
+{
+  return build (OP_ECC_SIGN, 0x80, slot, ECC_SIGN_EXEC);
+}
+
+} // namespace frame
+
+/* An open device.  Wakes the device on construction and sleeps and
+   closes it on destruction.  Move only. */
+class device
+{
+public:
+  explicit device (const char *bus, unsigned int addr = 0x60)
+    : fd_ (lca_atmel_setup (bus, addr))
+  {
+    if (fd_ < 0)
+      throw error (std::string ("unable to open ") + bus);
+  }
+
+  /* Adopts an already set up file descriptor. */
+  static device
+  adopt (int fd)
+  {
+    return device (fd);
+  }
+
+  device (const device &) = delete;
+  device &operator= (const device &) = delete;
+
+  device (device &&other) noexcept : fd_ (other.fd_) { other.fd_ = -1; }
+
+  device &
+  operator= (device &&other) noexcept
+  {
+    if (this != &other)
+      {
+        close ();
+        fd_ = other.fd_;
+        other.fd_ = -1;
+      }
+    return *this;
+  }
+
+  ~device () { close (); }
+
+  int fd () const noexcept { return fd_; }
+
+  /* Sends a prebuilt frame and reads a fixed size response.  This
+     goes through lca_send_frame, so the library's TempKey and key
+     caches stay in step with the device. */
+  template <std::size_t N>
+  void
+  execute (const frame::command<N> &c, std::uint8_t *rsp, std::size_t len)
+  {
+    struct timespec wait;
+    wait.tv_sec = 0;
+    wait.tv_nsec = c.exec_ns;
+
+    enum LCA_STATUS_RESPONSE r =
+      lca_send_frame (fd_, c.data (), static_cast<unsigned int> (c.size ()),
+                      rsp, static_cast<unsigned int> (len), &wait);
+    if (RSP_SUCCESS != r)
+      throw error ("command " + std::to_string (c.bytes[2])
+                   + " failed with status " + std::to_string (r));
+  }
+
+  secret<32>
+  random (bool update_seed = false)
+  {
+    secret<32> r;
+    if (update_seed)
+      execute (frame::random (true), r.data (), r.size ());
+    else
+      {
+        static constexpr auto cmd = frame::random (false);
+        execute (cmd, r.data (), r.size ());
+      }
+    return r;
+  }
+
+  block
+  read32 (enum DATA_ZONE zone, std::uint8_t addr)
+  {
+    block b;
+    execute (frame::read32 (zone, addr), b.data (), b.size ());
+    return b;
+  }
+
+  serial_number
+  serial ()
+  {
+    static constexpr auto cmd = frame::read32 (CONFIG_ZONE, 0);
+    block cz;
+    serial_number sn;
+
+    execute (cmd, cz.data (), cz.size ());
+    /* SN[0:3] at 0, SN[4:8] at 8 */
+    for (std::size_t i = 0; i < 4; i++)
+      sn[i] = cz[i];
+    for (std::size_t i = 0; i < 5; i++)
+      sn[4 + i] = cz[8 + i];
+    return sn;
+  }
+
+  /* Returns the public key for the private key in slot, from the
+     device store when attached. */
+  public_key
+  get_public_key (std::uint8_t slot)
+  {
+    return gen_ecc_key (slot, false);
+  }
+
+  /* Generates a new private key in slot and returns its public key.
+     Cached public keys and ECDH secrets of the slot are dropped. */
+  public_key
+  gen_key (std::uint8_t slot)
+  {
+    return gen_ecc_key (slot, true);
+  }
+
+  /* Signs a 32 byte digest with the key in slot. */
+  signature
+  sign (std::uint8_t slot, const digest &d)
+  {
+    std::uint8_t status = 0xFF;
+    signature sig;
+
+    check_slot (slot);
+
+    /* Nothing from another thread between the nonce and the sign */
+    session_lock hold (fd_);
+
+    execute (frame::load_nonce (d), &status, sizeof (status));
+    if (0 != status)
+      throw error ("nonce load failed");
+
+    buffer s (lca_ecc_sign (fd_, slot));
+    if (!s)
+      throw error ("sign failed");
+
+    copy_out (s, sig);
+    return sig;
+  }
+
+  /* On chip verify of the message previously loaded in TempKey. */
+  bool
+  verify (bytes pub_key, bytes sig)
+  {
+    if (64 != pub_key.size () || 64 != sig.size ())
+      throw std::invalid_argument ("P256 keys and signatures are 64 bytes");
+
+    return lca_ecc_verify (fd_, as_octet_buffer (pub_key),
+                           as_octet_buffer (sig));
+  }
+
+  secret<32>
+  ecdh (std::uint8_t slot, bytes x, bytes y)
+  {
+    if (32 != x.size () || 32 != y.size ())
+      throw std::invalid_argument ("P256 coordinates are 32 bytes");
+
+    buffer s (lca_ecdh (fd_, check_slot (slot),
+                        as_octet_buffer (x), as_octet_buffer (y)));
+    if (!s)
+      throw error ("ECDH failed");
+
+    secret<32> r;
+    copy_out (s, r);
+    return r;
+  }
+
+  buffer
+  config_zone ()
+  {
+    return buffer (get_config_zone (fd_));
+  }
+
+  buffer
+  otp_zone ()
+  {
+    buffer b (get_otp_zone (fd_));
+    if (!b)
+      throw error ("OTP read failed");
+    return b;
+  }
+
+  enum DEVICE_STATE state () { return lca_get_device_state (fd_); }
+
+private:
+  explicit device (int fd) noexcept : fd_ (fd) {}
+
+  /* Holds lca_device_lock for a scope */
+  class session_lock
+  {
+  public:
+    explicit session_lock (int fd) : fd_ (fd) { lca_device_lock (fd_); }
+    ~session_lock () { lca_device_unlock (fd_); }
+
+    session_lock (const session_lock &) = delete;
+    session_lock &operator= (const session_lock &) = delete;
+
+  private:
+    int fd_;
+  };
+
+  static std::uint8_t
+  check_slot (std::uint8_t slot)
+  {
+    if (slot > 15)
+      throw std::out_of_range ("slot must be 0-15");
+    return slot;
+  }
+
+  template <class A>
+  static void
+  copy_out (const buffer &b, A &out)
+  {
+    if (b.size () < out.size ())
+      throw error ("short response");
+    for (std::size_t i = 0; i < out.size (); i++)
+      out[i] = b.data ()[i];
+  }
+
+  public_key
+  gen_ecc_key (std::uint8_t slot, bool gen_private)
+  {
+    buffer q (lca_gen_ecc_key (fd_, check_slot (slot), gen_private));
+    if (!q)
+      throw error ("GenKey failed");
+
+    public_key r;
+    copy_out (q, r);
+    return r;
+  }
+
+  void
+  close () noexcept
+  {
+    if (fd_ >= 0)
+      lca_atmel_teardown (fd_);
+    fd_ = -1;
+  }
+
+  int fd_;
+};
+
+/* Host side helpers */
+
+inline digest
+sha256 (bytes data)
+{
+  buffer d (lca_sha256_buffer (as_octet_buffer (data)));
+  digest r;
+  for (std::size_t i = 0; i < r.size (); i++)
+    r[i] = d.data ()[i];
+  return r;
+}
+
+/* Verifies a raw r||s signature against a 64 byte public key, without
+   the uncompressed point tag. */
+inline bool
+ecdsa_p256_verify (const public_key &q, const signature &sig,
+                   const digest &d)
+{
+  std::array<std::uint8_t, 65> tagged;
+  tagged[0] = 0x04;
+  for (std::size_t i = 0; i < q.size (); i++)
+    tagged[1 + i] = q[i];
+
+  return lca_ecdsa_p256_verify (as_octet_buffer (tagged),
+                                as_octet_buffer (sig),
+                                as_octet_buffer (d));
+}
+
+inline std::string
+to_hex (bytes data)
+{
+  std::string s (2 * data.size (), '\0');
+  lca_hex_encode (data.data (), data.size (), &s[0]);
+  return s;
+}
+
+} // namespace lca
+
+#endif // LIBCRYPTOAUTH_HPP_
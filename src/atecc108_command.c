@@ -24,12 +24,18 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "../libcryptoauth.h"
 #include "command_util.h"
+#include "devstore.h"
+#include "config_view.h"
+#include "ecdh_cache.h"
+#include "verify_cache.h"
+#include "util.h"
 
 
 struct lca_octet_buffer
-lca_gen_ecc_key (int fd, uint8_t key_id, bool private)
+lca_gen_ecc_key (int fd, uint8_t key_id, bool gen_private)
 {
 
   assert (key_id <= 15);
@@ -39,16 +45,24 @@ lca_gen_ecc_key (int fd, uint8_t key_id, bool private)
 
   param2[0] = key_id;
 
-  if (private)
+  struct lca_octet_buffer pub_key = lca_make_buffer (PUB_KEY_LEN);
+
+  if (gen_private)
     {
       param1 = 0x04; /* Private key */
+      devstore_drop_pub_key (fd, key_id);
+      ecdh_cache_invalidate_slot (fd, key_id);
     }
   else
     {
       param1 = 0x00; /* Gen public key from private key in the slot */
-    }
 
-  struct lca_octet_buffer pub_key = lca_make_buffer (64);
+      if (devstore_get_pub_key (fd, key_id, pub_key.ptr))
+        {
+          LCA_LOG (DEBUG, "Public key from device store");
+          return pub_key;
+        }
+    }
 
   struct Command_ATSHA204 c = make_command ();
 
@@ -61,6 +75,7 @@ lca_gen_ecc_key (int fd, uint8_t key_id, bool private)
   if (RSP_SUCCESS == lca_process_command (fd, &c, pub_key.ptr, pub_key.len))
     {
       LCA_LOG (DEBUG, "Gen key success");
+      devstore_record_pub_key (fd, key_id, pub_key.ptr);
     }
   else
     {
@@ -74,19 +89,15 @@ lca_gen_ecc_key (int fd, uint8_t key_id, bool private)
 }
 
 
-struct lca_octet_buffer
-lca_ecc_sign (int fd, uint8_t key_id)
+/* Sends the sign command over whatever is in TempKey */
+static bool
+sign_tempkey (int fd, uint8_t key_id, uint8_t *signature)
 {
-
-  assert (key_id <= 15);
-
   uint8_t param2[2] = {0};
   uint8_t param1 = 0x80; /* external signatures only */
 
   param2[0] = key_id;
 
-  struct lca_octet_buffer signature = lca_make_buffer (64);
-
   struct Command_ATSHA204 c = make_command ();
 
   set_opcode (&c, COMMAND_ECC_SIGN);
@@ -95,7 +106,23 @@ lca_ecc_sign (int fd, uint8_t key_id)
   set_data (&c, NULL, 0);
   set_execution_time (&c, 0, ECC_SIGN_MAX_EXEC);
 
-  if (RSP_SUCCESS == lca_process_command (fd, &c, signature.ptr, signature.len))
+  return RSP_SUCCESS == lca_process_command (fd, &c, signature, 64);
+}
+
+struct lca_octet_buffer
+lca_ecc_sign (int fd, uint8_t key_id)
+{
+
+  assert (key_id <= 15);
+
+  struct lca_octet_buffer signature = {0,0};
+
+  if (!preflight_sign (fd, key_id))
+    return signature;
+
+  signature = lca_make_buffer (64);
+
+  if (sign_tempkey (fd, key_id, signature.ptr))
     {
       LCA_LOG (DEBUG, "Sign success");
     }
@@ -111,6 +138,117 @@ lca_ecc_sign (int fd, uint8_t key_id)
 
 }
 
+/* Loads a digest into TempKey with a pass through nonce and signs it,
+   without the allocations of load_nonce and lca_ecc_sign */
+static bool
+sign_digest (int fd, uint8_t key_id, const uint8_t *digest,
+             uint8_t *signature)
+{
+  const uint8_t PASS_THROUGH_MODE = 3;
+  uint8_t param2[2] = {0};
+  uint8_t status = 0xFF;
+
+  struct Command_ATSHA204 c = make_command ();
+
+  set_opcode (&c, COMMAND_NONCE);
+  set_param1 (&c, PASS_THROUGH_MODE);
+  set_param2 (&c, param2);
+  set_execution_time (&c, 0, NONCE_AVG_EXEC);
+
+  /* The frame is built from the caller's digest rather than a copy
+     from set_data, so there is nothing to free */
+  c.data = (uint8_t *)digest;
+  c.data_len = 32;
+
+  if (RSP_SUCCESS != lca_process_command (fd, &c, &status, sizeof (status))
+      || 0 != status)
+    return false;
+
+  return sign_tempkey (fd, key_id, signature);
+}
+
+static uint64_t
+ns_since (const struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000
+    + now.tv_nsec - start->tv_nsec;
+}
+
+static void
+rewake (int fd, struct timespec *woke)
+{
+  lca_idle (fd);
+  lca_wakeup (fd);
+  clock_gettime (CLOCK_MONOTONIC, woke);
+}
+
+unsigned int
+lca_ecc_sign_batch (int fd, uint8_t key_id, struct lca_sign_item *items,
+                    unsigned int count)
+{
+  /* The longest a nonce and sign pair may keep the device busy */
+  const uint64_t PAIR_MAX_NS = NONCE_MAX_EXEC + ECC_SIGN_MAX_EXEC;
+  struct timespec woke;
+  unsigned int x, signed_count = 0;
+
+  assert (key_id <= 15);
+  assert (NULL != items || 0 == count);
+
+  for (x = 0; x < count; x++)
+    items[x].ok = false;
+
+  if (0 == count)
+    return 0;
+
+  /* The whole session, so other threads' commands do not land
+     between a nonce and its sign */
+  lca_device_lock (fd);
+
+  /* Wake first: the preflight reads the config zone if it is not
+     cached yet */
+  lca_wakeup (fd);
+  clock_gettime (CLOCK_MONOTONIC, &woke);
+
+  if (!preflight_sign (fd, key_id))
+    {
+      lca_idle (fd);
+      lca_device_unlock (fd);
+      return 0;
+    }
+
+  for (x = 0; x < count; x++)
+    {
+      struct lca_sign_item *item = &items[x];
+
+      /* Idle and wake again rather than let the watchdog put the
+         device to sleep between a nonce and its sign */
+      if (ns_since (&woke) + PAIR_MAX_NS > WATCHDOG_MIN_NS)
+        rewake (fd, &woke);
+
+      item->ok = sign_digest (fd, key_id, item->digest, item->signature);
+
+      if (item->ok)
+        signed_count++;
+      else
+        {
+          LCA_LOG (DEBUG, "Sign of digest %u failed", x);
+          smemset (item->signature, 0, sizeof (item->signature));
+          /* Start the next pair on a freshly woken device */
+          rewake (fd, &woke);
+        }
+    }
+
+  lca_idle (fd);
+  lca_device_unlock (fd);
+
+  LCA_LOG (DEBUG, "Signed %u of %u digests", signed_count, count);
+
+  return signed_count;
+}
 
 bool
 lca_ecc_verify (int fd,
@@ -129,6 +267,16 @@ lca_ecc_verify (int fd,
 
   param2[0] = 0x04; /* Currently only support P256 Keys */
 
+  /* The digest is only known if it was loaded with load_nonce */
+  uint8_t digest[32];
+  const bool digest_known = verify_cache_get_tempkey (fd, digest);
+
+  if (digest_known && verify_cache_lookup (pub_key, digest, signature.ptr))
+    {
+      LCA_LOG (DEBUG, "Verify result from cache");
+      return true;
+    }
+
   struct lca_octet_buffer payload =
     lca_make_buffer (signature.len + pub_key.len);
 
@@ -150,6 +298,9 @@ lca_ecc_verify (int fd,
     {
       LCA_LOG (DEBUG, "Verify success");
       verified = true;
+
+      if (digest_known)
+        verify_cache_insert (pub_key, digest, signature.ptr);
     }
   else
     {
@@ -178,7 +329,19 @@ lca_ecdh (int fd, uint8_t slot,
 
   param2[0] = slot;
 
-  struct lca_octet_buffer shared_secret = lca_make_buffer (32);
+  struct lca_octet_buffer shared_secret = {0,0};
+
+  if (!preflight_ecdh (fd, slot))
+    return shared_secret;
+
+  shared_secret = lca_make_buffer (32);
+
+  if (ecdh_cache_lookup (fd, slot, x.ptr, y.ptr, shared_secret.ptr))
+    {
+      LCA_LOG (DEBUG, "ECDH from cache");
+      return shared_secret;
+    }
+
   struct lca_octet_buffer data = lca_make_buffer (64);
 
   memcpy (data.ptr, x.ptr, x.len);
@@ -196,6 +359,7 @@ lca_ecdh (int fd, uint8_t slot,
                                           shared_secret.ptr, shared_secret.len))
     {
       LCA_LOG (DEBUG, "ECDH success");
+      ecdh_cache_insert (fd, slot, x.ptr, y.ptr, shared_secret.ptr);
     }
   else
     {
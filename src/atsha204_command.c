@@ -27,6 +27,11 @@
 #include <time.h>
 #include "../libcryptoauth.h"
 #include "command_util.h"
+#include "command_adaptation.h"
+#include "zone_cache.h"
+#include "config_view.h"
+#include "verify_cache.h"
+#include "util.h"
 
 struct Command_ATSHA204
 lca_build_random_cmd (bool update_seed)
@@ -136,10 +141,15 @@ struct lca_octet_buffer
 read32 (int fd, enum DATA_ZONE zone, uint8_t addr)
 {
 
+  struct lca_octet_buffer buf = {0,0};
+
+  if (!preflight_read (fd, zone, addr))
+    return buf;
+
   struct Command_ATSHA204 c = lca_build_read32_cmd (zone, addr);
 
   const unsigned int LENGTH_OF_RESPONSE = 32;
-  struct lca_octet_buffer buf = lca_make_buffer (LENGTH_OF_RESPONSE);
+  buf = lca_make_buffer (LENGTH_OF_RESPONSE);
 
   if (RSP_SUCCESS != lca_process_command (fd, &c, buf.ptr, LENGTH_OF_RESPONSE))
     {
@@ -152,6 +162,68 @@ read32 (int fd, enum DATA_ZONE zone, uint8_t addr)
 }
 
 
+bool
+read_at (int fd, enum DATA_ZONE zone, uint16_t addr,
+         uint8_t *buf, unsigned int len)
+{
+  uint8_t param2[2] = {addr & 0xFF, addr >> 8};
+  uint8_t param1 = set_zone_bits (zone);
+
+  assert (NULL != buf);
+  assert (READ4_LENGTH == len || READ32_LENGTH == len);
+
+  if (READ32_LENGTH == len)
+    param1 |= 0b10000000;
+
+  if (!preflight_read (fd, zone, param2[0]))
+    return false;
+
+  struct Command_ATSHA204 c =
+    build_command (COMMAND_READ,
+                   param1,
+                   param2,
+                   NULL, 0,
+                   0, READ_AVG_EXEC);
+
+  return RSP_SUCCESS == lca_process_command (fd, &c, buf, len);
+}
+
+bool
+write_at (int fd, enum DATA_ZONE zone, uint16_t addr,
+          const uint8_t *buf, unsigned int len)
+{
+  uint8_t param2[2] = {addr & 0xFF, addr >> 8};
+  uint8_t param1 = set_zone_bits (zone);
+  uint8_t recv = 0xFF;
+  bool status = false;
+
+  assert (NULL != buf);
+  assert (READ4_LENGTH == len || READ32_LENGTH == len);
+
+  if (READ32_LENGTH == len)
+    param1 |= 0b10000000;
+
+  if (!preflight_write (fd, zone, param2[0], false))
+    return false;
+
+  struct Command_ATSHA204 c =
+    build_command (COMMAND_WRITE,
+                   param1,
+                   param2,
+                   (uint8_t *)buf, len,
+                   0, WRITE_AVG_EXEC);
+
+  if (RSP_SUCCESS == lca_process_command (fd, &c, &recv, sizeof (recv)))
+    status = (0 == recv);
+
+  if (NULL != c.data)
+    free (c.data);
+
+  zone_cache_invalidate (fd, zone, param2[0]);
+
+  return status;
+}
+
 struct Command_ATSHA204
 lca_build_write4_cmd (enum DATA_ZONE zone, uint8_t addr, uint32_t buf)
 {
@@ -187,6 +259,8 @@ write4 (int fd, enum DATA_ZONE zone, uint8_t addr, uint32_t buf)
       status = true;
   }
 
+  zone_cache_invalidate (fd, zone, addr);
+
   return status;
 
 }
@@ -246,6 +320,9 @@ lca_write32_cmd (const int fd,
   bool status = false;
   uint8_t recv = 0;
 
+  if (!preflight_write (fd, zone, addr, NULL != mac))
+    return false;
+
   struct Command_ATSHA204 c =
     lca_build_write32_cmd (zone,
                             addr,
@@ -262,46 +339,34 @@ lca_write32_cmd (const int fd,
   if (NULL != c.data)
     free (c.data);
 
+  zone_cache_invalidate (fd, zone, addr);
+
   return status;
 }
 
 bool
 lca_is_locked (int fd, enum DATA_ZONE zone)
 {
-  const uint8_t config_addr = 0x10;
-  const uint8_t UNLOCKED = 0x55;
   bool result = true;
-  const unsigned int CONFIG_ZONE_OFFSET = 23;
-  const unsigned int DATA_ZONE_OFFSET = 22;
   unsigned int offset = 0;
-  uint8_t * ptr = NULL;
+  uint8_t cz[CONFIG_ZONE_SIZE];
 
   switch (zone)
     {
     case CONFIG_ZONE:
-      offset = CONFIG_ZONE_OFFSET;
+      offset = LOCK_CONFIG_OFFSET;
       break;
     case DATA_ZONE:
     case OTP_ZONE:
-      offset = DATA_ZONE_OFFSET;
+      offset = LOCK_DATA_OFFSET;
       break;
     default:
       assert (false);
 
     }
 
-  struct lca_octet_buffer config_data = read32 (fd, CONFIG_ZONE, config_addr);
-
-  if (config_data.ptr != NULL)
-    {
-      ptr = config_data.ptr + offset;
-      if (UNLOCKED == *ptr)
-        result = false;
-      else
-        result = true;
-
-      lca_free_octet_buffer (config_data);
-    }
+  if (zone_cache_get_config (fd, cz))
+    result = (ZONE_UNLOCKED != cz[offset]);
 
   return result;
 }
@@ -322,20 +387,13 @@ lca_is_data_locked (int fd)
 struct lca_octet_buffer
 get_config_zone (int fd)
 {
-  const unsigned int SIZE_OF_CONFIG_ZONE = 128;
-  const unsigned int NUM_OF_WORDS = SIZE_OF_CONFIG_ZONE / 4;
+  struct lca_octet_buffer buf = lca_make_buffer (CONFIG_ZONE_SIZE);
 
-  struct lca_octet_buffer buf = lca_make_buffer (SIZE_OF_CONFIG_ZONE);
-  uint8_t *write_loc = buf.ptr;
-
-  unsigned int addr = 0;
-  unsigned int word = 0;
-
-  while (word < NUM_OF_WORDS)
+  if (!zone_cache_get_config (fd, buf.ptr))
     {
-      addr = word * 4;
-      read4 (fd, CONFIG_ZONE, word, (uint32_t*)(write_loc+addr));
-      word++;
+      lca_free_octet_buffer (buf);
+      buf.ptr = NULL;
+      buf.len = 0;
     }
 
   return buf;
@@ -344,37 +402,16 @@ get_config_zone (int fd)
 struct lca_octet_buffer
 get_otp_zone (int fd)
 {
-    const unsigned int SIZE_OF_OTP_ZONE = 64;
-    const unsigned int SIZE_OF_READ = 32;
-    const unsigned int SIZE_OF_WORD = 4;
-    const unsigned int SECOND_WORD = (SIZE_OF_READ / SIZE_OF_WORD);
-
-    struct lca_octet_buffer buf = lca_make_buffer (SIZE_OF_OTP_ZONE);
-    struct lca_octet_buffer half;
-
-    int x = 0;
-
-    for (x=0; x < 2; x++ )
-      {
-        int addr = x * SECOND_WORD;
-        int offset = x * SIZE_OF_READ;
-
-        half = read32 (fd, OTP_ZONE, addr);
-        if (NULL != half.ptr)
-          {
-            memcpy (buf.ptr + offset, half.ptr, SIZE_OF_READ);
-            lca_free_octet_buffer (half);
-          }
-        else
-          {
-            lca_free_octet_buffer (buf);
-            buf.ptr = NULL;
-            return buf;
-          }
+  struct lca_octet_buffer buf = lca_make_buffer (OTP_ZONE_SIZE);
 
-      }
+  if (!zone_cache_get_otp (fd, buf.ptr))
+    {
+      lca_free_octet_buffer (buf);
+      buf.ptr = NULL;
+      buf.len = 0;
+    }
 
-    return buf;
+  return buf;
 }
 
 bool
@@ -432,6 +469,8 @@ lock (int fd, enum DATA_ZONE zone, uint16_t crc)
         }
     }
 
+  zone_cache_invalidate_lock (fd, zone);
+
 
   return result;
 
@@ -440,16 +479,12 @@ lock (int fd, enum DATA_ZONE zone, uint16_t crc)
 static bool
 is_otp_read_only_mode (int fd)
 {
-  const uint8_t ADDR = 0x04;
-  uint32_t word = 0;
-  assert (read4 (fd, CONFIG_ZONE, ADDR, &word));
-
-  uint8_t * byte = (uint8_t *)&word;
+  uint8_t cz[CONFIG_ZONE_SIZE];
 
-  const unsigned int OFFSET_TO_OTP_MODE = 2;
-  const unsigned int OTP_READ_ONLY_MODE = 0xAA;
+  if (!zone_cache_get_config (fd, cz))
+    return false;
 
-  return OTP_READ_ONLY_MODE == byte[OFFSET_TO_OTP_MODE] ? true : false;
+  return OTP_MODE_READ_ONLY == cz[OTP_MODE_OFFSET] ? true : false;
 
 
 }
@@ -523,28 +558,22 @@ set_otp_zone (int fd, struct lca_octet_buffer *otp_zone)
 struct lca_octet_buffer
 get_serial_num (int fd)
 {
-  struct lca_octet_buffer serial;
+  struct lca_octet_buffer serial = {0,0};
   const unsigned int len = sizeof (uint32_t) * 2 + 1;
-  serial.ptr = lca_malloc_wipe (len);
-  serial.len = len;
-
-  uint32_t word = 0;
-
-  const uint8_t SERIAL_PART1_ADDR = 0x00;
-  const uint8_t SERIAL_PART2_ADDR = 0x02;
-  const uint8_t SERIAL_PART3_ADDR = 0x03;
-
-  read4 (fd, CONFIG_ZONE, SERIAL_PART1_ADDR, &word);
-  memcpy (serial.ptr, &word, sizeof (word));
 
-  read4 (fd, CONFIG_ZONE, SERIAL_PART2_ADDR, &word);
-  memcpy (serial.ptr + sizeof (word), &word, sizeof (word));
+  /* SN[0:3] is in word 0, SN[4:8] starts at word 2 */
+  const unsigned int SERIAL_PART1_OFFSET = 0;
+  const unsigned int SERIAL_PART2_OFFSET = 8;
 
-  read4 (fd, CONFIG_ZONE, SERIAL_PART3_ADDR, &word);
+  uint8_t cz[CONFIG_ZONE_SIZE];
 
-  uint8_t * ptr = (uint8_t *)&word;
-
-  memcpy (serial.ptr + len - 1, ptr, 1);
+  if (zone_cache_get_config (fd, cz))
+    {
+      serial = lca_make_buffer (len);
+      memcpy (serial.ptr, cz + SERIAL_PART1_OFFSET, sizeof (uint32_t));
+      memcpy (serial.ptr + sizeof (uint32_t), cz + SERIAL_PART2_OFFSET,
+              len - sizeof (uint32_t));
+    }
 
   return serial;
 
@@ -657,10 +686,226 @@ load_nonce (int fd, struct lca_octet_buffer data)
   assert (data.ptr != NULL && data.len == 32);
 
   struct lca_octet_buffer rsp = gen_nonce (fd, data);
+  bool result = false;
 
-  if (NULL == rsp.ptr || *rsp.ptr != 0)
-    return false;
-  else
+  if (NULL != rsp.ptr && 0 == *rsp.ptr)
+    {
+      verify_cache_set_tempkey (fd, data.ptr);
+      result = true;
+    }
+
+  if (NULL != rsp.ptr)
+    lca_free_octet_buffer (rsp);
+
+  return result;
+
+}
+
+struct Command_ATSHA204
+lca_build_mac_cmd (uint8_t mode, uint8_t key_slot, const uint8_t *challenge)
+{
+  uint8_t param2[2] = {0};
+  param2[0] = key_slot;
+
+  assert (key_slot < MAX_NUM_DATA_SLOTS);
+  /* The challenge is only sent when it is not taken from TempKey */
+  assert ((NULL == challenge) == !!(mode & LCA_MAC_MODE_CHALLENGE_TEMPKEY));
+
+  struct Command_ATSHA204 c =
+    build_command (COMMAND_MAC,
+                   mode,
+                   param2,
+                   (uint8_t *)challenge, NULL != challenge ? 32 : 0,
+                   0, MAC_MAX_EXEC);
+
+  return c;
+}
+
+bool
+lca_mac (int fd, uint8_t mode, uint8_t key_slot, const uint8_t *challenge,
+         uint8_t *response)
+{
+  assert (NULL != response);
+
+  struct Command_ATSHA204 c = lca_build_mac_cmd (mode, key_slot, challenge);
+  bool result;
+
+  result = RSP_SUCCESS == lca_process_command (fd, &c, response, 32);
+
+  if (NULL != c.data)
+    {
+      smemset (c.data, 0, c.data_len);
+      free (c.data);
+    }
+
+  if (!result)
+    LCA_LOG (DEBUG, "MAC command failed");
+
+  return result;
+}
+
+struct Command_ATSHA204
+lca_build_check_mac_cmd (uint8_t mode, uint8_t key_slot, const uint8_t *data)
+{
+  uint8_t param2[2] = {0};
+  param2[0] = key_slot;
+
+  assert (key_slot < MAX_NUM_DATA_SLOTS);
+  assert (NULL != data);
+
+  struct Command_ATSHA204 c =
+    build_command (COMMAND_CHECK_MAC,
+                   mode,
+                   param2,
+                   (uint8_t *)data, LCA_CHECK_MAC_DATA_LEN,
+                   0, CHECK_MAC_MAX_EXEC);
+
+  return c;
+}
+
+bool
+lca_check_mac (int fd, uint8_t mode, uint8_t key_slot,
+               const uint8_t *challenge, const uint8_t *response,
+               const uint8_t *other_data)
+{
+  uint8_t data[LCA_CHECK_MAC_DATA_LEN];
+  uint8_t status = 0xFF;
+  enum LCA_STATUS_RESPONSE rsp;
+
+  assert (NULL != response); assert (NULL != other_data);
+
+  /* The challenge field is sent even when the mode ignores it */
+  memset (data, 0, 32);
+  if (NULL != challenge)
+    memcpy (data, challenge, 32);
+  memcpy (data + 32, response, 32);
+  memcpy (data + 64, other_data, LCA_CHECK_MAC_OTHER_LEN);
+
+  struct Command_ATSHA204 c = lca_build_check_mac_cmd (mode, key_slot, data);
+
+  rsp = lca_process_command (fd, &c, &status, sizeof (status));
+
+  if (NULL != c.data)
+    {
+      smemset (c.data, 0, c.data_len);
+      free (c.data);
+    }
+  smemset (data, 0, sizeof (data));
+
+  LCA_LOG (DEBUG, "CheckMac: %s", status_to_string (rsp));
+
+  return RSP_SUCCESS == rsp && 0 == status;
+}
+
+struct Command_ATSHA204
+lca_build_hmac_cmd (uint8_t mode, uint8_t key_slot)
+{
+  uint8_t param2[2] = {0};
+  param2[0] = key_slot;
+
+  assert (key_slot < MAX_NUM_DATA_SLOTS);
+
+  struct Command_ATSHA204 c =
+    build_command (COMMAND_HMAC,
+                   mode,
+                   param2,
+                   NULL, 0,
+                   0, HMAC_MAX_EXEC);
+
+  return c;
+}
+
+bool
+lca_hmac (int fd, uint8_t mode, uint8_t key_slot, uint8_t *response)
+{
+  assert (NULL != response);
+
+  struct Command_ATSHA204 c = lca_build_hmac_cmd (mode, key_slot);
+
+  if (RSP_SUCCESS == lca_process_command (fd, &c, response, 32))
+    return true;
+
+  LCA_LOG (DEBUG, "HMAC command failed");
+  return false;
+}
+
+struct Command_ATSHA204
+lca_build_gen_dig_cmd (enum DATA_ZONE zone, uint8_t key_id)
+{
+  uint8_t param2[2] = {0};
+  uint8_t param1 = set_zone_bits (zone);
+  param2[0] = key_id;
+
+  assert (key_id < MAX_NUM_DATA_SLOTS);
+
+  struct Command_ATSHA204 c =
+    build_command (COMMAND_GEN_DIG,
+                   param1,
+                   param2,
+                   NULL, 0,
+                   0, GEN_DIG_MAX_EXEC);
+
+  return c;
+}
+
+bool
+lca_gen_dig (int fd, enum DATA_ZONE zone, uint8_t key_id)
+{
+  uint8_t status = 0xFF;
+
+  struct Command_ATSHA204 c = lca_build_gen_dig_cmd (zone, key_id);
+
+  if (RSP_SUCCESS == lca_process_command (fd, &c, &status, sizeof (status))
+      && 0 == status)
     return true;
 
+  LCA_LOG (DEBUG, "GenDig command failed");
+  return false;
+}
+
+struct Command_ATSHA204
+lca_build_derive_key_cmd (uint8_t mode, uint8_t target_key,
+                          const uint8_t *mac)
+{
+  uint8_t param2[2] = {0};
+  param2[0] = target_key;
+
+  assert (target_key < MAX_NUM_DATA_SLOTS);
+
+  struct Command_ATSHA204 c =
+    build_command (COMMAND_DERIVE_KEY,
+                   mode,
+                   param2,
+                   (uint8_t *)mac, NULL != mac ? 32 : 0,
+                   0, DERIVE_KEY_MAX_EXEC);
+
+  return c;
+}
+
+bool
+lca_derive_key (int fd, uint8_t mode, uint8_t target_key, const uint8_t *mac)
+{
+  uint8_t status = 0xFF;
+  bool result;
+
+  struct Command_ATSHA204 c = lca_build_derive_key_cmd (mode, target_key,
+                                                        mac);
+
+  result = RSP_SUCCESS == lca_process_command (fd, &c, &status,
+                                               sizeof (status))
+    && 0 == status;
+
+  if (NULL != c.data)
+    {
+      smemset (c.data, 0, c.data_len);
+      free (c.data);
+    }
+
+  /* The slot may hold a new key even if the response was lost */
+  zone_cache_invalidate (fd, DATA_ZONE, slot_to_addr (DATA_ZONE, target_key));
+
+  if (!result)
+    LCA_LOG (DEBUG, "DeriveKey command failed");
+
+  return result;
 }
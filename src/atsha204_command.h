@@ -56,6 +56,38 @@ bool
 write4 (int fd, enum DATA_ZONE zone, uint8_t addr, uint32_t buf);
 
 
+/**
+ * Reads 4 or 32 bytes at a full 16 bit address, for data zone blocks
+ * past the first in a slot.
+ *
+ * @param fd The open file descriptor.
+ * @param zone The zone from which to read.
+ * @param addr The address, param2 of the read command.
+ * @param buf Receives len bytes.
+ * @param len READ4_LENGTH or READ32_LENGTH.
+ *
+ * @return True if successful.
+ */
+bool
+read_at (int fd, enum DATA_ZONE zone, uint16_t addr,
+         uint8_t *buf, unsigned int len);
+
+/**
+ * Writes 4 or 32 clear text bytes at a full 16 bit address.
+ *
+ * @param fd The open file descriptor.
+ * @param zone The zone to which to write.
+ * @param addr The address, param2 of the write command.
+ * @param buf The len bytes to write.
+ * @param len READ4_LENGTH or READ32_LENGTH.
+ *
+ * @return True if successful.
+ */
+bool
+write_at (int fd, enum DATA_ZONE zone, uint16_t addr,
+          const uint8_t *buf, unsigned int len);
+
+
 /**
  * Performs the nonce operation on the device.  Depending on the data
  * parameter, this command will either generate a new nonce or combine
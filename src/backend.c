@@ -0,0 +1,149 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include "backend.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+#ifndef LCA_DEFAULT_BACKEND
+#define LCA_DEFAULT_BACKEND LCA_BACKEND_GCRYPT
+#endif
+
+static const struct backend *backends[] = {
+  [LCA_BACKEND_GCRYPT] = &backend_gcrypt,
+#ifdef HAVE_OPENSSL
+  [LCA_BACKEND_OPENSSL] = &backend_openssl,
+#endif
+  [LCA_BACKEND_BUILTIN] = &backend_builtin
+};
+
+#define NUM_BACKENDS (sizeof (backends) / sizeof (backends[0]))
+
+static const struct backend *current = NULL;
+static pthread_mutex_t select_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct backend *
+find_backend (enum LCA_BACKEND b)
+{
+  if ((unsigned int)b >= NUM_BACKENDS)
+    return NULL;
+
+  return backends[b];
+}
+
+bool
+lca_backend_available (enum LCA_BACKEND b)
+{
+  return NULL != find_backend (b);
+}
+
+const char *
+lca_backend_name (enum LCA_BACKEND b)
+{
+  const struct backend *be = find_backend (b);
+
+  return NULL != be ? be->name : NULL;
+}
+
+bool
+lca_backend_select (enum LCA_BACKEND b)
+{
+  const struct backend *be = find_backend (b);
+  bool result = false;
+
+  if (NULL == be)
+    return false;
+
+  pthread_mutex_lock (&select_lock);
+
+  if ((result = be->init ()))
+    {
+      __atomic_store_n (&current, be, __ATOMIC_RELEASE);
+      LCA_LOG (DEBUG, "Using the %s crypto backend", be->name);
+    }
+
+  pthread_mutex_unlock (&select_lock);
+
+  return result;
+}
+
+enum LCA_BACKEND
+lca_backend_current (void)
+{
+  return backend_get ()->id;
+}
+
+const struct backend *
+backend_get (void)
+{
+  const struct backend *be = __atomic_load_n (&current, __ATOMIC_ACQUIRE);
+
+  if (NULL == be)
+    {
+      /* The built-in backend has nothing to initialize */
+      if (!lca_backend_select (LCA_DEFAULT_BACKEND))
+        lca_backend_select (LCA_BACKEND_BUILTIN);
+      be = __atomic_load_n (&current, __ATOMIC_ACQUIRE);
+    }
+
+  return be;
+}
+
+bool
+lca_p256_verify (const uint8_t *pub_key, const uint8_t *digest,
+                 const uint8_t *signature)
+{
+  assert (NULL != pub_key); assert (NULL != digest);
+  assert (NULL != signature);
+
+  return backend_get ()->p256_verify (pub_key, digest, signature);
+}
+
+bool
+lca_p256_sign (const uint8_t *priv_key, const uint8_t *digest,
+               uint8_t *signature)
+{
+  assert (NULL != priv_key); assert (NULL != digest);
+  assert (NULL != signature);
+
+  return backend_get ()->p256_sign (priv_key, digest, signature);
+}
+
+bool
+lca_p256_keygen (uint8_t *priv_key, uint8_t *pub_key)
+{
+  assert (NULL != priv_key); assert (NULL != pub_key);
+
+  return backend_get ()->p256_keygen (priv_key, pub_key);
+}
+
+bool
+lca_p256_ecdh (const uint8_t *priv_key, const uint8_t *pub_key,
+               uint8_t *secret)
+{
+  assert (NULL != priv_key); assert (NULL != pub_key);
+  assert (NULL != secret);
+
+  return backend_get ()->p256_ecdh (priv_key, pub_key, secret);
+}
@@ -0,0 +1,64 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/* The host crypto operations a backend provides.  Public keys are the
+   64 byte x || y, signatures the 64 byte r || s and ECDH secrets the
+   32 byte x coordinate of the shared point. */
+struct backend
+{
+  enum LCA_BACKEND id;
+  const char *name;
+  bool (*init) (void);
+  void (*sha256) (const uint8_t *data, size_t len, uint8_t *digest);
+  bool (*hmac_sha256) (const uint8_t *key, size_t key_len,
+                       const uint8_t *data, size_t len, uint8_t *mac);
+  bool (*p256_verify) (const uint8_t *pub, const uint8_t *digest,
+                       const uint8_t *sig);
+  bool (*p256_sign) (const uint8_t *priv, const uint8_t *digest,
+                     uint8_t *sig);
+  bool (*p256_keygen) (uint8_t *priv, uint8_t *pub);
+  bool (*p256_ecdh) (const uint8_t *priv, const uint8_t *pub,
+                     uint8_t *secret);
+};
+
+extern const struct backend backend_gcrypt;
+extern const struct backend backend_builtin;
+#ifdef HAVE_OPENSSL
+extern const struct backend backend_openssl;
+#endif
+
+/**
+ * Returns the selected backend, the configured default until
+ * lca_backend_select is called.
+ *
+ * @return The backend.
+ */
+const struct backend *
+backend_get (void);
+
+#endif /* BACKEND_H */
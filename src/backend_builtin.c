@@ -0,0 +1,60 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "backend.h"
+#include "p256.h"
+#include "sha256.h"
+#include "../libcryptoauth.h"
+
+/* The backend with no dependencies: the library's own SHA-256, which
+   uses the CPU's SHA instructions when it can, and P-256. */
+
+static bool
+builtin_init (void)
+{
+  return true;
+}
+
+static bool
+builtin_hmac_sha256 (const uint8_t *key, size_t key_len,
+                     const uint8_t *data, size_t len, uint8_t *mac)
+{
+  struct lca_hmac_ctx ctx;
+
+  lca_hmac_init (&ctx, key, key_len);
+  lca_hmac_compute (&ctx, data, len, mac);
+  lca_hmac_wipe (&ctx);
+
+  return true;
+}
+
+const struct backend backend_builtin = {
+  LCA_BACKEND_BUILTIN,
+  "built-in",
+  builtin_init,
+  sha256,
+  builtin_hmac_sha256,
+  p256_ecdsa_verify,
+  p256_ecdsa_sign,
+  p256_keygen,
+  p256_ecdh
+};
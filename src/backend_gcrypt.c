@@ -0,0 +1,266 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <gcrypt.h>
+#include <string.h>
+#include "backend.h"
+#include "p256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* libgcrypt, through S-expressions.  Points are passed with the 0x04
+   uncompressed tag. */
+
+#define CURVE "(curve \"NIST P-256\")"
+
+static bool
+gcrypt_init (void)
+{
+  if (gcry_control (GCRYCTL_INITIALIZATION_FINISHED_P))
+    return true;
+
+  /* Nobody set gcrypt up, so do the minimum once */
+  if (NULL == gcry_check_version (NULL))
+    return false;
+
+  gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+  return true;
+}
+
+static void
+gcrypt_sha256 (const uint8_t *data, size_t len, uint8_t *digest)
+{
+  gcry_md_hash_buffer (GCRY_MD_SHA256, digest, data, len);
+}
+
+static bool
+gcrypt_hmac_sha256 (const uint8_t *key, size_t key_len,
+                    const uint8_t *data, size_t len, uint8_t *mac)
+{
+  gcry_md_hd_t hd;
+  gcry_error_t rc;
+
+  rc = gcry_md_open (&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
+
+  if (GPG_ERR_NO_ERROR != rc)
+    {
+      LCA_LOG (DEBUG, "gcrypt HMAC open failed: %s", gpg_strerror (rc));
+      return false;
+    }
+
+  rc = gcry_md_setkey (hd, key, key_len);
+
+  if (GPG_ERR_NO_ERROR == rc)
+    {
+      gcry_md_write (hd, data, len);
+      memcpy (mac, gcry_md_read (hd, GCRY_MD_SHA256), LCA_SHA256_DLEN);
+    }
+
+  gcry_md_close (hd);
+
+  return GPG_ERR_NO_ERROR == rc;
+}
+
+static void
+tag_point (uint8_t *q, const uint8_t *pub)
+{
+  q[0] = 0x04;
+  memcpy (q + 1, pub, 64);
+}
+
+/* Copies the named value of an S-expression, right aligned in len
+   bytes */
+static bool
+get_value (gcry_sexp_t sexp, const char *token, uint8_t *dst, size_t len)
+{
+  gcry_sexp_t t;
+  gcry_mpi_t mpi;
+  size_t n = 0;
+  bool result = false;
+
+  if (NULL == (t = gcry_sexp_find_token (sexp, token, 0)))
+    return false;
+
+  if (NULL != (mpi = gcry_sexp_nth_mpi (t, 1, GCRYMPI_FMT_USG)))
+    {
+      uint8_t buf[65];
+
+      if (0 == gcry_mpi_print (GCRYMPI_FMT_USG, buf, sizeof (buf), &n, mpi)
+          && n <= len)
+        {
+          memset (dst, 0, len - n);
+          memcpy (dst + len - n, buf, n);
+          result = true;
+        }
+
+      smemset (buf, 0, sizeof (buf));
+      gcry_mpi_release (mpi);
+    }
+
+  gcry_sexp_release (t);
+
+  return result;
+}
+
+static bool
+gcrypt_p256_verify (const uint8_t *pub, const uint8_t *digest,
+                    const uint8_t *sig)
+{
+  gcry_sexp_t g_pub_key = NULL, g_digest = NULL, g_sig = NULL;
+  uint8_t q[65];
+  int rc;
+
+  tag_point (q, pub);
+
+  rc = gcry_sexp_build (&g_pub_key, NULL,
+                        "(public-key(ecdsa" CURVE "(q %b)))",
+                        (int)sizeof (q), q)
+    || gcry_sexp_build (&g_digest, NULL, "(data (flags raw)(value %b))",
+                        32, digest)
+    || gcry_sexp_build (&g_sig, NULL, "(sig-val(ecdsa(r %b)(s %b)))",
+                        32, sig, 32, sig + 32);
+
+  if (0 == rc)
+    rc = gcry_pk_verify (g_sig, g_digest, g_pub_key);
+
+  if (0 != rc)
+    LCA_LOG (DEBUG, "gcrypt verify failed: %s", gpg_strerror (rc));
+
+  gcry_sexp_release (g_sig);
+  gcry_sexp_release (g_digest);
+  gcry_sexp_release (g_pub_key);
+
+  return 0 == rc;
+}
+
+static bool
+gcrypt_p256_sign (const uint8_t *priv, const uint8_t *digest, uint8_t *sig)
+{
+  gcry_sexp_t g_key = NULL, g_digest = NULL, g_sig = NULL;
+  bool result = false;
+
+  /* gcrypt signs with d = 0 or d >= n */
+  if (!p256_scalar_valid (priv))
+    return false;
+
+  if (0 == gcry_sexp_build (&g_key, NULL,
+                            "(private-key(ecdsa" CURVE "(d %b)))",
+                            32, priv)
+      && 0 == gcry_sexp_build (&g_digest, NULL,
+                               "(data (flags raw)(value %b))", 32, digest)
+      && 0 == gcry_pk_sign (&g_sig, g_digest, g_key))
+    result = get_value (g_sig, "r", sig, 32)
+      && get_value (g_sig, "s", sig + 32, 32);
+
+  gcry_sexp_release (g_sig);
+  gcry_sexp_release (g_digest);
+  gcry_sexp_release (g_key);
+
+  return result;
+}
+
+static bool
+gcrypt_p256_keygen (uint8_t *priv, uint8_t *pub)
+{
+  gcry_sexp_t params = NULL, key = NULL;
+  uint8_t q[65];
+  bool result = false;
+
+  if (0 == gcry_sexp_build (&params, NULL, "(genkey(ecdsa" CURVE "))")
+      && 0 == gcry_pk_genkey (&key, params))
+    result = get_value (key, "d", priv, 32)
+      && get_value (key, "q", q, sizeof (q))
+      && 0x04 == q[0];
+
+  if (result)
+    memcpy (pub, q + 1, 64);
+
+  gcry_sexp_release (key);
+  gcry_sexp_release (params);
+
+  return result;
+}
+
+static bool
+on_curve (gcry_sexp_t pub_key)
+{
+  gcry_ctx_t ctx = NULL;
+  gcry_mpi_point_t q = NULL;
+  bool result = false;
+
+  if (0 == gcry_mpi_ec_new (&ctx, pub_key, NULL)
+      && NULL != (q = gcry_mpi_ec_get_point ("q", ctx, 0)))
+    result = gcry_mpi_ec_curve_point (q, ctx);
+
+  gcry_mpi_point_release (q);
+  gcry_ctx_release (ctx);
+
+  return result;
+}
+
+static bool
+gcrypt_p256_ecdh (const uint8_t *priv, const uint8_t *pub, uint8_t *secret)
+{
+  gcry_sexp_t g_pub_key = NULL, g_data = NULL, g_enc = NULL;
+  uint8_t q[65], s[65];
+  bool result = false;
+
+  if (!p256_scalar_valid (priv))
+    return false;
+
+  tag_point (q, pub);
+
+  /* Encrypting the scalar with the peer key gives (s = d * Q), but
+     gcrypt does not check that Q is on the curve first */
+  if (0 == gcry_sexp_build (&g_pub_key, NULL,
+                            "(public-key(ecc" CURVE "(q %b)))",
+                            (int)sizeof (q), q)
+      && on_curve (g_pub_key)
+      && 0 == gcry_sexp_build (&g_data, NULL, "(data (flags raw)(value %b))",
+                               32, priv)
+      && 0 == gcry_pk_encrypt (&g_enc, g_data, g_pub_key))
+    result = get_value (g_enc, "s", s, sizeof (s)) && 0x04 == s[0];
+
+  if (result)
+    memcpy (secret, s + 1, 32);
+
+  smemset (s, 0, sizeof (s));
+  gcry_sexp_release (g_enc);
+  gcry_sexp_release (g_data);
+  gcry_sexp_release (g_pub_key);
+
+  return result;
+}
+
+const struct backend backend_gcrypt = {
+  LCA_BACKEND_GCRYPT,
+  "libgcrypt",
+  gcrypt_init,
+  gcrypt_sha256,
+  gcrypt_hmac_sha256,
+  gcrypt_p256_verify,
+  gcrypt_p256_sign,
+  gcrypt_p256_keygen,
+  gcrypt_p256_ecdh
+};
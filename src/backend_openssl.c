@@ -0,0 +1,211 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#ifdef HAVE_OPENSSL
+
+/* The EC_KEY interface is deprecated in OpenSSL 3 but is the one that
+   works across 1.1 and 3 without the provider plumbing. */
+#define OPENSSL_SUPPRESS_DEPRECATED 1
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdh.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/obj_mac.h>
+#include <openssl/sha.h>
+#include <assert.h>
+#include <string.h>
+#include "backend.h"
+#include "p256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+static bool
+openssl_init (void)
+{
+  return true;
+}
+
+static void
+openssl_sha256 (const uint8_t *data, size_t len, uint8_t *digest)
+{
+  SHA256 (data, len, digest);
+}
+
+static bool
+openssl_hmac_sha256 (const uint8_t *key, size_t key_len,
+                     const uint8_t *data, size_t len, uint8_t *mac)
+{
+  unsigned int mac_len = LCA_SHA256_DLEN;
+
+  return NULL != HMAC (EVP_sha256 (), key, (int)key_len, data, len,
+                       mac, &mac_len);
+}
+
+static EC_KEY *
+make_key (const uint8_t *priv, const uint8_t *pub)
+{
+  EC_KEY *key = EC_KEY_new_by_curve_name (NID_X9_62_prime256v1);
+  EC_POINT *q = NULL;
+  BIGNUM *d = NULL;
+  uint8_t tagged[65];
+  bool ok = NULL != key;
+
+  if (ok && NULL != pub)
+    {
+      tagged[0] = 0x04;
+      memcpy (tagged + 1, pub, 64);
+      ok = NULL != (q = EC_POINT_new (EC_KEY_get0_group (key)))
+        && 1 == EC_POINT_oct2point (EC_KEY_get0_group (key), q, tagged,
+                                    sizeof (tagged), NULL)
+        && 1 == EC_KEY_set_public_key (key, q);
+    }
+
+  if (ok && NULL != priv)
+    ok = NULL != (d = BN_bin2bn (priv, 32, NULL))
+      && 1 == EC_KEY_set_private_key (key, d);
+
+  BN_clear_free (d);
+  EC_POINT_free (q);
+
+  if (!ok)
+    {
+      EC_KEY_free (key);
+      key = NULL;
+    }
+
+  return key;
+}
+
+static bool
+openssl_p256_verify (const uint8_t *pub, const uint8_t *digest,
+                     const uint8_t *sig)
+{
+  EC_KEY *key = make_key (NULL, pub);
+  ECDSA_SIG *s = ECDSA_SIG_new ();
+  BIGNUM *r = BN_bin2bn (sig, 32, NULL);
+  BIGNUM *ss = BN_bin2bn (sig + 32, 32, NULL);
+  bool result = false;
+
+  if (NULL != key && NULL != s && NULL != r && NULL != ss
+      && 1 == ECDSA_SIG_set0 (s, r, ss))
+    {
+      r = ss = NULL;
+      result = 1 == ECDSA_do_verify (digest, 32, s, key);
+    }
+
+  BN_free (r);
+  BN_free (ss);
+  ECDSA_SIG_free (s);
+  EC_KEY_free (key);
+
+  return result;
+}
+
+static bool
+openssl_p256_sign (const uint8_t *priv, const uint8_t *digest, uint8_t *sig)
+{
+  EC_KEY *key;
+  ECDSA_SIG *s = NULL;
+  const BIGNUM *r, *ss;
+  bool result = false;
+
+  /* OpenSSL signs with d = 0 or d >= n */
+  if (!p256_scalar_valid (priv))
+    return false;
+
+  key = make_key (priv, NULL);
+
+  if (NULL != key && NULL != (s = ECDSA_do_sign (digest, 32, key)))
+    {
+      ECDSA_SIG_get0 (s, &r, &ss);
+      result = 32 == BN_bn2binpad (r, sig, 32)
+        && 32 == BN_bn2binpad (ss, sig + 32, 32);
+    }
+
+  ECDSA_SIG_free (s);
+  EC_KEY_free (key);
+
+  return result;
+}
+
+static bool
+openssl_p256_keygen (uint8_t *priv, uint8_t *pub)
+{
+  EC_KEY *key = EC_KEY_new_by_curve_name (NID_X9_62_prime256v1);
+  uint8_t tagged[65];
+  bool result = false;
+
+  if (NULL != key && 1 == EC_KEY_generate_key (key))
+    result = 32 == BN_bn2binpad (EC_KEY_get0_private_key (key), priv, 32)
+      && sizeof (tagged) == EC_POINT_point2oct (EC_KEY_get0_group (key),
+                                                EC_KEY_get0_public_key (key),
+                                                POINT_CONVERSION_UNCOMPRESSED,
+                                                tagged, sizeof (tagged),
+                                                NULL);
+
+  if (result)
+    memcpy (pub, tagged + 1, 64);
+
+  EC_KEY_free (key);
+
+  return result;
+}
+
+static bool
+openssl_p256_ecdh (const uint8_t *priv, const uint8_t *pub, uint8_t *secret)
+{
+  EC_KEY *mine, *peer;
+  bool result = false;
+
+  if (!p256_scalar_valid (priv))
+    return false;
+
+  mine = make_key (priv, NULL);
+  peer = make_key (NULL, pub);
+
+  if (NULL != mine && NULL != peer)
+    result = 32 == ECDH_compute_key (secret, 32,
+                                     EC_KEY_get0_public_key (peer),
+                                     mine, NULL);
+
+  EC_KEY_free (peer);
+  EC_KEY_free (mine);
+
+  return result;
+}
+
+const struct backend backend_openssl = {
+  LCA_BACKEND_OPENSSL,
+  "OpenSSL",
+  openssl_init,
+  openssl_sha256,
+  openssl_hmac_sha256,
+  openssl_p256_verify,
+  openssl_p256_sign,
+  openssl_p256_keygen,
+  openssl_p256_ecdh
+};
+
+#endif /* HAVE_OPENSSL */
@@ -0,0 +1,203 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zone_plan.h"
+#include "zone_cache.h"
+#include "command_util.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+unsigned int
+lca_data_slot_offset (uint8_t slot)
+{
+  return data_slot_offset (slot);
+}
+
+unsigned int
+lca_data_slot_size (uint8_t slot)
+{
+  return data_slot_size (slot);
+}
+
+/* Slots that read back in clear text never hold secrets, so their
+   contents are cached. */
+static bool
+is_public_slot (const struct lca_config_view *view, uint8_t slot)
+{
+  return NULL != view && view->data_locked
+    && lca_zone_can_read (view, DATA_ZONE, slot << 3)
+    && !view->slots[slot].encrypt_read;
+}
+
+static void
+cache_public_words (int fd, const struct zone_plan *plan,
+                    const uint8_t *image)
+{
+  struct lca_config_view view;
+  uint32_t words[WORD_MAP_LEN];
+  unsigned int x;
+
+  if (!zone_cache_get_view (fd, &view))
+    return;
+
+  memset (words, 0, sizeof (words));
+
+  for (x = 0; x < plan->count; x++)
+    if (is_public_slot (&view, data_offset_to_slot (plan->ops[x].offset)))
+      word_map_mark (words, plan->ops[x].offset, plan->ops[x].len);
+
+  zone_cache_put_data (fd, words, image);
+}
+
+bool
+lca_data_read (int fd, unsigned int offset, uint8_t *buf, unsigned int len)
+{
+  uint8_t image[DATA_ZONE_SIZE];
+  uint32_t wanted[WORD_MAP_LEN];
+  struct zone_plan *plan;
+  bool result = false;
+
+  assert (NULL != buf);
+
+  if (offset > DATA_ZONE_SIZE || len > DATA_ZONE_SIZE - offset)
+    return false;
+
+  memset (wanted, 0, sizeof (wanted));
+  word_map_mark (wanted, offset, len);
+
+  zone_cache_get_data (fd, wanted, image);
+
+  plan = malloc (sizeof (*plan));
+  assert (NULL != plan);
+
+  plan_reads (DATA_ZONE, wanted, plan);
+
+  LCA_LOG (DEBUG, "Data read of %u bytes in %u commands", len, plan->count);
+
+  if (run_reads (fd, plan, image))
+    {
+      cache_public_words (fd, plan, image);
+      memcpy (buf, image + offset, len);
+      result = true;
+    }
+
+  smemset (image, 0, sizeof (image));
+  free (plan);
+
+  return result;
+}
+
+static bool
+is_readable_range (int fd, unsigned int offset, unsigned int len)
+{
+  struct lca_config_view view;
+  uint8_t slot;
+
+  if (!zone_cache_get_view (fd, &view))
+    return false;
+
+  for (slot = data_offset_to_slot (offset);
+       slot < MAX_SLOTS && data_slot_offset (slot) < offset + len; slot++)
+    if (!lca_zone_can_read (&view, DATA_ZONE, slot << 3)
+        || view.slots[slot].encrypt_read)
+      return false;
+
+  return true;
+}
+
+bool
+lca_data_write (int fd, unsigned int offset, const uint8_t *buf,
+                unsigned int len)
+{
+  const unsigned int WORD_LEN = READ4_LENGTH;
+  uint8_t image[DATA_ZONE_SIZE];
+  uint32_t words[WORD_MAP_LEN];
+  struct zone_plan *plan;
+  unsigned int start, end;
+  bool result = false;
+
+  assert (NULL != buf);
+
+  if (offset > DATA_ZONE_SIZE || len > DATA_ZONE_SIZE - offset)
+    return false;
+
+  if (0 == len)
+    return true;
+
+  /* Words only partly covered keep their other bytes */
+  start = offset - offset % WORD_LEN;
+  end = offset + len;
+  if (0 != end % WORD_LEN)
+    end += WORD_LEN - end % WORD_LEN;
+
+  if (start != offset
+      && !lca_data_read (fd, start, image + start, WORD_LEN))
+    return false;
+
+  /* Unless the head word already covered it */
+  if (end != offset + len && (start == offset || end - start > WORD_LEN)
+      && !lca_data_read (fd, end - WORD_LEN, image + end - WORD_LEN,
+                         WORD_LEN))
+    return false;
+
+  memcpy (image + offset, buf, len);
+
+  memset (words, 0, sizeof (words));
+  word_map_mark (words, offset, len);
+
+  plan = malloc (sizeof (*plan));
+  assert (NULL != plan);
+
+  plan_writes (DATA_ZONE, words, plan);
+
+  LCA_LOG (DEBUG, "Data write of %u bytes in %u commands", len, plan->count);
+
+  if (run_writes (fd, plan, image))
+    {
+      result = true;
+
+      /* One trailing read back of the whole range instead of reading
+         after every block.  Secret slots can not be read back and
+         rely on the write status. */
+      if (is_readable_range (fd, start, end - start))
+        {
+          uint8_t *check = malloc (len);
+          assert (NULL != check);
+
+          result = lca_data_read (fd, offset, check, len)
+            && 0 == memcmp (check, buf, len);
+
+          if (!result)
+            LCA_LOG (DEBUG, "Data write verification failed");
+
+          free (check);
+        }
+    }
+
+  smemset (image, 0, sizeof (image));
+  free (plan);
+
+  return result;
+}
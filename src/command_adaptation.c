@@ -28,6 +28,9 @@
 #include "util.h"
 #include "../libcryptoauth.h"
 #include "command_util.h"
+#include "devstore.h"
+#include "ecdh_cache.h"
+#include "verify_cache.h"
 
 const char*
 status_to_string (enum LCA_STATUS_RESPONSE rsp)
@@ -81,6 +84,14 @@ lca_process_command (int fd, struct Command_ATSHA204 *c,
 
   c_len = lca_serialize_command (c, &serialized);
 
+  /* Held over the hook too, so TempKey is forgotten for the command
+     that changes it and not one from another thread */
+  lca_device_lock (fd);
+
+  /* Reads leave TempKey alone, anything else may change it */
+  if (COMMAND_READ != c->opcode)
+    verify_cache_forget_tempkey (fd);
+
   enum LCA_STATUS_RESPONSE rsp = lca_send_and_receive (fd,
                                                          serialized,
                                                          c_len,
@@ -88,6 +99,8 @@ lca_process_command (int fd, struct Command_ATSHA204 *c,
                                                          recv_len,
                                                          &c->exec_time);
 
+  lca_device_unlock (fd);
+
   lca_free_wipe (serialized, c_len);
 
   return rsp;
@@ -95,6 +108,56 @@ lca_process_command (int fd, struct Command_ATSHA204 *c,
 
 }
 
+enum LCA_STATUS_RESPONSE
+lca_send_frame (int fd,
+                const uint8_t *frame,
+                unsigned int frame_len,
+                uint8_t *rec_buf,
+                unsigned int recv_len,
+                struct timespec *wait_time)
+{
+  const uint8_t PASS_THROUGH_MODE = 3;
+  const uint8_t GEN_PRIVATE_KEY = 0x04;
+#ifndef USE_KERNEL
+  /* Word address and count come first, the CRC last */
+  const unsigned int HEADER_LEN = 6;
+  const unsigned int TRAILER_LEN = 2;
+#else
+  const unsigned int HEADER_LEN = 4;
+  const unsigned int TRAILER_LEN = 0;
+#endif
+  const uint8_t *cmd = frame + HEADER_LEN - 4;
+  enum LCA_STATUS_RESPONSE rsp;
+
+  assert (NULL != frame);
+  assert (NULL != rec_buf);
+  assert (frame_len >= HEADER_LEN + TRAILER_LEN);
+
+  lca_device_lock (fd);
+
+  if (COMMAND_READ != cmd[0])
+    verify_cache_forget_tempkey (fd);
+
+  if (COMMAND_GEN_KEY == cmd[0] && (cmd[1] & GEN_PRIVATE_KEY))
+    {
+      devstore_drop_pub_key (fd, cmd[2] & 0x0F);
+      ecdh_cache_invalidate_slot (fd, cmd[2] & 0x0F);
+    }
+
+  rsp = lca_send_and_receive (fd, frame, frame_len, rec_buf, recv_len,
+                              wait_time);
+
+  if (RSP_SUCCESS == rsp && COMMAND_NONCE == cmd[0]
+      && PASS_THROUGH_MODE == (cmd[1] & 0x03)
+      && HEADER_LEN + 32 + TRAILER_LEN == frame_len
+      && 0 == rec_buf[0])
+    verify_cache_set_tempkey (fd, frame + HEADER_LEN);
+
+  lca_device_unlock (fd);
+
+  return rsp;
+}
+
 enum LCA_STATUS_RESPONSE
 lca_send_and_receive (int fd,
                        const uint8_t *send_buf,
@@ -114,6 +177,8 @@ lca_send_and_receive (int fd,
   assert (NULL != recv_buf);
   assert (NULL != wait_time);
 
+  lca_device_lock (fd);
+
   /* Send the data at first.  During a read, if the device responds
   with an "I'm Awake" flag, we've lost synchronization, so send the
   data again in that case only.  Arbitrarily retry this procedure
@@ -152,6 +217,8 @@ lca_send_and_receive (int fd,
   assert (NULL != recv_buf);
   assert (NULL != wait_time);
 
+  lca_device_lock (fd);
+
   result = write (fd, send_buf, send_buf_len);
 
   if (result == send_buf_len)
@@ -174,6 +241,8 @@ lca_send_and_receive (int fd,
     }
 #endif
 
+  lca_device_unlock (fd);
+
   return rsp;
 }
 
@@ -420,6 +489,8 @@ lca_send_and_get_rsp (int fd,
 
   assert (NULL != send_buf);
 
+  lca_device_lock (fd);
+
   if (1 < (result = lca_write (fd, send_buf, send_buf_len)))
     {
       rsp = lca_get_response (fd, MAX_RECV_LEN, wait_time);
@@ -429,5 +500,7 @@ lca_send_and_get_rsp (int fd,
       LCA_LOG (DEBUG, "Send failed.");
     }
 
+  lca_device_unlock (fd);
+
   return rsp;
 }
@@ -55,6 +55,21 @@
 /* Slot config definition */
 #define MAX_SLOTS 16
 
+/* Zone sizes and the lock bytes within the config zone */
+#define CONFIG_ZONE_SIZE        128
+#define OTP_ZONE_SIZE           64
+#define DATA_ZONE_SIZE          1208
+#define LOCK_DATA_OFFSET        86
+#define LOCK_CONFIG_OFFSET      87
+#define OTP_MODE_OFFSET         18
+#define ZONE_UNLOCKED           0x55
+#define OTP_MODE_READ_ONLY      0xAA
+#define SERIAL_NUM_LEN          9
+#define PUB_KEY_LEN             64
+#define SLOT_CONFIG_OFFSET      20
+#define SLOT_LOCKED_OFFSET      88
+#define KEY_CONFIG_OFFSET       96
+
 
 /* Random Command, i.e. actual random not a random command, ha! */
 
@@ -102,6 +117,10 @@
 #define ECC_SIGN_MAX_EXEC 38000000
 #define ECC_VERIFY_MAX_EXEC 73000000
 
+/* The device sleeps this long after a wake at the earliest, whatever
+   it is doing */
+#define WATCHDOG_MIN_NS 700000000
+
 struct Command_ATSHA204
 make_command (void) __attribute__ ((const));
 
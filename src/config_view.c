@@ -0,0 +1,256 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+#include "config_view.h"
+#include "zone_cache.h"
+#include "command_util.h"
+#include "../libcryptoauth.h"
+
+/* SlotConfig bits */
+#define SLOT_IS_SECRET        0x0080
+#define SLOT_ENCRYPT_READ     0x0040
+
+/* ReadKey bits for ECC private keys */
+#define READ_KEY_EXT_SIGN     0x01
+#define READ_KEY_ECDH         0x04
+
+/* KeyConfig bits */
+#define KEY_PRIVATE           0x0001
+
+/* WriteConfig, for the Write command */
+#define WRITE_CONFIG_ENCRYPT  0x04
+#define WRITE_CONFIG_PUB_INVALID 0x01
+
+/* The first 16 bytes of the config zone are never writable */
+#define CONFIG_WRITABLE_START 16
+
+static uint16_t
+get_le16 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+static uint8_t
+addr_to_slot (uint8_t addr)
+{
+  return (addr >> 3) & 0x0F;
+}
+
+bool
+lca_decode_config (struct lca_octet_buffer config,
+                   struct lca_config_view *view)
+{
+  const uint8_t *cz = config.ptr;
+  uint16_t slot_locked;
+  unsigned int x;
+
+  assert (NULL != view);
+
+  if (NULL == cz || CONFIG_ZONE_SIZE != config.len)
+    return false;
+
+  memset (view, 0, sizeof (*view));
+
+  memcpy (view->serial, cz, sizeof (uint32_t));
+  memcpy (view->serial + sizeof (uint32_t), cz + 8,
+          sizeof (view->serial) - sizeof (uint32_t));
+
+  view->config_locked = ZONE_UNLOCKED != cz[LOCK_CONFIG_OFFSET];
+  view->data_locked = ZONE_UNLOCKED != cz[LOCK_DATA_OFFSET];
+  view->otp_read_only = OTP_MODE_READ_ONLY == cz[OTP_MODE_OFFSET];
+
+  slot_locked = get_le16 (cz + SLOT_LOCKED_OFFSET);
+
+  for (x = 0; x < MAX_SLOTS; x++)
+    {
+      struct lca_slot_policy *p = &view->slots[x];
+
+      p->slot_config = get_le16 (cz + SLOT_CONFIG_OFFSET + 2 * x);
+      p->key_config = get_le16 (cz + KEY_CONFIG_OFFSET + 2 * x);
+
+      p->read_key = p->slot_config & 0x0F;
+      p->write_key = (p->slot_config >> 8) & 0x0F;
+      p->write_config = (p->slot_config >> 12) & 0x0F;
+      p->is_secret = (p->slot_config & SLOT_IS_SECRET) ? true : false;
+      p->encrypt_read = (p->slot_config & SLOT_ENCRYPT_READ) ? true : false;
+
+      p->is_private = (p->key_config & KEY_PRIVATE) ? true : false;
+      p->key_type = (p->key_config >> 2) & 0x07;
+
+      p->slot_locked = (slot_locked & (1 << x)) ? false : true;
+    }
+
+  return true;
+}
+
+static bool
+is_p256_private (const struct lca_config_view *view, uint8_t slot)
+{
+  const struct lca_slot_policy *p = &view->slots[slot];
+
+  return p->is_private && LCA_KEY_TYPE_P256 == p->key_type;
+}
+
+bool
+lca_slot_can_sign (const struct lca_config_view *view, uint8_t slot)
+{
+  assert (NULL != view);
+  assert (slot < MAX_SLOTS);
+
+  /* ECC commands fail outright while the config zone is unlocked */
+  return view->config_locked && is_p256_private (view, slot)
+    && (view->slots[slot].read_key & READ_KEY_EXT_SIGN);
+}
+
+bool
+lca_slot_can_ecdh (const struct lca_config_view *view, uint8_t slot)
+{
+  assert (NULL != view);
+  assert (slot < MAX_SLOTS);
+
+  return view->config_locked && is_p256_private (view, slot)
+    && (view->slots[slot].read_key & READ_KEY_ECDH);
+}
+
+bool
+lca_zone_can_read (const struct lca_config_view *view,
+                   enum DATA_ZONE zone, uint8_t addr)
+{
+  const struct lca_slot_policy *p;
+
+  assert (NULL != view);
+
+  switch (zone)
+    {
+    case CONFIG_ZONE:
+      return true;
+    case OTP_ZONE:
+      return view->data_locked;
+    case DATA_ZONE:
+      p = &view->slots[addr_to_slot (addr)];
+      return view->data_locked && !p->is_private
+        && !(p->is_secret && !p->encrypt_read);
+    default:
+      assert (false);
+    }
+
+  return false;
+}
+
+bool
+lca_zone_can_write (const struct lca_config_view *view,
+                    enum DATA_ZONE zone, uint8_t addr, bool encrypted)
+{
+  const struct lca_slot_policy *p;
+
+  assert (NULL != view);
+
+  switch (zone)
+    {
+    case CONFIG_ZONE:
+      return !view->config_locked
+        && addr * sizeof (uint32_t) >= CONFIG_WRITABLE_START;
+    case OTP_ZONE:
+      return !view->data_locked || !view->otp_read_only;
+    case DATA_ZONE:
+      if (!view->data_locked)
+        return true;
+
+      p = &view->slots[addr_to_slot (addr)];
+
+      if (p->slot_locked)
+        return false;
+      else if (p->write_config & WRITE_CONFIG_ENCRYPT)
+        return encrypted;
+      else
+        return p->write_config <= WRITE_CONFIG_PUB_INVALID;
+    default:
+      assert (false);
+    }
+
+  return false;
+}
+
+bool
+preflight_sign (int fd, uint8_t slot)
+{
+  struct lca_config_view view;
+
+  if (zone_cache_get_view (fd, &view) && !lca_slot_can_sign (&view, slot))
+    {
+      LCA_LOG (DEBUG, "Slot %u can not sign, not sending", slot);
+      return false;
+    }
+
+  return true;
+}
+
+bool
+preflight_ecdh (int fd, uint8_t slot)
+{
+  struct lca_config_view view;
+
+  if (zone_cache_get_view (fd, &view) && !lca_slot_can_ecdh (&view, slot))
+    {
+      LCA_LOG (DEBUG, "Slot %u can not do ECDH, not sending", slot);
+      return false;
+    }
+
+  return true;
+}
+
+bool
+preflight_read (int fd, enum DATA_ZONE zone, uint8_t addr)
+{
+  struct lca_config_view view;
+
+  /* The config zone is always readable, and is what fills the view */
+  if (CONFIG_ZONE == zone)
+    return true;
+
+  if (zone_cache_get_view (fd, &view)
+      && !lca_zone_can_read (&view, zone, addr))
+    {
+      LCA_LOG (DEBUG, "Read of zone %d addr %u is not permitted", zone, addr);
+      return false;
+    }
+
+  return true;
+}
+
+bool
+preflight_write (int fd, enum DATA_ZONE zone, uint8_t addr, bool encrypted)
+{
+  struct lca_config_view view;
+
+  if (zone_cache_get_view (fd, &view)
+      && !lca_zone_can_write (&view, zone, addr, encrypted))
+    {
+      LCA_LOG (DEBUG, "Write to zone %d addr %u is not permitted",
+               zone, addr);
+      return false;
+    }
+
+  return true;
+}
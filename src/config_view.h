@@ -0,0 +1,46 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONFIG_VIEW_H
+#define CONFIG_VIEW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/* Host side checks made before a command is sent.  Each returns
+   false, without touching the bus, if the decoded config zone of the
+   device says the command can only fail.  If the config zone can not
+   be read the command is let through and the device has the final
+   word. */
+
+bool
+preflight_sign (int fd, uint8_t slot);
+
+bool
+preflight_ecdh (int fd, uint8_t slot);
+
+bool
+preflight_read (int fd, enum DATA_ZONE zone, uint8_t addr);
+
+bool
+preflight_write (int fd, enum DATA_ZONE zone, uint8_t addr, bool encrypted);
+
+#endif /* CONFIG_VIEW_H */
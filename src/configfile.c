@@ -32,22 +32,6 @@
 #include "../libcryptoauth.h"
 
 
-static unsigned char
-c2h(char c)
-{
-    if (c >= 'A')
-        return (c - 'A' + 10);
-    else
-        return (c - '0');
-}
-
-static unsigned char
-a2b(char *ptr)
-{
-  assert (NULL != ptr);
-  return c2h( *ptr )*16 + c2h( *(ptr+1) );
-}
-
 static struct lca_octet_buffer
 parse_body (xmlDocPtr doc, xmlNodePtr cur) {
 
@@ -62,6 +46,7 @@ parse_body (xmlDocPtr doc, xmlNodePtr cur) {
   struct lca_octet_buffer result = {0,0};
 
   uint8_t *configzone = NULL;
+  bool valid = true;
 
   while (cur != NULL)
     {
@@ -76,7 +61,12 @@ parse_body (xmlDocPtr doc, xmlNodePtr cur) {
             {
               configzone = realloc (configzone, x + 1);
               assert (NULL != configzone);
-              configzone[x] = a2b(token);
+              if (2 != strlen (token) ||
+                  0 != lca_hex_decode (token, 2, &configzone[x]))
+                {
+                  fprintf (stderr, "Invalid hex byte: %s\n", token);
+                  valid = false;
+                }
               x+=1;
 
               // get the next token
@@ -91,8 +81,13 @@ parse_body (xmlDocPtr doc, xmlNodePtr cur) {
       cur = cur->next;
     }
 
-  result.ptr = configzone;
-  result.len = x;
+  if (valid)
+    {
+      result.ptr = configzone;
+      result.len = x;
+    }
+  else
+    free (configzone);
 
   return result;
 }
@@ -0,0 +1,86 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "../libcryptoauth.h"
+
+/* One recursive mutex per device, found by file descriptor.  The
+   mutexes are never freed: a descriptor number that is closed and
+   opened again names a device again, and the list stays as short as
+   the number of descriptors ever used for devices. */
+
+struct device_lock
+{
+  int fd;
+  pthread_mutex_t mutex;
+  struct device_lock *next;
+};
+
+static struct device_lock *locks = NULL;
+static pthread_mutex_t locks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t *
+lock_for (int fd)
+{
+  pthread_mutexattr_t attr;
+  struct device_lock *l;
+
+  assert (fd >= 0);
+
+  pthread_mutex_lock (&locks_lock);
+
+  for (l = locks; NULL != l && l->fd != fd; l = l->next)
+    ;
+
+  if (NULL == l)
+    {
+      l = malloc (sizeof (*l));
+      assert (NULL != l);
+
+      pthread_mutexattr_init (&attr);
+      pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+      pthread_mutex_init (&l->mutex, &attr);
+      pthread_mutexattr_destroy (&attr);
+
+      l->fd = fd;
+      l->next = locks;
+      locks = l;
+    }
+
+  pthread_mutex_unlock (&locks_lock);
+
+  return &l->mutex;
+}
+
+void
+lca_device_lock (int fd)
+{
+  pthread_mutex_lock (lock_for (fd));
+}
+
+void
+lca_device_unlock (int fd)
+{
+  pthread_mutex_unlock (lock_for (fd));
+}
@@ -0,0 +1,645 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "devstore.h"
+#include "zone_cache.h"
+#include "command_util.h"
+#include "atsha204_command.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* The store is a flat file: a header followed by an array of fixed
+   size records, one per device serial number.  Records are only ever
+   appended, so a record index stays valid for the life of the file
+   and other processes sharing the store simply remap when it grows.
+   Everything in it can be re-read from the device, so a file that
+   fails validation is rebuilt.  The rebuild is written to a new file
+   and renamed over the old one, since truncating a file that other
+   processes have mapped would fault them; they notice the rename the
+   next time they take the lock.  Every write to the mapping is made
+   with the lock held.
+
+   The file lock belongs to the open file, which all threads share,
+   so it does not keep them apart.  store_lock does, and guards the
+   descriptor, the mapping and the attachments; it is taken before
+   the file lock and released after it. */
+
+#define DEVSTORE_MAGIC "LCADEVS"
+#define DEVSTORE_VERSION 1
+#define MAX_ATTACHED_DEVICES 8
+
+#define RECORD_CONFIG_VALID 0x01
+#define RECORD_OTP_VALID    0x02
+
+struct devstore_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct devstore_record
+{
+  uint8_t serial[SERIAL_NUM_LEN];
+  uint8_t lock_config;
+  uint8_t lock_data;
+  uint8_t flags;
+  uint16_t pub_key_valid;
+  uint8_t config[CONFIG_ZONE_SIZE];
+  uint8_t otp[OTP_ZONE_SIZE];
+  uint8_t pub_keys[MAX_SLOTS][PUB_KEY_LEN];
+};
+
+struct attachment
+{
+  int fd;
+  uint32_t index;
+};
+
+static char *store_path = NULL;
+static int store_fd = -1;
+static uint8_t *store_map = NULL;
+static size_t store_size = 0;
+static struct attachment attached[MAX_ATTACHED_DEVICES];
+static bool attached_initialized = false;
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+size_for (uint32_t count)
+{
+  return sizeof (struct devstore_header)
+    + (size_t) count * sizeof (struct devstore_record);
+}
+
+static struct devstore_header *
+header (void)
+{
+  return (struct devstore_header *) store_map;
+}
+
+static void
+unmap_store (void)
+{
+  if (NULL != store_map)
+    munmap (store_map, store_size);
+
+  store_map = NULL;
+  store_size = 0;
+}
+
+/* Maps the file at its current size, picking up records appended by
+   other processes. */
+static bool
+remap_store (void)
+{
+  struct stat st;
+
+  if (0 != fstat (store_fd, &st))
+    return false;
+
+  if (NULL != store_map && (size_t) st.st_size == store_size)
+    return true;
+
+  unmap_store ();
+
+  if ((size_t) st.st_size < sizeof (struct devstore_header))
+    return false;
+
+  store_map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    store_fd, 0);
+
+  if (MAP_FAILED == store_map)
+    {
+      store_map = NULL;
+      return false;
+    }
+
+  store_size = st.st_size;
+
+  return true;
+}
+
+static bool
+is_valid_store (void)
+{
+  const struct devstore_header *h = header ();
+
+  return 0 == memcmp (h->magic, DEVSTORE_MAGIC, sizeof (h->magic))
+    && DEVSTORE_VERSION == h->version
+    && sizeof (struct devstore_record) == h->record_size
+    && size_for (h->count) <= store_size;
+}
+
+/* Replaces the file with an empty store.  Called with the old file
+   locked, which stays locked until its descriptor is closed. */
+static bool
+init_store (void)
+{
+  struct devstore_header h;
+  const size_t path_len = strlen (store_path);
+  char *tmp_path = malloc (path_len + sizeof (".XXXXXX"));
+  int fd;
+
+  assert (NULL != tmp_path);
+
+  memset (&h, 0, sizeof (h));
+  memcpy (h.magic, DEVSTORE_MAGIC, sizeof (h.magic));
+  h.version = DEVSTORE_VERSION;
+  h.record_size = sizeof (struct devstore_record);
+
+  memcpy (tmp_path, store_path, path_len);
+  strcpy (tmp_path + path_len, ".XXXXXX");
+
+  if ((fd = mkstemp (tmp_path)) < 0)
+    {
+      free (tmp_path);
+      return false;
+    }
+
+  if ((ssize_t) sizeof (h) != pwrite (fd, &h, sizeof (h), 0)
+      || 0 != rename (tmp_path, store_path))
+    {
+      close (fd);
+      unlink (tmp_path);
+      free (tmp_path);
+      return false;
+    }
+
+  free (tmp_path);
+
+  unmap_store ();
+  close (store_fd);
+  store_fd = fd;
+
+  return remap_store ();
+}
+
+static struct devstore_record *
+record_at (uint32_t index)
+{
+  if (NULL == store_map || index >= header ()->count)
+    {
+      if (!remap_store () || index >= header ()->count)
+        return NULL;
+    }
+
+  return (struct devstore_record *)
+    (store_map + size_for (index));
+}
+
+static void
+reset_attachments (void)
+{
+  unsigned int x;
+
+  for (x = 0; x < MAX_ATTACHED_DEVICES; x++)
+    attached[x].fd = -1;
+
+  attached_initialized = true;
+}
+
+static struct attachment *
+find_attachment (int fd)
+{
+  unsigned int x;
+
+  if (!attached_initialized)
+    reset_attachments ();
+
+  for (x = 0; x < MAX_ATTACHED_DEVICES; x++)
+    if (attached[x].fd == fd)
+      return &attached[x];
+
+  return NULL;
+}
+
+static struct devstore_record *
+record_for (int fd)
+{
+  struct attachment *a;
+
+  if (store_fd < 0 || NULL == (a = find_attachment (fd)))
+    return NULL;
+
+  return record_at (a->index);
+}
+
+static bool
+is_current_file (void)
+{
+  struct stat fst, pst;
+
+  return 0 == fstat (store_fd, &fst) && 0 == stat (store_path, &pst)
+    && fst.st_dev == pst.st_dev && fst.st_ino == pst.st_ino;
+}
+
+/* Takes the store lock, LOCK_EX or LOCK_SH.  If another process has
+   rebuilt the store since it was opened, the new file is opened
+   instead, the attachments, whose record indices belong to the old
+   file, are dropped and false is returned without the lock. */
+static bool
+lock_store (int operation)
+{
+  if (store_fd < 0 || 0 != flock (store_fd, operation))
+    return false;
+
+  if (is_current_file ())
+    return true;
+
+  LCA_LOG (DEBUG, "Device store was rebuilt, reopening");
+
+  unmap_store ();
+  close (store_fd);
+  reset_attachments ();
+
+  store_fd = open (store_path, O_RDWR | O_CREAT, 0600);
+
+  return false;
+}
+
+static void
+unlock_store (void)
+{
+  flock (store_fd, LOCK_UN);
+}
+
+/* Returns the attached record for fd with store_lock and the store
+   locked, or NULL without either. */
+static struct devstore_record *
+lock_record (int fd, int operation)
+{
+  struct devstore_record *rec = NULL;
+
+  pthread_mutex_lock (&store_lock);
+
+  if (NULL != find_attachment (fd) && lock_store (operation))
+    {
+      if (NULL == (rec = record_for (fd)))
+        unlock_store ();
+    }
+
+  if (NULL == rec)
+    pthread_mutex_unlock (&store_lock);
+
+  return rec;
+}
+
+static void
+unlock_record (void)
+{
+  unlock_store ();
+  pthread_mutex_unlock (&store_lock);
+}
+
+/* Called with store_lock held */
+static void
+close_store (void)
+{
+  unmap_store ();
+
+  if (store_fd >= 0)
+    close (store_fd);
+
+  free (store_path);
+  store_path = NULL;
+  store_fd = -1;
+  reset_attachments ();
+}
+
+bool
+lca_devstore_open (const char *path)
+{
+  const unsigned int MAX_REOPENS = 4;
+  bool result = false;
+  unsigned int x;
+
+  assert (NULL != path);
+
+  pthread_mutex_lock (&store_lock);
+
+  close_store ();
+
+  store_path = strdup (path);
+  assert (NULL != store_path);
+
+  if ((store_fd = open (path, O_RDWR | O_CREAT, 0600)) < 0)
+    {
+      LCA_LOG (DEBUG, "Failed to open device store %s", path);
+      close_store ();
+      pthread_mutex_unlock (&store_lock);
+      return false;
+    }
+
+  /* Another process may rebuild the file while this one waits for
+     the lock, in which case the new file is checked instead */
+  for (x = 0; x < MAX_REOPENS && store_fd >= 0 && !result; x++)
+    if (lock_store (LOCK_EX))
+      {
+        if (remap_store () && is_valid_store ())
+          result = true;
+        else
+          {
+            LCA_LOG (DEBUG, "Initializing device store %s", path);
+            result = init_store ();
+          }
+
+        unlock_store ();
+      }
+
+  if (!result)
+    close_store ();
+
+  pthread_mutex_unlock (&store_lock);
+
+  return result;
+}
+
+void
+lca_devstore_close (void)
+{
+  pthread_mutex_lock (&store_lock);
+  close_store ();
+  pthread_mutex_unlock (&store_lock);
+}
+
+/* Finds the record for the serial number or appends a fresh one.
+   Called with the store locked. */
+static bool
+find_or_add_record (const uint8_t *serial, uint32_t *index)
+{
+  struct devstore_record rec;
+  uint32_t count;
+  uint32_t x;
+
+  if (!remap_store ())
+    return false;
+
+  count = header ()->count;
+
+  for (x = 0; x < count; x++)
+    if (0 == memcmp (record_at (x)->serial, serial, SERIAL_NUM_LEN))
+      {
+        *index = x;
+        return true;
+      }
+
+  memset (&rec, 0, sizeof (rec));
+  memcpy (rec.serial, serial, SERIAL_NUM_LEN);
+
+  if ((ssize_t) sizeof (rec) != pwrite (store_fd, &rec, sizeof (rec), size_for (count))
+      || !remap_store ())
+    return false;
+
+  header ()->count = count + 1;
+  *index = count;
+
+  return true;
+}
+
+bool
+lca_devstore_attach (int fd)
+{
+  const unsigned int LOCK_BLOCK = 2;
+  const unsigned int LOCK_BLOCK_ADDR = LOCK_BLOCK * READ32_LENGTH / 4;
+  const unsigned int LOCK_BLOCK_OFFSET = LOCK_BLOCK * READ32_LENGTH;
+
+  struct lca_octet_buffer ids = {0,0};
+  struct lca_octet_buffer locks = {0,0};
+  struct devstore_record *rec;
+  struct attachment *a;
+  uint8_t serial[SERIAL_NUM_LEN];
+  uint8_t lock_config, lock_data;
+  uint32_t index = 0;
+  bool found = false;
+  bool have_store;
+
+  pthread_mutex_lock (&store_lock);
+  have_store = store_fd >= 0;
+  pthread_mutex_unlock (&store_lock);
+
+  if (!have_store)
+    return false;
+
+  /* The serial number is in the first block, the lock bytes in the
+     third.  This is all that is read from the device on a hit.  The
+     reads take the device lock, so they are made before store_lock,
+     which is taken inside it elsewhere. */
+  ids = read32 (fd, CONFIG_ZONE, 0);
+  locks = read32 (fd, CONFIG_ZONE, LOCK_BLOCK_ADDR);
+
+  if (NULL == ids.ptr || NULL == locks.ptr)
+    goto out;
+
+  memcpy (serial, ids.ptr, sizeof (uint32_t));
+  memcpy (serial + sizeof (uint32_t), ids.ptr + 8,
+          SERIAL_NUM_LEN - sizeof (uint32_t));
+  lock_config = locks.ptr[LOCK_CONFIG_OFFSET - LOCK_BLOCK_OFFSET];
+  lock_data = locks.ptr[LOCK_DATA_OFFSET - LOCK_BLOCK_OFFSET];
+
+  pthread_mutex_lock (&store_lock);
+
+  /* A rebuild by another process is picked up on the second try */
+  if (!lock_store (LOCK_EX) && !lock_store (LOCK_EX))
+    {
+      pthread_mutex_unlock (&store_lock);
+      goto out;
+    }
+
+  if (NULL == (a = find_attachment (fd)) && NULL == (a = find_attachment (-1)))
+    {
+      unlock_record ();
+      goto out;
+    }
+
+  if (!(found = find_or_add_record (serial, &index)))
+    {
+      unlock_record ();
+      goto out;
+    }
+
+  rec = record_at (index);
+
+  if (rec->lock_config != lock_config || rec->lock_data != lock_data)
+    {
+      LCA_LOG (DEBUG, "Device store record is stale, resetting");
+      memset (rec, 0, sizeof (*rec));
+      memcpy (rec->serial, serial, SERIAL_NUM_LEN);
+      rec->lock_config = lock_config;
+      rec->lock_data = lock_data;
+    }
+
+  a->fd = fd;
+  a->index = index;
+
+  /* Only images of locked zones are trusted, and only if they agree
+     with what was just read. */
+  if ((rec->flags & RECORD_CONFIG_VALID)
+      && ZONE_UNLOCKED != lock_config
+      && 0 == memcmp (rec->config, ids.ptr, READ32_LENGTH)
+      && 0 == memcmp (rec->config + LOCK_BLOCK_OFFSET, locks.ptr,
+                      READ32_LENGTH))
+    {
+      zone_cache_seed (fd, CONFIG_ZONE, rec->config);
+
+      if ((rec->flags & RECORD_OTP_VALID)
+          && ZONE_UNLOCKED != lock_data
+          && OTP_MODE_READ_ONLY == rec->config[OTP_MODE_OFFSET])
+        zone_cache_seed (fd, OTP_ZONE, rec->otp);
+    }
+
+  unlock_record ();
+
+out:
+  if (NULL != ids.ptr)
+    lca_free_octet_buffer (ids);
+  if (NULL != locks.ptr)
+    lca_free_octet_buffer (locks);
+
+  return found;
+}
+
+void
+devstore_detach (int fd)
+{
+  struct attachment *a;
+
+  pthread_mutex_lock (&store_lock);
+
+  if (NULL != (a = find_attachment (fd)) && fd >= 0)
+    a->fd = -1;
+
+  pthread_mutex_unlock (&store_lock);
+}
+
+void
+devstore_record_zone (int fd, enum DATA_ZONE zone, const uint8_t *image)
+{
+  struct devstore_record *rec = lock_record (fd, LOCK_EX);
+
+  if (NULL == rec)
+    return;
+
+  switch (zone)
+    {
+    case CONFIG_ZONE:
+      memcpy (rec->config, image, CONFIG_ZONE_SIZE);
+      rec->lock_config = image[LOCK_CONFIG_OFFSET];
+      rec->lock_data = image[LOCK_DATA_OFFSET];
+      rec->flags |= RECORD_CONFIG_VALID;
+      break;
+    case OTP_ZONE:
+      memcpy (rec->otp, image, OTP_ZONE_SIZE);
+      rec->flags |= RECORD_OTP_VALID;
+      break;
+    default:
+      assert (false);
+    }
+
+  unlock_record ();
+}
+
+void
+devstore_drop_zone (int fd, enum DATA_ZONE zone)
+{
+  struct devstore_record *rec = lock_record (fd, LOCK_EX);
+
+  if (NULL == rec)
+    return;
+
+  switch (zone)
+    {
+    case CONFIG_ZONE:
+      rec->flags &= ~RECORD_CONFIG_VALID;
+      break;
+    case OTP_ZONE:
+      rec->flags &= ~RECORD_OTP_VALID;
+      break;
+    default:
+      assert (false);
+    }
+
+  unlock_record ();
+}
+
+bool
+devstore_get_pub_key (int fd, uint8_t slot, uint8_t *pub_key)
+{
+  struct devstore_record *rec;
+  bool hit = false;
+
+  assert (slot < MAX_SLOTS);
+
+  if (NULL == (rec = lock_record (fd, LOCK_SH)))
+    return false;
+
+  if (rec->pub_key_valid & (1 << slot))
+    {
+      memcpy (pub_key, rec->pub_keys[slot], PUB_KEY_LEN);
+      hit = true;
+    }
+
+  unlock_record ();
+
+  return hit;
+}
+
+void
+devstore_record_pub_key (int fd, uint8_t slot, const uint8_t *pub_key)
+{
+  struct devstore_record *rec;
+
+  assert (slot < MAX_SLOTS);
+
+  if (NULL == (rec = lock_record (fd, LOCK_EX)))
+    return;
+
+  memcpy (rec->pub_keys[slot], pub_key, PUB_KEY_LEN);
+  rec->pub_key_valid |= 1 << slot;
+
+  unlock_record ();
+}
+
+void
+devstore_drop_pub_key (int fd, uint8_t slot)
+{
+  struct devstore_record *rec;
+
+  assert (slot < MAX_SLOTS);
+
+  if (NULL != (rec = lock_record (fd, LOCK_EX)))
+    {
+      rec->pub_key_valid &= ~(1 << slot);
+      unlock_record ();
+    }
+}
@@ -0,0 +1,88 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DEVSTORE_H
+#define DEVSTORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/**
+ * Records a freshly read zone image for an attached device.  Does
+ * nothing if the device is not attached to a store.
+ *
+ * @param fd The open file descriptor.
+ * @param zone CONFIG_ZONE or OTP_ZONE.
+ * @param image The zone image.
+ */
+void
+devstore_record_zone (int fd, enum DATA_ZONE zone, const uint8_t *image);
+
+/**
+ * Marks the stored image of the zone as stale.
+ *
+ * @param fd The open file descriptor.
+ * @param zone CONFIG_ZONE or OTP_ZONE.
+ */
+void
+devstore_drop_zone (int fd, enum DATA_ZONE zone);
+
+/**
+ * Looks up the stored public key of a slot.
+ *
+ * @param fd The open file descriptor.
+ * @param slot The key slot.
+ * @param pub_key Receives PUB_KEY_LEN bytes on a hit.
+ *
+ * @return True on a hit.
+ */
+bool
+devstore_get_pub_key (int fd, uint8_t slot, uint8_t *pub_key);
+
+/**
+ * Stores the public key of a slot, as returned by GenKey.
+ *
+ * @param fd The open file descriptor.
+ * @param slot The key slot.
+ * @param pub_key PUB_KEY_LEN bytes.
+ */
+void
+devstore_record_pub_key (int fd, uint8_t slot, const uint8_t *pub_key);
+
+/**
+ * Forgets the stored public key of a slot, after the slot was
+ * written or a new key was generated in it.
+ *
+ * @param fd The open file descriptor.
+ * @param slot The key slot.
+ */
+void
+devstore_drop_pub_key (int fd, uint8_t slot);
+
+/**
+ * Detaches the device from the store.  The record stays on disk.
+ *
+ * @param fd The open file descriptor.
+ */
+void
+devstore_detach (int fd);
+
+#endif /* DEVSTORE_H */
@@ -0,0 +1,167 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+#include "drbg.h"
+#include "sha256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* V = HMAC (K, V) is the whole cost of generating, and its message is
+   always one digest long, so both of its blocks are padded once here
+   and each step is just two compressions. */
+static void
+next_v (const struct lca_hmac_ctx *key, uint8_t *v)
+{
+  uint8_t block[SHA256_BLOCK_LEN];
+  uint32_t h[8];
+
+  memset (block, 0, sizeof (block));
+  block[DRBG_LEN] = 0x80;
+  /* The bit length of one block of pad plus the digest */
+  block[SHA256_BLOCK_LEN - 2] = ((SHA256_BLOCK_LEN + DRBG_LEN) * 8) >> 8;
+  block[SHA256_BLOCK_LEN - 1] = ((SHA256_BLOCK_LEN + DRBG_LEN) * 8) & 0xFF;
+
+  memcpy (block, v, DRBG_LEN);
+  memcpy (h, key->inner, sizeof (h));
+  sha256_blocks (h, block, 1);
+
+  sha256_state_bytes (h, block);
+  memcpy (h, key->outer, sizeof (h));
+  sha256_blocks (h, block, 1);
+
+  sha256_state_bytes (h, v);
+
+  smemset (block, 0, sizeof (block));
+  smemset (h, 0, sizeof (h));
+}
+
+/* The HMAC_DRBG Update function over provided data a || b */
+static void
+update (struct drbg *d, const uint8_t *a, size_t a_len,
+        const uint8_t *b, size_t b_len)
+{
+  uint8_t msg[DRBG_LEN + 1 + 2 * DRBG_MAX_INPUT];
+  uint8_t k[DRBG_LEN];
+  const size_t len = DRBG_LEN + 1 + a_len + b_len;
+  uint8_t round;
+
+  assert (a_len <= DRBG_MAX_INPUT && b_len <= DRBG_MAX_INPUT);
+  assert (NULL != a || 0 == a_len);
+  assert (NULL != b || 0 == b_len);
+
+  for (round = 0; round < 2; round++)
+    {
+      memcpy (msg, d->v, DRBG_LEN);
+      msg[DRBG_LEN] = round;
+      if (a_len > 0)
+        memcpy (msg + DRBG_LEN + 1, a, a_len);
+      if (b_len > 0)
+        memcpy (msg + DRBG_LEN + 1 + a_len, b, b_len);
+
+      lca_hmac_compute (&d->key, msg, len, k);
+      lca_hmac_init (&d->key, k, sizeof (k));
+      next_v (&d->key, d->v);
+
+      /* Without provided data there is only the first round */
+      if (0 == a_len + b_len)
+        break;
+    }
+
+  smemset (msg, 0, sizeof (msg));
+  smemset (k, 0, sizeof (k));
+}
+
+void
+drbg_init (struct drbg *d, const uint8_t *entropy, size_t entropy_len,
+           const uint8_t *nonce, size_t nonce_len,
+           const uint8_t *pers, size_t pers_len)
+{
+  uint8_t seed[DRBG_MAX_INPUT];
+  uint8_t k[DRBG_LEN];
+
+  assert (NULL != d);
+  assert (NULL != entropy && entropy_len >= DRBG_LEN);
+  assert (NULL != nonce && nonce_len >= DRBG_LEN / 2);
+  assert (entropy_len + nonce_len <= sizeof (seed));
+
+  memcpy (seed, entropy, entropy_len);
+  memcpy (seed + entropy_len, nonce, nonce_len);
+
+  memset (k, 0x00, sizeof (k));
+  memset (d->v, 0x01, sizeof (d->v));
+  lca_hmac_init (&d->key, k, sizeof (k));
+
+  update (d, seed, entropy_len + nonce_len, pers, pers_len);
+  d->reseed_counter = 1;
+
+  smemset (seed, 0, sizeof (seed));
+}
+
+void
+drbg_reseed (struct drbg *d, const uint8_t *entropy, size_t entropy_len,
+             const uint8_t *add, size_t add_len)
+{
+  assert (NULL != d);
+  assert (NULL != entropy && entropy_len >= DRBG_LEN);
+
+  update (d, entropy, entropy_len, add, add_len);
+  d->reseed_counter = 1;
+}
+
+void
+drbg_generate (struct drbg *d, uint8_t *out, size_t len,
+               const uint8_t *add, size_t add_len)
+{
+  size_t done;
+
+  assert (NULL != d);
+  assert (NULL != out || 0 == len);
+  assert (len <= DRBG_MAX_REQUEST);
+
+  if (add_len > 0)
+    update (d, add, add_len, NULL, 0);
+
+  for (done = 0; done + DRBG_LEN <= len; done += DRBG_LEN)
+    {
+      next_v (&d->key, d->v);
+      memcpy (out + done, d->v, DRBG_LEN);
+    }
+
+  if (done < len)
+    {
+      next_v (&d->key, d->v);
+      memcpy (out + done, d->v, len - done);
+    }
+
+  update (d, add, add_len, NULL, 0);
+  d->reseed_counter++;
+}
+
+void
+drbg_wipe (struct drbg *d)
+{
+  assert (NULL != d);
+
+  smemset (d, 0, sizeof (*d));
+}
@@ -0,0 +1,89 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DRBG_H
+#define DRBG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/* HMAC_DRBG with SHA-256 from NIST SP 800-90A, without prediction
+   resistance.  Callers do their own locking and reseed policy. */
+
+#define DRBG_LEN 32
+/* The most bytes one generate call may return */
+#define DRBG_MAX_REQUEST 65536
+/* The most seed material, additional input or personalization */
+#define DRBG_MAX_INPUT 256
+
+struct drbg
+{
+  struct lca_hmac_ctx key;
+  uint8_t v[DRBG_LEN];
+  uint64_t reseed_counter;
+};
+
+/**
+ * Instantiates the DRBG.
+ *
+ * @param d The state.
+ * @param entropy The entropy input, at least 32 bytes.
+ * @param entropy_len Its length.
+ * @param nonce The nonce, at least 16 bytes.
+ * @param nonce_len Its length.
+ * @param pers The personalization string, or NULL.
+ * @param pers_len Its length.
+ */
+void
+drbg_init (struct drbg *d, const uint8_t *entropy, size_t entropy_len,
+           const uint8_t *nonce, size_t nonce_len,
+           const uint8_t *pers, size_t pers_len);
+
+/**
+ * Mixes in fresh entropy and resets the reseed counter.
+ *
+ * @param d The state.
+ * @param entropy The entropy input, at least 32 bytes.
+ * @param entropy_len Its length.
+ * @param add Additional input, or NULL.
+ * @param add_len Its length.
+ */
+void
+drbg_reseed (struct drbg *d, const uint8_t *entropy, size_t entropy_len,
+             const uint8_t *add, size_t add_len);
+
+/**
+ * Generates output.
+ *
+ * @param d The state.
+ * @param out The result.
+ * @param len Its length, at most DRBG_MAX_REQUEST.
+ * @param add Additional input, or NULL.
+ * @param add_len Its length.
+ */
+void
+drbg_generate (struct drbg *d, uint8_t *out, size_t len,
+               const uint8_t *add, size_t add_len);
+
+void
+drbg_wipe (struct drbg *d);
+
+#endif /* DRBG_H */
@@ -0,0 +1,287 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <gcrypt.h>
+#include "ecdh_cache.h"
+#include "command_util.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+#define ECDH_COORD_LEN 32
+#define ECDH_SECRET_LEN 32
+#define ECDH_CACHE_KEY_LEN 32
+
+struct ecdh_entry
+{
+  uint8_t key[ECDH_CACHE_KEY_LEN]; /* SHA-256 of fd, slot and peer point */
+  uint8_t secret[ECDH_SECRET_LEN];
+  int fd;
+  uint8_t slot;
+  bool used;
+  time_t expires;
+  uint64_t last_used;
+};
+
+/* The table lives in its own locked mapping so the secrets are never
+   swapped out and do not end up in core dumps.  All of it is under
+   cache_lock. */
+static struct ecdh_entry *entries = NULL;
+static size_t map_len = 0;
+static unsigned int max_entries = 0;
+static unsigned int ttl = 0;
+static uint64_t use_counter = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static time_t
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec;
+}
+
+static void
+wipe_entry (struct ecdh_entry *e)
+{
+  smemset (e, 0, sizeof (*e));
+}
+
+static void
+make_key (int fd, uint8_t slot, const uint8_t *x, const uint8_t *y,
+          uint8_t *key)
+{
+  uint8_t msg[sizeof (int32_t) + 1 + 2 * ECDH_COORD_LEN];
+  int32_t id = fd;
+
+  memcpy (msg, &id, sizeof (id));
+  msg[sizeof (id)] = slot;
+  memcpy (msg + sizeof (id) + 1, x, ECDH_COORD_LEN);
+  memcpy (msg + sizeof (id) + 1 + ECDH_COORD_LEN, y, ECDH_COORD_LEN);
+
+  gcry_md_hash_buffer (GCRY_MD_SHA256, key, msg, sizeof (msg));
+}
+
+/* Called with cache_lock held */
+static void
+flush_entries (void)
+{
+  unsigned int x;
+
+  for (x = 0; x < max_entries; x++)
+    wipe_entry (&entries[x]);
+}
+
+/* Called with cache_lock held */
+static void
+disable (void)
+{
+  if (NULL == entries)
+    return;
+
+  flush_entries ();
+
+  munlock (entries, map_len);
+  munmap (entries, map_len);
+
+  entries = NULL;
+  map_len = 0;
+  max_entries = 0;
+}
+
+bool
+lca_ecdh_cache_enable (unsigned int entries_max, unsigned int ttl_seconds)
+{
+  const size_t len = (size_t) entries_max * sizeof (struct ecdh_entry);
+  void *p;
+
+  assert (entries_max > 0);
+
+  p = mmap (NULL, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (MAP_FAILED == p)
+    {
+      lca_ecdh_cache_disable ();
+      return false;
+    }
+
+  if (0 != mlock (p, len))
+    {
+      LCA_LOG (DEBUG, "Failed to lock ECDH cache memory");
+      munmap (p, len);
+      lca_ecdh_cache_disable ();
+      return false;
+    }
+
+#ifdef MADV_DONTDUMP
+  madvise (p, len, MADV_DONTDUMP);
+#endif
+
+  pthread_mutex_lock (&cache_lock);
+
+  disable ();
+
+  entries = p;
+  map_len = len;
+  max_entries = entries_max;
+  ttl = ttl_seconds;
+
+  pthread_mutex_unlock (&cache_lock);
+
+  return true;
+}
+
+void
+lca_ecdh_cache_flush (void)
+{
+  pthread_mutex_lock (&cache_lock);
+  flush_entries ();
+  pthread_mutex_unlock (&cache_lock);
+}
+
+void
+lca_ecdh_cache_disable (void)
+{
+  pthread_mutex_lock (&cache_lock);
+  disable ();
+  pthread_mutex_unlock (&cache_lock);
+}
+
+bool
+ecdh_cache_lookup (int fd, uint8_t slot,
+                   const uint8_t *x, const uint8_t *y, uint8_t *secret)
+{
+  uint8_t key[ECDH_CACHE_KEY_LEN];
+  time_t t;
+  unsigned int i;
+  bool found = false;
+
+  make_key (fd, slot, x, y, key);
+  t = now ();
+
+  pthread_mutex_lock (&cache_lock);
+
+  for (i = 0; i < max_entries; i++)
+    {
+      struct ecdh_entry *e = &entries[i];
+
+      if (!e->used || 0 != memcmp (e->key, key, sizeof (key)))
+        continue;
+
+      if (t >= e->expires)
+        {
+          wipe_entry (e);
+          break;
+        }
+
+      memcpy (secret, e->secret, ECDH_SECRET_LEN);
+      e->last_used = ++use_counter;
+      found = true;
+
+      break;
+    }
+
+  pthread_mutex_unlock (&cache_lock);
+
+  return found;
+}
+
+void
+ecdh_cache_insert (int fd, uint8_t slot,
+                   const uint8_t *x, const uint8_t *y, const uint8_t *secret)
+{
+  struct ecdh_entry *victim = NULL;
+  uint8_t key[ECDH_CACHE_KEY_LEN];
+  time_t t;
+  unsigned int i;
+
+  make_key (fd, slot, x, y, key);
+  t = now ();
+
+  pthread_mutex_lock (&cache_lock);
+
+  for (i = 0; i < max_entries; i++)
+    {
+      struct ecdh_entry *e = &entries[i];
+
+      if (!e->used || t >= e->expires
+          || 0 == memcmp (e->key, key, sizeof (key)))
+        {
+          victim = e;
+          break;
+        }
+
+      if (NULL == victim || e->last_used < victim->last_used)
+        victim = e;
+    }
+
+  /* NULL when the cache is disabled */
+  if (NULL != victim)
+    {
+      wipe_entry (victim);
+
+      memcpy (victim->key, key, sizeof (key));
+      memcpy (victim->secret, secret, ECDH_SECRET_LEN);
+      victim->fd = fd;
+      victim->slot = slot;
+      victim->expires = t + ttl;
+      victim->last_used = ++use_counter;
+      victim->used = true;
+    }
+
+  pthread_mutex_unlock (&cache_lock);
+}
+
+void
+ecdh_cache_invalidate_slot (int fd, uint8_t slot)
+{
+  unsigned int i;
+
+  pthread_mutex_lock (&cache_lock);
+
+  for (i = 0; i < max_entries; i++)
+    if (entries[i].used && entries[i].fd == fd && entries[i].slot == slot)
+      wipe_entry (&entries[i]);
+
+  pthread_mutex_unlock (&cache_lock);
+}
+
+void
+ecdh_cache_invalidate_device (int fd)
+{
+  unsigned int i;
+
+  pthread_mutex_lock (&cache_lock);
+
+  for (i = 0; i < max_entries; i++)
+    if (entries[i].used && entries[i].fd == fd)
+      wipe_entry (&entries[i]);
+
+  pthread_mutex_unlock (&cache_lock);
+}
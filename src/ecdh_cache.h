@@ -0,0 +1,73 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ECDH_CACHE_H
+#define ECDH_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Looks up a cached ECDH result.
+ *
+ * @param fd The open file descriptor.
+ * @param slot The private key slot.
+ * @param x The 32 byte x component of the peer key.
+ * @param y The 32 byte y component of the peer key.
+ * @param secret Receives the 32 byte shared secret on a hit.
+ *
+ * @return True on a hit.  Always false while the cache is disabled.
+ */
+bool
+ecdh_cache_lookup (int fd, uint8_t slot,
+                   const uint8_t *x, const uint8_t *y, uint8_t *secret);
+
+/**
+ * Caches an ECDH result, evicting an expired or the least recently
+ * used entry if the cache is full.  Does nothing while disabled.
+ *
+ * @param fd The open file descriptor.
+ * @param slot The private key slot.
+ * @param x The 32 byte x component of the peer key.
+ * @param y The 32 byte y component of the peer key.
+ * @param secret The 32 byte shared secret.
+ */
+void
+ecdh_cache_insert (int fd, uint8_t slot,
+                   const uint8_t *x, const uint8_t *y, const uint8_t *secret);
+
+/**
+ * Wipes all entries for the slot, after its private key changed.
+ *
+ * @param fd The open file descriptor.
+ * @param slot The private key slot.
+ */
+void
+ecdh_cache_invalidate_slot (int fd, uint8_t slot);
+
+/**
+ * Wipes all entries for the device.
+ *
+ * @param fd The open file descriptor.
+ */
+void
+ecdh_cache_invalidate_device (int fd);
+
+#endif /* ECDH_CACHE_H */
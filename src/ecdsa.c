@@ -22,6 +22,8 @@
 
 #include <assert.h>
 #include "../libcryptoauth.h"
+#include "backend.h"
+#include "verify_cache.h"
 
 void
 lca_print_sexp (gcry_sexp_t to_print) {
@@ -45,65 +47,30 @@ lca_ecdsa_p256_verify (struct lca_octet_buffer pub_key,
                         struct lca_octet_buffer signature,
                         struct lca_octet_buffer sha256_digest)
 {
-  assert (NULL != gcry_check_version (NULL));
-
-  gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
-
-  if (lca_is_debug())
-    gcry_control (GCRYCTL_SET_DEBUG_FLAGS, 1u , 0);
+  bool result;
 
   assert (65 == pub_key.len); /* +1 for uncompressed point tag */
   assert (64 == signature.len);
   assert (32 == sha256_digest.len);
 
-  LCA_LOG (DEBUG, "Gcrypt init");
-
-  gcry_sexp_t g_pub_key;
-  gcry_sexp_t g_digest;
-  gcry_sexp_t g_sig;
-  int rc = 0;
-
-  rc = gcry_sexp_build (&g_pub_key, NULL,
-                        "(public-key\n"
-                        " (ecdsa\n"
-                        "  (curve \"NIST P-256\")\n"
-                        "  (q %b)"
-                        "))", pub_key.len, pub_key);
-
-  lca_print_sexp (g_pub_key);
-
-  assert (0 == rc);
-
-  rc = gcry_sexp_build (&g_digest, NULL,
-                        "(data (flags raw)\n"
-                        " (value %b))",
-                        sha256_digest.len, sha256_digest.ptr);
+  if (0x04 != pub_key.ptr[0])
+    return false;
 
-  assert (0 == rc);
-
-  lca_print_sexp (g_digest);
-
-  rc = gcry_sexp_build (&g_sig, NULL,
-                        "(sig-val(ecdsa(r %b)(s %b)))",
-                        32, signature.ptr,
-                        32, signature.ptr + 32);
-
-  assert (0 == rc);
+  if (verify_cache_lookup (pub_key, sha256_digest.ptr, signature.ptr))
+    {
+      LCA_LOG (DEBUG, "Verify result from cache");
+      return true;
+    }
 
-  lca_print_sexp( g_sig );
+  result = backend_get ()->p256_verify (pub_key.ptr + 1, sha256_digest.ptr,
+                                        signature.ptr);
 
-  rc = gcry_pk_verify (g_sig, g_digest, g_pub_key);
-  LCA_LOG (DEBUG, "verify complete");
-  if (0 != rc)
-    LCA_LOG (DEBUG, "gcry_pk_verify failed: %s", gpg_strerror (rc));
-  else
-    LCA_LOG (DEBUG, "gcry_pk_verify success");
+  LCA_LOG (DEBUG, "verify complete: %s", result ? "success" : "failed");
 
-  gcry_sexp_release (g_sig);
-  gcry_sexp_release (g_digest);
-  gcry_sexp_release (g_pub_key);
+  if (result)
+    verify_cache_insert (pub_key, sha256_digest.ptr, signature.ptr);
 
-  return (rc == 0) ? true : false;
+  return result;
 }
 
 
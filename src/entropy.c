@@ -0,0 +1,472 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "command_util.h"
+#include "drbg.h"
+#include "entropy.h"
+#include "health.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+#define DEFAULT_POOL_SIZE 4096
+#define DEFAULT_RESEED_BYTES (1024 * 1024)
+/* As many Random commands as surely fit in one wake */
+#define REFILL_BLOCKS (WATCHDOG_MIN_NS / RANDOM_MAX_EXEC)
+/* How long to wait before trying a failed source again */
+#define RETRY_SEC 1
+/* Failed refills in a row that trip the breaker */
+#define TRIP_REFILLS 3
+
+static const uint8_t PERSONALIZATION[] = "libcryptoauth entropy pool";
+
+/* The ring of raw source output, topped up by the refill thread, and
+   the DRBG seeded from it.  The ring and its flags are under lock and
+   the DRBG under drbg_lock, which is always taken first. */
+static struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t room;
+  pthread_cond_t filled;
+  pthread_mutex_t drbg_lock;
+  pthread_t thread;
+  entropy_source_fn fill;
+  void *arg;
+  int fd;
+  uint8_t *ring;
+  size_t size;
+  size_t tail;
+  size_t count;
+  bool running;
+  bool stop;
+  bool failing;
+  /* Only used by the refill thread */
+  struct health health;
+  unsigned int failed_refills;
+  struct lca_health_stats stats;
+  /* Bumped when the breaker trips, so the DRBG starts over */
+  unsigned int generation;
+  struct drbg drbg;
+  bool seeded;
+  unsigned int seed_generation;
+  size_t reseed_bytes;
+  size_t since_reseed;
+} pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .room = PTHREAD_COND_INITIALIZER,
+  .filled = PTHREAD_COND_INITIALIZER,
+  .drbg_lock = PTHREAD_MUTEX_INITIALIZER,
+  .fd = -1
+};
+
+/* Called with the lock held */
+static void
+ring_put (const uint8_t *src, size_t len)
+{
+  size_t head = (pool.tail + pool.count) % pool.size;
+  size_t first = len < pool.size - head ? len : pool.size - head;
+
+  assert (pool.count + len <= pool.size);
+
+  memcpy (pool.ring + head, src, first);
+  memcpy (pool.ring, src + first, len - first);
+  pool.count += len;
+}
+
+/* Called with the lock held */
+static void
+ring_take (uint8_t *dst, size_t len)
+{
+  size_t first = len < pool.size - pool.tail ? len : pool.size - pool.tail;
+
+  assert (len <= pool.count);
+
+  memcpy (dst, pool.ring + pool.tail, first);
+  smemset (pool.ring + pool.tail, 0, first);
+  memcpy (dst + first, pool.ring, len - first);
+  smemset (pool.ring, 0, len - first);
+
+  pool.tail = (pool.tail + len) % pool.size;
+  pool.count -= len;
+}
+
+/* Called with the lock held */
+static void
+ring_take_all (void)
+{
+  smemset (pool.ring, 0, pool.size);
+  pool.tail = 0;
+  pool.count = 0;
+}
+
+static void *
+refill_main (void *arg)
+{
+  uint8_t buf[REFILL_BLOCKS * ENTROPY_BLOCK_LEN];
+  struct lca_health_stats delta;
+  struct timespec retry;
+  unsigned int want, got;
+  bool passed;
+
+  (void)arg;
+
+  pthread_mutex_lock (&pool.lock);
+
+  for (;;)
+    {
+      while (!pool.stop && pool.count + ENTROPY_BLOCK_LEN > pool.size)
+        pthread_cond_wait (&pool.room, &pool.lock);
+
+      if (pool.stop)
+        break;
+
+      want = (pool.size - pool.count) / ENTROPY_BLOCK_LEN;
+      if (want > REFILL_BLOCKS)
+        want = REFILL_BLOCKS;
+
+      pthread_mutex_unlock (&pool.lock);
+      got = pool.fill (pool.arg, buf, want);
+      assert (got <= want);
+      memset (&delta, 0, sizeof (delta));
+      passed = got > 0 && health_test (&pool.health, buf, got, &delta);
+      pthread_mutex_lock (&pool.lock);
+
+      pool.stats.blocks += delta.blocks;
+      pool.stats.repetition_failures += delta.repetition_failures;
+      pool.stats.proportion_failures += delta.proportion_failures;
+      pool.stats.stuck_failures += delta.stuck_failures;
+
+      if (passed)
+        {
+          ring_put (buf, got * ENTROPY_BLOCK_LEN);
+          pool.failing = false;
+          pool.failed_refills = 0;
+          if (pool.stats.tripped)
+            LCA_LOG (DEBUG, "Entropy breaker closed");
+          pool.stats.tripped = false;
+        }
+      else if (0 == got)
+        {
+          /* Readers of an empty pool give up rather than wait */
+          LCA_LOG (DEBUG, "Entropy source failed, retrying");
+          pool.failing = true;
+        }
+
+      if (!passed && ++pool.failed_refills >= TRIP_REFILLS
+          && !pool.stats.tripped)
+        {
+          /* Nothing from a source that keeps failing is trusted, not
+             even what passed, nor the DRBG seeded from it */
+          LCA_LOG (DEBUG, "Entropy breaker tripped");
+          pool.stats.tripped = true;
+          pool.stats.trips++;
+          pool.generation++;
+          ring_take_all ();
+        }
+
+      smemset (buf, 0, sizeof (buf));
+      pthread_cond_broadcast (&pool.filled);
+
+      if (0 == got || pool.stats.tripped)
+        {
+          clock_gettime (CLOCK_REALTIME, &retry);
+          retry.tv_sec += RETRY_SEC;
+          while (!pool.stop
+                 && ETIMEDOUT != pthread_cond_timedwait (&pool.room,
+                                                         &pool.lock, &retry))
+            ;
+        }
+    }
+
+  pthread_mutex_unlock (&pool.lock);
+
+  return NULL;
+}
+
+/* Takes raw bytes out of the ring, waiting for the refill thread as
+   needed */
+static bool
+take (uint8_t *dst, size_t len)
+{
+  size_t n;
+  bool result = true;
+
+  pthread_mutex_lock (&pool.lock);
+
+  while (len > 0)
+    {
+      while (pool.running && 0 == pool.count && !pool.failing
+             && !pool.stats.tripped)
+        pthread_cond_wait (&pool.filled, &pool.lock);
+
+      if (0 == pool.count || pool.stats.tripped)
+        {
+          result = false;
+          break;
+        }
+
+      n = len < pool.count ? len : pool.count;
+      ring_take (dst, n);
+      dst += n;
+      len -= n;
+
+      pthread_cond_signal (&pool.room);
+    }
+
+  pthread_mutex_unlock (&pool.lock);
+
+  return result;
+}
+
+/* Instantiates or reseeds the DRBG from the ring, called with
+   drbg_lock held */
+static bool
+seed_drbg (unsigned int generation)
+{
+  /* Entropy input and, to instantiate, a nonce of half as much */
+  uint8_t seed[DRBG_LEN + DRBG_LEN / 2];
+  const size_t len = pool.seeded ? DRBG_LEN : sizeof (seed);
+
+  if (!take (seed, len))
+    return false;
+
+  if (pool.seeded)
+    drbg_reseed (&pool.drbg, seed, DRBG_LEN, NULL, 0);
+  else
+    drbg_init (&pool.drbg, seed, DRBG_LEN, seed + DRBG_LEN, DRBG_LEN / 2,
+               PERSONALIZATION, sizeof (PERSONALIZATION) - 1);
+
+  LCA_LOG (DEBUG, "DRBG %s", pool.seeded ? "reseeded" : "seeded");
+
+  pool.seeded = true;
+  pool.seed_generation = generation;
+  pool.since_reseed = 0;
+  smemset (seed, 0, sizeof (seed));
+
+  return true;
+}
+
+bool
+entropy_start_source (entropy_source_fn fill, void *arg, size_t pool_size,
+                      size_t reseed_bytes)
+{
+  bool result = false;
+
+  assert (NULL != fill);
+
+  if (0 == pool_size)
+    pool_size = DEFAULT_POOL_SIZE;
+  if (0 == reseed_bytes)
+    reseed_bytes = DEFAULT_RESEED_BYTES;
+
+  /* Whole blocks, and enough for a seed */
+  pool_size -= pool_size % ENTROPY_BLOCK_LEN;
+  if (pool_size < 2 * ENTROPY_BLOCK_LEN)
+    pool_size = 2 * ENTROPY_BLOCK_LEN;
+
+  pthread_mutex_lock (&pool.drbg_lock);
+  pthread_mutex_lock (&pool.lock);
+
+  if (!pool.running)
+    {
+      pool.ring = lca_malloc_wipe (pool_size);
+      pool.size = pool_size;
+      pool.tail = 0;
+      pool.count = 0;
+      pool.fill = fill;
+      pool.arg = arg;
+      pool.stop = false;
+      pool.failing = false;
+      health_init (&pool.health);
+      pool.failed_refills = 0;
+      memset (&pool.stats, 0, sizeof (pool.stats));
+      pool.seeded = false;
+      pool.reseed_bytes = reseed_bytes;
+
+      result = 0 == pthread_create (&pool.thread, NULL, refill_main, NULL);
+      if (result)
+        pool.running = true;
+      else
+        lca_free_wipe (pool.ring, pool_size);
+    }
+
+  pthread_mutex_unlock (&pool.lock);
+  pthread_mutex_unlock (&pool.drbg_lock);
+
+  return result;
+}
+
+static unsigned int
+device_fill (void *arg, uint8_t *buf, unsigned int blocks)
+{
+  const int fd = *(const int *)arg;
+  unsigned int x;
+
+  /* Other threads may use fd, but not inside the burst */
+  lca_device_lock (fd);
+  lca_wakeup (fd);
+
+  /* Without updating the seed, which is kept in EEPROM */
+  for (x = 0; x < blocks; x++)
+    {
+      struct Command_ATSHA204 c = lca_build_random_cmd (false);
+
+      if (RSP_SUCCESS != lca_process_command (fd, &c,
+                                              buf + x * ENTROPY_BLOCK_LEN,
+                                              ENTROPY_BLOCK_LEN))
+        break;
+    }
+
+  lca_idle (fd);
+  lca_device_unlock (fd);
+
+  return x;
+}
+
+bool
+lca_entropy_start (int fd, size_t pool_size, size_t reseed_bytes)
+{
+  assert (fd >= 0);
+
+  /* Only read by the refill thread, which start has not made yet */
+  if (lca_entropy_running ())
+    return false;
+
+  pool.fd = fd;
+
+  return entropy_start_source (device_fill, &pool.fd, pool_size,
+                               reseed_bytes);
+}
+
+bool
+lca_entropy_running (void)
+{
+  bool result;
+
+  pthread_mutex_lock (&pool.lock);
+  result = pool.running;
+  pthread_mutex_unlock (&pool.lock);
+
+  return result;
+}
+
+void
+lca_entropy_get_health (struct lca_health_stats *out)
+{
+  assert (NULL != out);
+
+  pthread_mutex_lock (&pool.lock);
+  *out = pool.stats;
+  pthread_mutex_unlock (&pool.lock);
+}
+
+void
+lca_entropy_stop (void)
+{
+  pthread_mutex_lock (&pool.drbg_lock);
+  pthread_mutex_lock (&pool.lock);
+
+  if (!pool.running)
+    {
+      pthread_mutex_unlock (&pool.lock);
+      pthread_mutex_unlock (&pool.drbg_lock);
+      return;
+    }
+
+  pool.stop = true;
+  pthread_cond_signal (&pool.room);
+  pthread_mutex_unlock (&pool.lock);
+
+  pthread_join (pool.thread, NULL);
+
+  pthread_mutex_lock (&pool.lock);
+  pool.running = false;
+  /* Raw readers waiting on the ring give up */
+  pthread_cond_broadcast (&pool.filled);
+  lca_free_wipe (pool.ring, pool.size);
+  pool.ring = NULL;
+  pool.count = 0;
+  pthread_mutex_unlock (&pool.lock);
+
+  drbg_wipe (&pool.drbg);
+  pool.seeded = false;
+
+  pthread_mutex_unlock (&pool.drbg_lock);
+}
+
+bool
+lca_random_bytes_mode (uint8_t *buf, size_t len, enum LCA_RANDOM_MODE mode)
+{
+  unsigned int generation;
+  size_t n;
+  bool result = true;
+
+  assert (NULL != buf || 0 == len);
+
+  if (LCA_RANDOM_RAW == mode)
+    return take (buf, len);
+
+  assert (LCA_RANDOM_DRBG == mode);
+
+  pthread_mutex_lock (&pool.drbg_lock);
+
+  pthread_mutex_lock (&pool.lock);
+  result = !pool.stats.tripped;
+  generation = pool.generation;
+  pthread_mutex_unlock (&pool.lock);
+
+  /* Seeded from before the breaker last tripped */
+  if (pool.seeded && generation != pool.seed_generation)
+    {
+      drbg_wipe (&pool.drbg);
+      pool.seeded = false;
+    }
+
+  while (result && len > 0)
+    {
+      if (!pool.seeded || pool.since_reseed >= pool.reseed_bytes)
+        if (!(result = seed_drbg (generation)))
+          break;
+
+      n = len < DRBG_MAX_REQUEST ? len : DRBG_MAX_REQUEST;
+      drbg_generate (&pool.drbg, buf, n, NULL, 0);
+
+      pool.since_reseed += n;
+      buf += n;
+      len -= n;
+    }
+
+  pthread_mutex_unlock (&pool.drbg_lock);
+
+  return result;
+}
+
+bool
+lca_random_bytes (uint8_t *buf, size_t len)
+{
+  return lca_random_bytes_mode (buf, len, LCA_RANDOM_DRBG);
+}
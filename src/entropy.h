@@ -0,0 +1,59 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The pool is filled in whole device responses */
+#define ENTROPY_BLOCK_LEN 32
+
+/**
+ * Fills the pool from any source, which lca_entropy_start does with
+ * the device's Random command.
+ *
+ * @param arg The source's argument.
+ * @param buf Where to write blocks * ENTROPY_BLOCK_LEN bytes.
+ * @param blocks The number of blocks wanted.
+ *
+ * @return The number of blocks written, 0 on failure.
+ */
+typedef unsigned int (*entropy_source_fn) (void *arg, uint8_t *buf,
+                                           unsigned int blocks);
+
+/**
+ * Starts the pool on a source.  The source is only called from the
+ * refill thread.
+ *
+ * @param fill The source.
+ * @param arg Its argument.
+ * @param pool_size See lca_entropy_start.
+ * @param reseed_bytes See lca_entropy_start.
+ *
+ * @return False if already running or the thread could not start.
+ */
+bool
+entropy_start_source (entropy_source_fn fill, void *arg, size_t pool_size,
+                      size_t reseed_bytes);
+
+#endif /* ENTROPY_H */
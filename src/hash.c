@@ -22,44 +22,30 @@
 
 #include <assert.h>
 #include <gcrypt.h>
+#include <string.h>
+#include "backend.h"
+#include "command_util.h"
 #include "hash.h"
+#include "sha256.h"
+#include "util.h"
 #include "../libcryptoauth.h"
 
 struct lca_octet_buffer
 lca_sha256 (FILE *fp)
 {
-
   struct lca_octet_buffer digest;
 
   assert (NULL != fp);
-  /* Init gcrypt */
-  assert (NULL != gcry_check_version (NULL));
-
-  struct gcry_md_handle *hd;
-  struct gcry_md_handle **hd_ptr = &hd;
 
-  assert (GPG_ERR_NO_ERROR == gcry_md_open (hd_ptr, GCRY_MD_SHA256, 0));
+  digest = lca_make_buffer (LCA_SHA256_DLEN);
 
-  int c;
-
-  /* Perform the hash */
-  while ((c = getc (fp)) != EOF)
+  if (!sha256_stream (fp, digest.ptr))
     {
-      gcry_md_putc (hd, c);
+      lca_free_octet_buffer (digest);
+      digest.ptr = NULL;
+      digest.len = 0;
     }
 
-  unsigned char *result;
-
-  result = gcry_md_read (hd, GCRY_MD_SHA256);
-  assert (NULL != result);
-
-  /* copy over to the digest */
-  const unsigned int DLEN = gcry_md_get_algo_dlen (GCRY_MD_SHA256);
-  digest = lca_make_buffer (DLEN);
-  memcpy (digest.ptr, result, DLEN);
-
-  gcry_md_close (hd);
-
   return digest;
 }
 
@@ -92,15 +78,12 @@ struct lca_octet_buffer
 lca_sha256_buffer (struct lca_octet_buffer data)
   {
     struct lca_octet_buffer digest;
-    const unsigned int DLEN = gcry_md_get_algo_dlen (GCRY_MD_SHA256);
 
     assert (NULL != data.ptr);
-    /* Init gcrypt */
-    assert (NULL != gcry_check_version (NULL));
 
-    digest = lca_make_buffer (DLEN);
+    digest = lca_make_buffer (SHA256_DIGEST_LEN);
 
-    gcry_md_hash_buffer (GCRY_MD_SHA256, digest.ptr, data.ptr, data.len);
+    backend_get ()->sha256 (data.ptr, data.len, digest.ptr);
 
     return digest;
   }
@@ -114,58 +97,6 @@ copy_over (uint8_t *dst, const uint8_t *src, unsigned int src_len,
 }
 
 
-static struct lca_octet_buffer
-perform_hash(struct lca_octet_buffer challenge,
-             struct lca_octet_buffer key,
-             uint8_t mode, uint16_t param2,
-             struct lca_octet_buffer otp8,
-             struct lca_octet_buffer otp3,
-             struct lca_octet_buffer sn4,
-             struct lca_octet_buffer sn23)
-{
-
-  assert (NULL != challenge.ptr); assert (32 == challenge.len);
-  assert (NULL != key.ptr); assert (32 == key.len);
-  assert (NULL != otp8.ptr); assert (8 == otp8.len);
-  assert (NULL != otp3.ptr); assert (3 == otp3.len);
-  assert (NULL != sn4.ptr); assert (4 == sn4.len);
-  assert (NULL != sn23.ptr); assert (2 == sn23.len);
-
-  const uint8_t opcode = {0x08};
-  const uint8_t sn = 0xEE;
-  const uint8_t sn2[] ={0x01, 0x23};
-
-  unsigned int len = challenge.len + key.len + sizeof(opcode) + sizeof(mode)
-    + sizeof(param2) + otp8.len + otp3.len + sizeof(sn)  + sn4.len
-    + sizeof(sn2) + sn23.len;
-
-  uint8_t *buf = lca_malloc_wipe(len);
-
-  unsigned int offset = 0;
-  offset = copy_over (buf, key.ptr, key.len, offset);
-  offset = copy_over (buf, challenge.ptr, challenge.len, offset);
-  offset = copy_over (buf, &opcode, sizeof(opcode), offset);
-  offset = copy_over (buf, &mode, sizeof(mode), offset);
-  offset = copy_over (buf, (uint8_t *)&param2, sizeof(param2), offset);
-  offset = copy_over (buf, otp8.ptr, otp8.len, offset);
-  offset = copy_over (buf, otp3.ptr, otp3.len, offset);
-  offset = copy_over (buf, &sn, sizeof(sn), offset);
-  offset = copy_over (buf, sn4.ptr, sn4.len, offset);
-  offset = copy_over (buf, sn2, sizeof (sn2), offset);
-  offset = copy_over (buf, sn23.ptr, sn23.len, offset);
-
-  lca_print_hex_string("Data to hash", buf, len);
-  struct lca_octet_buffer data_to_hash = {buf, len};
-  struct lca_octet_buffer digest;
-  digest = lca_sha256_buffer (data_to_hash);
-
-  lca_print_hex_string ("Result hash", digest.ptr, digest.len);
-
-  free(buf);
-
-  return digest;
-}
-
 bool
 lca_verify_hash_defaults (struct lca_octet_buffer challenge,
                            struct lca_octet_buffer challenge_rsp,
@@ -174,31 +105,26 @@ lca_verify_hash_defaults (struct lca_octet_buffer challenge,
 
   bool result = false;
 
-  const uint8_t MAX_NUM_DATA_SLOTS = 16;
-
-  struct lca_octet_buffer otp8 = lca_make_buffer (8);
-  struct lca_octet_buffer otp3 = lca_make_buffer (3);
-  struct lca_octet_buffer sn4 = lca_make_buffer (4);
-  struct lca_octet_buffer sn23 = lca_make_buffer (2);
-  uint8_t mode = 0;
-  uint16_t param2 = 0;
+  const uint8_t mode = 0;
+  uint8_t msg[DEFAULTS_MSG_LEN];
+  uint8_t digest[SHA256_DIGEST_LEN];
 
-  uint8_t *p = (uint8_t *)&param2;
+  assert (NULL != challenge.ptr); assert (32 == challenge.len);
+  assert (NULL != key.ptr); assert (32 == key.len);
+  assert (NULL != challenge_rsp.ptr);
   assert (key_slot < MAX_NUM_DATA_SLOTS);
-  *p = key_slot;
-
 
-  struct lca_octet_buffer digest;
-  digest = perform_hash (challenge, key, mode, param2, otp8, otp3, sn4, sn23);
+  defaults_message (msg, key.ptr, challenge.ptr, COMMAND_MAC, mode, key_slot);
+  lca_print_hex_string ("Data to hash", msg, sizeof (msg));
 
-  lca_free_octet_buffer (otp8);
-  lca_free_octet_buffer (otp3);
-  lca_free_octet_buffer (sn4);
-  lca_free_octet_buffer (sn23);
+  sha256 (msg, sizeof (msg), digest);
+  lca_print_hex_string ("Result hash", digest, sizeof (digest));
 
-  result = lca_memcmp_octet_buffer (digest, challenge_rsp);
+  if (sizeof (digest) == challenge_rsp.len)
+    result = cmemeq (digest, challenge_rsp.ptr, sizeof (digest));
 
-  lca_free_octet_buffer (digest);
+  smemset (msg, 0, sizeof (msg));
+  smemset (digest, 0, sizeof (digest));
 
   return result;
 
@@ -209,186 +135,267 @@ hmac_buffer (struct lca_octet_buffer data_to_hash,
              struct lca_octet_buffer key)
 {
   struct lca_octet_buffer digest;
-  const unsigned int DLEN = gcry_md_get_algo_dlen (GCRY_MD_SHA256);
 
   assert (NULL != data_to_hash.ptr);
   assert (NULL != key.ptr);
 
-  /* Init gcrypt */
-  if (!gcry_control (GCRYCTL_INITIALIZATION_FINISHED_P))
+  digest = lca_make_buffer (LCA_SHA256_DLEN);
+
+  lca_print_hex_string("hmac input", data_to_hash.ptr, data_to_hash.len);
+  lca_print_hex_string("hmac key", key.ptr, key.len);
+
+  if (!backend_get ()->hmac_sha256 (key.ptr, key.len,
+                                    data_to_hash.ptr, data_to_hash.len,
+                                    digest.ptr))
     {
-      fputs ("libgcrypt has not been initialized\n", stderr);
-      abort ();
+      lca_free_octet_buffer (digest);
+      digest.ptr = NULL;
+      digest.len = 0;
+      return digest;
     }
 
-  digest = lca_make_buffer (DLEN);
+  lca_print_hex_string("hmac result", digest.ptr, digest.len);
+
+  return digest;
+}
 
-  gcry_md_hd_t hd;
+void
+message_tail (uint8_t *tail, uint8_t opcode, uint8_t mode, uint8_t key_slot,
+              const uint8_t *otp, const uint8_t *serial)
+{
+  /* SN[0:1] and SN[8] are fixed and always included */
+  const uint8_t sn8 = NULL != serial ? serial[8] : 0xEE;
+  const uint8_t sn01[] = {NULL != serial ? serial[0] : 0x01,
+                          NULL != serial ? serial[1] : 0x23};
+  /* param2 is little endian */
+  const uint8_t param2[] = {key_slot, 0};
+
+  assert (NULL != tail);
+  assert (key_slot < MAX_NUM_DATA_SLOTS);
+  assert (NULL != otp || !(mode & (LCA_MAC_MODE_OTP88 | LCA_MAC_MODE_OTP64)));
+  assert (NULL != serial || !(mode & LCA_MAC_MODE_SN));
 
-  gcry_md_open (&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
+  memset (tail, 0, MESSAGE_TAIL_LEN);
 
-  assert (NULL != hd);
+  unsigned int offset = 0;
+  offset = copy_over (tail, &opcode, sizeof (opcode), offset);
+  offset = copy_over (tail, &mode, sizeof (mode), offset);
+  offset = copy_over (tail, param2, sizeof (param2), offset);
+
+  /* OTP[0:7], then OTP[8:10] */
+  if (mode & (LCA_MAC_MODE_OTP88 | LCA_MAC_MODE_OTP64))
+    copy_over (tail, otp, 8, offset);
+  offset += 8;
+  if (mode & LCA_MAC_MODE_OTP88)
+    copy_over (tail, otp + 8, 3, offset);
+  offset += 3;
+
+  offset = copy_over (tail, &sn8, sizeof (sn8), offset);
+  if (mode & LCA_MAC_MODE_SN)
+    copy_over (tail, serial + 4, 4, offset);
+  offset += 4;
+  offset = copy_over (tail, sn01, sizeof (sn01), offset);
+  if (mode & LCA_MAC_MODE_SN)
+    copy_over (tail, serial + 2, 2, offset);
+  offset += 2;
+
+  assert (MESSAGE_TAIL_LEN == offset);
+}
 
-  gcry_md_setkey (hd, key.ptr, key.len);
+void
+defaults_message (uint8_t *msg, const uint8_t *first,
+                  const uint8_t *challenge, uint8_t opcode, uint8_t mode,
+                  uint8_t key_slot)
+{
+  assert (NULL != msg); assert (NULL != first); assert (NULL != challenge);
 
-  lca_print_hex_string("hmac input", data_to_hash.ptr, data_to_hash.len);
-  lca_print_hex_string("hmac key", key.ptr, key.len);
+  unsigned int offset = 0;
+  offset = copy_over (msg, first, 32, offset);
+  offset = copy_over (msg, challenge, 32, offset);
+  message_tail (msg + offset, opcode, mode, key_slot, NULL, NULL);
+}
 
-  gcry_md_write (hd, data_to_hash.ptr, data_to_hash.len);
+struct lca_octet_buffer
+lca_soft_hmac256_defaults(struct lca_octet_buffer challenge,
+                          struct lca_octet_buffer key,
+                          uint8_t key_slot)
+{
+  struct lca_hmac_ctx ctx;
+  struct lca_octet_buffer digest;
 
-  unsigned char *result = gcry_md_read (hd, GCRY_MD_SHA256);
+  assert (NULL != challenge.ptr); assert (32 == challenge.len);
+  assert (NULL != key.ptr); assert (32 == key.len);
 
-  assert (NULL != result);
-  lca_print_hex_string("hmac result", result, 32);
+  digest = lca_make_buffer (LCA_SHA256_DLEN);
 
-  memcpy (digest.ptr, result, DLEN);
+  lca_hmac_init (&ctx, key.ptr, key.len);
+  lca_hmac_defaults (&ctx, challenge.ptr, key_slot, digest.ptr);
+  lca_hmac_wipe (&ctx);
 
-  gcry_md_close (hd);
+  lca_print_hex_string("Result hash", digest.ptr, digest.len);
 
   return digest;
+
 }
 
-static struct lca_octet_buffer
-prepare_hmac_buffer(struct lca_octet_buffer challenge,
-                    struct lca_octet_buffer key,
-                    uint8_t mode,
-                    uint8_t key_slot,
-                    struct lca_octet_buffer otp8,
-                    struct lca_octet_buffer otp3,
-                    struct lca_octet_buffer sn4,
-                    struct lca_octet_buffer sn23)
+bool
+lca_verify_hmac_defaults (struct lca_octet_buffer challenge,
+                           struct lca_octet_buffer challenge_rsp,
+                           struct lca_octet_buffer key, unsigned int key_slot)
 {
-  assert (NULL != challenge.ptr); assert (32 == challenge.len);
-  assert (NULL != key.ptr); assert (32 == key.len);
-  assert (NULL != otp8.ptr); assert (8 == otp8.len);
-  assert (NULL != otp3.ptr); assert (3 == otp3.len);
-  assert (NULL != sn4.ptr); assert (4 == sn4.len);
-  assert (NULL != sn23.ptr); assert (2 == sn23.len);
 
-  const uint8_t MAX_NUM_DATA_SLOTS = 16;
-  uint16_t param2 = 0;
+  bool result = false;
+  struct lca_hmac_ctx ctx;
 
-  uint8_t *p = (uint8_t *)&param2;
+  assert (NULL != challenge.ptr); assert (32 == challenge.len);
+  assert (NULL != key.ptr); assert (32 == key.len);
+  assert (NULL != challenge_rsp.ptr);
   assert (key_slot < MAX_NUM_DATA_SLOTS);
-  *p = key_slot;
 
-  struct lca_octet_buffer zeros = lca_make_buffer (32);
+  if (LCA_SHA256_DLEN != challenge_rsp.len)
+    return false;
+
+  lca_hmac_init (&ctx, key.ptr, key.len);
+  result = lca_hmac_verify_defaults (&ctx, challenge.ptr, challenge_rsp.ptr,
+                                     key_slot);
+  lca_hmac_wipe (&ctx);
 
-  const uint8_t opcode = {0x11};
-  const uint8_t sn = 0xEE;
-  const uint8_t sn2[] ={0x01, 0x23};
+  return result;
 
-  unsigned int len = zeros.len +
-    challenge.len +
-    sizeof(opcode) +
-    sizeof(mode) +
-    sizeof(param2) +
-    otp8.len +
-    otp3.len +
-    sizeof(sn) +
-    sn4.len +
-    sizeof(sn2) +
-    sn23.len;
+}
 
-  assert (88 == len);
+void
+lca_nonce_compute (const uint8_t *rand_out, const uint8_t *num_in,
+                   uint8_t mode, uint8_t *tempkey)
+{
+  const uint8_t tail[] = {COMMAND_NONCE, mode, 0};
+  uint8_t msg[32 + LCA_NONCE_NUM_IN_LEN + sizeof (tail)];
 
-  uint8_t *buf = lca_malloc_wipe(len);
+  assert (NULL != rand_out); assert (NULL != num_in);
+  assert (NULL != tempkey);
 
   unsigned int offset = 0;
-  offset = copy_over(buf, zeros.ptr, zeros.len, offset);
-  offset = copy_over(buf, challenge.ptr, challenge.len, offset);
-  offset = copy_over(buf, &opcode, sizeof(opcode), offset);
-  offset = copy_over(buf, &mode, sizeof(mode), offset);
-  offset = copy_over(buf, (uint8_t *)&param2, sizeof(param2), offset);
-  offset = copy_over(buf, otp8.ptr, otp8.len, offset);
-  offset = copy_over(buf, otp3.ptr, otp3.len, offset);
-  offset = copy_over(buf, &sn, sizeof(sn), offset);
-  offset = copy_over(buf, sn4.ptr, sn4.len, offset);
-  offset = copy_over(buf, sn2, sizeof (sn2), offset);
-  offset = copy_over(buf, sn23.ptr, sn23.len, offset);
-
-  lca_print_hex_string("Data to hmac", buf, len);
-
-  struct lca_octet_buffer result = {buf, len};
+  offset = copy_over (msg, rand_out, 32, offset);
+  offset = copy_over (msg, num_in, LCA_NONCE_NUM_IN_LEN, offset);
+  offset = copy_over (msg, tail, sizeof (tail), offset);
+  assert (sizeof (msg) == offset);
 
-  return result;
+  sha256 (msg, sizeof (msg), tempkey);
 }
 
-static struct lca_octet_buffer
-perform_hmac_256(struct lca_octet_buffer challenge,
-                 struct lca_octet_buffer key,
-                 uint8_t mode,
-                 uint8_t key_slot,
-                 struct lca_octet_buffer otp8,
-                 struct lca_octet_buffer otp3,
-                 struct lca_octet_buffer sn4,
-                 struct lca_octet_buffer sn23)
-{
-
-  struct lca_octet_buffer data_to_hmac =
-    prepare_hmac_buffer(challenge, key, mode, key_slot,
-                        otp8, otp3, sn4, sn23);
-
-  struct lca_octet_buffer digest;
-  digest = hmac_buffer (data_to_hmac, key);
+/* The key, opcode, param1, param2 and fixed serial number bytes that
+   GenDig and DeriveKey messages start with */
+#define KEY_MESSAGE_LEN 39
+/* Those followed by 25 zeros and TempKey */
+#define TEMPKEY_MESSAGE_LEN (KEY_MESSAGE_LEN + 25 + 32)
 
-  lca_print_hex_string("Result hash", digest.ptr, digest.len);
+static void
+key_message (uint8_t *msg, const uint8_t *key, uint8_t opcode,
+             uint8_t param1, uint8_t key_id, const uint8_t *serial)
+{
+  const uint8_t sn8 = NULL != serial ? serial[8] : 0xEE;
+  const uint8_t sn01[] = {NULL != serial ? serial[0] : 0x01,
+                          NULL != serial ? serial[1] : 0x23};
+  /* param2 is little endian */
+  const uint8_t param2[] = {key_id, 0};
 
-  lca_free_octet_buffer(data_to_hmac);
+  assert (NULL != msg); assert (NULL != key);
+  assert (key_id < MAX_NUM_DATA_SLOTS);
 
-  return digest;
+  unsigned int offset = 0;
+  offset = copy_over (msg, key, 32, offset);
+  offset = copy_over (msg, &opcode, sizeof (opcode), offset);
+  offset = copy_over (msg, &param1, sizeof (param1), offset);
+  offset = copy_over (msg, param2, sizeof (param2), offset);
+  offset = copy_over (msg, &sn8, sizeof (sn8), offset);
+  offset = copy_over (msg, sn01, sizeof (sn01), offset);
+  assert (KEY_MESSAGE_LEN == offset);
 }
 
-struct lca_octet_buffer
-lca_soft_hmac256_defaults(struct lca_octet_buffer challenge,
-                          struct lca_octet_buffer key,
-                          uint8_t key_slot)
+static void
+tempkey_message_digest (const uint8_t *key, uint8_t opcode, uint8_t param1,
+                        uint8_t key_id, const uint8_t *serial,
+                        const uint8_t *tempkey, uint8_t *digest)
 {
-  struct lca_octet_buffer otp8 = lca_make_buffer (8);
-  struct lca_octet_buffer otp3 = lca_make_buffer (3);
-  struct lca_octet_buffer sn4 = lca_make_buffer (4);
-  struct lca_octet_buffer sn23 = lca_make_buffer (2);
-  uint8_t mode = 0x04;
+  uint8_t msg[TEMPKEY_MESSAGE_LEN];
 
-  struct lca_octet_buffer digest;
-  digest = perform_hmac_256 (challenge, key, mode, key_slot,
-                             otp8, otp3, sn4, sn23);
+  assert (NULL != tempkey); assert (NULL != digest);
 
-  lca_free_octet_buffer (otp8);
-  lca_free_octet_buffer (otp3);
-  lca_free_octet_buffer (sn4);
-  lca_free_octet_buffer (sn23);
+  key_message (msg, key, opcode, param1, key_id, serial);
+  memset (msg + KEY_MESSAGE_LEN, 0, 25);
+  memcpy (msg + KEY_MESSAGE_LEN + 25, tempkey, 32);
 
-  return digest;
+  sha256 (msg, sizeof (msg), digest);
 
+  smemset (msg, 0, sizeof (msg));
 }
 
-bool
-lca_verify_hmac_defaults (struct lca_octet_buffer challenge,
-                           struct lca_octet_buffer challenge_rsp,
-                           struct lca_octet_buffer key, unsigned int key_slot)
+void
+lca_gen_dig_compute (const uint8_t *data, enum DATA_ZONE zone,
+                     uint8_t key_id, const uint8_t *serial,
+                     const uint8_t *tempkey, uint8_t *new_tempkey)
 {
+  tempkey_message_digest (data, COMMAND_GEN_DIG, set_zone_bits (zone),
+                          key_id, serial, tempkey, new_tempkey);
+}
 
-  bool result = false;
-  struct lca_octet_buffer otp8 = lca_make_buffer (8);
-  struct lca_octet_buffer otp3 = lca_make_buffer (3);
-  struct lca_octet_buffer sn4 = lca_make_buffer (4);
-  struct lca_octet_buffer sn23 = lca_make_buffer (2);
-  uint8_t mode = 0x04;
+void
+lca_derive_key_compute (const uint8_t *parent_key, uint8_t mode,
+                        uint8_t target_key, const uint8_t *serial,
+                        const uint8_t *tempkey, uint8_t *new_key)
+{
+  tempkey_message_digest (parent_key, COMMAND_DERIVE_KEY, mode, target_key,
+                          serial, tempkey, new_key);
+}
 
-  struct lca_octet_buffer digest;
-  digest = perform_hmac_256 (challenge, key, mode, key_slot,
-                             otp8, otp3, sn4, sn23);
+void
+lca_derive_key_mac (const uint8_t *parent_key, uint8_t mode,
+                    uint8_t target_key, const uint8_t *serial, uint8_t *mac)
+{
+  uint8_t msg[KEY_MESSAGE_LEN];
 
-  lca_free_octet_buffer (otp8);
-  lca_free_octet_buffer (otp3);
-  lca_free_octet_buffer (sn4);
-  lca_free_octet_buffer (sn23);
+  assert (NULL != mac);
 
-  result = lca_memcmp_octet_buffer (digest, challenge_rsp);
+  key_message (msg, parent_key, COMMAND_DERIVE_KEY, mode, target_key, serial);
+  sha256 (msg, sizeof (msg), mac);
 
-  lca_free_octet_buffer (digest);
+  smemset (msg, 0, sizeof (msg));
+}
 
-  return result;
+void
+lca_check_mac_compute (const uint8_t *first, const uint8_t *second,
+                       uint8_t mode, const uint8_t *other_data,
+                       const uint8_t *otp, const uint8_t *serial,
+                       uint8_t *response)
+{
+  const uint8_t sn8 = NULL != serial ? serial[8] : 0xEE;
+  const uint8_t sn01[] = {NULL != serial ? serial[0] : 0x01,
+                          NULL != serial ? serial[1] : 0x23};
+  uint8_t msg[DEFAULTS_MSG_LEN];
 
+  assert (NULL != first); assert (NULL != second);
+  assert (NULL != other_data); assert (NULL != response);
+  assert (NULL != otp || !(mode & LCA_MAC_MODE_OTP64));
+
+  memset (msg, 0, sizeof (msg));
+
+  /* The MAC layout, with the other data standing in for the command
+     bytes and the optional OTP and serial number bytes */
+  unsigned int offset = 0;
+  offset = copy_over (msg, first, 32, offset);
+  offset = copy_over (msg, second, 32, offset);
+  offset = copy_over (msg, other_data, 4, offset);
+  if (mode & LCA_MAC_MODE_OTP64)
+    copy_over (msg, otp, 8, offset);
+  offset += 8;
+  offset = copy_over (msg, other_data + 4, 3, offset);
+  offset = copy_over (msg, &sn8, sizeof (sn8), offset);
+  offset = copy_over (msg, other_data + 7, 4, offset);
+  offset = copy_over (msg, sn01, sizeof (sn01), offset);
+  offset = copy_over (msg, other_data + 11, 2, offset);
+  assert (sizeof (msg) == offset);
+
+  sha256 (msg, sizeof (msg), response);
+
+  smemset (msg, 0, sizeof (msg));
 }
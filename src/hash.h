@@ -21,7 +21,9 @@
 #ifndef HASH_H
 #define HASH_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 /**
  * Copies the src data to the destination at the offset and returns
@@ -38,8 +40,71 @@ unsigned int
 copy_over (uint8_t *dst, const uint8_t *src, unsigned int src_len,
            unsigned int offset);
 
+/* The message the device MACs or HMACs with the default mode bits:
+   32 bytes of key or zeros, the 32 byte challenge, opcode, mode,
+   param2 and the fixed OTP and serial number bytes. */
+#define DEFAULTS_MSG_LEN 88
+#define DEFAULTS_CHALLENGE_OFFSET 32
+
+/* The bytes after the two 32 byte inputs: opcode, mode, param2, OTP
+   and serial number */
+#define MESSAGE_TAIL_LEN (DEFAULTS_MSG_LEN - 64)
+
+/**
+ * Lays out the part of a MAC or HMAC message that does not depend on
+ * the challenge, honoring the OTP and serial number mode bits.
+ *
+ * @param tail The MESSAGE_TAIL_LEN byte destination.
+ * @param opcode The command opcode.
+ * @param mode The mode byte.
+ * @param key_slot The key slot.
+ * @param otp The first 11 bytes of the OTP zone, or NULL if the mode
+ * does not include them.
+ * @param serial The 9 byte serial number, or NULL to use the fixed
+ * bytes only.  Required if the mode includes the serial number.
+ */
+void
+message_tail (uint8_t *tail, uint8_t opcode, uint8_t mode, uint8_t key_slot,
+              const uint8_t *otp, const uint8_t *serial);
+
+/**
+ * Lays out the default MAC or HMAC message.
+ *
+ * @param msg The DEFAULTS_MSG_LEN byte destination.
+ * @param first The 32 bytes that lead the message, the key for MAC and
+ * zeros for HMAC.
+ * @param challenge The 32 byte challenge.
+ * @param opcode The command opcode.
+ * @param mode The mode byte.
+ * @param key_slot The key slot.
+ */
+void
+defaults_message (uint8_t *msg, const uint8_t *first,
+                  const uint8_t *challenge, uint8_t opcode, uint8_t mode,
+                  uint8_t key_slot);
+
+/**
+ * HMAC-SHA256s a buffer with the selected backend.
+ *
+ * @param data_to_hash The data.
+ * @param key The key.
+ *
+ * @return The 32 byte MAC, or a NULL buffer if the backend failed.
+ */
 struct lca_octet_buffer
 hmac_buffer (struct lca_octet_buffer data_to_hash,
              struct lca_octet_buffer key);
 
+/**
+ * SHA-256s the rest of a stdio stream, mapping it if it is a regular
+ * file and reading it in large blocks otherwise.
+ *
+ * @param fp The stream, left at its end.
+ * @param digest The 32 byte result.
+ *
+ * @return False on a read error.
+ */
+bool
+sha256_stream (FILE *fp, uint8_t *digest);
+
 #endif /* HASH_H */
@@ -0,0 +1,383 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "hash.h"
+#include "sha256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* Files are mapped a window at a time, so a 32 bit process can hash
+   images bigger than its address space. */
+#define MAP_WINDOW (64 * 1024 * 1024)
+#define READ_BLOCK (1024 * 1024)
+
+static bool
+hash_mapped (int fd, off_t off, off_t end, struct sha256_ctx *sha)
+{
+  const off_t page = sysconf (_SC_PAGESIZE);
+  off_t base;
+  size_t len;
+  uint8_t *map;
+
+  while (off < end)
+    {
+      base = off - off % page;
+      len = end - base < MAP_WINDOW ? end - base : MAP_WINDOW;
+
+      map = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, base);
+      if (MAP_FAILED == map)
+        return false;
+
+      madvise (map, len, MADV_SEQUENTIAL);
+      sha256_update (sha, map + (off - base), len - (off - base));
+      munmap (map, len);
+
+      off = base + len;
+    }
+
+  return true;
+}
+
+/* Fills buf unless the input ends first; short only at the end */
+static ssize_t
+read_block (int fd, uint8_t *buf, size_t len)
+{
+  size_t got = 0;
+  ssize_t n;
+
+  while (got < len)
+    {
+      n = read (fd, buf + got, len - got);
+      if (n < 0 && EINTR == errno)
+        continue;
+      if (n < 0)
+        return -1;
+      if (0 == n)
+        break;
+      got += n;
+    }
+
+  return got;
+}
+
+static uint8_t *
+block_alloc (void)
+{
+  void *buf = NULL;
+
+  if (0 != posix_memalign (&buf, sysconf (_SC_PAGESIZE), READ_BLOCK))
+    return NULL;
+
+  return buf;
+}
+
+static bool
+hash_reads (int fd, struct sha256_ctx *sha)
+{
+  uint8_t *buf = block_alloc ();
+  ssize_t n = -1;
+
+  if (NULL == buf)
+    return false;
+
+  while ((n = read_block (fd, buf, READ_BLOCK)) > 0)
+    sha256_update (sha, buf, n);
+
+  free (buf);
+
+  return 0 == n;
+}
+
+/* Two buffers: a reader thread fills one while the caller hashes the
+   other. */
+struct overlap
+{
+  int fd;
+  uint8_t *buf[2];
+  ssize_t len[2];
+  bool full[2];
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void *
+reader_main (void *arg)
+{
+  struct overlap *o = arg;
+  unsigned int i;
+  ssize_t n;
+
+  for (i = 0;; i ^= 1)
+    {
+      pthread_mutex_lock (&o->lock);
+      while (o->full[i])
+        pthread_cond_wait (&o->cond, &o->lock);
+      pthread_mutex_unlock (&o->lock);
+
+      n = read_block (o->fd, o->buf[i], READ_BLOCK);
+
+      pthread_mutex_lock (&o->lock);
+      o->len[i] = n;
+      o->full[i] = true;
+      pthread_cond_signal (&o->cond);
+      pthread_mutex_unlock (&o->lock);
+
+      /* A short block is the last one */
+      if (n < READ_BLOCK)
+        return NULL;
+    }
+}
+
+static bool
+hash_overlapped (int fd, struct sha256_ctx *sha)
+{
+  struct overlap o;
+  pthread_t reader;
+  unsigned int i;
+  ssize_t n;
+
+  memset (&o, 0, sizeof (o));
+  o.fd = fd;
+  o.buf[0] = block_alloc ();
+  o.buf[1] = block_alloc ();
+
+  if (NULL == o.buf[0] || NULL == o.buf[1])
+    {
+      free (o.buf[0]);
+      free (o.buf[1]);
+      return false;
+    }
+
+  pthread_mutex_init (&o.lock, NULL);
+  pthread_cond_init (&o.cond, NULL);
+
+  if (0 != pthread_create (&reader, NULL, reader_main, &o))
+    {
+      n = hash_reads (fd, sha) ? 0 : -1;
+      goto out;
+    }
+
+  for (i = 0;; i ^= 1)
+    {
+      pthread_mutex_lock (&o.lock);
+      while (!o.full[i])
+        pthread_cond_wait (&o.cond, &o.lock);
+      n = o.len[i];
+      pthread_mutex_unlock (&o.lock);
+
+      if (n > 0)
+        sha256_update (sha, o.buf[i], n);
+
+      if (n < READ_BLOCK)
+        break;
+
+      pthread_mutex_lock (&o.lock);
+      o.full[i] = false;
+      pthread_cond_signal (&o.cond);
+      pthread_mutex_unlock (&o.lock);
+    }
+
+  pthread_join (reader, NULL);
+
+ out:
+  pthread_cond_destroy (&o.cond);
+  pthread_mutex_destroy (&o.lock);
+  free (o.buf[0]);
+  free (o.buf[1]);
+
+  return n >= 0;
+}
+
+static bool
+hash_fd (int fd, enum LCA_HASH_FILE_MODE mode, struct sha256_ctx *sha)
+{
+  struct stat st;
+  off_t off = -1;
+  bool regular;
+
+  regular = 0 == fstat (fd, &st) && S_ISREG (st.st_mode)
+    && (off = lseek (fd, 0, SEEK_CUR)) >= 0;
+
+  if (!regular)
+    return LCA_HASH_FILE_OVERLAP == mode
+      ? hash_overlapped (fd, sha) : hash_reads (fd, sha);
+
+  if (LCA_HASH_FILE_AUTO == mode || LCA_HASH_FILE_MMAP == mode)
+    {
+      /* Some file systems cannot be mapped; read those instead */
+      if (hash_mapped (fd, off, st.st_size, sha))
+        return lseek (fd, 0, SEEK_END) >= 0;
+
+      LCA_LOG (DEBUG, "mmap failed, reading instead");
+      sha256_init (sha);
+      if (lseek (fd, off, SEEK_SET) < 0)
+        return false;
+    }
+
+  posix_fadvise (fd, off, 0, POSIX_FADV_SEQUENTIAL);
+
+  return LCA_HASH_FILE_OVERLAP == mode
+    ? hash_overlapped (fd, sha) : hash_reads (fd, sha);
+}
+
+bool
+lca_sha256_fd (int fd, enum LCA_HASH_FILE_MODE mode, uint8_t *digest)
+{
+  struct sha256_ctx sha;
+
+  assert (fd >= 0); assert (NULL != digest);
+
+  sha256_init (&sha);
+
+  if (!hash_fd (fd, mode, &sha))
+    return false;
+
+  sha256_final (&sha, digest);
+
+  return true;
+}
+
+bool
+sha256_stream (FILE *fp, uint8_t *digest)
+{
+  struct sha256_ctx sha;
+  struct stat st;
+  uint8_t *buf;
+  off_t off;
+  size_t n;
+
+  assert (NULL != fp); assert (NULL != digest);
+
+  sha256_init (&sha);
+
+  /* The stream's position counts what stdio has buffered, so a file
+     can be mapped from there */
+  if (0 == fstat (fileno (fp), &st) && S_ISREG (st.st_mode)
+      && (off = ftello (fp)) >= 0
+      && hash_mapped (fileno (fp), off, st.st_size, &sha)
+      && 0 == fseeko (fp, 0, SEEK_END))
+    {
+      sha256_final (&sha, digest);
+      return true;
+    }
+
+  sha256_init (&sha);
+
+  if (NULL == (buf = block_alloc ()))
+    return false;
+
+  while ((n = fread (buf, 1, READ_BLOCK, fp)) > 0)
+    sha256_update (&sha, buf, n);
+
+  free (buf);
+
+  if (ferror (fp))
+    return false;
+
+  sha256_final (&sha, digest);
+
+  return true;
+}
+
+/* Workers take the next file with an atomic add */
+struct file_batch
+{
+  struct lca_file_digest *files;
+  unsigned int count;
+  unsigned int next;
+  unsigned int hashed;
+};
+
+static void *
+hash_worker (void *arg)
+{
+  struct file_batch *b = arg;
+  struct lca_file_digest *f;
+  unsigned int x;
+  int fd;
+
+  while ((x = __atomic_fetch_add (&b->next, 1, __ATOMIC_RELAXED)) < b->count)
+    {
+      f = &b->files[x];
+
+      if ((fd = open (f->path, O_RDONLY)) < 0)
+        {
+          LCA_LOG (DEBUG, "Can't open %s", f->path);
+          f->ok = false;
+          continue;
+        }
+
+      f->ok = lca_sha256_fd (fd, LCA_HASH_FILE_AUTO, f->digest);
+      close (fd);
+
+      if (f->ok)
+        __atomic_fetch_add (&b->hashed, 1, __ATOMIC_RELAXED);
+    }
+
+  return NULL;
+}
+
+unsigned int
+lca_sha256_files (struct lca_file_digest *files, unsigned int count,
+                  unsigned int workers)
+{
+  struct file_batch b = {files, count, 0, 0};
+  pthread_t *threads;
+  unsigned int x, started = 0;
+
+  assert (NULL != files || 0 == count);
+
+  if (0 == workers)
+    {
+      const long n = sysconf (_SC_NPROCESSORS_ONLN);
+      workers = n > 0 ? n : 1;
+    }
+
+  if (workers > count)
+    workers = count;
+
+  /* The caller hashes too */
+  threads = calloc (workers, sizeof (*threads));
+  assert (NULL != threads || 0 == workers);
+
+  for (x = 1; x < workers; x++)
+    if (0 == pthread_create (&threads[started], NULL, hash_worker, &b))
+      started++;
+
+  hash_worker (&b);
+
+  for (x = 0; x < started; x++)
+    pthread_join (threads[x], NULL);
+
+  free (threads);
+
+  return b.hashed;
+}
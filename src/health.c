@@ -0,0 +1,288 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+#include "health.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_HEALTH_X86 1
+#include <immintrin.h>
+#endif
+
+/* Blocks compared per kernel call */
+#define CHUNK_BLOCKS 64
+#define ALL_BITS 0xFFFFFFFFu
+
+/* What the device returns from Random while its config zone is
+   unlocked */
+static const uint8_t UNLOCKED_PATTERN[HEALTH_BLOCK_LEN] = {
+  0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00,
+  0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00,
+  0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00,
+  0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00
+};
+
+/* Comparisons over one block, bit i standing for byte i */
+struct block_masks
+{
+  /* Byte i equals byte i - 1, across the block boundary */
+  uint32_t rep;
+  /* Byte i equals the adaptive proportion window's value */
+  uint32_t apt;
+  /* Byte i equals that of the block before */
+  uint32_t prev;
+  /* Byte i equals that of UNLOCKED_PATTERN */
+  uint32_t pattern;
+};
+
+typedef void (*health_kernel) (const uint8_t *blocks, size_t n,
+                               const uint8_t *before, const uint8_t *apt,
+                               struct block_masks *out);
+
+static uint32_t
+eq_bytes (const uint8_t *a, const uint8_t *b)
+{
+  uint32_t mask = 0;
+  unsigned int x;
+
+  for (x = 0; x < HEALTH_BLOCK_LEN; x++)
+    mask |= (uint32_t)(a[x] == b[x]) << x;
+
+  return mask;
+}
+
+static void
+masks_scalar (const uint8_t *blocks, size_t n, const uint8_t *before,
+              const uint8_t *apt, struct block_masks *out)
+{
+  const uint8_t *b, *p;
+  size_t i;
+  unsigned int x;
+
+  for (i = 0; i < n; i++)
+    {
+      b = blocks + i * HEALTH_BLOCK_LEN;
+      p = i > 0 ? b - HEALTH_BLOCK_LEN : before;
+
+      out[i].rep = b[0] == p[HEALTH_BLOCK_LEN - 1];
+      out[i].apt = 0;
+      for (x = 1; x < HEALTH_BLOCK_LEN; x++)
+        out[i].rep |= (uint32_t)(b[x] == b[x - 1]) << x;
+      for (x = 0; x < HEALTH_BLOCK_LEN; x++)
+        out[i].apt |= (uint32_t)(b[x] == apt[i]) << x;
+
+      out[i].prev = eq_bytes (b, p);
+      out[i].pattern = eq_bytes (b, UNLOCKED_PATTERN);
+    }
+}
+
+#ifdef HAVE_HEALTH_X86
+
+__attribute__ ((target ("avx2"))) static void
+masks_avx2 (const uint8_t *blocks, size_t n, const uint8_t *before,
+            const uint8_t *apt, struct block_masks *out)
+{
+  const __m256i pattern = _mm256_loadu_si256 ((const __m256i *)
+                                              UNLOCKED_PATTERN);
+  uint8_t first[HEALTH_BLOCK_LEN + 1];
+  __m256i cur, prev, shifted;
+  size_t i;
+
+  /* The first block's predecessor bytes are not in the buffer */
+  first[0] = before[HEALTH_BLOCK_LEN - 1];
+  memcpy (first + 1, blocks, HEALTH_BLOCK_LEN);
+
+  for (i = 0; i < n; i++)
+    {
+      const uint8_t *b = blocks + i * HEALTH_BLOCK_LEN;
+
+      cur = _mm256_loadu_si256 ((const __m256i *)b);
+      if (0 == i)
+        {
+          prev = _mm256_loadu_si256 ((const __m256i *)before);
+          shifted = _mm256_loadu_si256 ((const __m256i *)first);
+        }
+      else
+        {
+          prev = _mm256_loadu_si256 ((const __m256i *)(b - HEALTH_BLOCK_LEN));
+          shifted = _mm256_loadu_si256 ((const __m256i *)(b - 1));
+        }
+
+      out[i].rep = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (cur, shifted));
+      out[i].apt = _mm256_movemask_epi8
+        (_mm256_cmpeq_epi8 (cur, _mm256_set1_epi8 ((char)apt[i])));
+      out[i].prev = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (cur, prev));
+      out[i].pattern = _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (cur,
+                                                                 pattern));
+    }
+}
+
+#endif /* HAVE_HEALTH_X86 */
+
+static health_kernel kernel = NULL;
+
+bool
+health_select (enum HEALTH_IMPL impl)
+{
+#ifdef HAVE_HEALTH_X86
+  __builtin_cpu_init ();
+
+  if (HEALTH_AUTO == impl)
+    impl = __builtin_cpu_supports ("avx2") ? HEALTH_AVX2 : HEALTH_SCALAR;
+
+  if (HEALTH_AVX2 == impl)
+    {
+      if (!__builtin_cpu_supports ("avx2"))
+        return false;
+      kernel = masks_avx2;
+      return true;
+    }
+#endif
+
+  if (HEALTH_AUTO != impl && HEALTH_SCALAR != impl)
+    return false;
+
+  kernel = masks_scalar;
+
+  return true;
+}
+
+void
+health_init (struct health *h)
+{
+  assert (NULL != h);
+
+  smemset (h, 0, sizeof (*h));
+}
+
+/* True if mask has a run of len set bits */
+static bool
+has_run (uint32_t mask, unsigned int len)
+{
+  unsigned int x;
+
+  for (x = 1; x < len && 0 != mask; x++)
+    mask &= mask >> 1;
+
+  return 0 != mask;
+}
+
+/* Applies one block's masks to the stream, counting what fails */
+static bool
+test_block (struct health *h, const uint8_t *block,
+            const struct block_masks *m, struct lca_health_stats *stats)
+{
+  /* A run of c identical samples is c - 1 repeats */
+  const unsigned int max_repeats = HEALTH_RCT_CUTOFF - 1;
+  uint32_t rep = m->rep;
+  bool stuck = false, rct = false, apt = false;
+
+  if (!h->have_prev)
+    rep &= ~1u;
+  else
+    stuck = ALL_BITS == m->prev;
+
+  stuck = stuck || ALL_BITS == m->pattern || ALL_BITS == (rep | 1);
+
+  /* Repetition count */
+  if (ALL_BITS == rep)
+    {
+      h->run += HEALTH_BLOCK_LEN;
+      rct = h->run >= max_repeats;
+    }
+  else
+    {
+      rct = h->run + __builtin_ctz (~rep) >= max_repeats
+        || has_run (rep, max_repeats);
+      h->run = __builtin_clz (~rep);
+    }
+
+  /* Adaptive proportion, counting the window's first sample too */
+  if (0 == h->apt_pos)
+    {
+      h->apt_value = block[0];
+      h->apt_count = 0;
+    }
+  h->apt_count += __builtin_popcount (m->apt);
+  h->apt_pos = (h->apt_pos + HEALTH_BLOCK_LEN) % HEALTH_APT_WINDOW;
+  apt = h->apt_count >= HEALTH_APT_CUTOFF;
+
+  memcpy (h->prev, block, HEALTH_BLOCK_LEN);
+  h->have_prev = true;
+
+  stats->blocks++;
+  stats->stuck_failures += stuck;
+  stats->repetition_failures += rct;
+  stats->proportion_failures += apt;
+
+  return !(stuck || rct || apt);
+}
+
+bool
+health_test (struct health *h, const uint8_t *blocks, size_t nblocks,
+             struct lca_health_stats *stats)
+{
+  struct block_masks masks[CHUNK_BLOCKS];
+  uint8_t apt[CHUNK_BLOCKS];
+  size_t done, n, i;
+  unsigned int pos;
+  uint8_t value;
+
+  assert (NULL != h); assert (NULL != stats);
+  assert (NULL != blocks || 0 == nblocks);
+
+  if (NULL == kernel)
+    health_select (HEALTH_AUTO);
+
+  for (done = 0; done < nblocks; done += n)
+    {
+      const uint8_t *chunk = blocks + done * HEALTH_BLOCK_LEN;
+
+      n = nblocks - done < CHUNK_BLOCKS ? nblocks - done : CHUNK_BLOCKS;
+
+      /* Each block's window value, known before comparing */
+      pos = h->apt_pos;
+      value = h->apt_value;
+      for (i = 0; i < n; i++)
+        {
+          if (0 == pos)
+            value = chunk[i * HEALTH_BLOCK_LEN];
+          apt[i] = value;
+          pos = (pos + HEALTH_BLOCK_LEN) % HEALTH_APT_WINDOW;
+        }
+
+      kernel (chunk, n, h->prev, apt, masks);
+
+      for (i = 0; i < n; i++)
+        if (!test_block (h, chunk + i * HEALTH_BLOCK_LEN, &masks[i], stats))
+          {
+            LCA_LOG (DEBUG, "Random block failed its health tests");
+            health_init (h);
+            return false;
+          }
+    }
+
+  return true;
+}
@@ -0,0 +1,90 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/* Continuous health tests from NIST SP 800-90B 4.4 over device Random
+   output, taken as byte samples with an assessed min-entropy of 4
+   bits each, half of full, and a false positive rate of 2^-20. */
+#define HEALTH_BLOCK_LEN 32
+/* 1 + ceil (20 / 4) identical samples in a row */
+#define HEALTH_RCT_CUTOFF 6
+#define HEALTH_APT_WINDOW 512
+/* 1 + critbinom (512, 2^-4, 1 - 2^-20) */
+#define HEALTH_APT_CUTOFF 62
+
+enum HEALTH_IMPL
+  {
+    HEALTH_AUTO = 0,
+    HEALTH_SCALAR,
+    HEALTH_AVX2
+  };
+
+struct health
+{
+  /* The block before the next one, once there is one */
+  uint8_t prev[HEALTH_BLOCK_LEN];
+  bool have_prev;
+  /* Samples ending the stream that repeat their predecessor */
+  unsigned int run;
+  /* The adaptive proportion window */
+  uint8_t apt_value;
+  unsigned int apt_pos;
+  unsigned int apt_count;
+};
+
+void
+health_init (struct health *h);
+
+/**
+ * Selects the kernel, for testing.  HEALTH_AUTO picks the widest the
+ * CPU supports.
+ *
+ * @param impl The kernel.
+ *
+ * @return False if the CPU lacks it.
+ */
+bool
+health_select (enum HEALTH_IMPL impl);
+
+/**
+ * Runs the repetition count and adaptive proportion tests over the
+ * next blocks of a stream, and rejects blocks that repeat the one
+ * before or match the device's known failure responses.  After a
+ * failure the stream starts over.
+ *
+ * @param h The stream state.
+ * @param blocks The samples.
+ * @param nblocks The number of HEALTH_BLOCK_LEN byte blocks.
+ * @param stats The counters to add to.
+ *
+ * @return True if every block passed.
+ */
+bool
+health_test (struct health *h, const uint8_t *blocks, size_t nblocks,
+             struct lca_health_stats *stats);
+
+#endif /* HEALTH_H */
@@ -0,0 +1,355 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2015 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../libcryptoauth.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LCA_HEX_X86 1
+#include <immintrin.h>
+#endif
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static const uint8_t HEX_VALUES[256] =
+  {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['A'] = 0x1A, ['B'] = 0x1B, ['C'] = 0x1C, ['D'] = 0x1D, ['E'] = 0x1E,
+    ['F'] = 0x1F,
+    ['a'] = 0x1A, ['b'] = 0x1B, ['c'] = 0x1C, ['d'] = 0x1D, ['e'] = 0x1E,
+    ['f'] = 0x1F
+  };
+
+/* The table is offset by 0x10 so that the zero initialized entries
+   are the invalid ones. */
+static inline unsigned int
+hex_value (unsigned char c)
+{
+  return (unsigned int)HEX_VALUES[c] - 0x10;
+}
+
+static void
+encode_scalar (const uint8_t *in, size_t len, char *out)
+{
+  size_t x;
+
+  for (x = 0; x < len; x++)
+    {
+      out[2 * x] = HEX_DIGITS[in[x] >> 4];
+      out[2 * x + 1] = HEX_DIGITS[in[x] & 0x0F];
+    }
+}
+
+static int
+decode_scalar (const char *in, size_t len, uint8_t *out)
+{
+  unsigned int bad = 0;
+  size_t x;
+
+  for (x = 0; x < len / 2; x++)
+    {
+      unsigned int hi = hex_value ((unsigned char)in[2 * x]);
+      unsigned int lo = hex_value ((unsigned char)in[2 * x + 1]);
+
+      bad |= (hi | lo) & ~0x0FU;
+      out[x] = (uint8_t)((hi << 4) | (lo & 0x0F));
+    }
+
+  return bad ? -1 : 0;
+}
+
+#ifdef LCA_HEX_X86
+
+/* Encodes 16 bytes into 32 characters. */
+__attribute__ ((target ("ssse3")))
+static size_t
+encode_ssse3 (const uint8_t *in, size_t len, char *out)
+{
+  const __m128i digits = _mm_loadu_si128 ((const __m128i *)HEX_DIGITS);
+  const __m128i low_mask = _mm_set1_epi8 (0x0F);
+  size_t done = 0;
+
+  for (; done + 16 <= len; done += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *)(in + done));
+      __m128i hi = _mm_and_si128 (_mm_srli_epi16 (v, 4), low_mask);
+      __m128i lo = _mm_and_si128 (v, low_mask);
+
+      hi = _mm_shuffle_epi8 (digits, hi);
+      lo = _mm_shuffle_epi8 (digits, lo);
+
+      _mm_storeu_si128 ((__m128i *)(out + 2 * done),
+                        _mm_unpacklo_epi8 (hi, lo));
+      _mm_storeu_si128 ((__m128i *)(out + 2 * done + 16),
+                        _mm_unpackhi_epi8 (hi, lo));
+    }
+
+  return done;
+}
+
+/* Encodes 32 bytes into 64 characters. */
+__attribute__ ((target ("avx2")))
+static size_t
+encode_avx2 (const uint8_t *in, size_t len, char *out)
+{
+  const __m256i digits =
+    _mm256_broadcastsi128_si256 (_mm_loadu_si128 ((const __m128i *)HEX_DIGITS));
+  const __m256i low_mask = _mm256_set1_epi8 (0x0F);
+  size_t done = 0;
+
+  for (; done + 32 <= len; done += 32)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *)(in + done));
+      __m256i hi = _mm256_and_si256 (_mm256_srli_epi16 (v, 4), low_mask);
+      __m256i lo = _mm256_and_si256 (v, low_mask);
+
+      hi = _mm256_shuffle_epi8 (digits, hi);
+      lo = _mm256_shuffle_epi8 (digits, lo);
+
+      /* unpack works per 128 bit lane, so fix up the lane order */
+      __m256i a = _mm256_unpacklo_epi8 (hi, lo);
+      __m256i b = _mm256_unpackhi_epi8 (hi, lo);
+
+      _mm256_storeu_si256 ((__m256i *)(out + 2 * done),
+                           _mm256_permute2x128_si256 (a, b, 0x20));
+      _mm256_storeu_si256 ((__m256i *)(out + 2 * done + 32),
+                           _mm256_permute2x128_si256 (a, b, 0x31));
+    }
+
+  return done;
+}
+
+/* Converts 16 characters to their nibble values.  Invalid characters
+   set bits in *bad. */
+__attribute__ ((target ("ssse3")))
+static inline __m128i
+nibbles_ssse3 (__m128i c, __m128i *bad)
+{
+  const __m128i nine = _mm_set1_epi8 (9);
+  const __m128i five = _mm_set1_epi8 (5);
+
+  __m128i digit = _mm_sub_epi8 (c, _mm_set1_epi8 ('0'));
+  __m128i alpha = _mm_sub_epi8 (_mm_or_si128 (c, _mm_set1_epi8 (0x20)),
+                                _mm_set1_epi8 ('a'));
+
+  /* unsigned x <= k  <=>  min (x, k) == x */
+  __m128i is_digit = _mm_cmpeq_epi8 (_mm_min_epu8 (digit, nine), digit);
+  __m128i is_alpha = _mm_cmpeq_epi8 (_mm_min_epu8 (alpha, five), alpha);
+
+  *bad = _mm_or_si128 (*bad,
+                       _mm_andnot_si128 (_mm_or_si128 (is_digit, is_alpha),
+                                         _mm_set1_epi8 (-1)));
+
+  return _mm_or_si128 (_mm_and_si128 (is_digit, digit),
+                       _mm_and_si128 (is_alpha,
+                                      _mm_add_epi8 (alpha,
+                                                    _mm_set1_epi8 (10))));
+}
+
+/* Decodes 32 characters into 16 bytes. */
+__attribute__ ((target ("ssse3")))
+static size_t
+decode_ssse3 (const char *in, size_t len, uint8_t *out, int *rc)
+{
+  /* hi * 16 + lo for each (even, odd) pair of nibbles */
+  const __m128i weights = _mm_set1_epi16 (0x0110);
+  __m128i bad = _mm_setzero_si128 ();
+  size_t done = 0;
+
+  for (; done + 32 <= len; done += 32)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *)(in + done));
+      __m128i b = _mm_loadu_si128 ((const __m128i *)(in + done + 16));
+
+      a = _mm_maddubs_epi16 (nibbles_ssse3 (a, &bad), weights);
+      b = _mm_maddubs_epi16 (nibbles_ssse3 (b, &bad), weights);
+
+      _mm_storeu_si128 ((__m128i *)(out + done / 2), _mm_packus_epi16 (a, b));
+    }
+
+  if (0 != _mm_movemask_epi8 (bad))
+    *rc = -1;
+
+  return done;
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+nibbles_avx2 (__m256i c, __m256i *bad)
+{
+  const __m256i nine = _mm256_set1_epi8 (9);
+  const __m256i five = _mm256_set1_epi8 (5);
+
+  __m256i digit = _mm256_sub_epi8 (c, _mm256_set1_epi8 ('0'));
+  __m256i alpha = _mm256_sub_epi8 (_mm256_or_si256 (c,
+                                                    _mm256_set1_epi8 (0x20)),
+                                   _mm256_set1_epi8 ('a'));
+
+  __m256i is_digit = _mm256_cmpeq_epi8 (_mm256_min_epu8 (digit, nine), digit);
+  __m256i is_alpha = _mm256_cmpeq_epi8 (_mm256_min_epu8 (alpha, five), alpha);
+
+  *bad = _mm256_or_si256 (*bad,
+                          _mm256_andnot_si256 (_mm256_or_si256 (is_digit,
+                                                                is_alpha),
+                                               _mm256_set1_epi8 (-1)));
+
+  return _mm256_or_si256 (_mm256_and_si256 (is_digit, digit),
+                          _mm256_and_si256 (is_alpha,
+                                            _mm256_add_epi8
+                                            (alpha, _mm256_set1_epi8 (10))));
+}
+
+/* Decodes 64 characters into 32 bytes. */
+__attribute__ ((target ("avx2")))
+static size_t
+decode_avx2 (const char *in, size_t len, uint8_t *out, int *rc)
+{
+  const __m256i weights = _mm256_set1_epi16 (0x0110);
+  __m256i bad = _mm256_setzero_si256 ();
+  size_t done = 0;
+
+  for (; done + 64 <= len; done += 64)
+    {
+      __m256i a = _mm256_loadu_si256 ((const __m256i *)(in + done));
+      __m256i b = _mm256_loadu_si256 ((const __m256i *)(in + done + 32));
+
+      a = _mm256_maddubs_epi16 (nibbles_avx2 (a, &bad), weights);
+      b = _mm256_maddubs_epi16 (nibbles_avx2 (b, &bad), weights);
+
+      /* packus interleaves the lanes: a.lo b.lo a.hi b.hi */
+      __m256i packed = _mm256_permute4x64_epi64 (_mm256_packus_epi16 (a, b),
+                                                 0xD8);
+
+      _mm256_storeu_si256 ((__m256i *)(out + done / 2), packed);
+    }
+
+  if (0 != _mm256_movemask_epi8 (bad))
+    *rc = -1;
+
+  return done;
+}
+
+enum HEX_IMPL
+  {
+    HEX_UNKNOWN = 0,
+    HEX_SCALAR,
+    HEX_SSSE3,
+    HEX_AVX2
+  };
+
+static enum HEX_IMPL
+hex_impl (void)
+{
+  static enum HEX_IMPL impl = HEX_UNKNOWN;
+
+  if (HEX_UNKNOWN == impl)
+    {
+      __builtin_cpu_init ();
+
+      if (__builtin_cpu_supports ("avx2"))
+        impl = HEX_AVX2;
+      else if (__builtin_cpu_supports ("ssse3"))
+        impl = HEX_SSSE3;
+      else
+        impl = HEX_SCALAR;
+    }
+
+  return impl;
+}
+
+#endif /* LCA_HEX_X86 */
+
+void
+lca_hex_encode (const uint8_t *in, size_t len, char *out)
+{
+  size_t done = 0;
+
+  assert (NULL != in || 0 == len);
+  assert (NULL != out || 0 == len);
+
+#ifdef LCA_HEX_X86
+  switch (hex_impl ())
+    {
+    case HEX_AVX2:
+      done = encode_avx2 (in, len, out);
+      /* fall through - pick up a 16 byte tail */
+    case HEX_SSSE3:
+      done += encode_ssse3 (in + done, len - done, out + 2 * done);
+      break;
+    default:
+      break;
+    }
+#endif
+
+  encode_scalar (in + done, len - done, out + 2 * done);
+}
+
+int
+lca_hex_decode (const char *in, size_t len, uint8_t *out)
+{
+  size_t done = 0;
+  int rc = 0;
+
+  assert (NULL != in || 0 == len);
+  assert (NULL != out || 0 == len);
+
+  if (0 != len % 2)
+    return -1;
+
+#ifdef LCA_HEX_X86
+  switch (hex_impl ())
+    {
+    case HEX_AVX2:
+      done = decode_avx2 (in, len, out, &rc);
+      /* fall through */
+    case HEX_SSSE3:
+      done += decode_ssse3 (in + done, len - done, out + done / 2, &rc);
+      break;
+    default:
+      break;
+    }
+#endif
+
+  if (0 != decode_scalar (in + done, len - done, out + done / 2))
+    rc = -1;
+
+  return rc;
+}
+
+const char*
+lca_octet_buffer2hex_string (struct lca_octet_buffer buf)
+{
+  char *str;
+
+  assert (NULL != buf.ptr || 0 == buf.len);
+
+  str = malloc (2 * (size_t)buf.len + 1);
+  assert (NULL != str);
+
+  lca_hex_encode (buf.ptr, buf.len, str);
+  str[2 * (size_t)buf.len] = '\0';
+
+  return str;
+}
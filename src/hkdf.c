@@ -21,9 +21,17 @@
 #include "config.h"
 
 #include <assert.h>
-#include <gcrypt.h>
+#include <string.h>
 #include "../libcryptoauth.h"
 #include "hash.h"
+#include "sha256.h"
+#include "sha256_mb.h"
+#include "util.h"
+
+/* Output block T(i) is HMAC (PRK, T(i-1) || info || i).  Labels up to
+   this long make that a single block after the ipad block, which the
+   batch call hashes side by side. */
+#define LANE_INFO_MAX (SHA256_BLOCK_LEN - SHA256_DIGEST_LEN - 1 - 9)
 
 /*
  *  hkdfExtract
@@ -57,48 +65,249 @@ lca_hkdf_256_extract( const uint8_t *salt, int salt_len,
                       const uint8_t *ikm, int ikm_len,
                       uint8_t prk[LCA_SHA256_DLEN])
 {
-  unsigned char nullSalt[LCA_SHA256_DLEN];
-  struct lca_octet_buffer saltb, keyb, prkb;
+  struct lca_hmac_ctx hmac;
 
-  assert (salt >= 0);
-  assert (ikm);
+  assert (NULL != ikm || 0 == ikm_len);
   assert (prk);
 
-  if (salt == 0)
+  /* A missing salt is HashLen zeros, the same key as no key at all */
+  lca_hmac_init (&hmac, salt, NULL != salt ? salt_len : 0);
+  lca_hmac_compute (&hmac, ikm, ikm_len, prk);
+  lca_hmac_wipe (&hmac);
+
+  return 0;
+}
+
+void
+lca_hkdf_init (struct lca_hkdf_ctx *ctx, const uint8_t *salt, size_t salt_len,
+               const uint8_t *ikm, size_t ikm_len)
+{
+  uint8_t prk[LCA_SHA256_DLEN];
+
+  assert (NULL != ctx);
+
+  lca_hkdf_256_extract (salt, salt_len, ikm, ikm_len, prk);
+  lca_hkdf_init_prk (ctx, prk, sizeof (prk));
+
+  smemset (prk, 0, sizeof (prk));
+}
+
+void
+lca_hkdf_init_prk (struct lca_hkdf_ctx *ctx, const uint8_t *prk,
+                   size_t prk_len)
+{
+  assert (NULL != ctx); assert (NULL != prk);
+
+  lca_hmac_init (&ctx->prk, prk, prk_len);
+}
+
+void
+lca_hkdf_wipe (struct lca_hkdf_ctx *ctx)
+{
+  assert (NULL != ctx);
+
+  lca_hmac_wipe (&ctx->prk);
+}
+
+void
+lca_hkdf_start (struct lca_hkdf_stream *s, const struct lca_hkdf_ctx *ctx,
+                const uint8_t *info, size_t info_len)
+{
+  assert (NULL != s); assert (NULL != ctx);
+  assert (NULL != info || 0 == info_len);
+
+  s->ctx = ctx;
+  s->info = info;
+  s->info_len = info_len;
+  s->counter = 0;
+  s->used = sizeof (s->block);
+}
+
+/* Replaces T(i) with T(i + 1) */
+static void
+next_block (struct lca_hkdf_stream *s)
+{
+  const uint8_t c = ++s->counter;
+  struct sha256_ctx sha;
+  uint8_t inner[SHA256_DIGEST_LEN];
+
+  sha256_resume (&sha, s->ctx->prk.inner, SHA256_BLOCK_LEN);
+  if (c > 1)
+    sha256_update (&sha, s->block, sizeof (s->block));
+  sha256_update (&sha, s->info, s->info_len);
+  sha256_update (&sha, &c, 1);
+  sha256_final (&sha, inner);
+
+  sha256_resume (&sha, s->ctx->prk.outer, SHA256_BLOCK_LEN);
+  sha256_update (&sha, inner, sizeof (inner));
+  sha256_final (&sha, s->block);
+
+  s->used = 0;
+
+  smemset (inner, 0, sizeof (inner));
+  smemset (&sha, 0, sizeof (sha));
+}
+
+bool
+lca_hkdf_read (struct lca_hkdf_stream *s, uint8_t *out, size_t len)
+{
+  size_t produced, n;
+
+  assert (NULL != s); assert (NULL != out || 0 == len);
+
+  produced = s->counter * sizeof (s->block) + s->used - sizeof (s->block);
+
+  if (len > LCA_HKDF_MAX_LEN - produced)
+    return false;
+
+  while (len > 0)
     {
-      salt = nullSalt;
-      salt_len = LCA_SHA256_DLEN;
-      memset(nullSalt, '\0', salt_len);
+      if (sizeof (s->block) == s->used)
+        next_block (s);
+
+      n = sizeof (s->block) - s->used;
+      if (n > len)
+        n = len;
+
+      memcpy (out, s->block + s->used, n);
+      s->used += n;
+      out += n;
+      len -= n;
     }
 
-  saltb.ptr = salt;
-  saltb.len = salt_len;
+  return true;
+}
+
+void
+lca_hkdf_stream_wipe (struct lca_hkdf_stream *s)
+{
+  assert (NULL != s);
+
+  smemset (s, 0, sizeof (*s));
+}
 
-  keyb.ptr = ikm;
-  keyb.len = ikm_len;
+static unsigned int
+item_blocks (const struct lca_hkdf_item *it)
+{
+  return (it->len + LCA_SHA256_DLEN - 1) / LCA_SHA256_DLEN;
+}
 
-  prkb = hmac_buffer (keyb, saltb);
+/* T(round) for n short label items at once, reading T(round - 1)
+   back from their outputs */
+static void
+hash_round (const struct lca_hkdf_ctx *ctx, const struct lca_hkdf_item *items,
+            const unsigned int *idx, unsigned int n, unsigned int round)
+{
+  uint8_t lanes[SHA256_MB_LANES_MAX][SHA256_BLOCK_LEN];
+  uint32_t h[SHA256_MB_LANES_MAX][8];
+  uint8_t t[SHA256_DIGEST_LEN];
+  unsigned int x, len, offset;
 
-  if (NULL == prkb.ptr)
-    return -1;
-  else
+  assert (n > 0 && n <= SHA256_MB_LANES_MAX);
+
+  for (x = 0; x < n; x++)
     {
-      memcpy (prk, prkb.ptr, prkb.len);
-      lca_free_octet_buffer(prkb);
+      const struct lca_hkdf_item *it = &items[idx[x]];
+
+      len = 0;
+      if (round > 1)
+        {
+          memcpy (lanes[x], it->okm + (round - 2) * SHA256_DIGEST_LEN,
+                  SHA256_DIGEST_LEN);
+          len = SHA256_DIGEST_LEN;
+        }
+      if (it->info_len > 0)
+        memcpy (lanes[x] + len, it->info, it->info_len);
+      len += it->info_len;
+      lanes[x][len++] = round;
+
+      sha256_mb_pad (lanes[x], len, SHA256_BLOCK_LEN + len, SHA256_BLOCK_LEN);
+      memcpy (h[x], ctx->prk.inner, sizeof (h[x]));
     }
 
-  return 0;
+  sha256_mb_blocks (h, lanes[0], SHA256_BLOCK_LEN, 1, n);
+
+  for (x = 0; x < n; x++)
+    {
+      sha256_state_bytes (h[x], lanes[x]);
+      sha256_mb_pad (lanes[x], SHA256_DIGEST_LEN,
+                     SHA256_BLOCK_LEN + SHA256_DIGEST_LEN, SHA256_BLOCK_LEN);
+      memcpy (h[x], ctx->prk.outer, sizeof (h[x]));
+    }
+
+  sha256_mb_blocks (h, lanes[0], SHA256_BLOCK_LEN, 1, n);
+
+  for (x = 0; x < n; x++)
+    {
+      const struct lca_hkdf_item *it = &items[idx[x]];
+
+      offset = (round - 1) * SHA256_DIGEST_LEN;
+      sha256_state_bytes (h[x], t);
+      memcpy (it->okm + offset, t, it->len - offset < sizeof (t)
+              ? it->len - offset : sizeof (t));
+    }
+
+  smemset (lanes, 0, sizeof (lanes));
+  smemset (h, 0, sizeof (h));
+  smemset (t, 0, sizeof (t));
 }
 
+bool
+lca_hkdf_expand_batch (const struct lca_hkdf_ctx *ctx,
+                       const struct lca_hkdf_item *items, unsigned int count)
+{
+  struct lca_hkdf_stream s;
+  unsigned int idx[SHA256_MB_LANES_MAX];
+  unsigned int x, n, round, rounds = 0;
+
+  assert (NULL != ctx);
+  assert (NULL != items || 0 == count);
+
+  for (x = 0; x < count; x++)
+    {
+      assert (NULL != items[x].okm || 0 == items[x].len);
+      assert (NULL != items[x].info || 0 == items[x].info_len);
+
+      if (items[x].len > LCA_HKDF_MAX_LEN)
+        return false;
+    }
+
+  /* Long labels are expanded one at a time */
+  for (x = 0; x < count; x++)
+    if (items[x].info_len > LANE_INFO_MAX)
+      {
+        lca_hkdf_start (&s, ctx, items[x].info, items[x].info_len);
+        lca_hkdf_read (&s, items[x].okm, items[x].len);
+        lca_hkdf_stream_wipe (&s);
+      }
+    else if (item_blocks (&items[x]) > rounds)
+      rounds = item_blocks (&items[x]);
+
+  /* Round i computes T(i) of every item that needs it */
+  for (round = 1; round <= rounds; round++)
+    for (x = 0, n = 0; x < count; x++)
+      {
+        if (items[x].info_len <= LANE_INFO_MAX
+            && item_blocks (&items[x]) >= round)
+          idx[n++] = x;
+
+        if (n > 0 && (SHA256_MB_LANES_MAX == n || count - 1 == x))
+          {
+            hash_round (ctx, items, idx, n, round);
+            n = 0;
+          }
+      }
+
+  return true;
+}
 
 int
 lca_hkdf_256_expand(const uint8_t prk[ ], int prk_len,
                     const unsigned char *info, int info_len,
                     uint8_t okm[ ], int okm_len)
 {
-  int hash_len, N;
-  unsigned char T[LCA_SHA256_DLEN];
-  int Tlen, where, i;
+  struct lca_hkdf_ctx ctx;
+  struct lca_hkdf_stream s;
 
   if (info == 0)
     {
@@ -106,49 +315,20 @@ lca_hkdf_256_expand(const uint8_t prk[ ], int prk_len,
       info_len = 0;
     }
 
-  assert (info > 0);
-
   assert (okm_len > 0);
   assert (okm);
 
-  hash_len = LCA_SHA256_DLEN;
-  if (prk_len < hash_len)
+  if (prk_len < LCA_SHA256_DLEN)
     return -2;
-  N = okm_len / hash_len;
-  if ((okm_len % hash_len) != 0) N++;
-  if (N > 255)
+  if (okm_len > LCA_HKDF_MAX_LEN)
     return -3;
 
-  /* setup hmac with gcrypt */
-  gcry_md_hd_t hd;
-  gcry_md_open (&hd, GCRY_MD_SHA256, GCRY_MD_FLAG_HMAC);
-
-  assert (NULL != hd);
-  gcry_md_setkey (hd, prk, prk_len);
-
-  Tlen = 0;
-  where = 0;
-  for (i = 1; i <= N; i++)
-    {
-      unsigned char c = i;
-      gcry_md_reset(hd);
-
-      gcry_md_write (hd, T, Tlen);
-      gcry_md_write (hd, info, info_len);
-      gcry_md_write (hd, &c, 1);
-
-      unsigned char *result = gcry_md_read (hd, GCRY_MD_SHA256);
-
-      if (result == NULL)
-        return -4;
-      memcpy (T, result, hash_len);
-      memcpy(okm + where, T,
-             (i != N) ? hash_len : (okm_len - where));
-      where += hash_len;
-      Tlen = hash_len;
-    }
+  lca_hkdf_init_prk (&ctx, prk, prk_len);
+  lca_hkdf_start (&s, &ctx, info, info_len);
+  lca_hkdf_read (&s, okm, okm_len);
 
-  gcry_md_close (hd);
+  lca_hkdf_stream_wipe (&s);
+  lca_hkdf_wipe (&ctx);
 
   return 0;
 }
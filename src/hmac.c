@@ -0,0 +1,143 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+#include "command_util.h"
+#include "hash.h"
+#include "sha256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+#define IPAD 0x36
+#define OPAD 0x5C
+
+static void
+absorb_pad (uint32_t *state, const uint8_t *key, uint8_t pad)
+{
+  uint8_t block[SHA256_BLOCK_LEN];
+  struct sha256_ctx sha;
+  unsigned int x;
+
+  for (x = 0; x < SHA256_BLOCK_LEN; x++)
+    block[x] = key[x] ^ pad;
+
+  sha256_init (&sha);
+  sha256_blocks (sha.h, block, 1);
+  memcpy (state, sha.h, sizeof (sha.h));
+
+  smemset (block, 0, sizeof (block));
+  smemset (&sha, 0, sizeof (sha));
+}
+
+void
+lca_hmac_init (struct lca_hmac_ctx *ctx, const uint8_t *key, size_t key_len)
+{
+  uint8_t k[SHA256_BLOCK_LEN];
+
+  assert (NULL != ctx);
+  assert (NULL != key || 0 == key_len);
+
+  memset (k, 0, sizeof (k));
+
+  if (key_len > SHA256_BLOCK_LEN)
+    sha256 (key, key_len, k);
+  else if (key_len > 0)
+    memcpy (k, key, key_len);
+
+  absorb_pad (ctx->inner, k, IPAD);
+  absorb_pad (ctx->outer, k, OPAD);
+
+  smemset (k, 0, sizeof (k));
+}
+
+void
+lca_hmac_wipe (struct lca_hmac_ctx *ctx)
+{
+  assert (NULL != ctx);
+
+  smemset (ctx, 0, sizeof (*ctx));
+}
+
+void
+lca_hmac_compute (const struct lca_hmac_ctx *ctx, const uint8_t *msg,
+                  size_t len, uint8_t *mac)
+{
+  struct sha256_ctx sha;
+  uint8_t inner[SHA256_DIGEST_LEN];
+
+  assert (NULL != ctx);
+  assert (NULL != mac);
+
+  sha256_resume (&sha, ctx->inner, SHA256_BLOCK_LEN);
+  sha256_update (&sha, msg, len);
+  sha256_final (&sha, inner);
+
+  sha256_resume (&sha, ctx->outer, SHA256_BLOCK_LEN);
+  sha256_update (&sha, inner, sizeof (inner));
+  sha256_final (&sha, mac);
+
+  smemset (inner, 0, sizeof (inner));
+}
+
+bool
+lca_hmac_verify (const struct lca_hmac_ctx *ctx, const uint8_t *msg,
+                 size_t len, const uint8_t *mac)
+{
+  uint8_t expected[SHA256_DIGEST_LEN];
+  bool result;
+
+  assert (NULL != mac);
+
+  lca_hmac_compute (ctx, msg, len, expected);
+  result = cmemeq (expected, mac, sizeof (expected));
+
+  smemset (expected, 0, sizeof (expected));
+
+  return result;
+}
+
+void
+lca_hmac_defaults (const struct lca_hmac_ctx *ctx, const uint8_t *challenge,
+                   uint8_t key_slot, uint8_t *mac)
+{
+  const uint8_t zeros[32] = {0};
+  const uint8_t MODE = 0x04;
+  uint8_t msg[DEFAULTS_MSG_LEN];
+
+  defaults_message (msg, zeros, challenge, COMMAND_HMAC, MODE, key_slot);
+  lca_hmac_compute (ctx, msg, sizeof (msg), mac);
+}
+
+bool
+lca_hmac_verify_defaults (const struct lca_hmac_ctx *ctx,
+                          const uint8_t *challenge, const uint8_t *response,
+                          uint8_t key_slot)
+{
+  const uint8_t zeros[32] = {0};
+  const uint8_t MODE = 0x04;
+  uint8_t msg[DEFAULTS_MSG_LEN];
+
+  defaults_message (msg, zeros, challenge, COMMAND_HMAC, MODE, key_slot);
+
+  return lca_hmac_verify (ctx, msg, sizeof (msg), response);
+}
@@ -31,6 +31,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include "../libcryptoauth.h"
+#include "devstore.h"
+#include "ecdh_cache.h"
+#include "verify_cache.h"
 
 int
 lca_setup(const char* bus)
@@ -82,6 +85,8 @@ lca_wakeup(int fd)
   if(fcntl(fd, F_GETFD) < 0)
     perror("Invalid FD.\n");
 
+  lca_device_lock (fd);
+
   while (!awake)
     {
       if (write(fd,&wup,sizeof(wup)) > 1)
@@ -102,6 +107,8 @@ lca_wakeup(int fd)
         }
     }
 
+  lca_device_unlock (fd);
+
   return awake;
 
 }
@@ -111,8 +118,18 @@ lca_sleep_device(int fd)
 {
 
   unsigned char sleep_byte[] = {0x01};
+  int result;
+
+  lca_device_lock (fd);
 
-  return write(fd, sleep_byte, sizeof(sleep_byte));
+  /* TempKey does not survive sleep */
+  verify_cache_forget_tempkey (fd);
+
+  result = write(fd, sleep_byte, sizeof(sleep_byte));
+
+  lca_device_unlock (fd);
+
+  return result;
 
 
 }
@@ -125,11 +142,15 @@ lca_idle(int fd)
 
   uint8_t idle [] = {0x02};
 
+  lca_device_lock (fd);
+
   if (1 == write(fd, idle, sizeof(idle)))
     {
       result = true;
     }
 
+  lca_device_unlock (fd);
+
   return result;
 
 }
@@ -195,6 +216,8 @@ lca_atmel_setup(const char *bus, unsigned int addr)
     int fd = open (bus, O_RDWR);
 #endif
 
+    lca_flush_zone_cache (fd);
+
     return fd;
 
 }
@@ -206,6 +229,10 @@ lca_atmel_teardown(int fd)
     lca_sleep_device(fd);
 #endif
 
+    lca_flush_zone_cache (fd);
+    devstore_detach (fd);
+    ecdh_cache_invalidate_device (fd);
+
     close(fd);
 
 }
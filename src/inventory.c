@@ -0,0 +1,237 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* The index is a header followed by lca_inventory_entry records
+   sorted by serial number, then slot.  The serial number and slot
+   are the first LCA_SERIAL_NUM_LEN + 1 bytes of a record, so the
+   mapped file is searched in place with memcmp. */
+
+#define INVENTORY_MAGIC "LCAINV1"
+#define INVENTORY_VERSION 1
+#define INVENTORY_KEY_LEN (LCA_SERIAL_NUM_LEN + 1)
+
+struct inventory_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct lca_inventory
+{
+  void *map;
+  size_t size;
+  const struct lca_inventory_entry *entries;
+  uint32_t count;
+};
+
+static int
+compare_entries (const void *a, const void *b)
+{
+  return memcmp (a, b, INVENTORY_KEY_LEN);
+}
+
+int
+lca_inventory_write (const char *path,
+                     struct lca_inventory_entry *entries, size_t count)
+{
+  struct inventory_header h;
+  char *tmp_path = NULL;
+  FILE *fp = NULL;
+  size_t x;
+  int rc = -1;
+
+  assert (NULL != path);
+  assert (NULL != entries || 0 == count);
+
+  if (count > UINT32_MAX)
+    return -1;
+
+  qsort (entries, count, sizeof (*entries), compare_entries);
+
+  for (x = 1; x < count; x++)
+    if (0 == compare_entries (&entries[x - 1], &entries[x]))
+      {
+        LCA_LOG (DEBUG, "Duplicate inventory entry for slot %u",
+                 entries[x].slot);
+        return -2;
+      }
+
+  memset (&h, 0, sizeof (h));
+  memcpy (h.magic, INVENTORY_MAGIC, sizeof (h.magic));
+  h.version = INVENTORY_VERSION;
+  h.entry_size = sizeof (struct lca_inventory_entry);
+  h.count = count;
+
+  /* Write a new file and rename it over the old one, so readers
+     never map a half written index. */
+  if (NULL == (tmp_path = malloc (strlen (path) + sizeof (".tmp"))))
+    return -1;
+
+  sprintf (tmp_path, "%s.tmp", path);
+
+  if (NULL == (fp = fopen (tmp_path, "wb")))
+    goto OUT;
+
+  if (1 != fwrite (&h, sizeof (h), 1, fp)
+      || count != fwrite (entries, sizeof (*entries), count, fp))
+    {
+      fclose (fp);
+      unlink (tmp_path);
+      goto OUT;
+    }
+
+  if (0 != fclose (fp) || 0 != rename (tmp_path, path))
+    {
+      unlink (tmp_path);
+      goto OUT;
+    }
+
+  rc = 0;
+
+ OUT:
+  free (tmp_path);
+  return rc;
+}
+
+struct lca_inventory *
+lca_inventory_open (const char *path)
+{
+  struct lca_inventory *inv = NULL;
+  const struct inventory_header *h;
+  struct stat st;
+  void *map;
+  int fd;
+
+  assert (NULL != path);
+
+  if ((fd = open (path, O_RDONLY)) < 0)
+    return NULL;
+
+  if (0 != fstat (fd, &st)
+      || (size_t) st.st_size < sizeof (struct inventory_header))
+    {
+      close (fd);
+      return NULL;
+    }
+
+  map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (MAP_FAILED == map)
+    return NULL;
+
+  h = map;
+
+  if (0 != memcmp (h->magic, INVENTORY_MAGIC, sizeof (h->magic))
+      || INVENTORY_VERSION != h->version
+      || sizeof (struct lca_inventory_entry) != h->entry_size
+      || sizeof (*h) + (size_t) h->count * h->entry_size
+         != (size_t) st.st_size)
+    {
+      LCA_LOG (DEBUG, "%s is not an inventory index", path);
+      munmap (map, st.st_size);
+      return NULL;
+    }
+
+  /* Lookups touch a handful of pages each */
+  madvise (map, st.st_size, MADV_RANDOM);
+
+  inv = malloc (sizeof (*inv));
+  assert (NULL != inv);
+
+  inv->map = map;
+  inv->size = st.st_size;
+  inv->entries = (const struct lca_inventory_entry *)
+    ((const uint8_t *) map + sizeof (*h));
+  inv->count = h->count;
+
+  return inv;
+}
+
+void
+lca_inventory_close (struct lca_inventory *inv)
+{
+  if (NULL == inv)
+    return;
+
+  munmap (inv->map, inv->size);
+  free (inv);
+}
+
+uint32_t
+lca_inventory_size (const struct lca_inventory *inv)
+{
+  assert (NULL != inv);
+
+  return inv->count;
+}
+
+const uint8_t *
+lca_inventory_lookup (const struct lca_inventory *inv,
+                      const uint8_t *serial, uint8_t slot)
+{
+  uint8_t key[INVENTORY_KEY_LEN];
+  const struct lca_inventory_entry *e;
+
+  assert (NULL != inv);
+  assert (NULL != serial);
+
+  memcpy (key, serial, LCA_SERIAL_NUM_LEN);
+  key[LCA_SERIAL_NUM_LEN] = slot;
+
+  e = bsearch (key, inv->entries, inv->count, sizeof (*e), compare_entries);
+
+  return NULL != e ? e->pub_key : NULL;
+}
+
+bool
+lca_inventory_verify (const struct lca_inventory *inv,
+                      const uint8_t *serial, uint8_t slot,
+                      struct lca_octet_buffer signature,
+                      struct lca_octet_buffer sha256_digest)
+{
+  struct lca_octet_buffer pub_key;
+  const uint8_t *q = lca_inventory_lookup (inv, serial, slot);
+
+  if (NULL == q)
+    return false;
+
+  /* Verification only reads the key, so it is used in place */
+  pub_key.ptr = (uint8_t *) q;
+  pub_key.len = LCA_TAGGED_PUB_KEY_LEN;
+
+  return lca_ecdsa_p256_verify (pub_key, signature, sha256_digest);
+}
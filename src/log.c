@@ -26,6 +26,10 @@
 
 static enum LCA_LOG_LEVEL CURRENT_LOG_LEVEL = INFO;
 
+/* Hex dumps are formatted in chunks of this many bytes so the whole
+   dump costs a handful of writes instead of a printf per byte. */
+#define HEX_CHUNK 64
+
 void
 LCA_LOG(enum LCA_LOG_LEVEL lvl, const char *format, ...)
 {
@@ -53,17 +57,33 @@ lca_print_hex_string(const char *str, const uint8_t *hex, unsigned int len)
   if (CURRENT_LOG_LEVEL < DEBUG)
     return;
 
-  unsigned int i;
+  char encoded[2 * HEX_CHUNK];
+  char line[5 * HEX_CHUNK];
+  unsigned int i, x;
 
   assert(NULL != str);
   assert(NULL != hex);
 
   printf("%s : ", str);
 
-  for (i = 0; i < len; i++)
+  for (i = 0; i < len; i += HEX_CHUNK)
     {
-      if (i > 0) printf(" ");
-      printf("0x%02X", hex[i]);
+      unsigned int n = (len - i < HEX_CHUNK) ? len - i : HEX_CHUNK;
+      char *p = line;
+
+      lca_hex_encode (hex + i, n, encoded);
+
+      for (x = 0; x < n; x++)
+        {
+          if (i + x > 0)
+            *p++ = ' ';
+          *p++ = '0';
+          *p++ = 'x';
+          *p++ = encoded[2 * x];
+          *p++ = encoded[2 * x + 1];
+        }
+
+      fwrite (line, 1, p - line, stdout);
     }
 
   printf("\n");
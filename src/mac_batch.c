@@ -0,0 +1,162 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+#include "command_util.h"
+#include "hash.h"
+#include "sha256.h"
+#include "sha256_mb.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* The 88 byte defaults message pads to two blocks, and so does the
+   HMAC inner hash, which starts after the key block. */
+#define MSG_BLOCKS 2
+#define MSG_STRIDE (MSG_BLOCKS * SHA256_BLOCK_LEN)
+
+static const uint32_t H0[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static unsigned int
+record (uint8_t *results, unsigned int index, bool ok)
+{
+  if (ok)
+    results[index / 8] |= 1 << (index % 8);
+  else
+    results[index / 8] &= ~(1 << (index % 8));
+
+  return ok ? 1 : 0;
+}
+
+unsigned int
+lca_verify_mac_batch (const struct lca_mac_item *items, unsigned int count,
+                      uint8_t *results)
+{
+  uint8_t lanes[SHA256_MB_LANES_MAX][MSG_STRIDE];
+  uint32_t h[SHA256_MB_LANES_MAX][8];
+  uint8_t digest[SHA256_DIGEST_LEN];
+  unsigned int base, n, x, matched = 0;
+
+  assert (NULL != items || 0 == count);
+  assert (NULL != results || 0 == count);
+
+  for (base = 0; base < count; base += n)
+    {
+      n = count - base < SHA256_MB_LANES_MAX
+        ? count - base : SHA256_MB_LANES_MAX;
+
+      for (x = 0; x < n; x++)
+        {
+          const struct lca_mac_item *it = &items[base + x];
+
+          assert (NULL != it->key && NULL != it->challenge);
+
+          defaults_message (lanes[x], it->key, it->challenge, COMMAND_MAC,
+                            0, it->key_slot);
+          sha256_mb_pad (lanes[x], DEFAULTS_MSG_LEN, DEFAULTS_MSG_LEN,
+                         MSG_STRIDE);
+          memcpy (h[x], H0, sizeof (H0));
+        }
+
+      sha256_mb_blocks (h, lanes[0], MSG_STRIDE, MSG_BLOCKS, n);
+
+      for (x = 0; x < n; x++)
+        {
+          sha256_state_bytes (h[x], digest);
+          matched += record (results, base + x,
+                             cmemeq (digest, items[base + x].response,
+                                     sizeof (digest)));
+        }
+    }
+
+  smemset (lanes, 0, sizeof (lanes));
+  smemset (h, 0, sizeof (h));
+  smemset (digest, 0, sizeof (digest));
+
+  return matched;
+}
+
+unsigned int
+lca_verify_hmac_batch (const struct lca_hmac_item *items, unsigned int count,
+                       uint8_t *results)
+{
+  const uint8_t zeros[32] = {0};
+  const uint8_t MODE = 0x04;
+  uint8_t lanes[SHA256_MB_LANES_MAX][MSG_STRIDE];
+  uint32_t h[SHA256_MB_LANES_MAX][8];
+  uint8_t digest[SHA256_DIGEST_LEN];
+  unsigned int base, n, x, matched = 0;
+
+  assert (NULL != items || 0 == count);
+  assert (NULL != results || 0 == count);
+
+  for (base = 0; base < count; base += n)
+    {
+      n = count - base < SHA256_MB_LANES_MAX
+        ? count - base : SHA256_MB_LANES_MAX;
+
+      /* Inner hash, resumed after the ipad block */
+      for (x = 0; x < n; x++)
+        {
+          const struct lca_hmac_item *it = &items[base + x];
+
+          assert (NULL != it->ctx && NULL != it->challenge);
+
+          defaults_message (lanes[x], zeros, it->challenge, COMMAND_HMAC,
+                            MODE, it->key_slot);
+          sha256_mb_pad (lanes[x], DEFAULTS_MSG_LEN,
+                         SHA256_BLOCK_LEN + DEFAULTS_MSG_LEN, MSG_STRIDE);
+          memcpy (h[x], it->ctx->inner, sizeof (h[x]));
+        }
+
+      sha256_mb_blocks (h, lanes[0], MSG_STRIDE, MSG_BLOCKS, n);
+
+      /* Outer hash, one block after the opad block */
+      for (x = 0; x < n; x++)
+        {
+          sha256_state_bytes (h[x], lanes[x]);
+          sha256_mb_pad (lanes[x], SHA256_DIGEST_LEN,
+                         SHA256_BLOCK_LEN + SHA256_DIGEST_LEN,
+                         SHA256_BLOCK_LEN);
+          memcpy (h[x], items[base + x].ctx->outer, sizeof (h[x]));
+        }
+
+      sha256_mb_blocks (h, lanes[0], MSG_STRIDE, 1, n);
+
+      for (x = 0; x < n; x++)
+        {
+          sha256_state_bytes (h[x], digest);
+          matched += record (results, base + x,
+                             cmemeq (digest, items[base + x].response,
+                                     sizeof (digest)));
+        }
+    }
+
+  smemset (lanes, 0, sizeof (lanes));
+  smemset (h, 0, sizeof (h));
+  smemset (digest, 0, sizeof (digest));
+
+  return matched;
+}
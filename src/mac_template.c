@@ -0,0 +1,175 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+#include "command_util.h"
+#include "hash.h"
+#include "sha256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* The first block of the message is the two 32 byte inputs, and it is
+   the only one that varies per challenge.  The second holds the tail
+   and the padding, which depend only on the template; for HMAC the
+   length also counts the ipad block. */
+
+#define MAC_RESERVED_BITS 0x88
+#define HMAC_RESERVED_BITS (0x88 | LCA_MAC_MODE_CHALLENGE_TEMPKEY \
+                            | LCA_MAC_MODE_KEY_TEMPKEY)
+
+static void
+pad_last (uint8_t *last, uint64_t total)
+{
+  const uint64_t bits = total * 8;
+  unsigned int x;
+
+  last[MESSAGE_TAIL_LEN] = 0x80;
+  memset (last + MESSAGE_TAIL_LEN + 1, 0,
+          SHA256_BLOCK_LEN - MESSAGE_TAIL_LEN - 1);
+
+  for (x = 0; x < 8; x++)
+    last[SHA256_BLOCK_LEN - 1 - x] = bits >> (x * 8);
+}
+
+bool
+lca_mac_template_init (struct lca_mac_template *t, uint8_t opcode,
+                       uint8_t mode, uint8_t key_slot, const uint8_t *key,
+                       const uint8_t *otp, const uint8_t *serial)
+{
+  assert (NULL != t);
+
+  memset (t, 0, sizeof (*t));
+
+  if (key_slot >= MAX_NUM_DATA_SLOTS)
+    return false;
+  if ((mode & (LCA_MAC_MODE_OTP88 | LCA_MAC_MODE_OTP64)) && NULL == otp)
+    return false;
+  if ((mode & LCA_MAC_MODE_SN) && NULL == serial)
+    return false;
+
+  switch (opcode)
+    {
+    case COMMAND_MAC:
+      if (mode & MAC_RESERVED_BITS)
+        return false;
+      if (!(mode & LCA_MAC_MODE_KEY_TEMPKEY))
+        {
+          if (NULL == key)
+            return false;
+          memcpy (t->key, key, sizeof (t->key));
+        }
+      message_tail (t->last, opcode, mode, key_slot, otp, serial);
+      pad_last (t->last, DEFAULTS_MSG_LEN);
+      break;
+    case COMMAND_HMAC:
+      if ((mode & HMAC_RESERVED_BITS) || NULL == key)
+        return false;
+      lca_hmac_init (&t->hmac, key, 32);
+      message_tail (t->last, opcode, mode, key_slot, otp, serial);
+      pad_last (t->last, SHA256_BLOCK_LEN + DEFAULTS_MSG_LEN);
+      break;
+    default:
+      return false;
+    }
+
+  t->opcode = opcode;
+  t->mode = mode;
+
+  return true;
+}
+
+void
+lca_mac_template_wipe (struct lca_mac_template *t)
+{
+  assert (NULL != t);
+
+  smemset (t, 0, sizeof (*t));
+}
+
+void
+lca_mac_compute (const struct lca_mac_template *t, const uint8_t *challenge,
+                 const uint8_t *tempkey, uint8_t *mac)
+{
+  const uint8_t zeros[32] = {0};
+  const uint8_t *first, *second;
+  uint8_t block[SHA256_BLOCK_LEN];
+  struct sha256_ctx sha;
+
+  assert (NULL != t); assert (NULL != mac);
+
+  if (COMMAND_MAC == t->opcode)
+    {
+      first = (t->mode & LCA_MAC_MODE_KEY_TEMPKEY) ? tempkey : t->key;
+      second = (t->mode & LCA_MAC_MODE_CHALLENGE_TEMPKEY)
+        ? tempkey : challenge;
+      sha256_init (&sha);
+    }
+  else
+    {
+      assert (COMMAND_HMAC == t->opcode);
+      first = zeros;
+      second = tempkey;
+      sha256_resume (&sha, t->hmac.inner, SHA256_BLOCK_LEN);
+    }
+
+  assert (NULL != first); assert (NULL != second);
+
+  memcpy (block, first, 32);
+  memcpy (block + 32, second, 32);
+  sha256_blocks (sha.h, block, 1);
+  sha256_blocks (sha.h, t->last, 1);
+
+  /* The padding is already in the last block, so the state is the
+     digest */
+  if (COMMAND_HMAC == t->opcode)
+    {
+      struct sha256_ctx outer;
+
+      sha256_resume (&outer, t->hmac.outer, SHA256_BLOCK_LEN);
+      sha256_state_bytes (sha.h, block);
+      sha256_update (&outer, block, SHA256_DIGEST_LEN);
+      sha256_final (&outer, mac);
+    }
+  else
+    sha256_state_bytes (sha.h, mac);
+
+  smemset (block, 0, sizeof (block));
+  smemset (&sha, 0, sizeof (sha));
+}
+
+bool
+lca_mac_verify (const struct lca_mac_template *t, const uint8_t *challenge,
+                const uint8_t *tempkey, const uint8_t *response)
+{
+  uint8_t expected[SHA256_DIGEST_LEN];
+  bool result;
+
+  assert (NULL != response);
+
+  lca_mac_compute (t, challenge, tempkey, expected);
+  result = cmemeq (expected, response, sizeof (expected));
+
+  smemset (expected, 0, sizeof (expected));
+
+  return result;
+}
@@ -0,0 +1,455 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "command_util.h"
+#include "merkle.h"
+#include "sha256.h"
+#include "sha256_mb.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* Leaves are SHA-256 (0x00 || digest) and nodes SHA-256 (0x01 || left
+   || right), as in RFC 6962, so a node can never pass as a leaf.  The
+   last node of an odd sized level moves up unhashed. */
+#define LEAF_PREFIX 0x00
+#define NODE_PREFIX 0x01
+#define LEAF_MSG_LEN (1 + LCA_SHA256_DLEN)
+#define NODE_MSG_LEN (1 + 2 * LCA_SHA256_DLEN)
+#define LANE_LEN (2 * SHA256_BLOCK_LEN)
+
+/* SHA-256s n messages of one length side by side */
+static void
+hash_many (const uint8_t *msgs, unsigned int len, unsigned int n,
+           uint8_t (*out)[LCA_SHA256_DLEN])
+{
+  const unsigned int nblocks = (len + 9 + SHA256_BLOCK_LEN - 1)
+    / SHA256_BLOCK_LEN;
+  uint8_t lanes[SHA256_MB_LANES_MAX][LANE_LEN];
+  uint32_t h[SHA256_MB_LANES_MAX][8];
+  struct sha256_ctx iv;
+  unsigned int base, lanes_n, x;
+
+  assert (nblocks * SHA256_BLOCK_LEN <= LANE_LEN);
+
+  sha256_init (&iv);
+
+  for (base = 0; base < n; base += lanes_n)
+    {
+      lanes_n = n - base < SHA256_MB_LANES_MAX
+        ? n - base : SHA256_MB_LANES_MAX;
+
+      for (x = 0; x < lanes_n; x++)
+        {
+          memcpy (lanes[x], msgs + (base + x) * len, len);
+          sha256_mb_pad (lanes[x], len, len, nblocks * SHA256_BLOCK_LEN);
+          memcpy (h[x], iv.h, sizeof (h[x]));
+        }
+
+      sha256_mb_blocks (h, lanes[0], LANE_LEN, nblocks, lanes_n);
+
+      for (x = 0; x < lanes_n; x++)
+        sha256_state_bytes (h[x], out[base + x]);
+    }
+}
+
+static void
+hash_node (const uint8_t *left, const uint8_t *right, uint8_t *out)
+{
+  uint8_t msg[NODE_MSG_LEN];
+
+  msg[0] = NODE_PREFIX;
+  memcpy (msg + 1, left, LCA_SHA256_DLEN);
+  memcpy (msg + 1 + LCA_SHA256_DLEN, right, LCA_SHA256_DLEN);
+
+  sha256 (msg, sizeof (msg), out);
+}
+
+bool
+lca_merkle_build (const uint8_t (*digests)[LCA_SHA256_DLEN],
+                  unsigned int count, uint8_t *root,
+                  struct lca_merkle_proof *proofs)
+{
+  uint8_t (*nodes)[LCA_SHA256_DLEN], *msgs;
+  unsigned int level[LCA_MERKLE_MAX_DEPTH + 1], start[LCA_MERKLE_MAX_DEPTH + 1];
+  unsigned int depth, x, i, idx, total;
+
+  assert (NULL != digests || 0 == count);
+  assert (NULL != root);
+
+  if (0 == count || count > LCA_MERKLE_MAX_LEAVES)
+    return false;
+
+  /* Level sizes and where each starts in nodes */
+  level[0] = count;
+  start[0] = 0;
+  for (depth = 0; level[depth] > 1; depth++)
+    {
+      level[depth + 1] = (level[depth] + 1) / 2;
+      start[depth + 1] = start[depth] + level[depth];
+    }
+  total = start[depth] + 1;
+
+  nodes = malloc (total * sizeof (*nodes));
+  msgs = malloc (count * NODE_MSG_LEN);
+  assert (NULL != nodes); assert (NULL != msgs);
+
+  for (x = 0; x < count; x++)
+    {
+      msgs[x * LEAF_MSG_LEN] = LEAF_PREFIX;
+      memcpy (msgs + x * LEAF_MSG_LEN + 1, digests[x], LCA_SHA256_DLEN);
+    }
+  hash_many (msgs, LEAF_MSG_LEN, count, nodes);
+
+  for (i = 0; i < depth; i++)
+    {
+      const uint8_t (*below)[LCA_SHA256_DLEN] = nodes + start[i];
+      const unsigned int pairs = level[i] / 2;
+
+      for (x = 0; x < pairs; x++)
+        {
+          msgs[x * NODE_MSG_LEN] = NODE_PREFIX;
+          memcpy (msgs + x * NODE_MSG_LEN + 1, below[2 * x],
+                  2 * LCA_SHA256_DLEN);
+        }
+      hash_many (msgs, NODE_MSG_LEN, pairs, nodes + start[i + 1]);
+
+      if (level[i] % 2)
+        memcpy (nodes[start[i + 1] + pairs], below[level[i] - 1],
+                LCA_SHA256_DLEN);
+    }
+
+  memcpy (root, nodes[start[depth]], LCA_SHA256_DLEN);
+
+  for (x = 0; NULL != proofs && x < count; x++)
+    {
+      struct lca_merkle_proof *p = &proofs[x];
+
+      p->index = x;
+      p->count = count;
+      p->depth = 0;
+
+      for (i = 0, idx = x; i < depth; i++, idx /= 2)
+        if ((idx ^ 1) < level[i])
+          memcpy (p->path[p->depth++], nodes[start[i] + (idx ^ 1)],
+                  LCA_SHA256_DLEN);
+    }
+
+  free (msgs);
+  free (nodes);
+
+  return true;
+}
+
+bool
+lca_merkle_root (const uint8_t *digest, const struct lca_merkle_proof *proof,
+                 uint8_t *root)
+{
+  uint8_t h[LCA_SHA256_DLEN], leaf[LEAF_MSG_LEN];
+  unsigned int idx, n, used = 0;
+
+  assert (NULL != digest); assert (NULL != proof); assert (NULL != root);
+
+  if (0 == proof->count || proof->count > LCA_MERKLE_MAX_LEAVES
+      || proof->index >= proof->count || proof->depth > LCA_MERKLE_MAX_DEPTH)
+    return false;
+
+  leaf[0] = LEAF_PREFIX;
+  memcpy (leaf + 1, digest, LCA_SHA256_DLEN);
+  sha256 (leaf, sizeof (leaf), h);
+
+  for (idx = proof->index, n = proof->count; n > 1; idx /= 2, n = (n + 1) / 2)
+    {
+      if ((idx ^ 1) >= n)
+        continue;
+
+      if (used == proof->depth)
+        return false;
+
+      if (idx % 2)
+        hash_node (proof->path[used], h, h);
+      else
+        hash_node (h, proof->path[used], h);
+
+      used++;
+    }
+
+  if (used != proof->depth)
+    return false;
+
+  memcpy (root, h, LCA_SHA256_DLEN);
+
+  return true;
+}
+
+bool
+lca_merkle_verify (const uint8_t *pub_key, const uint8_t *digest,
+                   const struct lca_merkle_proof *proof)
+{
+  uint8_t root[LCA_SHA256_DLEN];
+
+  assert (NULL != pub_key);
+
+  return lca_merkle_root (digest, proof, root)
+    && lca_p256_verify (pub_key, root, proof->signature);
+}
+
+/* A caller waiting in lca_merkle_sign */
+struct pending
+{
+  const uint8_t *digest;
+  struct lca_merkle_proof *proof;
+  bool done;
+  bool ok;
+};
+
+struct lca_merkle_signer
+{
+  pthread_mutex_t lock;
+  pthread_cond_t queued;
+  pthread_cond_t finished;
+  pthread_t thread;
+  merkle_sign_fn sign;
+  void *arg;
+  unsigned int window_us;
+  unsigned int max_batch;
+  /* Callers queue on one array while the thread signs the other */
+  struct pending **queue;
+  struct pending **batch;
+  unsigned int count;
+  bool stop;
+  /* For the device signer */
+  int fd;
+  uint8_t key_slot;
+};
+
+static void
+sign_batch (struct lca_merkle_signer *s, unsigned int n)
+{
+  uint8_t (*digests)[LCA_SHA256_DLEN] = malloc (n * sizeof (*digests));
+  struct lca_merkle_proof *proofs = malloc (n * sizeof (*proofs));
+  uint8_t root[LCA_SHA256_DLEN], sig[64];
+  unsigned int x;
+  bool ok;
+
+  assert (NULL != digests); assert (NULL != proofs);
+
+  for (x = 0; x < n; x++)
+    memcpy (digests[x], s->batch[x]->digest, LCA_SHA256_DLEN);
+
+  ok = lca_merkle_build ((const uint8_t (*)[LCA_SHA256_DLEN])digests, n,
+                         root, proofs)
+    && s->sign (s->arg, root, sig);
+
+  LCA_LOG (DEBUG, "Signed a root over %u digests: %s", n, ok ? "ok" : "failed");
+
+  for (x = 0; ok && x < n; x++)
+    {
+      memcpy (proofs[x].signature, sig, sizeof (sig));
+      memcpy (s->batch[x]->proof, &proofs[x], sizeof (proofs[x]));
+    }
+
+  pthread_mutex_lock (&s->lock);
+  for (x = 0; x < n; x++)
+    {
+      s->batch[x]->ok = ok;
+      s->batch[x]->done = true;
+    }
+  pthread_cond_broadcast (&s->finished);
+  pthread_mutex_unlock (&s->lock);
+
+  free (proofs);
+  free (digests);
+}
+
+static void *
+signer_main (void *arg)
+{
+  struct lca_merkle_signer *s = arg;
+  struct pending **swap;
+  struct timespec deadline;
+  unsigned int n;
+
+  pthread_mutex_lock (&s->lock);
+
+  for (;;)
+    {
+      while (!s->stop && 0 == s->count)
+        pthread_cond_wait (&s->queued, &s->lock);
+
+      if (0 == s->count)
+        break;
+
+      /* Collect for the window after the first digest, or until full */
+      clock_gettime (CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += (long)(s->window_us % 1000000) * 1000;
+      deadline.tv_sec += s->window_us / 1000000 + deadline.tv_nsec / 1000000000;
+      deadline.tv_nsec %= 1000000000;
+
+      while (!s->stop && s->count < s->max_batch)
+        if (ETIMEDOUT == pthread_cond_timedwait (&s->queued, &s->lock,
+                                                 &deadline))
+          break;
+
+      swap = s->batch;
+      s->batch = s->queue;
+      s->queue = swap;
+      n = s->count;
+      s->count = 0;
+
+      /* Callers blocked on a full queue may go on */
+      pthread_cond_broadcast (&s->finished);
+      pthread_mutex_unlock (&s->lock);
+
+      sign_batch (s, n);
+
+      pthread_mutex_lock (&s->lock);
+    }
+
+  pthread_mutex_unlock (&s->lock);
+
+  return NULL;
+}
+
+struct lca_merkle_signer *
+merkle_signer_new (merkle_sign_fn sign, void *arg, unsigned int window_us,
+                   unsigned int max_batch)
+{
+  struct lca_merkle_signer *s = calloc (1, sizeof (*s));
+
+  assert (NULL != s); assert (NULL != sign);
+  assert (max_batch > 0 && max_batch <= LCA_MERKLE_MAX_LEAVES);
+
+  s->sign = sign;
+  s->arg = arg;
+  s->window_us = window_us;
+  s->max_batch = max_batch;
+  s->fd = -1;
+  s->queue = calloc (max_batch, sizeof (*s->queue));
+  s->batch = calloc (max_batch, sizeof (*s->batch));
+  assert (NULL != s->queue); assert (NULL != s->batch);
+
+  pthread_mutex_init (&s->lock, NULL);
+  pthread_cond_init (&s->queued, NULL);
+  pthread_cond_init (&s->finished, NULL);
+
+  if (0 != pthread_create (&s->thread, NULL, signer_main, s))
+    {
+      pthread_cond_destroy (&s->finished);
+      pthread_cond_destroy (&s->queued);
+      pthread_mutex_destroy (&s->lock);
+      free (s->batch);
+      free (s->queue);
+      free (s);
+      return NULL;
+    }
+
+  return s;
+}
+
+static bool
+device_sign (void *arg, const uint8_t *digest, uint8_t *signature)
+{
+  struct lca_merkle_signer *s = arg;
+  struct lca_sign_item item = {digest, {0}, false};
+
+  if (1 != lca_ecc_sign_batch (s->fd, s->key_slot, &item, 1))
+    return false;
+
+  memcpy (signature, item.signature, sizeof (item.signature));
+
+  return true;
+}
+
+struct lca_merkle_signer *
+lca_merkle_signer_new (int fd, uint8_t key_slot, unsigned int window_us,
+                       unsigned int max_batch)
+{
+  struct lca_merkle_signer *s;
+
+  assert (fd >= 0); assert (key_slot < MAX_NUM_DATA_SLOTS);
+
+  /* device_sign only runs on the signer's thread, after these are set */
+  s = merkle_signer_new (device_sign, NULL, window_us, max_batch);
+  if (NULL != s)
+    {
+      pthread_mutex_lock (&s->lock);
+      s->arg = s;
+      s->fd = fd;
+      s->key_slot = key_slot;
+      pthread_mutex_unlock (&s->lock);
+    }
+
+  return s;
+}
+
+void
+lca_merkle_signer_free (struct lca_merkle_signer *s)
+{
+  if (NULL == s)
+    return;
+
+  /* Anything queued is still signed */
+  pthread_mutex_lock (&s->lock);
+  s->stop = true;
+  pthread_cond_signal (&s->queued);
+  pthread_mutex_unlock (&s->lock);
+
+  pthread_join (s->thread, NULL);
+
+  pthread_cond_destroy (&s->finished);
+  pthread_cond_destroy (&s->queued);
+  pthread_mutex_destroy (&s->lock);
+  free (s->batch);
+  free (s->queue);
+  free (s);
+}
+
+bool
+lca_merkle_sign (struct lca_merkle_signer *s, const uint8_t *digest,
+                 struct lca_merkle_proof *proof)
+{
+  struct pending p = {digest, proof, false, false};
+
+  assert (NULL != s); assert (NULL != digest); assert (NULL != proof);
+
+  pthread_mutex_lock (&s->lock);
+
+  while (s->count == s->max_batch)
+    pthread_cond_wait (&s->finished, &s->lock);
+
+  s->queue[s->count++] = &p;
+  if (1 == s->count || s->max_batch == s->count)
+    pthread_cond_signal (&s->queued);
+
+  while (!p.done)
+    pthread_cond_wait (&s->finished, &s->lock);
+
+  pthread_mutex_unlock (&s->lock);
+
+  return p.ok;
+}
@@ -0,0 +1,55 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/**
+ * Signs one digest for a batching signer.
+ *
+ * @param arg The signer's argument.
+ * @param digest The 32 byte Merkle root.
+ * @param signature The 64 byte r || s result.
+ *
+ * @return True if signed.
+ */
+typedef bool (*merkle_sign_fn) (void *arg, const uint8_t *digest,
+                                uint8_t *signature);
+
+/**
+ * Starts a batching signer that signs roots with any function, which
+ * lca_merkle_signer_new does with the device.
+ *
+ * @param sign The function, called on the signer's thread only.
+ * @param arg Its argument.
+ * @param window_us How long to collect digests after the first.
+ * @param max_batch The most digests per root.
+ *
+ * @return The signer, or NULL if its thread could not start.
+ */
+struct lca_merkle_signer *
+merkle_signer_new (merkle_sign_fn sign, void *arg, unsigned int window_us,
+                   unsigned int max_batch);
+
+#endif /* MERKLE_H */
@@ -0,0 +1,1076 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "p256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* Arithmetic is Montgomery multiplication over four 64 bit limbs, used
+   for both the field (mod p) and the scalars (mod n).  Points use the
+   complete addition formulas of Renes, Costello and Batina for a = -3,
+   which have no special cases, so secret scalar multiplication is a
+   fixed sequence of operations with table lookups done by masking. */
+
+typedef unsigned __int128 u128;
+
+struct p256_mod
+{
+  struct p256_fe m;
+  uint64_t inv;                 /* -m^-1 mod 2^64 */
+  struct p256_fe r2;            /* 2^512 mod m */
+  struct p256_fe one;           /* 2^256 mod m, i.e. 1 in Montgomery form */
+};
+
+static const struct p256_mod FP = {
+  {{0xffffffffffffffffULL, 0x00000000ffffffffULL,
+    0x0000000000000000ULL, 0xffffffff00000001ULL}},
+  0x1,
+  {{0x0000000000000003ULL, 0xfffffffbffffffffULL,
+    0xfffffffffffffffeULL, 0x00000004fffffffdULL}},
+  {{0x0000000000000001ULL, 0xffffffff00000000ULL,
+    0xffffffffffffffffULL, 0x00000000fffffffeULL}}
+};
+
+static const struct p256_mod FN = {
+  {{0xf3b9cac2fc632551ULL, 0xbce6faada7179e84ULL,
+    0xffffffffffffffffULL, 0xffffffff00000000ULL}},
+  0xccd1c8aaee00bc4fULL,
+  {{0x83244c95be79eea2ULL, 0x4699799c49bd6fa6ULL,
+    0x2845b2392b6bec59ULL, 0x66e12d94f3d95620ULL}},
+  {{0x0c46353d039cdaafULL, 0x4319055258e8617bULL,
+    0x0000000000000000ULL, 0x00000000ffffffffULL}}
+};
+
+/* b, Gx and Gy in Montgomery form */
+static const struct p256_fe B = {{0xd89cdf6229c4bddfULL, 0xacf005cd78843090ULL,
+                                  0xe5a220abf7212ed6ULL, 0xdc30061d04874834ULL}};
+
+static const struct p256_point G = {
+  {{0x79e730d418a9143cULL, 0x75ba95fc5fedb601ULL,
+    0x79fb732b77622510ULL, 0x18905f76a53755c6ULL}},
+  {{0xddf25357ce95560aULL, 0x8b4ab8e4ba19e45cULL,
+    0xd2e88688dd21f325ULL, 0x8571ff1825885d85ULL}},
+  {{0x0000000000000001ULL, 0xffffffff00000000ULL,
+    0xffffffffffffffffULL, 0x00000000fffffffeULL}}
+};
+
+static const struct p256_fe PLAIN_ONE = {{1, 0, 0, 0}};
+
+/* Subtracts m from t + hi * 2^256 if that does not go negative */
+static void
+reduce_once (struct p256_fe *r, const uint64_t *t, uint64_t hi,
+             const struct p256_mod *m)
+{
+  uint64_t s[4], borrow = 0, keep;
+  unsigned int i;
+
+  for (i = 0; i < 4; i++)
+    {
+      const u128 d = (u128)t[i] - m->m.v[i] - borrow;
+      s[i] = (uint64_t)d;
+      borrow = (uint64_t)(d >> 64) & 1;
+    }
+
+  keep = (uint64_t)0 - (borrow & (hi ^ 1));
+
+  for (i = 0; i < 4; i++)
+    r->v[i] = (t[i] & keep) | (s[i] & ~keep);
+}
+
+static void
+fe_add (struct p256_fe *r, const struct p256_fe *a, const struct p256_fe *b,
+        const struct p256_mod *m)
+{
+  uint64_t t[4], carry = 0;
+  unsigned int i;
+
+  for (i = 0; i < 4; i++)
+    {
+      const u128 s = (u128)a->v[i] + b->v[i] + carry;
+      t[i] = (uint64_t)s;
+      carry = (uint64_t)(s >> 64);
+    }
+
+  reduce_once (r, t, carry, m);
+}
+
+static void
+fe_sub (struct p256_fe *r, const struct p256_fe *a, const struct p256_fe *b,
+        const struct p256_mod *m)
+{
+  uint64_t t[4], borrow = 0, mask, carry = 0;
+  unsigned int i;
+
+  for (i = 0; i < 4; i++)
+    {
+      const u128 d = (u128)a->v[i] - b->v[i] - borrow;
+      t[i] = (uint64_t)d;
+      borrow = (uint64_t)(d >> 64) & 1;
+    }
+
+  mask = (uint64_t)0 - borrow;
+
+  for (i = 0; i < 4; i++)
+    {
+      const u128 s = (u128)t[i] + (m->m.v[i] & mask) + carry;
+      r->v[i] = (uint64_t)s;
+      carry = (uint64_t)(s >> 64);
+    }
+}
+
+static void
+fe_mul (struct p256_fe *r, const struct p256_fe *a, const struct p256_fe *b,
+        const struct p256_mod *m)
+{
+  uint64_t t[6] = {0, 0, 0, 0, 0, 0}, c, q;
+  unsigned int i, j;
+  u128 acc;
+
+  for (i = 0; i < 4; i++)
+    {
+      c = 0;
+      for (j = 0; j < 4; j++)
+        {
+          acc = (u128)a->v[j] * b->v[i] + t[j] + c;
+          t[j] = (uint64_t)acc;
+          c = (uint64_t)(acc >> 64);
+        }
+      acc = (u128)t[4] + c;
+      t[4] = (uint64_t)acc;
+      t[5] = (uint64_t)(acc >> 64);
+
+      q = t[0] * m->inv;
+      acc = (u128)q * m->m.v[0] + t[0];
+      c = (uint64_t)(acc >> 64);
+      for (j = 1; j < 4; j++)
+        {
+          acc = (u128)q * m->m.v[j] + t[j] + c;
+          t[j - 1] = (uint64_t)acc;
+          c = (uint64_t)(acc >> 64);
+        }
+      acc = (u128)t[4] + c;
+      t[3] = (uint64_t)acc;
+      t[4] = t[5] + (uint64_t)(acc >> 64);
+    }
+
+  reduce_once (r, t, t[4], m);
+}
+
+/* a^(m - 2), which is the inverse for prime m; the exponent is public */
+static void
+fe_inv (struct p256_fe *r, const struct p256_fe *a, const struct p256_mod *m)
+{
+  struct p256_fe e = m->m, acc = m->one;
+  int bit;
+
+  e.v[0] -= 2;
+
+  for (bit = 255; bit >= 0; bit--)
+    {
+      fe_mul (&acc, &acc, &acc, m);
+      if ((e.v[bit / 64] >> (bit % 64)) & 1)
+        fe_mul (&acc, &acc, a, m);
+    }
+
+  *r = acc;
+}
+
+static bool
+fe_is_zero (const struct p256_fe *a)
+{
+  return 0 == (a->v[0] | a->v[1] | a->v[2] | a->v[3]);
+}
+
+static bool
+fe_equal (const struct p256_fe *a, const struct p256_fe *b)
+{
+  return 0 == ((a->v[0] ^ b->v[0]) | (a->v[1] ^ b->v[1])
+               | (a->v[2] ^ b->v[2]) | (a->v[3] ^ b->v[3]));
+}
+
+/* Big endian bytes to plain limbs, false if not below m */
+static bool
+fe_from_bytes (struct p256_fe *r, const uint8_t *b, const struct p256_mod *m)
+{
+  unsigned int i, j;
+  uint64_t borrow = 0;
+
+  for (i = 0; i < 4; i++)
+    {
+      r->v[i] = 0;
+      for (j = 0; j < 8; j++)
+        r->v[i] |= (uint64_t)b[31 - i * 8 - j] << (j * 8);
+    }
+
+  for (i = 0; i < 4; i++)
+    {
+      const u128 d = (u128)r->v[i] - m->m.v[i] - borrow;
+      borrow = (uint64_t)(d >> 64) & 1;
+    }
+
+  return 1 == borrow;
+}
+
+static void
+fe_to_bytes (uint8_t *b, const struct p256_fe *a)
+{
+  unsigned int i, j;
+
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 8; j++)
+      b[31 - i * 8 - j] = a->v[i] >> (j * 8);
+}
+
+static void
+to_mont (struct p256_fe *r, const struct p256_fe *a, const struct p256_mod *m)
+{
+  fe_mul (r, a, &m->r2, m);
+}
+
+static void
+from_mont (struct p256_fe *r, const struct p256_fe *a,
+           const struct p256_mod *m)
+{
+  fe_mul (r, a, &PLAIN_ONE, m);
+}
+
+static void
+fe_cmov (struct p256_fe *r, const struct p256_fe *a, uint64_t mask)
+{
+  unsigned int i;
+
+  for (i = 0; i < 4; i++)
+    r->v[i] = (r->v[i] & ~mask) | (a->v[i] & mask);
+}
+
+static void
+point_identity (struct p256_point *p)
+{
+  memset (p, 0, sizeof (*p));
+  p->y = FP.one;
+}
+
+static void
+point_add (struct p256_point *r, const struct p256_point *p,
+           const struct p256_point *q)
+{
+  struct p256_fe t0, t1, t2, t3, t4, x3, y3, z3;
+
+  fe_mul (&t0, &p->x, &q->x, &FP);
+  fe_mul (&t1, &p->y, &q->y, &FP);
+  fe_mul (&t2, &p->z, &q->z, &FP);
+  fe_add (&t3, &p->x, &p->y, &FP);
+  fe_add (&t4, &q->x, &q->y, &FP);
+  fe_mul (&t3, &t3, &t4, &FP);
+  fe_add (&t4, &t0, &t1, &FP);
+  fe_sub (&t3, &t3, &t4, &FP);
+  fe_add (&t4, &p->y, &p->z, &FP);
+  fe_add (&x3, &q->y, &q->z, &FP);
+  fe_mul (&t4, &t4, &x3, &FP);
+  fe_add (&x3, &t1, &t2, &FP);
+  fe_sub (&t4, &t4, &x3, &FP);
+  fe_add (&x3, &p->x, &p->z, &FP);
+  fe_add (&y3, &q->x, &q->z, &FP);
+  fe_mul (&x3, &x3, &y3, &FP);
+  fe_add (&y3, &t0, &t2, &FP);
+  fe_sub (&y3, &x3, &y3, &FP);
+  fe_mul (&z3, &B, &t2, &FP);
+  fe_sub (&x3, &y3, &z3, &FP);
+  fe_add (&z3, &x3, &x3, &FP);
+  fe_add (&x3, &x3, &z3, &FP);
+  fe_sub (&z3, &t1, &x3, &FP);
+  fe_add (&x3, &t1, &x3, &FP);
+  fe_mul (&y3, &B, &y3, &FP);
+  fe_add (&t1, &t2, &t2, &FP);
+  fe_add (&t2, &t1, &t2, &FP);
+  fe_sub (&y3, &y3, &t2, &FP);
+  fe_sub (&y3, &y3, &t0, &FP);
+  fe_add (&t1, &y3, &y3, &FP);
+  fe_add (&y3, &t1, &y3, &FP);
+  fe_add (&t1, &t0, &t0, &FP);
+  fe_add (&t0, &t1, &t0, &FP);
+  fe_sub (&t0, &t0, &t2, &FP);
+  fe_mul (&t1, &t4, &y3, &FP);
+  fe_mul (&t2, &t0, &y3, &FP);
+  fe_mul (&y3, &x3, &z3, &FP);
+  fe_add (&y3, &y3, &t2, &FP);
+  fe_mul (&x3, &t3, &x3, &FP);
+  fe_sub (&x3, &x3, &t1, &FP);
+  fe_mul (&z3, &t4, &z3, &FP);
+  fe_mul (&t1, &t3, &t0, &FP);
+  fe_add (&z3, &z3, &t1, &FP);
+
+  r->x = x3;
+  r->y = y3;
+  r->z = z3;
+}
+
+static void
+point_double (struct p256_point *r, const struct p256_point *p)
+{
+  struct p256_fe t0, t1, t2, t3, x3, y3, z3;
+
+  fe_mul (&t0, &p->x, &p->x, &FP);
+  fe_mul (&t1, &p->y, &p->y, &FP);
+  fe_mul (&t2, &p->z, &p->z, &FP);
+  fe_mul (&t3, &p->x, &p->y, &FP);
+  fe_add (&t3, &t3, &t3, &FP);
+  fe_mul (&z3, &p->x, &p->z, &FP);
+  fe_add (&z3, &z3, &z3, &FP);
+  fe_mul (&y3, &B, &t2, &FP);
+  fe_sub (&y3, &y3, &z3, &FP);
+  fe_add (&x3, &y3, &y3, &FP);
+  fe_add (&y3, &x3, &y3, &FP);
+  fe_sub (&x3, &t1, &y3, &FP);
+  fe_add (&y3, &t1, &y3, &FP);
+  fe_mul (&y3, &x3, &y3, &FP);
+  fe_mul (&x3, &x3, &t3, &FP);
+  fe_add (&t3, &t2, &t2, &FP);
+  fe_add (&t2, &t2, &t3, &FP);
+  fe_mul (&z3, &B, &z3, &FP);
+  fe_sub (&z3, &z3, &t2, &FP);
+  fe_sub (&z3, &z3, &t0, &FP);
+  fe_add (&t3, &z3, &z3, &FP);
+  fe_add (&z3, &z3, &t3, &FP);
+  fe_add (&t3, &t0, &t0, &FP);
+  fe_add (&t0, &t3, &t0, &FP);
+  fe_sub (&t0, &t0, &t2, &FP);
+  fe_mul (&t0, &t0, &z3, &FP);
+  fe_add (&y3, &y3, &t0, &FP);
+  fe_mul (&t0, &p->y, &p->z, &FP);
+  fe_add (&t0, &t0, &t0, &FP);
+  fe_mul (&z3, &t0, &z3, &FP);
+  fe_sub (&x3, &x3, &z3, &FP);
+  fe_mul (&z3, &t0, &t1, &FP);
+  fe_add (&z3, &z3, &z3, &FP);
+  fe_add (&z3, &z3, &z3, &FP);
+
+  r->x = x3;
+  r->y = y3;
+  r->z = z3;
+}
+
+/* x and y as plain integers; false at infinity */
+static bool
+point_affine (const struct p256_point *p, struct p256_fe *x,
+              struct p256_fe *y)
+{
+  struct p256_fe zinv;
+
+  if (fe_is_zero (&p->z))
+    return false;
+
+  fe_inv (&zinv, &p->z, &FP);
+  fe_mul (x, &p->x, &zinv, &FP);
+  from_mont (x, x, &FP);
+
+  if (NULL != y)
+    {
+      fe_mul (y, &p->y, &zinv, &FP);
+      from_mont (y, y, &FP);
+    }
+
+  return true;
+}
+
+#define WINDOW_BITS 4
+#define WINDOW_SIZE (1 << WINDOW_BITS)
+
+static void
+window_table (struct p256_point *table, const struct p256_point *p)
+{
+  unsigned int i;
+
+  point_identity (&table[0]);
+  table[1] = *p;
+
+  for (i = 2; i < WINDOW_SIZE; i++)
+    if (i % 2)
+      point_add (&table[i], &table[i - 1], p);
+    else
+      point_double (&table[i], &table[i / 2]);
+}
+
+static unsigned int
+scalar_window (const uint8_t *k, unsigned int i)
+{
+  /* Window i counts from the least significant nibble */
+  return (k[31 - i / 2] >> ((i % 2) * 4)) & 0x0F;
+}
+
+static void
+table_select (struct p256_point *r, const struct p256_point *table,
+              unsigned int w)
+{
+  unsigned int i;
+
+  point_identity (r);
+
+  for (i = 0; i < WINDOW_SIZE; i++)
+    {
+      const uint64_t mask = (uint64_t)0 - (uint64_t)(i == w);
+      fe_cmov (&r->x, &table[i].x, mask);
+      fe_cmov (&r->y, &table[i].y, mask);
+      fe_cmov (&r->z, &table[i].z, mask);
+    }
+}
+
+/* k * p for a secret k, given as 32 big endian bytes */
+static void
+point_mul_secret (struct p256_point *r, const struct p256_point *p,
+                  const uint8_t *k)
+{
+  struct p256_point table[WINDOW_SIZE], acc, sel;
+  int i;
+
+  window_table (table, p);
+  point_identity (&acc);
+
+  for (i = 256 / WINDOW_BITS - 1; i >= 0; i--)
+    {
+      point_double (&acc, &acc);
+      point_double (&acc, &acc);
+      point_double (&acc, &acc);
+      point_double (&acc, &acc);
+      table_select (&sel, table, scalar_window (k, i));
+      point_add (&acc, &acc, &sel);
+    }
+
+  *r = acc;
+
+  smemset (table, 0, sizeof (table));
+  smemset (&sel, 0, sizeof (sel));
+  smemset (&acc, 0, sizeof (acc));
+}
+
+/* u1 * G + u2 * q for public scalars */
+static void
+point_mul2_public (struct p256_point *r, const uint8_t *u1,
+                   const struct p256_point *q, const uint8_t *u2)
+{
+  struct p256_point tg[WINDOW_SIZE], tq[WINDOW_SIZE], acc;
+  unsigned int w;
+  int i;
+
+  window_table (tg, &G);
+  window_table (tq, q);
+  point_identity (&acc);
+
+  for (i = 256 / WINDOW_BITS - 1; i >= 0; i--)
+    {
+      point_double (&acc, &acc);
+      point_double (&acc, &acc);
+      point_double (&acc, &acc);
+      point_double (&acc, &acc);
+      if (0 != (w = scalar_window (u1, i)))
+        point_add (&acc, &acc, &tg[w]);
+      if (0 != (w = scalar_window (u2, i)))
+        point_add (&acc, &acc, &tq[w]);
+    }
+
+  *r = acc;
+}
+
+/* Mixed addition, algorithm 5 of Renes, Costello and Batina.  It is
+   complete except for q at infinity, which no table entry is. */
+static void
+point_add_affine (struct p256_point *r, const struct p256_point *p,
+                  const struct p256_affine *q)
+{
+  struct p256_fe t0, t1, t2, t3, t4, x3, y3, z3;
+
+  fe_mul (&t0, &p->x, &q->x, &FP);
+  fe_mul (&t1, &p->y, &q->y, &FP);
+  fe_add (&t3, &q->x, &q->y, &FP);
+  fe_add (&t4, &p->x, &p->y, &FP);
+  fe_mul (&t3, &t3, &t4, &FP);
+  fe_add (&t4, &t0, &t1, &FP);
+  fe_sub (&t3, &t3, &t4, &FP);
+  fe_mul (&t4, &q->y, &p->z, &FP);
+  fe_add (&t4, &t4, &p->y, &FP);
+  fe_mul (&y3, &q->x, &p->z, &FP);
+  fe_add (&y3, &y3, &p->x, &FP);
+  fe_mul (&z3, &B, &p->z, &FP);
+  fe_sub (&x3, &y3, &z3, &FP);
+  fe_add (&z3, &x3, &x3, &FP);
+  fe_add (&x3, &x3, &z3, &FP);
+  fe_sub (&z3, &t1, &x3, &FP);
+  fe_add (&x3, &t1, &x3, &FP);
+  fe_mul (&y3, &B, &y3, &FP);
+  fe_add (&t1, &p->z, &p->z, &FP);
+  fe_add (&t2, &t1, &p->z, &FP);
+  fe_sub (&y3, &y3, &t2, &FP);
+  fe_sub (&y3, &y3, &t0, &FP);
+  fe_add (&t1, &y3, &y3, &FP);
+  fe_add (&y3, &t1, &y3, &FP);
+  fe_add (&t1, &t0, &t0, &FP);
+  fe_add (&t0, &t1, &t0, &FP);
+  fe_sub (&t0, &t0, &t2, &FP);
+  fe_mul (&t1, &t4, &y3, &FP);
+  fe_mul (&t2, &t0, &y3, &FP);
+  fe_mul (&y3, &x3, &z3, &FP);
+  fe_add (&y3, &y3, &t2, &FP);
+  fe_mul (&x3, &t3, &x3, &FP);
+  fe_sub (&x3, &x3, &t1, &FP);
+  fe_mul (&z3, &t4, &z3, &FP);
+  fe_mul (&t1, &t3, &t0, &FP);
+  fe_add (&z3, &z3, &t1, &FP);
+
+  r->x = x3;
+  r->y = y3;
+  r->z = z3;
+}
+
+#define TABLE_LEN (P256_TABLE_ROWS * P256_TABLE_COLS)
+
+static void
+build_table (struct p256_table *t, const struct p256_point *p)
+{
+  struct p256_point *pts = malloc (TABLE_LEN * sizeof (*pts));
+  struct p256_fe *prefix = malloc (TABLE_LEN * sizeof (*prefix));
+  struct p256_point base = *p;
+  struct p256_fe inv, zinv;
+  unsigned int i, j;
+
+  assert (NULL != pts); assert (NULL != prefix);
+
+  /* Row i holds base, 2 base ... 15 base for base = 16^i p */
+  for (i = 0; i < P256_TABLE_ROWS; i++)
+    {
+      struct p256_point *row = pts + i * P256_TABLE_COLS;
+
+      row[0] = base;
+      for (j = 1; j < P256_TABLE_COLS; j++)
+        if (j % 2)
+          point_double (&row[j], &row[j / 2]);
+        else
+          point_add (&row[j], &row[j - 1], &base);
+
+      point_double (&base, &row[7]);
+    }
+
+  /* Every Z is inverted at once with Montgomery's trick.  None is zero,
+     since 15 * 16^63 is below n. */
+  prefix[0] = pts[0].z;
+  for (i = 1; i < TABLE_LEN; i++)
+    fe_mul (&prefix[i], &prefix[i - 1], &pts[i].z, &FP);
+
+  fe_inv (&inv, &prefix[TABLE_LEN - 1], &FP);
+
+  for (i = TABLE_LEN; i-- > 0;)
+    {
+      struct p256_affine *a = &t->t[i / P256_TABLE_COLS][i % P256_TABLE_COLS];
+
+      if (i > 0)
+        {
+          fe_mul (&zinv, &inv, &prefix[i - 1], &FP);
+          fe_mul (&inv, &inv, &pts[i].z, &FP);
+        }
+      else
+        zinv = inv;
+
+      fe_mul (&a->x, &pts[i].x, &zinv, &FP);
+      fe_mul (&a->y, &pts[i].y, &zinv, &FP);
+    }
+
+  free (prefix);
+  free (pts);
+}
+
+static struct p256_table g_table;
+static pthread_once_t g_table_once = PTHREAD_ONCE_INIT;
+
+static void
+build_g_table (void)
+{
+  build_table (&g_table, &G);
+}
+
+/* u1 * G + u2 * q for public scalars, with q's table */
+static void
+point_mul2_table (struct p256_point *r, const uint8_t *u1,
+                  const struct p256_table *q, const uint8_t *u2)
+{
+  struct p256_point acc;
+  unsigned int i, w;
+
+  pthread_once (&g_table_once, build_g_table);
+  point_identity (&acc);
+
+  for (i = 0; i < P256_TABLE_ROWS; i++)
+    {
+      if (0 != (w = scalar_window (u1, i)))
+        point_add_affine (&acc, &acc, &g_table.t[i][w - 1]);
+      if (0 != (w = scalar_window (u2, i)))
+        point_add_affine (&acc, &acc, &q->t[i][w - 1]);
+    }
+
+  *r = acc;
+}
+
+bool
+p256_point_from_bytes (struct p256_point *p, const uint8_t *xy)
+{
+  struct p256_fe x, y, lhs, rhs, t;
+
+  assert (NULL != p); assert (NULL != xy);
+
+  if (!fe_from_bytes (&x, xy, &FP) || !fe_from_bytes (&y, xy + 32, &FP))
+    return false;
+
+  to_mont (&x, &x, &FP);
+  to_mont (&y, &y, &FP);
+
+  /* y^2 = x^3 - 3x + b */
+  fe_mul (&lhs, &y, &y, &FP);
+  fe_mul (&rhs, &x, &x, &FP);
+  fe_mul (&rhs, &rhs, &x, &FP);
+  fe_add (&t, &x, &x, &FP);
+  fe_add (&t, &t, &x, &FP);
+  fe_sub (&rhs, &rhs, &t, &FP);
+  fe_add (&rhs, &rhs, &B, &FP);
+
+  if (!fe_equal (&lhs, &rhs))
+    return false;
+
+  p->x = x;
+  p->y = y;
+  p->z = FP.one;
+
+  return true;
+}
+
+bool
+p256_point_to_bytes (const struct p256_point *p, uint8_t *xy)
+{
+  struct p256_fe x, y;
+
+  if (!point_affine (p, &x, &y))
+    return false;
+
+  fe_to_bytes (xy, &x);
+  fe_to_bytes (xy + 32, &y);
+
+  return true;
+}
+
+/* A digest as an integer mod n */
+static void
+digest_to_scalar (struct p256_fe *e, const uint8_t *digest)
+{
+  struct p256_fe t;
+
+  fe_from_bytes (&t, digest, &FN);
+  reduce_once (e, t.v, 0, &FN);
+}
+
+static bool
+scalar_from_bytes (struct p256_fe *s, const uint8_t *b)
+{
+  return fe_from_bytes (s, b, &FN) && !fe_is_zero (s);
+}
+
+bool
+p256_ecdsa_verify (const uint8_t *pub, const uint8_t *digest,
+                   const uint8_t *sig)
+{
+  struct p256_point q, x;
+  struct p256_fe r, s, e, w, u1, u2, xr;
+  uint8_t u1b[P256_SCALAR_LEN], u2b[P256_SCALAR_LEN];
+
+  assert (NULL != pub); assert (NULL != digest); assert (NULL != sig);
+
+  if (!scalar_from_bytes (&r, sig) || !scalar_from_bytes (&s, sig + 32))
+    return false;
+
+  if (!p256_point_from_bytes (&q, pub))
+    return false;
+
+  digest_to_scalar (&e, digest);
+
+  /* w is s^-1 in Montgomery form, so multiplying a plain value by it
+     gives a plain product */
+  to_mont (&w, &s, &FN);
+  fe_inv (&w, &w, &FN);
+  fe_mul (&u1, &e, &w, &FN);
+  fe_mul (&u2, &r, &w, &FN);
+  fe_to_bytes (u1b, &u1);
+  fe_to_bytes (u2b, &u2);
+
+  point_mul2_public (&x, u1b, &q, u2b);
+
+  if (!point_affine (&x, &xr, NULL))
+    return false;
+
+  reduce_once (&xr, xr.v, 0, &FN);
+
+  return fe_equal (&xr, &r);
+}
+
+/* Whether x(p) mod n is the plain scalar r, without an inversion.
+   x = X / Z is below p, so it is either r or r + n. */
+static bool
+x_matches (const struct p256_point *p, const struct p256_fe *r)
+{
+  struct p256_fe t, rn;
+  uint64_t carry = 0, borrow = 0;
+  unsigned int i;
+
+  if (fe_is_zero (&p->z))
+    return false;
+
+  to_mont (&t, r, &FP);
+  fe_mul (&t, &t, &p->z, &FP);
+  if (fe_equal (&t, &p->x))
+    return true;
+
+  for (i = 0; i < 4; i++)
+    {
+      const u128 s = (u128)r->v[i] + FN.m.v[i] + carry;
+      rn.v[i] = (uint64_t)s;
+      carry = (uint64_t)(s >> 64);
+    }
+
+  for (i = 0; i < 4; i++)
+    {
+      const u128 d = (u128)rn.v[i] - FP.m.v[i] - borrow;
+      borrow = (uint64_t)(d >> 64) & 1;
+    }
+
+  if (0 != carry || 0 == borrow)
+    return false;
+
+  to_mont (&t, &rn, &FP);
+  fe_mul (&t, &t, &p->z, &FP);
+
+  return fe_equal (&t, &p->x);
+}
+
+/* Verifies with w = s^-1 already computed, in Montgomery form */
+static bool
+verify_table (const struct p256_table *q, const uint8_t *digest,
+              const struct p256_fe *r, const struct p256_fe *w)
+{
+  struct p256_point x;
+  struct p256_fe e, u1, u2;
+  uint8_t u1b[P256_SCALAR_LEN], u2b[P256_SCALAR_LEN];
+
+  digest_to_scalar (&e, digest);
+  fe_mul (&u1, &e, w, &FN);
+  fe_mul (&u2, r, w, &FN);
+  fe_to_bytes (u1b, &u1);
+  fe_to_bytes (u2b, &u2);
+
+  point_mul2_table (&x, u1b, q, u2b);
+
+  return x_matches (&x, r);
+}
+
+bool
+p256_table_init (struct p256_table *t, const uint8_t *pub)
+{
+  struct p256_point q;
+
+  assert (NULL != t); assert (NULL != pub);
+
+  if (!p256_point_from_bytes (&q, pub))
+    return false;
+
+  build_table (t, &q);
+
+  return true;
+}
+
+bool
+p256_ecdsa_verify_table (const struct p256_table *q, const uint8_t *digest,
+                         const uint8_t *sig)
+{
+  struct p256_fe r, w;
+
+  assert (NULL != q); assert (NULL != digest); assert (NULL != sig);
+
+  if (!scalar_from_bytes (&r, sig) || !scalar_from_bytes (&w, sig + 32))
+    return false;
+
+  to_mont (&w, &w, &FN);
+  fe_inv (&w, &w, &FN);
+
+  return verify_table (q, digest, &r, &w);
+}
+
+void
+p256_ecdsa_verify_table_batch (const struct p256_table *q,
+                               const struct lca_p256_sig_item *items,
+                               unsigned int count, bool *valid)
+{
+  struct p256_fe r[P256_VERIFY_BATCH], s[P256_VERIFY_BATCH], prefix[P256_VERIFY_BATCH];
+  struct p256_fe inv, w;
+  unsigned int base, n, x;
+
+  assert (NULL != q);
+  assert (NULL != items || 0 == count);
+  assert (NULL != valid || 0 == count);
+
+  for (base = 0; base < count; base += n)
+    {
+      n = count - base < P256_VERIFY_BATCH ? count - base : P256_VERIFY_BATCH;
+
+      /* Malformed signatures take part in the product as one */
+      for (x = 0; x < n; x++)
+        {
+          const uint8_t *sig = items[base + x].signature;
+
+          valid[base + x] = scalar_from_bytes (&r[x], sig)
+            && scalar_from_bytes (&s[x], sig + 32);
+
+          if (valid[base + x])
+            to_mont (&s[x], &s[x], &FN);
+          else
+            s[x] = FN.one;
+
+          if (0 == x)
+            prefix[0] = s[0];
+          else
+            fe_mul (&prefix[x], &prefix[x - 1], &s[x], &FN);
+        }
+
+      fe_inv (&inv, &prefix[n - 1], &FN);
+
+      for (x = n; x-- > 0;)
+        {
+          if (x > 0)
+            {
+              fe_mul (&w, &inv, &prefix[x - 1], &FN);
+              fe_mul (&inv, &inv, &s[x], &FN);
+            }
+          else
+            w = inv;
+
+          if (valid[base + x])
+            valid[base + x] = verify_table (q, items[base + x].digest,
+                                            &r[x], &w);
+        }
+    }
+}
+
+/* RFC 6979 section 3.2 for SHA-256 and a 256 bit order */
+struct rfc6979
+{
+  uint8_t k[32];
+  uint8_t v[32];
+};
+
+static void
+rfc6979_step (struct rfc6979 *st, uint8_t sep, const uint8_t *x,
+              const uint8_t *h)
+{
+  uint8_t msg[32 + 1 + 32 + 32];
+  struct lca_hmac_ctx hmac;
+  size_t len = 0;
+
+  memcpy (msg, st->v, 32);
+  len += 32;
+  msg[len++] = sep;
+  if (NULL != x)
+    {
+      memcpy (msg + len, x, 32);
+      memcpy (msg + len + 32, h, 32);
+      len += 64;
+    }
+
+  lca_hmac_init (&hmac, st->k, sizeof (st->k));
+  lca_hmac_compute (&hmac, msg, len, st->k);
+  lca_hmac_init (&hmac, st->k, sizeof (st->k));
+  lca_hmac_compute (&hmac, st->v, sizeof (st->v), st->v);
+
+  lca_hmac_wipe (&hmac);
+  smemset (msg, 0, sizeof (msg));
+}
+
+static void
+rfc6979_next (struct rfc6979 *st)
+{
+  struct lca_hmac_ctx hmac;
+
+  lca_hmac_init (&hmac, st->k, sizeof (st->k));
+  lca_hmac_compute (&hmac, st->v, sizeof (st->v), st->v);
+  lca_hmac_wipe (&hmac);
+}
+
+bool
+p256_ecdsa_sign (const uint8_t *priv, const uint8_t *digest, uint8_t *sig)
+{
+  struct rfc6979 st;
+  struct p256_fe d, e, k, r, s, t;
+  struct p256_point R;
+  uint8_t h[32];
+  bool done = false;
+
+  assert (NULL != priv); assert (NULL != digest); assert (NULL != sig);
+
+  if (!scalar_from_bytes (&d, priv))
+    return false;
+
+  digest_to_scalar (&e, digest);
+  fe_to_bytes (h, &e);
+
+  memset (st.v, 0x01, sizeof (st.v));
+  memset (st.k, 0x00, sizeof (st.k));
+  rfc6979_step (&st, 0x00, priv, h);
+  rfc6979_step (&st, 0x01, priv, h);
+
+  to_mont (&d, &d, &FN);
+  to_mont (&e, &e, &FN);
+
+  while (!done)
+    {
+      rfc6979_next (&st);
+
+      if (scalar_from_bytes (&k, st.v))
+        {
+          point_mul_secret (&R, &G, st.v);
+          point_affine (&R, &r, NULL);
+          reduce_once (&r, r.v, 0, &FN);
+
+          if (!fe_is_zero (&r))
+            {
+              /* s = k^-1 (e + r d) */
+              to_mont (&t, &r, &FN);
+              fe_mul (&t, &t, &d, &FN);
+              fe_add (&t, &t, &e, &FN);
+              to_mont (&k, &k, &FN);
+              fe_inv (&k, &k, &FN);
+              fe_mul (&s, &k, &t, &FN);
+              from_mont (&s, &s, &FN);
+
+              if (!fe_is_zero (&s))
+                {
+                  fe_to_bytes (sig, &r);
+                  fe_to_bytes (sig + 32, &s);
+                  done = true;
+                }
+            }
+        }
+
+      if (!done)
+        rfc6979_step (&st, 0x00, NULL, NULL);
+    }
+
+  smemset (&st, 0, sizeof (st));
+  smemset (&d, 0, sizeof (d));
+  smemset (&k, 0, sizeof (k));
+  smemset (&t, 0, sizeof (t));
+  smemset (&R, 0, sizeof (R));
+
+  return true;
+}
+
+bool
+p256_scalar_valid (const uint8_t *priv)
+{
+  struct p256_fe d;
+  bool result;
+
+  assert (NULL != priv);
+
+  result = scalar_from_bytes (&d, priv);
+  smemset (&d, 0, sizeof (d));
+
+  return result;
+}
+
+bool
+p256_public_key (const uint8_t *priv, uint8_t *pub)
+{
+  struct p256_fe d;
+  struct p256_point q;
+
+  assert (NULL != priv); assert (NULL != pub);
+
+  if (!scalar_from_bytes (&d, priv))
+    return false;
+
+  point_mul_secret (&q, &G, priv);
+  p256_point_to_bytes (&q, pub);
+
+  smemset (&d, 0, sizeof (d));
+  smemset (&q, 0, sizeof (q));
+
+  return true;
+}
+
+bool
+p256_keygen (uint8_t *priv, uint8_t *pub)
+{
+  struct p256_fe d;
+  bool result = false;
+  int fd;
+
+  assert (NULL != priv); assert (NULL != pub);
+
+  if ((fd = open ("/dev/urandom", O_RDONLY | O_CLOEXEC)) < 0)
+    return false;
+
+  while (P256_SCALAR_LEN == read (fd, priv, P256_SCALAR_LEN))
+    if (scalar_from_bytes (&d, priv))
+      {
+        result = p256_public_key (priv, pub);
+        break;
+      }
+
+  close (fd);
+  smemset (&d, 0, sizeof (d));
+
+  if (!result)
+    smemset (priv, 0, P256_SCALAR_LEN);
+
+  return result;
+}
+
+bool
+p256_ecdh (const uint8_t *priv, const uint8_t *pub, uint8_t *secret)
+{
+  struct p256_fe d, x;
+  struct p256_point q, s;
+  bool result = false;
+
+  assert (NULL != priv); assert (NULL != pub); assert (NULL != secret);
+
+  if (scalar_from_bytes (&d, priv) && p256_point_from_bytes (&q, pub))
+    {
+      point_mul_secret (&s, &q, priv);
+      if ((result = point_affine (&s, &x, NULL)))
+        fe_to_bytes (secret, &x);
+    }
+
+  smemset (&d, 0, sizeof (d));
+  smemset (&x, 0, sizeof (x));
+  smemset (&s, 0, sizeof (s));
+
+  return result;
+}
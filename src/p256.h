@@ -0,0 +1,205 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef P256_H
+#define P256_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+#define P256_SCALAR_LEN 32
+#define P256_POINT_LEN 64
+
+/* A field element mod p or a scalar mod n, as four little endian
+   64 bit limbs in Montgomery form unless noted otherwise. */
+struct p256_fe
+{
+  uint64_t v[4];
+};
+
+/* A point in projective coordinates (X/Z, Y/Z); Z = 0 is the point at
+   infinity. */
+struct p256_point
+{
+  struct p256_fe x, y, z;
+};
+
+/* An affine point in Montgomery form, as stored in tables */
+struct p256_affine
+{
+  struct p256_fe x, y;
+};
+
+/* j * 16^i * P for every 4 bit window i of a scalar and every nonzero
+   digit j, so a multiple of P is one addition per window and no
+   doublings. */
+#define P256_TABLE_ROWS 64
+#define P256_TABLE_COLS 15
+
+struct p256_table
+{
+  struct p256_affine t[P256_TABLE_ROWS][P256_TABLE_COLS];
+};
+
+/* What an lca_p256_key holds */
+struct lca_p256_key
+{
+  struct p256_table table;
+};
+
+/**
+ * Decodes and validates an uncompressed public point.
+ *
+ * @param p The point.
+ * @param xy The P256_POINT_LEN byte big endian x and y coordinates.
+ *
+ * @return False if the coordinates are out of range or not on the
+ * curve.
+ */
+bool
+p256_point_from_bytes (struct p256_point *p, const uint8_t *xy);
+
+/**
+ * Encodes a point's affine coordinates.
+ *
+ * @param p The point.
+ * @param xy The P256_POINT_LEN byte destination.
+ *
+ * @return False for the point at infinity.
+ */
+bool
+p256_point_to_bytes (const struct p256_point *p, uint8_t *xy);
+
+/**
+ * Verifies an ECDSA signature.  Runs in variable time; all the inputs
+ * are public.
+ *
+ * @param pub The P256_POINT_LEN byte public key.
+ * @param digest The 32 byte digest.
+ * @param sig The 64 byte r || s signature.
+ *
+ * @return True if valid.
+ */
+bool
+p256_ecdsa_verify (const uint8_t *pub, const uint8_t *digest,
+                   const uint8_t *sig);
+
+/**
+ * Validates a public key and builds its table.
+ *
+ * @param t The table.
+ * @param pub The P256_POINT_LEN byte public key.
+ *
+ * @return False if the key is not on the curve.
+ */
+bool
+p256_table_init (struct p256_table *t, const uint8_t *pub);
+
+/**
+ * Verifies an ECDSA signature with a public key's table.  Runs in
+ * variable time; all the inputs are public.
+ *
+ * @param q The public key's table.
+ * @param digest The 32 byte digest.
+ * @param sig The 64 byte r || s signature.
+ *
+ * @return True if valid.
+ */
+bool
+p256_ecdsa_verify_table (const struct p256_table *q, const uint8_t *digest,
+                         const uint8_t *sig);
+
+/* Signatures verified together share one inversion */
+#define P256_VERIFY_BATCH 32
+
+/**
+ * Verifies several signatures under one public key, sharing a single
+ * inversion of the s values between each P256_VERIFY_BATCH of them.
+ *
+ * @param q The public key's table.
+ * @param items The digests and signatures.
+ * @param count The number of items.
+ * @param valid The count results.
+ */
+void
+p256_ecdsa_verify_table_batch (const struct p256_table *q,
+                               const struct lca_p256_sig_item *items,
+                               unsigned int count, bool *valid);
+
+/**
+ * Signs a digest with a nonce derived as in RFC 6979.  Runs in
+ * constant time with respect to the key and nonce.
+ *
+ * @param priv The P256_SCALAR_LEN byte private key.
+ * @param digest The 32 byte digest.
+ * @param sig The 64 byte r || s destination.
+ *
+ * @return False if the private key is out of range.
+ */
+bool
+p256_ecdsa_sign (const uint8_t *priv, const uint8_t *digest, uint8_t *sig);
+
+/**
+ * Checks that a private key is in [1, n - 1].  The other backends use
+ * this so every backend rejects the same keys.
+ *
+ * @param priv The P256_SCALAR_LEN byte private key.
+ *
+ * @return True if the key is in range.
+ */
+bool
+p256_scalar_valid (const uint8_t *priv);
+
+/**
+ * Computes the public key for a private key.
+ *
+ * @param priv The P256_SCALAR_LEN byte private key.
+ * @param pub The P256_POINT_LEN byte destination.
+ *
+ * @return False if the private key is out of range.
+ */
+bool
+p256_public_key (const uint8_t *priv, uint8_t *pub);
+
+/**
+ * Generates a key pair from /dev/urandom.
+ *
+ * @param priv The P256_SCALAR_LEN byte destination.
+ * @param pub The P256_POINT_LEN byte destination.
+ *
+ * @return False if no randomness was available.
+ */
+bool
+p256_keygen (uint8_t *priv, uint8_t *pub);
+
+/**
+ * Computes the ECDH shared secret, the x coordinate of priv * pub.
+ *
+ * @param priv The P256_SCALAR_LEN byte private key.
+ * @param pub The P256_POINT_LEN byte peer public key.
+ * @param secret The 32 byte destination.
+ *
+ * @return False if either key is invalid.
+ */
+bool
+p256_ecdh (const uint8_t *priv, const uint8_t *pub, uint8_t *secret);
+
+#endif /* P256_H */
@@ -0,0 +1,96 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include "p256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+struct lca_p256_key *
+lca_p256_key_import (const uint8_t *pub_key)
+{
+  struct lca_p256_key *key;
+
+  assert (NULL != pub_key);
+
+  if (0x04 != pub_key[0])
+    return NULL;
+
+  key = malloc (sizeof (*key));
+  assert (NULL != key);
+
+  if (!p256_table_init (&key->table, pub_key + 1))
+    {
+      LCA_LOG (DEBUG, "Public key is not on the curve");
+      free (key);
+      return NULL;
+    }
+
+  return key;
+}
+
+void
+lca_p256_key_free (struct lca_p256_key *key)
+{
+  free (key);
+}
+
+bool
+lca_p256_key_verify (const struct lca_p256_key *key, const uint8_t *digest,
+                     const uint8_t *signature)
+{
+  assert (NULL != key);
+
+  return p256_ecdsa_verify_table (&key->table, digest, signature);
+}
+
+unsigned int
+lca_p256_key_verify_batch (const struct lca_p256_key *key,
+                           const struct lca_p256_sig_item *items,
+                           unsigned int count, uint8_t *results)
+{
+  bool valid[P256_VERIFY_BATCH];
+  unsigned int base, n, x, matched = 0;
+
+  assert (NULL != key);
+  assert (NULL != results || 0 == count);
+
+  for (base = 0; base < count; base += n)
+    {
+      n = count - base < P256_VERIFY_BATCH
+        ? count - base : P256_VERIFY_BATCH;
+
+      p256_ecdsa_verify_table_batch (&key->table, items + base, n, valid);
+
+      for (x = 0; x < n; x++)
+        if (valid[x])
+          {
+            results[(base + x) / 8] |= 1 << ((base + x) % 8);
+            matched++;
+          }
+        else
+          results[(base + x) / 8] &= ~(1 << ((base + x) % 8));
+    }
+
+  return matched;
+}
@@ -0,0 +1,426 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <gcrypt.h>
+#include <string.h>
+#include "sha256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_SHA_X86 1
+#include <immintrin.h>
+#elif defined (__GNUC__) && defined (__aarch64__) && defined (__linux__)
+#define HAVE_SHA_ARM 1
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t
+load_be32 (const uint8_t *p)
+{
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+    | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void
+store_be32 (uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static void
+blocks_portable (uint32_t h[8], const uint8_t *blocks, size_t n)
+{
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, k, t1, t2;
+  unsigned int x;
+
+  for (; n > 0; n--, blocks += SHA256_BLOCK_LEN)
+    {
+      for (x = 0; x < 16; x++)
+        w[x] = load_be32 (blocks + x * 4);
+
+      for (x = 16; x < 64; x++)
+        {
+          const uint32_t s0 = ROR (w[x-15], 7) ^ ROR (w[x-15], 18)
+            ^ (w[x-15] >> 3);
+          const uint32_t s1 = ROR (w[x-2], 17) ^ ROR (w[x-2], 19)
+            ^ (w[x-2] >> 10);
+          w[x] = w[x-16] + s0 + w[x-7] + s1;
+        }
+
+      a = h[0]; b = h[1]; c = h[2]; d = h[3];
+      e = h[4]; f = h[5]; g = h[6]; k = h[7];
+
+      for (x = 0; x < 64; x++)
+        {
+          t1 = k + (ROR (e, 6) ^ ROR (e, 11) ^ ROR (e, 25))
+            + ((e & f) ^ (~e & g)) + K[x] + w[x];
+          t2 = (ROR (a, 2) ^ ROR (a, 13) ^ ROR (a, 22))
+            + ((a & b) ^ (a & c) ^ (b & c));
+          k = g; g = f; f = e; e = d + t1;
+          d = c; c = b; b = a; a = t1 + t2;
+        }
+
+      h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+      h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+    }
+
+  smemset (w, 0, sizeof (w));
+}
+
+#ifdef HAVE_SHA_X86
+
+/* The SHA extensions keep the state as ABEF and CDGH and run four
+   rounds per pair of sha256rnds2, extending the schedule four words at
+   a time alongside. */
+__attribute__ ((target ("sha,sse4.1"))) static void
+blocks_native (uint32_t h[8], const uint8_t *blocks, size_t n)
+{
+  const __m128i MASK = _mm_set_epi64x (0x0c0d0e0f08090a0bULL,
+                                       0x0405060700010203ULL);
+  __m128i state0, state1, abef, cdgh, msg, tmp, m[4];
+  unsigned int i;
+
+  tmp = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)&h[0]), 0xB1);
+  state1 = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)&h[4]),
+                              0x1B);
+  state0 = _mm_alignr_epi8 (tmp, state1, 8);
+  state1 = _mm_blend_epi16 (state1, tmp, 0xF0);
+
+  for (; n > 0; n--, blocks += SHA256_BLOCK_LEN)
+    {
+      abef = state0;
+      cdgh = state1;
+
+      for (i = 0; i < 4; i++)
+        m[i] = _mm_shuffle_epi8
+          (_mm_loadu_si128 ((const __m128i *)(blocks + i * 16)), MASK);
+
+#pragma GCC unroll 16
+      for (i = 0; i < 16; i++)
+        {
+          msg = _mm_add_epi32 (m[i % 4],
+                               _mm_loadu_si128 ((const __m128i *)&K[i * 4]));
+          state1 = _mm_sha256rnds2_epu32 (state1, state0, msg);
+
+          if (i >= 3 && i <= 14)
+            {
+              tmp = _mm_alignr_epi8 (m[i % 4], m[(i + 3) % 4], 4);
+              m[(i + 1) % 4] = _mm_add_epi32 (m[(i + 1) % 4], tmp);
+              m[(i + 1) % 4] = _mm_sha256msg2_epu32 (m[(i + 1) % 4],
+                                                     m[i % 4]);
+            }
+
+          msg = _mm_shuffle_epi32 (msg, 0x0E);
+          state0 = _mm_sha256rnds2_epu32 (state0, state1, msg);
+
+          if (i >= 1 && i <= 12)
+            m[(i + 3) % 4] = _mm_sha256msg1_epu32 (m[(i + 3) % 4], m[i % 4]);
+        }
+
+      state0 = _mm_add_epi32 (state0, abef);
+      state1 = _mm_add_epi32 (state1, cdgh);
+    }
+
+  tmp = _mm_shuffle_epi32 (state0, 0x1B);
+  state1 = _mm_shuffle_epi32 (state1, 0xB1);
+  _mm_storeu_si128 ((__m128i *)&h[0], _mm_blend_epi16 (tmp, state1, 0xF0));
+  _mm_storeu_si128 ((__m128i *)&h[4], _mm_alignr_epi8 (state1, tmp, 8));
+}
+
+static bool
+have_native (void)
+{
+  __builtin_cpu_init ();
+
+  return __builtin_cpu_supports ("sha") && __builtin_cpu_supports ("sse4.1");
+}
+
+#elif defined (HAVE_SHA_ARM)
+
+__attribute__ ((target ("+crypto"))) static void
+blocks_native (uint32_t h[8], const uint8_t *blocks, size_t n)
+{
+  uint32x4_t state0, state1, abcd, efgh, wk, tmp, m[4];
+  unsigned int i;
+
+  state0 = vld1q_u32 (&h[0]);
+  state1 = vld1q_u32 (&h[4]);
+
+  for (; n > 0; n--, blocks += SHA256_BLOCK_LEN)
+    {
+      abcd = state0;
+      efgh = state1;
+
+      for (i = 0; i < 4; i++)
+        m[i] = vreinterpretq_u32_u8 (vrev32q_u8 (vld1q_u8 (blocks + i * 16)));
+
+#pragma GCC unroll 16
+      for (i = 0; i < 16; i++)
+        {
+          wk = vaddq_u32 (m[i % 4], vld1q_u32 (&K[i * 4]));
+
+          if (i < 12)
+            m[i % 4] = vsha256su0q_u32 (m[i % 4], m[(i + 1) % 4]);
+
+          tmp = state0;
+          state0 = vsha256hq_u32 (state0, state1, wk);
+          state1 = vsha256h2q_u32 (state1, tmp, wk);
+
+          if (i < 12)
+            m[i % 4] = vsha256su1q_u32 (m[i % 4], m[(i + 2) % 4],
+                                        m[(i + 3) % 4]);
+        }
+
+      state0 = vaddq_u32 (state0, abcd);
+      state1 = vaddq_u32 (state1, efgh);
+    }
+
+  vst1q_u32 (&h[0], state0);
+  vst1q_u32 (&h[4], state1);
+}
+
+static bool
+have_native (void)
+{
+  return 0 != (getauxval (AT_HWCAP) & HWCAP_SHA2);
+}
+
+#else
+
+static void
+blocks_native (uint32_t h[8], const uint8_t *blocks, size_t n)
+{
+  blocks_portable (h, blocks, n);
+}
+
+static bool
+have_native (void)
+{
+  return false;
+}
+
+#endif
+
+static enum LCA_SHA256_IMPL impl = LCA_SHA256_AUTO;
+static bool native = false;
+static bool selected = false;
+
+bool
+lca_sha256_select (enum LCA_SHA256_IMPL want)
+{
+  const bool available = have_native ();
+
+  if (LCA_SHA256_NATIVE == want && !available)
+    return false;
+
+  impl = want;
+  native = available && LCA_SHA256_PORTABLE != want;
+  selected = true;
+
+  LCA_LOG (DEBUG, "SHA-256 %s compression, %s one shot digests",
+           native ? "native" : "portable",
+           LCA_SHA256_GCRYPT == want ? "gcrypt" : "built-in");
+
+  return true;
+}
+
+void
+sha256_blocks (uint32_t h[8], const uint8_t *blocks, size_t n)
+{
+  uint32_t check[8];
+
+  if (!selected)
+    lca_sha256_select (LCA_SHA256_AUTO);
+
+  if (!native)
+    {
+      blocks_portable (h, blocks, n);
+      return;
+    }
+
+  if (LCA_SHA256_CROSSCHECK == impl)
+    {
+      memcpy (check, h, sizeof (check));
+      blocks_portable (check, blocks, n);
+    }
+
+  blocks_native (h, blocks, n);
+
+  if (LCA_SHA256_CROSSCHECK == impl)
+    assert (0 == memcmp (check, h, sizeof (check)));
+}
+
+void
+sha256_init (struct sha256_ctx *ctx)
+{
+  sha256_resume (ctx, H0, 0);
+}
+
+void
+sha256_resume (struct sha256_ctx *ctx, const uint32_t h[8], uint64_t len)
+{
+  assert (NULL != ctx);
+  assert (0 == len % SHA256_BLOCK_LEN);
+
+  memcpy (ctx->h, h, sizeof (ctx->h));
+  ctx->len = len;
+  ctx->fill = 0;
+}
+
+void
+sha256_update (struct sha256_ctx *ctx, const uint8_t *data, size_t len)
+{
+  size_t n;
+
+  assert (NULL != ctx);
+  assert (NULL != data || 0 == len);
+
+  /* memcpy may not be passed NULL, even for zero bytes */
+  if (0 == len)
+    return;
+
+  ctx->len += len;
+
+  if (ctx->fill > 0)
+    {
+      n = SHA256_BLOCK_LEN - ctx->fill;
+      if (n > len)
+        n = len;
+
+      memcpy (ctx->buf + ctx->fill, data, n);
+      ctx->fill += n;
+      data += n;
+      len -= n;
+
+      if (SHA256_BLOCK_LEN != ctx->fill)
+        return;
+
+      sha256_blocks (ctx->h, ctx->buf, 1);
+      ctx->fill = 0;
+    }
+
+  if (len >= SHA256_BLOCK_LEN)
+    {
+      n = len / SHA256_BLOCK_LEN;
+      sha256_blocks (ctx->h, data, n);
+      data += n * SHA256_BLOCK_LEN;
+      len -= n * SHA256_BLOCK_LEN;
+    }
+
+  memcpy (ctx->buf, data, len);
+  ctx->fill = len;
+}
+
+void
+sha256_final (struct sha256_ctx *ctx, uint8_t *digest)
+{
+  const uint64_t bits = ctx->len * 8;
+
+  assert (NULL != digest);
+
+  ctx->buf[ctx->fill++] = 0x80;
+
+  if (ctx->fill > SHA256_BLOCK_LEN - 8)
+    {
+      memset (ctx->buf + ctx->fill, 0, SHA256_BLOCK_LEN - ctx->fill);
+      sha256_blocks (ctx->h, ctx->buf, 1);
+      ctx->fill = 0;
+    }
+
+  memset (ctx->buf + ctx->fill, 0, SHA256_BLOCK_LEN - 8 - ctx->fill);
+  store_be32 (ctx->buf + SHA256_BLOCK_LEN - 8, bits >> 32);
+  store_be32 (ctx->buf + SHA256_BLOCK_LEN - 4, bits);
+  sha256_blocks (ctx->h, ctx->buf, 1);
+
+  sha256_state_bytes (ctx->h, digest);
+
+  smemset (ctx, 0, sizeof (*ctx));
+}
+
+void
+sha256_state_bytes (const uint32_t h[8], uint8_t *digest)
+{
+  unsigned int x;
+
+  for (x = 0; x < 8; x++)
+    store_be32 (digest + x * 4, h[x]);
+}
+
+void
+sha256 (const uint8_t *data, size_t len, uint8_t *digest)
+{
+  struct sha256_ctx ctx;
+  uint8_t check[SHA256_DIGEST_LEN];
+
+  if (!selected)
+    lca_sha256_select (LCA_SHA256_AUTO);
+
+  if (LCA_SHA256_GCRYPT == impl || LCA_SHA256_CROSSCHECK == impl)
+    {
+      assert (NULL != gcry_check_version (NULL));
+      gcry_md_hash_buffer (GCRY_MD_SHA256, check, data, len);
+
+      if (LCA_SHA256_GCRYPT == impl)
+        {
+          memcpy (digest, check, sizeof (check));
+          return;
+        }
+    }
+
+  sha256_init (&ctx);
+  sha256_update (&ctx, data, len);
+  sha256_final (&ctx, digest);
+
+  if (LCA_SHA256_CROSSCHECK == impl)
+    assert (0 == memcmp (check, digest, sizeof (check)));
+}
@@ -0,0 +1,106 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_BLOCK_LEN 64
+#define SHA256_DIGEST_LEN 32
+
+struct sha256_ctx
+{
+  uint32_t h[8];
+  uint64_t len;
+  uint8_t buf[SHA256_BLOCK_LEN];
+  unsigned int fill;
+};
+
+/**
+ * Runs the SHA-256 compression function over whole blocks.
+ *
+ * @param h The chaining state, updated in place.
+ * @param blocks The input, a multiple of SHA256_BLOCK_LEN bytes.
+ * @param n The number of blocks.
+ */
+void
+sha256_blocks (uint32_t h[8], const uint8_t *blocks, size_t n);
+
+/**
+ * Writes a chaining state out big endian, which is the digest once the
+ * padding has been hashed.
+ *
+ * @param h The state.
+ * @param digest The SHA256_DIGEST_LEN byte destination.
+ */
+void
+sha256_state_bytes (const uint32_t h[8], uint8_t *digest);
+
+/**
+ * Loads the SHA-256 initial state.
+ *
+ * @param ctx The context.
+ */
+void
+sha256_init (struct sha256_ctx *ctx);
+
+/**
+ * Starts a context from a midstate that has already absorbed len
+ * bytes, which must be a multiple of the block size.
+ *
+ * @param ctx The context.
+ * @param h The midstate.
+ * @param len The number of bytes the midstate covers.
+ */
+void
+sha256_resume (struct sha256_ctx *ctx, const uint32_t h[8], uint64_t len);
+
+/**
+ * Absorbs more data.
+ *
+ * @param ctx The context.
+ * @param data The data, which may be NULL if len is zero.
+ * @param len The length of data.
+ */
+void
+sha256_update (struct sha256_ctx *ctx, const uint8_t *data, size_t len);
+
+/**
+ * Pads, finishes and wipes the context.
+ *
+ * @param ctx The context.
+ * @param digest The SHA256_DIGEST_LEN byte result.
+ */
+void
+sha256_final (struct sha256_ctx *ctx, uint8_t *digest);
+
+/**
+ * One shot SHA-256 with no allocation.
+ *
+ * @param data The data.
+ * @param len The length of data.
+ * @param digest The SHA256_DIGEST_LEN byte result.
+ */
+void
+sha256 (const uint8_t *data, size_t len, uint8_t *digest);
+
+#endif /* SHA256_H */
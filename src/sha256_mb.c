@@ -0,0 +1,345 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <string.h>
+#include "sha256.h"
+#include "sha256_mb.h"
+#include "util.h"
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define HAVE_MB_X86 1
+#include <immintrin.h>
+#endif
+
+static const uint32_t K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+typedef void (*mb_kernel) (uint32_t (*h)[8], const uint8_t *data,
+                           size_t stride, size_t nblocks, unsigned int lanes);
+
+static void
+blocks_scalar (uint32_t (*h)[8], const uint8_t *data, size_t stride,
+               size_t nblocks, unsigned int lanes)
+{
+  unsigned int i;
+
+  for (i = 0; i < lanes; i++)
+    sha256_blocks (h[i], data + i * stride, nblocks);
+}
+
+#ifdef HAVE_MB_X86
+
+/* The vector kernels keep lane i of every register for stream i.  Short
+   chunks point their spare lanes at stream 0 and drop the results. */
+
+#define AVX2_LANES 8
+
+__attribute__ ((target ("avx2"))) static inline __m256i
+ror256 (__m256i x, int n)
+{
+  return _mm256_or_si256 (_mm256_srli_epi32 (x, n),
+                          _mm256_slli_epi32 (x, 32 - n));
+}
+
+__attribute__ ((target ("avx2"))) static void
+blocks_avx2 (uint32_t (*h)[8], const uint8_t *data, size_t stride,
+             size_t nblocks, unsigned int lanes)
+{
+  const __m256i bswap = _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4,
+                                          11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4,
+                                          11, 10, 9, 8, 15, 14, 13, 12);
+  uint32_t tmp[AVX2_LANES] __attribute__ ((aligned (32)));
+  int32_t idx[AVX2_LANES] __attribute__ ((aligned (32)));
+  __m256i s[8], w[16], v[8], index, t1, t2;
+  unsigned int i, j, t;
+  size_t b;
+
+  for (i = 0; i < AVX2_LANES; i++)
+    idx[i] = i < lanes ? (int32_t)(i * stride) : 0;
+  index = _mm256_load_si256 ((const __m256i *)idx);
+
+  for (j = 0; j < 8; j++)
+    {
+      for (i = 0; i < AVX2_LANES; i++)
+        tmp[i] = h[i < lanes ? i : 0][j];
+      s[j] = _mm256_load_si256 ((const __m256i *)tmp);
+    }
+
+  for (b = 0; b < nblocks; b++)
+    {
+      const uint8_t *block = data + b * SHA256_BLOCK_LEN;
+
+      for (t = 0; t < 16; t++)
+        w[t] = _mm256_shuffle_epi8
+          (_mm256_i32gather_epi32 ((const int *)(block + t * 4), index, 1),
+           bswap);
+
+      memcpy (v, s, sizeof (v));
+
+      for (t = 0; t < 64; t++)
+        {
+          if (t >= 16)
+            {
+              const __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+              const __m256i s0 = _mm256_xor_si256
+                (_mm256_xor_si256 (ror256 (w15, 7), ror256 (w15, 18)),
+                 _mm256_srli_epi32 (w15, 3));
+              const __m256i s1 = _mm256_xor_si256
+                (_mm256_xor_si256 (ror256 (w2, 17), ror256 (w2, 19)),
+                 _mm256_srli_epi32 (w2, 10));
+              w[t & 15] = _mm256_add_epi32
+                (_mm256_add_epi32 (w[t & 15], s0),
+                 _mm256_add_epi32 (w[(t - 7) & 15], s1));
+            }
+
+          t1 = _mm256_add_epi32
+            (_mm256_add_epi32
+             (v[7], _mm256_xor_si256
+              (_mm256_xor_si256 (ror256 (v[4], 6), ror256 (v[4], 11)),
+               ror256 (v[4], 25))),
+             _mm256_add_epi32
+             (_mm256_xor_si256 (_mm256_and_si256 (v[4], v[5]),
+                                _mm256_andnot_si256 (v[4], v[6])),
+              _mm256_add_epi32 (_mm256_set1_epi32 (K[t]), w[t & 15])));
+          t2 = _mm256_add_epi32
+            (_mm256_xor_si256
+             (_mm256_xor_si256 (ror256 (v[0], 2), ror256 (v[0], 13)),
+              ror256 (v[0], 22)),
+             _mm256_xor_si256
+             (_mm256_xor_si256 (_mm256_and_si256 (v[0], v[1]),
+                                _mm256_and_si256 (v[0], v[2])),
+              _mm256_and_si256 (v[1], v[2])));
+
+          v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+          v[4] = _mm256_add_epi32 (v[3], t1);
+          v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+          v[0] = _mm256_add_epi32 (t1, t2);
+        }
+
+      for (j = 0; j < 8; j++)
+        s[j] = _mm256_add_epi32 (s[j], v[j]);
+    }
+
+  for (j = 0; j < 8; j++)
+    {
+      _mm256_store_si256 ((__m256i *)tmp, s[j]);
+      for (i = 0; i < lanes; i++)
+        h[i][j] = tmp[i];
+    }
+
+  smemset (w, 0, sizeof (w));
+  smemset (v, 0, sizeof (v));
+}
+
+#define AVX512_LANES 16
+
+__attribute__ ((target ("avx512f"))) static void
+blocks_avx512 (uint32_t (*h)[8], const uint8_t *data, size_t stride,
+               size_t nblocks, unsigned int lanes)
+{
+  const __m512i hi = _mm512_set1_epi32 ((int)0xFF00FF00);
+  const __m512i lo = _mm512_set1_epi32 (0x00FF00FF);
+  uint32_t tmp[AVX512_LANES] __attribute__ ((aligned (64)));
+  int32_t idx[AVX512_LANES] __attribute__ ((aligned (64)));
+  __m512i s[8], w[16], v[8], index, t1, t2, x;
+  unsigned int i, j, t;
+  size_t b;
+
+  for (i = 0; i < AVX512_LANES; i++)
+    idx[i] = i < lanes ? (int32_t)(i * stride) : 0;
+  index = _mm512_load_si512 (idx);
+
+  for (j = 0; j < 8; j++)
+    {
+      for (i = 0; i < AVX512_LANES; i++)
+        tmp[i] = h[i < lanes ? i : 0][j];
+      s[j] = _mm512_load_si512 (tmp);
+    }
+
+  for (b = 0; b < nblocks; b++)
+    {
+      const uint8_t *block = data + b * SHA256_BLOCK_LEN;
+
+      /* Byte swap with rotates, which needs no AVX-512BW */
+      for (t = 0; t < 16; t++)
+        {
+          x = _mm512_i32gather_epi32 (index, block + t * 4, 1);
+          w[t] = _mm512_or_si512
+            (_mm512_and_si512 (_mm512_ror_epi32 (x, 8), hi),
+             _mm512_and_si512 (_mm512_rol_epi32 (x, 8), lo));
+        }
+
+      memcpy (v, s, sizeof (v));
+
+      for (t = 0; t < 64; t++)
+        {
+          if (t >= 16)
+            {
+              const __m512i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+              const __m512i s0 = _mm512_ternarylogic_epi32
+                (_mm512_ror_epi32 (w15, 7), _mm512_ror_epi32 (w15, 18),
+                 _mm512_srli_epi32 (w15, 3), 0x96);
+              const __m512i s1 = _mm512_ternarylogic_epi32
+                (_mm512_ror_epi32 (w2, 17), _mm512_ror_epi32 (w2, 19),
+                 _mm512_srli_epi32 (w2, 10), 0x96);
+              w[t & 15] = _mm512_add_epi32
+                (_mm512_add_epi32 (w[t & 15], s0),
+                 _mm512_add_epi32 (w[(t - 7) & 15], s1));
+            }
+
+          /* 0x96 is a ^ b ^ c, 0xCA is a ? b : c, 0xE8 is majority */
+          t1 = _mm512_add_epi32
+            (_mm512_add_epi32
+             (v[7], _mm512_ternarylogic_epi32
+              (_mm512_ror_epi32 (v[4], 6), _mm512_ror_epi32 (v[4], 11),
+               _mm512_ror_epi32 (v[4], 25), 0x96)),
+             _mm512_add_epi32
+             (_mm512_ternarylogic_epi32 (v[4], v[5], v[6], 0xCA),
+              _mm512_add_epi32 (_mm512_set1_epi32 (K[t]), w[t & 15])));
+          t2 = _mm512_add_epi32
+            (_mm512_ternarylogic_epi32
+             (_mm512_ror_epi32 (v[0], 2), _mm512_ror_epi32 (v[0], 13),
+              _mm512_ror_epi32 (v[0], 22), 0x96),
+             _mm512_ternarylogic_epi32 (v[0], v[1], v[2], 0xE8));
+
+          v[7] = v[6]; v[6] = v[5]; v[5] = v[4];
+          v[4] = _mm512_add_epi32 (v[3], t1);
+          v[3] = v[2]; v[2] = v[1]; v[1] = v[0];
+          v[0] = _mm512_add_epi32 (t1, t2);
+        }
+
+      for (j = 0; j < 8; j++)
+        s[j] = _mm512_add_epi32 (s[j], v[j]);
+    }
+
+  for (j = 0; j < 8; j++)
+    {
+      _mm512_store_si512 (tmp, s[j]);
+      for (i = 0; i < lanes; i++)
+        h[i][j] = tmp[i];
+    }
+
+  smemset (w, 0, sizeof (w));
+  smemset (v, 0, sizeof (v));
+}
+
+#endif /* HAVE_MB_X86 */
+
+static mb_kernel kernel = NULL;
+static unsigned int kernel_lanes = 1;
+
+void
+sha256_mb_pad (uint8_t *lane, unsigned int len, uint64_t total,
+               unsigned int size)
+{
+  const uint64_t bits = total * 8;
+  unsigned int x;
+
+  lane[len] = 0x80;
+  memset (lane + len + 1, 0, size - len - 1);
+
+  for (x = 0; x < 8; x++)
+    lane[size - 1 - x] = bits >> (x * 8);
+}
+
+bool
+sha256_mb_select (enum SHA256_MB_IMPL impl)
+{
+#ifdef HAVE_MB_X86
+  __builtin_cpu_init ();
+
+  if (SHA256_MB_AUTO == impl)
+    {
+      if (__builtin_cpu_supports ("avx512f"))
+        impl = SHA256_MB_AVX512;
+      else if (__builtin_cpu_supports ("avx2"))
+        impl = SHA256_MB_AVX2;
+      else
+        impl = SHA256_MB_SCALAR;
+    }
+
+  switch (impl)
+    {
+    case SHA256_MB_AVX512:
+      if (!__builtin_cpu_supports ("avx512f"))
+        return false;
+      kernel = blocks_avx512;
+      kernel_lanes = AVX512_LANES;
+      return true;
+    case SHA256_MB_AVX2:
+      if (!__builtin_cpu_supports ("avx2"))
+        return false;
+      kernel = blocks_avx2;
+      kernel_lanes = AVX2_LANES;
+      return true;
+    default:
+      break;
+    }
+#endif
+
+  if (SHA256_MB_AUTO != impl && SHA256_MB_SCALAR != impl)
+    return false;
+
+  kernel = blocks_scalar;
+  kernel_lanes = 1;
+
+  return true;
+}
+
+void
+sha256_mb_blocks (uint32_t (*h)[8], const uint8_t *data, size_t stride,
+                  size_t nblocks, unsigned int lanes)
+{
+  unsigned int n;
+
+  assert (NULL != h);
+  assert (NULL != data || 0 == lanes);
+  /* Gather offsets are 32 bit */
+  assert (stride * lanes < 0x7FFFFFFF);
+
+  if (NULL == kernel)
+    sha256_mb_select (SHA256_MB_AUTO);
+
+  for (; lanes > 0; lanes -= n, h += n, data += n * stride)
+    {
+      n = lanes < kernel_lanes ? lanes : kernel_lanes;
+
+      /* A lone stream is quicker without the transposes */
+      if (1 == n)
+        blocks_scalar (h, data, stride, nblocks, n);
+      else
+        kernel (h, data, stride, nblocks, n);
+    }
+}
@@ -0,0 +1,79 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SHA256_MB_H
+#define SHA256_MB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The most lanes any kernel hashes at once */
+#define SHA256_MB_LANES_MAX 16
+
+enum SHA256_MB_IMPL
+  {
+    SHA256_MB_AUTO = 0,
+    SHA256_MB_SCALAR,
+    SHA256_MB_AVX2,
+    SHA256_MB_AVX512
+  };
+
+/**
+ * Hashes independent streams of the same number of whole blocks side
+ * by side.  Stream i starts at data + i * stride; padding is the
+ * caller's job.
+ *
+ * @param h The chaining state of each lane, updated in place.
+ * @param data The first stream.
+ * @param stride The distance between streams in bytes.
+ * @param nblocks The number of blocks in each stream.
+ * @param lanes The number of streams.
+ */
+void
+sha256_mb_blocks (uint32_t (*h)[8], const uint8_t *data, size_t stride,
+                  size_t nblocks, unsigned int lanes);
+
+/**
+ * Pads the end of a lane in place.
+ *
+ * @param lane The lane, holding len bytes of message.
+ * @param len The bytes of message in the lane.
+ * @param total The length of the whole message, including any blocks
+ * already in the chaining state.
+ * @param size The padded size of the lane, a multiple of the block
+ * size with room for nine more bytes.
+ */
+void
+sha256_mb_pad (uint8_t *lane, unsigned int len, uint64_t total,
+               unsigned int size);
+
+/**
+ * Selects the kernel, for testing.  SHA256_MB_AUTO picks the widest
+ * one the CPU supports.
+ *
+ * @param impl The kernel.
+ *
+ * @return False if the CPU lacks it, in which case nothing changes.
+ */
+bool
+sha256_mb_select (enum SHA256_MB_IMPL impl);
+
+#endif /* SHA256_MB_H */
@@ -110,7 +110,7 @@ lca_c2b (char c)
     result = c - '0';
   else if (c >= 'A' && c <= 'F')
     result = c - 'A' + 10;
-  else if (c >= 'a' && c >= 'f')
+  else if (c >= 'a' && c <= 'f')
     result = c - 'a' + 10;
   else
     result = UINT_MAX;
@@ -136,26 +136,7 @@ lca_ascii_hex_2_bin (const char* hex,
     {
       result = lca_make_buffer (len / 2);
 
-      unsigned int x;
-
-      bool ishex = true;
-      for (x=0; x<len && ishex; x++)
-        {
-          unsigned int a;
-
-          if ((a = lca_c2b (hex[x])) != UINT_MAX)
-            {
-              if (x % 2 == 0)
-                result.ptr[x/2] = (a << 4);
-              else
-                result.ptr[x/2] += a;
-            }
-          else
-            ishex = false;
-
-        }
-
-      if (!ishex)
+      if (0 != lca_hex_decode (hex, len, result.ptr))
         {
           lca_free_octet_buffer (result);
           result.ptr = NULL;
@@ -234,12 +215,31 @@ lca_xor_buffers (const struct lca_octet_buffer lhs,
 void *
 smemset(void *s, int c, size_t n)
 {
+#if defined (__GNUC__)
+  /* The barrier keeps the store from being dropped as dead */
+  memset (s, c, n);
+  __asm__ __volatile__ ("" : : "r" (s) : "memory");
+#else
   volatile char *p=s;
   while (n--)
     *p++=c;
+#endif
   return s;
 }
 
+bool
+cmemeq (const void *a, const void *b, size_t n)
+{
+  const volatile uint8_t *pa = a;
+  const volatile uint8_t *pb = b;
+  uint8_t diff = 0;
+
+  while (n--)
+    diff |= *pa++ ^ *pb++;
+
+  return 0 == diff;
+}
+
 /* Adapted from
    http://jansson.readthedocs.org/en/latest/apiref.html#library-version
 */
@@ -39,4 +39,17 @@
 void *
 smemset(void *s, int c, size_t n);
 
+/**
+ * Compares two buffers in time independent of their contents, for
+ * checking MACs and other secrets.
+ *
+ * @param a The first buffer.
+ * @param b The second buffer.
+ * @param n The number of bytes to compare.
+ *
+ * @return True if equal.
+ */
+bool
+cmemeq (const void *a, const void *b, size_t n);
+
 #endif /* UTIL_H */
@@ -0,0 +1,285 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gcrypt.h>
+#include "verify_cache.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* Only successful verifications are remembered: a (key, digest,
+   signature) triple that verified once always will, whichever of the
+   device or the host checked it.
+
+   All state is under one lock, so verifies may run on any thread. */
+
+#define VERIFY_CACHE_DEFAULT_ENTRIES 64
+#define VERIFY_KEY_LEN 32
+#define P256_POINT_LEN 64
+#define DIGEST_LEN 32
+#define SIGNATURE_LEN 64
+#define MAX_TRACKED_DEVICES 8
+
+struct verify_entry
+{
+  uint8_t key[VERIFY_KEY_LEN];
+  uint64_t last_used;           /* 0 if unused */
+};
+
+struct tempkey
+{
+  int fd;
+  uint8_t digest[DIGEST_LEN];
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct verify_entry *entries = NULL;
+static unsigned int num_entries = VERIFY_CACHE_DEFAULT_ENTRIES;
+static uint64_t use_counter = 0;
+static struct lca_verify_cache_stats stats;
+
+static struct tempkey tempkeys[MAX_TRACKED_DEVICES];
+static bool tempkeys_initialized = false;
+
+static void
+make_key (struct lca_octet_buffer pub_key, const uint8_t *digest,
+          const uint8_t *signature, uint8_t *key)
+{
+  uint8_t msg[P256_POINT_LEN + DIGEST_LEN + SIGNATURE_LEN];
+  const uint8_t *point = pub_key.ptr;
+
+  assert (NULL != pub_key.ptr);
+  assert (P256_POINT_LEN == pub_key.len || P256_POINT_LEN + 1 == pub_key.len);
+
+  /* Skip the uncompressed point tag so both verify paths agree */
+  if (P256_POINT_LEN + 1 == pub_key.len)
+    point++;
+
+  memcpy (msg, point, P256_POINT_LEN);
+  memcpy (msg + P256_POINT_LEN, digest, DIGEST_LEN);
+  memcpy (msg + P256_POINT_LEN + DIGEST_LEN, signature, SIGNATURE_LEN);
+
+  gcry_md_hash_buffer (GCRY_MD_SHA256, key, msg, sizeof (msg));
+}
+
+/* Called with the lock held */
+static struct verify_entry *
+get_entries (void)
+{
+  if (NULL == entries && num_entries > 0)
+    entries = calloc (num_entries, sizeof (struct verify_entry));
+
+  return entries;
+}
+
+bool
+verify_cache_lookup (struct lca_octet_buffer pub_key, const uint8_t *digest,
+                     const uint8_t *signature)
+{
+  uint8_t key[VERIFY_KEY_LEN];
+  struct verify_entry *e;
+  bool hit = false;
+  unsigned int x;
+
+  make_key (pub_key, digest, signature, key);
+
+  pthread_mutex_lock (&lock);
+
+  if (NULL != (e = get_entries ()))
+    {
+      for (x = 0; x < num_entries && !hit; x++)
+        if (0 != e[x].last_used && 0 == memcmp (e[x].key, key, sizeof (key)))
+          {
+            e[x].last_used = ++use_counter;
+            hit = true;
+          }
+
+      if (hit)
+        stats.hits++;
+      else
+        stats.misses++;
+    }
+
+  pthread_mutex_unlock (&lock);
+
+  return hit;
+}
+
+void
+verify_cache_insert (struct lca_octet_buffer pub_key, const uint8_t *digest,
+                     const uint8_t *signature)
+{
+  uint8_t key[VERIFY_KEY_LEN];
+  struct verify_entry *e;
+  struct verify_entry *victim = NULL;
+  unsigned int x;
+
+  make_key (pub_key, digest, signature, key);
+
+  pthread_mutex_lock (&lock);
+
+  if (NULL == (e = get_entries ()))
+    {
+      pthread_mutex_unlock (&lock);
+      return;
+    }
+
+  for (x = 0; x < num_entries; x++)
+    {
+      if (0 == e[x].last_used || 0 == memcmp (e[x].key, key, sizeof (key)))
+        {
+          victim = &e[x];
+          break;
+        }
+
+      if (NULL == victim || e[x].last_used < victim->last_used)
+        victim = &e[x];
+    }
+
+  if (0 != victim->last_used && 0 != memcmp (victim->key, key, sizeof (key)))
+    stats.evictions++;
+
+  memcpy (victim->key, key, sizeof (key));
+  victim->last_used = ++use_counter;
+  stats.inserts++;
+
+  pthread_mutex_unlock (&lock);
+}
+
+void
+lca_verify_cache_flush (void)
+{
+  pthread_mutex_lock (&lock);
+
+  if (NULL != entries)
+    memset (entries, 0, num_entries * sizeof (struct verify_entry));
+
+  pthread_mutex_unlock (&lock);
+}
+
+void
+lca_verify_cache_resize (unsigned int entries_max)
+{
+  pthread_mutex_lock (&lock);
+
+  free (entries);
+  entries = NULL;
+  num_entries = entries_max;
+
+  pthread_mutex_unlock (&lock);
+}
+
+void
+lca_verify_cache_get_stats (struct lca_verify_cache_stats *out)
+{
+  assert (NULL != out);
+
+  pthread_mutex_lock (&lock);
+  *out = stats;
+  pthread_mutex_unlock (&lock);
+}
+
+/* Called with the lock held */
+static struct tempkey *
+find_tempkey (int fd, bool create)
+{
+  unsigned int x;
+
+  if (!tempkeys_initialized)
+    {
+      for (x = 0; x < MAX_TRACKED_DEVICES; x++)
+        tempkeys[x].fd = -1;
+      tempkeys_initialized = true;
+    }
+
+  for (x = 0; x < MAX_TRACKED_DEVICES; x++)
+    if (tempkeys[x].fd == fd)
+      return &tempkeys[x];
+
+  if (create)
+    return find_tempkey (-1, false);
+
+  return NULL;
+}
+
+void
+verify_cache_set_tempkey (int fd, const uint8_t *digest)
+{
+  struct tempkey *t;
+
+  if (fd < 0)
+    return;
+
+  pthread_mutex_lock (&lock);
+
+  if (NULL != (t = find_tempkey (fd, true)))
+    {
+      t->fd = fd;
+      memcpy (t->digest, digest, DIGEST_LEN);
+    }
+
+  pthread_mutex_unlock (&lock);
+}
+
+bool
+verify_cache_get_tempkey (int fd, uint8_t *digest)
+{
+  struct tempkey *t;
+  bool known = false;
+
+  assert (NULL != digest);
+
+  if (fd < 0)
+    return false;
+
+  pthread_mutex_lock (&lock);
+
+  if (NULL != (t = find_tempkey (fd, false)))
+    {
+      memcpy (digest, t->digest, DIGEST_LEN);
+      known = true;
+    }
+
+  pthread_mutex_unlock (&lock);
+
+  return known;
+}
+
+void
+verify_cache_forget_tempkey (int fd)
+{
+  struct tempkey *t;
+
+  if (fd < 0)
+    return;
+
+  pthread_mutex_lock (&lock);
+
+  if (NULL != (t = find_tempkey (fd, false)))
+    t->fd = -1;
+
+  pthread_mutex_unlock (&lock);
+}
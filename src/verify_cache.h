@@ -0,0 +1,81 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef VERIFY_CACHE_H
+#define VERIFY_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/**
+ * Returns true if the triple is known to verify.
+ *
+ * @param pub_key The P256 public key, with or without the
+ * uncompressed point tag.
+ * @param digest The 32 byte message digest.
+ * @param signature The 64 byte signature, R + S.
+ */
+bool
+verify_cache_lookup (struct lca_octet_buffer pub_key, const uint8_t *digest,
+                     const uint8_t *signature);
+
+/**
+ * Remembers a triple that verified.
+ *
+ * @param pub_key The P256 public key, with or without the
+ * uncompressed point tag.
+ * @param digest The 32 byte message digest.
+ * @param signature The 64 byte signature, R + S.
+ */
+void
+verify_cache_insert (struct lca_octet_buffer pub_key, const uint8_t *digest,
+                     const uint8_t *signature);
+
+/**
+ * Records the digest loaded into TempKey by a pass through nonce, so
+ * that on-chip verification can be looked up by digest.
+ *
+ * @param fd The open file descriptor.
+ * @param digest The 32 bytes loaded into TempKey.
+ */
+void
+verify_cache_set_tempkey (int fd, const uint8_t *digest);
+
+/**
+ * Copies out the digest known to be in TempKey.
+ *
+ * @param fd The open file descriptor.
+ * @param digest The 32 byte destination.
+ *
+ * @return True if the digest is known.
+ */
+bool
+verify_cache_get_tempkey (int fd, uint8_t *digest);
+
+/**
+ * Forgets the TempKey digest, after any command that may change it.
+ *
+ * @param fd The open file descriptor.
+ */
+void
+verify_cache_forget_tempkey (int fd);
+
+#endif /* VERIFY_CACHE_H */
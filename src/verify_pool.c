@@ -0,0 +1,257 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "p256.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* Workers claim this many jobs at a time, so runs under one key share
+   an inversion and claiming costs one atomic add per chunk. */
+#define CHUNK P256_VERIFY_BATCH
+
+/* Each thread's scratch space for a chunk */
+struct worker
+{
+  struct lca_verify_pool *pool;
+  pthread_t thread;
+  struct lca_p256_sig_item items[CHUNK];
+  bool valid[CHUNK];
+};
+
+struct lca_verify_pool
+{
+  pthread_mutex_t lock;
+  pthread_mutex_t run_lock;
+  pthread_cond_t work;
+  pthread_cond_t finished;
+  unsigned int workers;
+  unsigned int started;
+  struct worker *threads;
+  /* The run in progress */
+  const struct lca_verify_job *jobs;
+  bool *valid;
+  unsigned int count;
+  unsigned int next;
+  unsigned int busy;
+  unsigned int matched;
+  unsigned long generation;
+  bool stop;
+};
+
+/* Verifies jobs [first, first + n), a run of same key jobs at a time */
+static unsigned int
+verify_chunk (struct worker *w, unsigned int first, unsigned int n)
+{
+  const struct lca_verify_job *jobs = w->pool->jobs + first;
+  bool *valid = w->pool->valid + first;
+  unsigned int x, y, len, matched = 0;
+
+  for (x = 0; x < n; x += len)
+    {
+      for (len = 0; x + len < n && jobs[x + len].key == jobs[x].key; len++)
+        {
+          w->items[len].digest = jobs[x + len].digest;
+          w->items[len].signature = jobs[x + len].signature;
+        }
+
+      assert (NULL != jobs[x].key);
+      p256_ecdsa_verify_table_batch (&jobs[x].key->table, w->items, len,
+                                     w->valid);
+
+      for (y = 0; y < len; y++)
+        {
+          valid[x + y] = w->valid[y];
+          matched += w->valid[y];
+        }
+    }
+
+  return matched;
+}
+
+static unsigned int
+drain (struct worker *w)
+{
+  struct lca_verify_pool *pool = w->pool;
+  unsigned int first, matched = 0;
+
+  while ((first = __atomic_fetch_add (&pool->next, CHUNK, __ATOMIC_RELAXED))
+         < pool->count)
+    matched += verify_chunk (w, first, pool->count - first < CHUNK
+                             ? pool->count - first : CHUNK);
+
+  return matched;
+}
+
+static void *
+worker_main (void *arg)
+{
+  struct worker *w = arg;
+  struct lca_verify_pool *pool = w->pool;
+  unsigned long seen = 0;
+  unsigned int matched;
+
+  pthread_mutex_lock (&pool->lock);
+
+  for (;;)
+    {
+      while (!pool->stop && seen == pool->generation)
+        pthread_cond_wait (&pool->work, &pool->lock);
+
+      if (pool->stop)
+        break;
+
+      seen = pool->generation;
+      pthread_mutex_unlock (&pool->lock);
+
+      matched = drain (w);
+
+      pthread_mutex_lock (&pool->lock);
+      pool->matched += matched;
+      if (0 == --pool->busy)
+        pthread_cond_signal (&pool->finished);
+    }
+
+  pthread_mutex_unlock (&pool->lock);
+
+  return NULL;
+}
+
+static unsigned int
+online_cpus (void)
+{
+  const long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? n : 1;
+}
+
+struct lca_verify_pool *
+lca_verify_pool_new (unsigned int workers)
+{
+  struct lca_verify_pool *pool = calloc (1, sizeof (*pool));
+  unsigned int x;
+
+  assert (NULL != pool);
+
+  pool->workers = 0 == workers ? online_cpus () : workers;
+
+  /* The caller of lca_verify_pool_run is worker 0 */
+  pool->threads = calloc (pool->workers, sizeof (*pool->threads));
+  assert (NULL != pool->threads);
+
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_mutex_init (&pool->run_lock, NULL);
+  pthread_cond_init (&pool->work, NULL);
+  pthread_cond_init (&pool->finished, NULL);
+
+  for (x = 0; x < pool->workers; x++)
+    pool->threads[x].pool = pool;
+
+  for (x = 1; x < pool->workers; x++, pool->started++)
+    if (0 != pthread_create (&pool->threads[x].thread, NULL, worker_main,
+                             &pool->threads[x]))
+      {
+        LCA_LOG (DEBUG, "Failed to start verify worker %u", x);
+        lca_verify_pool_free (pool);
+        return NULL;
+      }
+
+  return pool;
+}
+
+void
+lca_verify_pool_free (struct lca_verify_pool *pool)
+{
+  unsigned int x;
+
+  if (NULL == pool)
+    return;
+
+  pthread_mutex_lock (&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast (&pool->work);
+  pthread_mutex_unlock (&pool->lock);
+
+  for (x = 1; x <= pool->started; x++)
+    pthread_join (pool->threads[x].thread, NULL);
+
+  pthread_cond_destroy (&pool->finished);
+  pthread_cond_destroy (&pool->work);
+  pthread_mutex_destroy (&pool->run_lock);
+  pthread_mutex_destroy (&pool->lock);
+
+  free (pool->threads);
+  free (pool);
+}
+
+unsigned int
+lca_verify_pool_workers (const struct lca_verify_pool *pool)
+{
+  assert (NULL != pool);
+
+  return pool->workers;
+}
+
+unsigned int
+lca_verify_pool_run (struct lca_verify_pool *pool,
+                     const struct lca_verify_job *jobs, unsigned int count,
+                     bool *valid)
+{
+  unsigned int matched;
+
+  assert (NULL != pool);
+  assert (NULL != jobs || 0 == count);
+  assert (NULL != valid || 0 == count);
+
+  if (0 == count)
+    return 0;
+
+  pthread_mutex_lock (&pool->run_lock);
+
+  pthread_mutex_lock (&pool->lock);
+  pool->jobs = jobs;
+  pool->valid = valid;
+  pool->count = count;
+  pool->next = 0;
+  pool->matched = 0;
+  pool->busy = pool->started;
+  pool->generation++;
+  pthread_cond_broadcast (&pool->work);
+  pthread_mutex_unlock (&pool->lock);
+
+  matched = drain (&pool->threads[0]);
+
+  pthread_mutex_lock (&pool->lock);
+  while (0 != pool->busy)
+    pthread_cond_wait (&pool->finished, &pool->lock);
+  matched += pool->matched;
+  pool->jobs = NULL;
+  pool->valid = NULL;
+  pthread_mutex_unlock (&pool->lock);
+
+  pthread_mutex_unlock (&pool->run_lock);
+
+  return matched;
+}
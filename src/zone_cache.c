@@ -0,0 +1,421 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zone_cache.h"
+#include "zone_plan.h"
+#include "devstore.h"
+#include "ecdh_cache.h"
+#include "command_util.h"
+#include "atsha204_command.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+/* Devices are identified by their file descriptor, so the cache for
+   an fd is dropped when it is set up or torn down. */
+#define MAX_CACHED_DEVICES 8
+
+struct zone_cache
+{
+  int fd;
+  bool config_valid;
+  bool otp_valid;
+  uint8_t config[CONFIG_ZONE_SIZE];
+  uint8_t otp[OTP_ZONE_SIZE];
+  struct lca_config_view view;
+  uint8_t data[DATA_ZONE_SIZE];
+  uint32_t data_valid[WORD_MAP_LEN];
+};
+
+/* The entries are under cache_lock, which is only held to copy in and out.
+   Device reads and the device store run without it. */
+static struct zone_cache caches[MAX_CACHED_DEVICES];
+static bool caches_initialized = false;
+static unsigned int next_victim = 0;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+reset_entry (struct zone_cache *c)
+{
+  smemset (c, 0, sizeof (*c));
+  c->fd = -1;
+}
+
+/* Called with cache_lock held */
+static struct zone_cache *
+find_entry (int fd, bool create)
+{
+  unsigned int x;
+
+  if (!caches_initialized)
+    {
+      for (x = 0; x < MAX_CACHED_DEVICES; x++)
+        reset_entry (&caches[x]);
+      caches_initialized = true;
+    }
+
+  for (x = 0; x < MAX_CACHED_DEVICES; x++)
+    if (caches[x].fd == fd)
+      return &caches[x];
+
+  if (!create)
+    return NULL;
+
+  for (x = 0; x < MAX_CACHED_DEVICES; x++)
+    if (caches[x].fd < 0)
+      break;
+
+  if (MAX_CACHED_DEVICES == x)
+    {
+      x = next_victim;
+      next_victim = (next_victim + 1) % MAX_CACHED_DEVICES;
+    }
+
+  reset_entry (&caches[x]);
+  caches[x].fd = fd;
+
+  return &caches[x];
+}
+
+static bool
+read_zone (int fd, enum DATA_ZONE zone, uint8_t *dst, unsigned int len)
+{
+  uint32_t words[WORD_MAP_LEN];
+  struct zone_plan *plan = malloc (sizeof (*plan));
+  bool result;
+
+  assert (NULL != plan);
+
+  memset (words, 0, sizeof (words));
+  word_map_mark (words, 0, len);
+
+  plan_reads (zone, words, plan);
+  result = run_reads (fd, plan, dst);
+
+  free (plan);
+
+  return result;
+}
+
+static void
+decode_view (struct zone_cache *c)
+{
+  struct lca_octet_buffer cz = {c->config, sizeof (c->config)};
+
+  lca_decode_config (cz, &c->view);
+}
+
+/* Copies out the cached config or OTP image, called with cache_lock
+   held */
+static bool
+copy_image (const struct zone_cache *c, enum DATA_ZONE zone, uint8_t *image)
+{
+  switch (zone)
+    {
+    case CONFIG_ZONE:
+      if (c->config_valid)
+        memcpy (image, c->config, sizeof (c->config));
+      return c->config_valid;
+    case OTP_ZONE:
+      if (c->otp_valid)
+        memcpy (image, c->otp, sizeof (c->otp));
+      return c->otp_valid;
+    default:
+      return false;
+    }
+}
+
+/* Called with cache_lock held */
+static void
+install_image (struct zone_cache *c, enum DATA_ZONE zone,
+               const uint8_t *image)
+{
+  switch (zone)
+    {
+    case CONFIG_ZONE:
+      memcpy (c->config, image, sizeof (c->config));
+      decode_view (c);
+      c->config_valid = true;
+      break;
+    case OTP_ZONE:
+      memcpy (c->otp, image, sizeof (c->otp));
+      c->otp_valid = true;
+      break;
+    default:
+      assert (false);
+    }
+}
+
+/* Copies out the cached config or OTP image, reading it on a miss.
+   The device stays locked from the read to the install, so a write
+   from another thread lands before the read or invalidates after
+   it. */
+static bool
+get_zone (int fd, enum DATA_ZONE zone, unsigned int len, uint8_t *image)
+{
+  bool result, fresh = false;
+
+  assert (NULL != image);
+
+  lca_device_lock (fd);
+  pthread_mutex_lock (&cache_lock);
+
+  if (!(result = copy_image (find_entry (fd, true), zone, image)))
+    {
+      pthread_mutex_unlock (&cache_lock);
+      fresh = read_zone (fd, zone, image, len);
+      pthread_mutex_lock (&cache_lock);
+
+      /* The entry may have been reused while cache_lock was dropped */
+      if (fresh)
+        install_image (find_entry (fd, true), zone, image);
+      result = fresh;
+    }
+
+  pthread_mutex_unlock (&cache_lock);
+
+  if (fresh)
+    {
+      LCA_LOG (DEBUG, "Cached zone %d", zone);
+      devstore_record_zone (fd, zone, image);
+    }
+
+  lca_device_unlock (fd);
+
+  return result;
+}
+
+bool
+zone_cache_get_config (int fd, uint8_t *config)
+{
+  return get_zone (fd, CONFIG_ZONE, CONFIG_ZONE_SIZE, config);
+}
+
+bool
+zone_cache_peek (int fd, enum DATA_ZONE zone, uint8_t *image)
+{
+  const struct zone_cache *c;
+  bool result = false;
+
+  assert (NULL != image);
+
+  pthread_mutex_lock (&cache_lock);
+
+  if (NULL != (c = find_entry (fd, false)))
+    result = copy_image (c, zone, image);
+
+  pthread_mutex_unlock (&cache_lock);
+
+  return result;
+}
+
+bool
+zone_cache_get_view (int fd, struct lca_config_view *view)
+{
+  uint8_t config[CONFIG_ZONE_SIZE];
+  const struct zone_cache *c;
+  bool result = false;
+
+  assert (NULL != view);
+
+  if (!zone_cache_get_config (fd, config))
+    return false;
+
+  pthread_mutex_lock (&cache_lock);
+
+  if (NULL != (c = find_entry (fd, false)) && c->config_valid)
+    {
+      *view = c->view;
+      result = true;
+    }
+
+  pthread_mutex_unlock (&cache_lock);
+
+  /* Dropped since the read: decode the copy instead */
+  if (!result)
+    {
+      struct lca_octet_buffer cz = {config, sizeof (config)};
+
+      result = lca_decode_config (cz, view);
+    }
+
+  return result;
+}
+
+bool
+zone_cache_get_otp (int fd, uint8_t *otp)
+{
+  return get_zone (fd, OTP_ZONE, OTP_ZONE_SIZE, otp);
+}
+
+void
+zone_cache_seed (int fd, enum DATA_ZONE zone, const uint8_t *image)
+{
+  pthread_mutex_lock (&cache_lock);
+  install_image (find_entry (fd, true), zone, image);
+  pthread_mutex_unlock (&cache_lock);
+}
+
+static bool
+is_cached_locked (const struct zone_cache *c, unsigned int offset)
+{
+  return c->config_valid && ZONE_UNLOCKED != c->config[offset];
+}
+
+void
+zone_cache_get_data (int fd, uint32_t *wanted, uint8_t *image)
+{
+  struct zone_cache *c;
+  unsigned int w;
+
+  pthread_mutex_lock (&cache_lock);
+
+  if (NULL != (c = find_entry (fd, false)))
+    for (w = 0; w < ZONE_WORDS_MAX; w++)
+      if (word_map_test (wanted, w) && word_map_test (c->data_valid, w))
+        {
+          memcpy (image + w * 4, c->data + w * 4, 4);
+          wanted[w / 32] &= ~(1u << (w % 32));
+        }
+
+  pthread_mutex_unlock (&cache_lock);
+}
+
+void
+zone_cache_put_data (int fd, const uint32_t *words, const uint8_t *image)
+{
+  struct zone_cache *c;
+  unsigned int w;
+
+  pthread_mutex_lock (&cache_lock);
+
+  c = find_entry (fd, true);
+
+  for (w = 0; w < ZONE_WORDS_MAX; w++)
+    if (word_map_test (words, w))
+      {
+        memcpy (c->data + w * 4, image + w * 4, 4);
+        c->data_valid[w / 32] |= 1u << (w % 32);
+      }
+
+  pthread_mutex_unlock (&cache_lock);
+}
+
+static void
+drop_slot (struct zone_cache *c, uint8_t slot)
+{
+  const unsigned int first = data_slot_offset (slot) / 4;
+  const unsigned int last = data_slot_offset (slot + 1) / 4;
+  unsigned int w;
+
+  for (w = first; w < last; w++)
+    {
+      c->data_valid[w / 32] &= ~(1u << (w % 32));
+      smemset (c->data + w * 4, 0, 4);
+    }
+}
+
+void
+zone_cache_invalidate (int fd, enum DATA_ZONE zone, uint8_t addr)
+{
+  struct zone_cache *c;
+  bool dropped = false;
+
+  /* Data zone addresses carry the slot in bits 3 to 6.  Writing a
+     slot may replace the key in it. */
+  if (DATA_ZONE == zone)
+    {
+      devstore_drop_pub_key (fd, (addr >> 3) & 0x0F);
+      ecdh_cache_invalidate_slot (fd, (addr >> 3) & 0x0F);
+    }
+
+  pthread_mutex_lock (&cache_lock);
+
+  if (NULL != (c = find_entry (fd, false)))
+    switch (zone)
+      {
+      case CONFIG_ZONE:
+        if (!is_cached_locked (c, LOCK_CONFIG_OFFSET))
+          {
+            c->config_valid = false;
+            dropped = true;
+          }
+        break;
+      case OTP_ZONE:
+        /* Only the read only OTP mode is immutable after the lock */
+        if (!is_cached_locked (c, LOCK_DATA_OFFSET) ||
+            OTP_MODE_READ_ONLY != c->config[OTP_MODE_OFFSET])
+          {
+            c->otp_valid = false;
+            dropped = true;
+          }
+        break;
+      case DATA_ZONE:
+        drop_slot (c, (addr >> 3) & 0x0F);
+        break;
+      default:
+        assert (false);
+      }
+
+  pthread_mutex_unlock (&cache_lock);
+
+  if (dropped)
+    devstore_drop_zone (fd, zone);
+}
+
+void
+zone_cache_invalidate_lock (int fd, enum DATA_ZONE zone)
+{
+  struct zone_cache *c;
+
+  devstore_drop_zone (fd, CONFIG_ZONE);
+  if (CONFIG_ZONE != zone)
+    devstore_drop_zone (fd, OTP_ZONE);
+
+  pthread_mutex_lock (&cache_lock);
+
+  if (NULL != (c = find_entry (fd, false)))
+    {
+      c->config_valid = false;
+
+      if (CONFIG_ZONE != zone)
+        c->otp_valid = false;
+    }
+
+  pthread_mutex_unlock (&cache_lock);
+}
+
+void
+lca_flush_zone_cache (int fd)
+{
+  struct zone_cache *c;
+
+  pthread_mutex_lock (&cache_lock);
+
+  if (NULL != (c = find_entry (fd, false)))
+    reset_entry (c);
+
+  pthread_mutex_unlock (&cache_lock);
+}
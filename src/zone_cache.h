@@ -0,0 +1,138 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef ZONE_CACHE_H
+#define ZONE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../libcryptoauth.h"
+
+/* The cache is shared by all threads.  Images and views are copied
+   out under its lock, since another thread may drop or replace the
+   entry at any time. */
+
+/**
+ * Copies the cached config zone image for the device, reading it on
+ * first use.  Once the config zone is locked the image never changes
+ * and is kept until the device is torn down.
+ *
+ * @param fd The open file descriptor.
+ * @param config The CONFIG_ZONE_SIZE byte result.
+ *
+ * @return False if it could not be read.
+ */
+bool
+zone_cache_get_config (int fd, uint8_t *config);
+
+/**
+ * Copies the cached image of the config or OTP zone without reading
+ * the device.
+ *
+ * @param fd The open file descriptor.
+ * @param zone The zone.
+ * @param image The result, the size of the zone.
+ *
+ * @return False if it is not cached or zone is the data zone.
+ */
+bool
+zone_cache_peek (int fd, enum DATA_ZONE zone, uint8_t *image);
+
+/**
+ * Copies the decoded view of the cached config zone, reading it on
+ * first use.
+ *
+ * @param fd The open file descriptor.
+ * @param view The result.
+ *
+ * @return False if the config zone could not be read.
+ */
+bool
+zone_cache_get_view (int fd, struct lca_config_view *view);
+
+/**
+ * Copies the cached OTP zone image for the device, reading it on
+ * first use.  The OTP zone can only be read once the data zone is
+ * locked.
+ *
+ * @param fd The open file descriptor.
+ * @param otp The OTP_ZONE_SIZE byte result.
+ *
+ * @return False if it could not be read.
+ */
+bool
+zone_cache_get_otp (int fd, uint8_t *otp);
+
+/**
+ * Copies the cached words of the data zone into a data zone image
+ * and clears them from the wanted map.
+ *
+ * @param fd The open file descriptor.
+ * @param wanted The word map of words wanted, updated in place.
+ * @param image The DATA_ZONE_SIZE byte image to fill.
+ */
+void
+zone_cache_get_data (int fd, uint32_t *wanted, uint8_t *image);
+
+/**
+ * Caches words of the data zone.  Only slots that can be read in
+ * clear text should be cached; the words of a slot are dropped when
+ * the library writes to it.
+ *
+ * @param fd The open file descriptor.
+ * @param words The word map of words to cache.
+ * @param image The DATA_ZONE_SIZE byte image holding them.
+ */
+void
+zone_cache_put_data (int fd, const uint32_t *words, const uint8_t *image);
+
+/**
+ * Installs a known good zone image, e.g. from the device store.
+ *
+ * @param fd The open file descriptor.
+ * @param zone CONFIG_ZONE or OTP_ZONE.
+ * @param image The zone image to copy.
+ */
+void
+zone_cache_seed (int fd, enum DATA_ZONE zone, const uint8_t *image);
+
+/**
+ * Called after the library writes to or locks a zone.  Drops the
+ * cached image unless the zone is already locked, in which case the
+ * write could not have changed it.
+ *
+ * @param fd The open file descriptor.
+ * @param zone The zone that was written.
+ * @param addr The address that was written.
+ */
+void
+zone_cache_invalidate (int fd, enum DATA_ZONE zone, uint8_t addr);
+
+/**
+ * Called after a lock command.  The lock bytes live in the config
+ * zone, so the config image is dropped along with the OTP image when
+ * the data zone was locked.
+ *
+ * @param fd The open file descriptor.
+ * @param zone The zone that was locked.
+ */
+void
+zone_cache_invalidate_lock (int fd, enum DATA_ZONE zone);
+
+#endif /* ZONE_CACHE_H */
@@ -0,0 +1,374 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zone_plan.h"
+#include "atsha204_command.h"
+#include "zone_cache.h"
+#include "util.h"
+#include "../libcryptoauth.h"
+
+#define WORD_LEN READ4_LENGTH
+#define BLOCK_LEN READ32_LENGTH
+#define WORDS_PER_BLOCK (BLOCK_LEN / WORD_LEN)
+
+/* Relative bus cost of a read, in bytes on the wire: the command, a
+   read's execution time expressed as bytes, and the response with
+   count and CRC.  A 32 byte read wins once three words of a block
+   are wanted. */
+#define COMMAND_COST 8
+#define READ_EXEC_COST 4
+#define READ4_COST (COMMAND_COST + READ_EXEC_COST + WORD_LEN + 3)
+#define READ32_COST (COMMAND_COST + READ_EXEC_COST + BLOCK_LEN + 3)
+
+/* ATECC108 data slots 0 to 7 hold 36 bytes, slot 8 416 bytes and
+   slots 9 to 15 72 bytes. */
+unsigned int
+data_slot_size (uint8_t slot)
+{
+  assert (slot < MAX_SLOTS);
+
+  if (slot < 8)
+    return 36;
+  else if (8 == slot)
+    return 416;
+  else
+    return 72;
+}
+
+unsigned int
+data_slot_offset (uint8_t slot)
+{
+  assert (slot <= MAX_SLOTS);
+
+  if (slot <= 8)
+    return slot * 36;
+  else
+    return 8 * 36 + 416 + (slot - 9) * 72;
+}
+
+uint8_t
+data_offset_to_slot (unsigned int offset)
+{
+  uint8_t slot = 0;
+
+  assert (offset < DATA_ZONE_SIZE);
+
+  while (offset >= data_slot_offset (slot + 1))
+    slot++;
+
+  return slot;
+}
+
+unsigned int
+zone_size (enum DATA_ZONE zone)
+{
+  switch (zone)
+    {
+    case CONFIG_ZONE:
+      return CONFIG_ZONE_SIZE;
+    case OTP_ZONE:
+      return OTP_ZONE_SIZE;
+    case DATA_ZONE:
+      return DATA_ZONE_SIZE;
+    default:
+      assert (false);
+    }
+
+  return 0;
+}
+
+void
+word_map_mark (uint32_t *map, unsigned int offset, unsigned int len)
+{
+  unsigned int w;
+
+  if (0 == len)
+    return;
+
+  assert (offset + len <= DATA_ZONE_SIZE);
+
+  for (w = offset / WORD_LEN; w <= (offset + len - 1) / WORD_LEN; w++)
+    map[w / 32] |= 1u << (w % 32);
+}
+
+bool
+word_map_test (const uint32_t *map, unsigned int word)
+{
+  return (map[word / 32] >> (word % 32)) & 1;
+}
+
+/* A zone is a run of segments, each addressed from block 0: the data
+   slots for the data zone, and the whole zone otherwise. */
+static unsigned int
+segment_count (enum DATA_ZONE zone)
+{
+  return DATA_ZONE == zone ? MAX_SLOTS : 1;
+}
+
+static unsigned int
+segment_offset (enum DATA_ZONE zone, unsigned int seg)
+{
+  return DATA_ZONE == zone ? data_slot_offset (seg) : 0;
+}
+
+static unsigned int
+segment_size (enum DATA_ZONE zone, unsigned int seg)
+{
+  return DATA_ZONE == zone ? data_slot_size (seg) : zone_size (zone);
+}
+
+static uint16_t
+make_addr (enum DATA_ZONE zone, unsigned int seg,
+           unsigned int block, unsigned int word)
+{
+  if (DATA_ZONE == zone)
+    return (block << 8) | (seg << 3) | word;
+  else
+    return block * WORDS_PER_BLOCK + word;
+}
+
+static void
+add_op (struct zone_plan *plan, uint16_t addr, unsigned int offset,
+        unsigned int len)
+{
+  struct zone_op *op;
+
+  assert (plan->count < ZONE_WORDS_MAX);
+
+  op = &plan->ops[plan->count++];
+  op->addr = addr;
+  op->offset = offset;
+  op->len = len;
+}
+
+static void
+plan_zone (enum DATA_ZONE zone, const uint32_t *words,
+           struct zone_plan *plan, bool is_write)
+{
+  unsigned int seg, block, word;
+
+  plan->zone = zone;
+  plan->count = 0;
+
+  for (seg = 0; seg < segment_count (zone); seg++)
+    {
+      const unsigned int base = segment_offset (zone, seg);
+      const unsigned int size = segment_size (zone, seg);
+
+      for (block = 0; block * BLOCK_LEN < size; block++)
+        {
+          const unsigned int start = base + block * BLOCK_LEN;
+          const unsigned int first = start / WORD_LEN;
+          unsigned int in_block = (size - block * BLOCK_LEN) / WORD_LEN;
+          unsigned int wanted = 0;
+
+          if (in_block > WORDS_PER_BLOCK)
+            in_block = WORDS_PER_BLOCK;
+
+          for (word = 0; word < in_block; word++)
+            if (word_map_test (words, first + word))
+              wanted++;
+
+          if (0 == wanted)
+            continue;
+
+          /* The tail of a slot shorter than a block can only be
+             reached a word at a time */
+          if (WORDS_PER_BLOCK == in_block
+              && (is_write ? WORDS_PER_BLOCK == wanted
+                  : wanted * READ4_COST > READ32_COST))
+            {
+              add_op (plan, make_addr (zone, seg, block, 0), start,
+                      BLOCK_LEN);
+              continue;
+            }
+
+          for (word = 0; word < in_block; word++)
+            if (word_map_test (words, first + word))
+              add_op (plan, make_addr (zone, seg, block, word),
+                      start + word * WORD_LEN, WORD_LEN);
+        }
+    }
+}
+
+void
+plan_reads (enum DATA_ZONE zone, const uint32_t *words,
+            struct zone_plan *plan)
+{
+  plan_zone (zone, words, plan, false);
+}
+
+void
+plan_writes (enum DATA_ZONE zone, const uint32_t *words,
+             struct zone_plan *plan)
+{
+  plan_zone (zone, words, plan, true);
+}
+
+bool
+run_reads (int fd, const struct zone_plan *plan, uint8_t *image)
+{
+  unsigned int x;
+
+  for (x = 0; x < plan->count; x++)
+    {
+      const struct zone_op *op = &plan->ops[x];
+
+      if (!read_at (fd, plan->zone, op->addr, image + op->offset, op->len))
+        {
+          LCA_LOG (DEBUG, "Planned read of 0x%04x failed", op->addr);
+          return false;
+        }
+    }
+
+  return true;
+}
+
+bool
+run_writes (int fd, const struct zone_plan *plan, const uint8_t *image)
+{
+  unsigned int x;
+
+  for (x = 0; x < plan->count; x++)
+    {
+      const struct zone_op *op = &plan->ops[x];
+
+      if (!write_at (fd, plan->zone, op->addr, image + op->offset, op->len))
+        {
+          LCA_LOG (DEBUG, "Planned write of 0x%04x failed", op->addr);
+          return false;
+        }
+    }
+
+  return true;
+}
+
+static bool
+mark_requests (enum DATA_ZONE zone, const struct lca_read_request *reqs,
+               unsigned int count, uint32_t *words)
+{
+  bool any = false;
+  unsigned int x;
+
+  memset (words, 0, WORD_MAP_LEN * sizeof (uint32_t));
+
+  for (x = 0; x < count; x++)
+    if (reqs[x].zone == zone && reqs[x].len > 0)
+      {
+        word_map_mark (words, reqs[x].offset, reqs[x].len);
+        any = true;
+      }
+
+  return any;
+}
+
+static bool
+is_valid_request (const struct lca_read_request *r)
+{
+  const unsigned int size = zone_size (r->zone);
+
+  return NULL != r->dst && r->offset <= size && r->len <= size - r->offset;
+}
+
+unsigned int
+lca_plan_read_ranges (const struct lca_read_request *reqs, unsigned int count)
+{
+  const enum DATA_ZONE zones[] = {CONFIG_ZONE, OTP_ZONE, DATA_ZONE};
+  uint32_t words[WORD_MAP_LEN];
+  struct zone_plan *plan;
+  unsigned int x, commands = 0;
+
+  assert (NULL != reqs || 0 == count);
+
+  for (x = 0; x < count; x++)
+    assert (is_valid_request (&reqs[x]));
+
+  plan = malloc (sizeof (*plan));
+  assert (NULL != plan);
+
+  for (x = 0; x < sizeof (zones) / sizeof (zones[0]); x++)
+    if (mark_requests (zones[x], reqs, count, words))
+      {
+        plan_reads (zones[x], words, plan);
+        commands += plan->count;
+      }
+
+  free (plan);
+
+  return commands;
+}
+
+bool
+lca_read_ranges (int fd, const struct lca_read_request *reqs,
+                 unsigned int count)
+{
+  const enum DATA_ZONE zones[] = {CONFIG_ZONE, OTP_ZONE, DATA_ZONE};
+  uint8_t image[DATA_ZONE_SIZE];
+  uint32_t words[WORD_MAP_LEN];
+  struct zone_plan *plan;
+  bool result = true;
+  unsigned int x, z;
+
+  assert (NULL != reqs || 0 == count);
+
+  for (x = 0; x < count; x++)
+    if (!is_valid_request (&reqs[x]))
+      return false;
+
+  plan = malloc (sizeof (*plan));
+  assert (NULL != plan);
+
+  for (z = 0; z < sizeof (zones) / sizeof (zones[0]) && result; z++)
+    {
+      const enum DATA_ZONE zone = zones[z];
+
+      if (!mark_requests (zone, reqs, count, words))
+        continue;
+
+      /* Serve what the zone cache already holds */
+      if (!zone_cache_peek (fd, zone, image))
+        {
+          if (DATA_ZONE == zone)
+            zone_cache_get_data (fd, words, image);
+
+          plan_reads (zone, words, plan);
+
+          LCA_LOG (DEBUG, "Reading zone %d in %u commands", zone,
+                   plan->count);
+
+          if (!(result = run_reads (fd, plan, image)))
+            break;
+        }
+
+      for (x = 0; x < count; x++)
+        if (reqs[x].zone == zone)
+          memcpy (reqs[x].dst, image + reqs[x].offset, reqs[x].len);
+    }
+
+  smemset (image, 0, sizeof (image));
+  free (plan);
+
+  return result;
+}
@@ -0,0 +1,122 @@
+/* -*- mode: c; c-file-style: "gnu" -*-
+ * Copyright (C) 2014-2018 Cryptotronix, LLC.
+ *
+ * This file is part of libcryptoauth.
+ *
+ * libcryptoauth is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * libcryptoauth is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libcryptoauth.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ZONE_PLAN_H
+#define ZONE_PLAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "command_util.h"
+#include "../libcryptoauth.h"
+
+/* Zones are planned a word at a time.  A word map has one bit per 4
+   byte word of the zone image; the data zone image is the slots laid
+   end to end. */
+#define ZONE_WORDS_MAX (DATA_ZONE_SIZE / 4)
+#define WORD_MAP_LEN ((ZONE_WORDS_MAX + 31) / 32)
+
+struct zone_op
+{
+  uint16_t addr;        /* param2 of the command */
+  uint16_t offset;      /* Byte offset in the zone image */
+  uint8_t len;          /* READ4_LENGTH or READ32_LENGTH */
+};
+
+struct zone_plan
+{
+  enum DATA_ZONE zone;
+  unsigned int count;
+  struct zone_op ops[ZONE_WORDS_MAX];
+};
+
+/**
+ * Returns the size of a zone image in bytes.
+ */
+unsigned int
+zone_size (enum DATA_ZONE zone);
+
+/**
+ * Returns the offset of a slot in the data zone image.
+ */
+unsigned int
+data_slot_offset (uint8_t slot);
+
+/**
+ * Returns the size of a data slot in bytes.
+ */
+unsigned int
+data_slot_size (uint8_t slot);
+
+/**
+ * Returns the slot holding a byte offset of the data zone image.
+ */
+uint8_t
+data_offset_to_slot (unsigned int offset);
+
+/**
+ * Sets the bits of all words touched by a byte range.
+ */
+void
+word_map_mark (uint32_t *map, unsigned int offset, unsigned int len);
+
+/**
+ * Returns true if the bit of a word is set.
+ */
+bool
+word_map_test (const uint32_t *map, unsigned int word);
+
+/**
+ * Plans the cheapest reads covering every marked word.  Whole blocks
+ * are read with one 32 byte read once enough of their words are
+ * wanted, the rest a word at a time.
+ *
+ * @param zone The zone to read.
+ * @param words The words wanted.
+ * @param plan Receives the operations, in address order.
+ */
+void
+plan_reads (enum DATA_ZONE zone, const uint32_t *words,
+            struct zone_plan *plan);
+
+/**
+ * Plans writes of every marked word.  A block is written with one 32
+ * byte write when all of it is marked, otherwise a word at a time.
+ */
+void
+plan_writes (enum DATA_ZONE zone, const uint32_t *words,
+             struct zone_plan *plan);
+
+/**
+ * Runs a read plan back to back, filling the zone image.
+ *
+ * @return True if every read succeeded.
+ */
+bool
+run_reads (int fd, const struct zone_plan *plan, uint8_t *image);
+
+/**
+ * Runs a write plan back to back from the zone image.
+ *
+ * @return True if every write succeeded.
+ */
+bool
+run_writes (int fd, const struct zone_plan *plan, const uint8_t *image);
+
+#endif /* ZONE_PLAN_H */
@@ -1,7 +1,10 @@
 #include <stdlib.h>
 #include <argp.h>
+#include <dirent.h>
 #include <gcrypt.h>
 #include <assert.h>
+#include <string.h>
+#include <sys/stat.h>
 #include "../libcryptoauth.h"
 
 const char *argp_program_version =
@@ -14,7 +17,7 @@ static char doc[] =
   "cryptoauth signing utility";
 
 /* A description of the arguments we accept. */
-static char args_doc[] = "KEYFILE";
+static char args_doc[] = "KEYFILE\n--slot SLOT BUS";
 
 /* Number of required args */
 #define NUM_ARGS 1
@@ -29,6 +32,14 @@ static struct argp_option options[] = {
    "DISPLAY option for the result" },
   {"file",     'f', "FILE", 0,
    "FILE to hash and sign instead of stdin" },
+  {"batch",    'b', "LIST", 0,
+   "Sign every file in LIST, a directory or a manifest of paths" },
+  {"output",   'o', "OUTPUT", 0,
+   "Write batch results to OUTPUT instead of stdout" },
+  {"jobs",     'j', "N", 0,
+   "Hash batch files with N threads, one per CPU by default" },
+  {"slot",     'k', "SLOT", 0,
+   "Batch sign with the key in device SLOT; the argument is the I2C bus" },
   { 0 }
 };
 
@@ -39,6 +50,10 @@ struct arguments
   int silent, verbose, hash;
   char *input_file;
   char *display;
+  char *batch;
+  char *output;
+  unsigned int jobs;
+  int slot;
 };
 
 /* Parse a single option. */
@@ -66,6 +81,20 @@ parse_opt (int key, char *arg, struct argp_state *state)
     case 'd':
       arguments->display = arg;
       break;
+    case 'b':
+      arguments->batch = arg;
+      break;
+    case 'o':
+      arguments->output = arg;
+      break;
+    case 'j':
+      arguments->jobs = atoi (arg);
+      break;
+    case 'k':
+      arguments->slot = atoi (arg);
+      if (arguments->slot < 0 || arguments->slot > 15)
+        argp_error (state, "SLOT must be 0 to 15");
+      break;
 
     case ARGP_KEY_ARG:
       if (state->arg_num >= NUM_ARGS)
@@ -161,6 +190,255 @@ KEY:
 OUT:
     return rc;
 }
+
+/* Batch mode: the artifacts are hashed in parallel, then signed in one
+   loop with a key loaded once. */
+
+static int
+cmp_paths (const void *a, const void *b)
+{
+    return strcmp (((const struct lca_file_digest *)a)->path,
+                   ((const struct lca_file_digest *)b)->path);
+}
+
+static void
+add_path (struct lca_file_digest **files, unsigned int *count, char *path)
+{
+    if (0 == *count % 256)
+    {
+        *files = realloc (*files, (*count + 256) * sizeof (**files));
+        assert (NULL != *files);
+    }
+
+    memset (&(*files)[*count], 0, sizeof (**files));
+    (*files)[(*count)++].path = path;
+}
+
+/* Lists the regular files in a directory, sorted, or the paths in a
+   manifest, one per line with blank lines and # comments skipped. */
+static unsigned int
+list_files (const char *list, struct lca_file_digest **files)
+{
+    unsigned int count = 0;
+    struct stat st;
+    char *path;
+
+    *files = NULL;
+
+    if (0 != stat (list, &st))
+        return 0;
+
+    if (S_ISDIR (st.st_mode))
+    {
+        DIR *dir = opendir (list);
+        struct dirent *e;
+
+        if (NULL == dir)
+            return 0;
+
+        while (NULL != (e = readdir (dir)))
+        {
+            if ('.' == e->d_name[0])
+                continue;
+
+            path = malloc (strlen (list) + strlen (e->d_name) + 2);
+            assert (NULL != path);
+            sprintf (path, "%s/%s", list, e->d_name);
+
+            if (0 == stat (path, &st) && S_ISREG (st.st_mode))
+                add_path (files, &count, path);
+            else
+                free (path);
+        }
+
+        closedir (dir);
+        qsort (*files, count, sizeof (**files), cmp_paths);
+    }
+    else
+    {
+        FILE *fp = fopen (list, "r");
+        char *line = NULL;
+        size_t cap = 0;
+        ssize_t len;
+
+        if (NULL == fp)
+            return 0;
+
+        while ((len = getline (&line, &cap, fp)) >= 0)
+        {
+            while (len > 0 && ('\n' == line[len - 1] || '\r' == line[len - 1]))
+                line[--len] = '\0';
+
+            if (0 == len || '#' == line[0])
+                continue;
+
+            path = strdup (line);
+            assert (NULL != path);
+            add_path (files, &count, path);
+        }
+
+        free (line);
+        fclose (fp);
+    }
+
+    return count;
+}
+
+/* The private scalar from a signing key S-expression, right aligned */
+static int
+key_scalar (gcry_sexp_t key, uint8_t *d)
+{
+    gcry_sexp_t tok = gcry_sexp_find_token (key, "d", 0);
+    gcry_mpi_t mpi = NULL;
+    size_t n = 0;
+    int rc = -1;
+
+    if (NULL != tok && NULL != (mpi = gcry_sexp_nth_mpi (tok, 1,
+                                                         GCRYMPI_FMT_USG)))
+    {
+        uint8_t buf[33];
+
+        if (0 == gcry_mpi_print (GCRYMPI_FMT_USG, buf, sizeof (buf), &n, mpi)
+            && n <= 32)
+        {
+            memset (d, 0, 32 - n);
+            memcpy (d + 32 - n, buf, n);
+            rc = 0;
+        }
+
+        lca_wipe (buf, sizeof (buf));
+    }
+
+    gcry_mpi_release (mpi);
+    gcry_sexp_release (tok);
+
+    return rc;
+}
+
+static void
+print_hex (FILE *out, const uint8_t *p, unsigned int len)
+{
+    unsigned int i;
+
+    for (i = 0; i < len; i++)
+        fprintf (out, "%02x", p[i]);
+}
+
+int
+sign_batch (struct arguments *arguments)
+{
+    struct lca_file_digest *files;
+    struct lca_sign_item *items;
+    unsigned int count, x, failed = 0;
+    uint8_t d[32];
+    FILE *out = stdout;
+    int fd = -1;
+
+    count = list_files (arguments->batch, &files);
+    if (0 == count)
+    {
+        fprintf (stderr, "No files to sign in %s\n", arguments->batch);
+        return -2;
+    }
+
+    /* Load the key once: parse the software key, or open the device */
+    if (arguments->slot < 0)
+    {
+        gcry_sexp_t key;
+
+        if (0 != lca_load_signing_key (arguments->args[0], &key))
+            return -1;
+
+        x = key_scalar (key, d);
+        gcry_sexp_release (key);
+
+        if (0 != x)
+        {
+            fprintf (stderr, "No private key in %s\n", arguments->args[0]);
+            return -1;
+        }
+    }
+    else if ((fd = lca_atmel_setup (arguments->args[0], 0x60)) < 0)
+        return -1;
+
+    if (NULL != arguments->output
+        && NULL == (out = fopen (arguments->output, "w")))
+        return -2;
+
+    lca_sha256_files (files, count, arguments->jobs);
+
+    /* The device signs everything in one wake session */
+    items = calloc (count, sizeof (*items));
+    assert (NULL != items);
+
+    for (x = 0; x < count; x++)
+        items[x].digest = files[x].digest;
+
+    if (fd >= 0)
+    {
+        struct lca_sign_item *todo = calloc (count, sizeof (*todo));
+        unsigned int n = 0;
+
+        assert (NULL != todo);
+
+        for (x = 0; x < count; x++)
+            if (files[x].ok)
+                todo[n++] = items[x];
+
+        lca_ecc_sign_batch (fd, arguments->slot, todo, n);
+
+        for (x = 0, n = 0; x < count; x++)
+            if (files[x].ok)
+                items[x] = todo[n++];
+
+        free (todo);
+    }
+    else
+        for (x = 0; x < count; x++)
+            items[x].ok = files[x].ok
+                && lca_p256_sign (d, files[x].digest, items[x].signature);
+
+    fprintf (out, "# status\tpath\tsha256\tsignature\n");
+
+    for (x = 0; x < count; x++)
+    {
+        struct lca_file_digest *f = &files[x];
+        bool ok = items[x].ok;
+
+        fprintf (out, "%s\t%s\t", ok ? "ok" : "error", f->path);
+        if (f->ok)
+            print_hex (out, f->digest, sizeof (f->digest));
+        else
+            fprintf (out, "-");
+        fprintf (out, "\t");
+        if (ok)
+            print_hex (out, items[x].signature, sizeof (items[x].signature));
+        else
+            fprintf (out, "-");
+        fprintf (out, "\n");
+
+        failed += !ok;
+    }
+
+    if (!arguments->silent)
+        fprintf (stderr, "Signed %u of %u files\n", count - failed, count);
+
+    lca_wipe (d, sizeof (d));
+
+    if (fd >= 0)
+        lca_atmel_teardown (fd);
+
+    if (stdout != out)
+        fclose (out);
+
+    for (x = 0; x < count; x++)
+        free ((char *)files[x].path);
+    free (files);
+    free (items);
+
+    return 0 == failed ? 0 : 1;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -174,11 +452,18 @@ main (int argc, char **argv)
   arguments.hash = 0;
   arguments.input_file = NULL;
   arguments.display = "sexp";
+  arguments.batch = NULL;
+  arguments.output = NULL;
+  arguments.jobs = 0;
+  arguments.slot = -1;
 
   /* Parse our arguments; every option seen by parse_opt will
      be reflected in arguments. */
   argp_parse (&argp, argc, argv, 0, 0, &arguments);
 
+  if (NULL != arguments.batch)
+      exit (sign_batch (&arguments));
+
   FILE *fp;
 
   if (NULL == arguments.input_file)
@@ -0,0 +1,259 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "../libcryptoauth.h"
+#include "fake_device.h"
+
+#define OP_READ 0x02
+#define OP_NONCE 0x16
+#define OP_RANDOM 0x1B
+#define OP_GEN_KEY 0x40
+#define OP_ECDH 0x43
+#define OP_SIGN 0x41
+
+struct images
+{
+    uint8_t config[FAKE_CONFIG_SIZE];
+    uint8_t otp[FAKE_OTP_SIZE];
+    uint8_t data[FAKE_DATA_SIZE];
+};
+
+void
+fake_device_default_config (uint8_t *config, uint8_t serial_byte)
+{
+    unsigned int x;
+
+    memset (config, 0, FAKE_CONFIG_SIZE);
+    for (x = 0; x < 4; x++)
+        config[x] = serial_byte;
+    for (x = 8; x < 13; x++)
+        config[x] = serial_byte;
+    /* Every slot a P256 private key that can sign and do ECDH */
+    for (x = 0; x < 16; x++)
+    {
+        config[20 + 2 * x] = 0x85;
+        config[96 + 2 * x] = 0x11;
+    }
+    config[18] = 0xAA;          /* OTP read only */
+    config[86] = 0x00;          /* Data locked */
+    config[87] = 0x00;          /* Config locked */
+}
+
+static void
+log_event (struct fake_log *log, uint8_t event)
+{
+    if (log->count < FAKE_LOG_MAX)
+        log->events[log->count] = event;
+    log->count++;
+}
+
+static void
+respond (int fd, const uint8_t *payload, unsigned int len)
+{
+    uint8_t rsp[3 + 64];
+    uint16_t crc;
+
+    assert (len <= 64);
+
+    rsp[0] = len + 3;
+    memcpy (rsp + 1, payload, len);
+    crc = lca_calculate_crc16 (rsp, len + 1);
+    memcpy (rsp + len + 1, &crc, sizeof (crc));
+
+    if ((ssize_t) (len + 3) != write (fd, rsp, len + 3))
+        _exit (1);
+}
+
+static void
+respond_status (int fd, uint8_t status)
+{
+    uint8_t rsp[4] = {4, status, 0, 0};
+    uint16_t crc = lca_calculate_crc16 (rsp, 2);
+
+    memcpy (rsp + 2, &crc, sizeof (crc));
+    if (4 != write (fd, rsp, sizeof (rsp)))
+        _exit (1);
+}
+
+static void
+serve_read (int fd, const struct images *img, const uint8_t *frame)
+{
+    const unsigned int len = (frame[3] & 0x80) ? 32 : 4;
+    const unsigned int offset = (frame[4] | frame[5] << 8) * 4;
+    const uint8_t *zone;
+    unsigned int size;
+
+    switch (frame[3] & 0x03)
+    {
+    case 0:
+        zone = img->config; size = sizeof (img->config);
+        break;
+    case 1:
+        zone = img->otp; size = sizeof (img->otp);
+        break;
+    default:
+        zone = img->data; size = sizeof (img->data);
+        break;
+    }
+
+    if (offset + len > size)
+        respond_status (fd, 0x03);
+    else
+        respond (fd, zone + offset, len);
+}
+
+/* Random output that passes the entropy pool's health tests */
+static void
+fill_random (uint32_t *state, uint8_t *buf, unsigned int len)
+{
+    unsigned int x;
+
+    for (x = 0; x < len; x++)
+    {
+        *state ^= *state << 13;
+        *state ^= *state >> 17;
+        *state ^= *state << 5;
+        buf[x] = *state >> 24;
+    }
+}
+
+static void
+serve (int fd, const struct images *img, struct fake_log *log)
+{
+    uint8_t frame[256], pattern[64], keys[16][64];
+    uint32_t state = 0x9E3779B9;
+    ssize_t n;
+    uint16_t crc;
+    unsigned int x;
+
+    for (x = 0; x < 16; x++)
+        memset (keys[x], 0xA0 + x, sizeof (keys[x]));
+
+    while ((n = read (fd, frame, sizeof (frame))) > 0)
+    {
+        if (2 == n && 0 == frame[0])
+        {
+            const uint8_t awake[] = {0x11};
+
+            log_event (log, FAKE_EVENT_WAKE);
+            respond (fd, awake, sizeof (awake));
+            continue;
+        }
+
+        if (1 == n)
+        {
+            log_event (log, 0x01 == frame[0] ?
+                       FAKE_EVENT_SLEEP : FAKE_EVENT_IDLE);
+            continue;
+        }
+
+        crc = lca_calculate_crc16 (frame + 1, n - 3);
+        if (n < 8 || 0x03 != frame[0] || frame[1] != n - 1
+            || 0 != memcmp (frame + n - 2, &crc, sizeof (crc)))
+        {
+            log->bad_frames++;
+            respond_status (fd, 0xFF);
+            continue;
+        }
+
+        /* Results differ from command to command */
+        memset (pattern, frame[2] + log->count, sizeof (pattern));
+        log_event (log, frame[2]);
+
+        switch (frame[2])
+        {
+        case OP_READ:
+            serve_read (fd, img, frame);
+            break;
+        case OP_RANDOM:
+            fill_random (&state, pattern, 32);
+            respond (fd, pattern, 32);
+            break;
+        case OP_ECDH:
+            respond (fd, pattern, 32);
+            break;
+        case OP_NONCE:
+            if (0x03 == (frame[3] & 0x03))
+                respond_status (fd, 0);
+            else
+                respond (fd, pattern, 32);
+            break;
+        case OP_GEN_KEY:
+            /* A private key GenKey replaces the slot's key */
+            if (frame[3] & 0x04)
+                memcpy (keys[frame[4] & 0x0F], pattern, sizeof (pattern));
+            respond (fd, keys[frame[4] & 0x0F], 64);
+            break;
+        case OP_SIGN:
+            respond (fd, pattern, 64);
+            break;
+        default:
+            respond_status (fd, 0);
+        }
+    }
+}
+
+bool
+fake_device_start (struct fake_device *dev, const uint8_t *config,
+                   const uint8_t *otp, const uint8_t *data)
+{
+    struct images img;
+    int fds[2];
+
+    assert (NULL != dev); assert (NULL != config);
+
+    memset (&img, 0, sizeof (img));
+    memcpy (img.config, config, sizeof (img.config));
+    if (NULL != otp)
+        memcpy (img.otp, otp, sizeof (img.otp));
+    if (NULL != data)
+        memcpy (img.data, data, sizeof (img.data));
+
+    dev->log = mmap (NULL, sizeof (*dev->log), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == dev->log)
+        return false;
+    memset (dev->log, 0, sizeof (*dev->log));
+
+    if (0 != socketpair (AF_UNIX, SOCK_SEQPACKET, 0, fds))
+    {
+        munmap (dev->log, sizeof (*dev->log));
+        return false;
+    }
+
+    if (0 == (dev->pid = fork ()))
+    {
+        close (fds[0]);
+        serve (fds[1], &img, dev->log);
+        _exit (0);
+    }
+
+    close (fds[1]);
+    dev->fd = fds[0];
+
+    return dev->pid > 0;
+}
+
+unsigned int
+fake_device_count (const struct fake_device *dev, uint8_t event)
+{
+    unsigned int x, n = 0;
+
+    for (x = 0; x < dev->log->count && x < FAKE_LOG_MAX; x++)
+        if (dev->log->events[x] == event)
+            n++;
+
+    return n;
+}
+
+void
+fake_device_stop (struct fake_device *dev)
+{
+    close (dev->fd);
+    waitpid (dev->pid, NULL, 0);
+    munmap (dev->log, sizeof (*dev->log));
+}
@@ -0,0 +1,66 @@
+#ifndef _FAKE_DEVICE_H_
+#define _FAKE_DEVICE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A device stand in for tests: a child process on the other end of a
+   packet socket that answers wakes and command frames the way the
+   library's I2C framing expects.  Reads are served from the zone
+   images, Random from a PRNG, other commands return a fixed pattern
+   or a success status.
+   Everything the child sees is logged in shared memory. */
+
+#define FAKE_CONFIG_SIZE 128
+#define FAKE_OTP_SIZE 64
+#define FAKE_DATA_SIZE 1208
+#define FAKE_LOG_MAX 512
+
+/* Log events other than command opcodes */
+#define FAKE_EVENT_WAKE 0xF0
+#define FAKE_EVENT_IDLE 0xF1
+#define FAKE_EVENT_SLEEP 0xF2
+
+struct fake_log
+{
+    unsigned int count;
+    unsigned int bad_frames;
+    uint8_t events[FAKE_LOG_MAX];
+};
+
+struct fake_device
+{
+    pid_t pid;
+    int fd;                     /* The host end */
+    struct fake_log *log;
+};
+
+/* Sets the config image to a locked device with the given serial
+   number byte, OTP in read only mode and a signing P256 key in every
+   slot. */
+void
+fake_device_default_config (uint8_t *config, uint8_t serial_byte);
+
+/* Starts the child.  config is FAKE_CONFIG_SIZE bytes, otp and data
+   may be NULL for zeros. */
+bool
+fake_device_start (struct fake_device *dev, const uint8_t *config,
+                   const uint8_t *otp, const uint8_t *data);
+
+/* Counts the logged events equal to event. */
+unsigned int
+fake_device_count (const struct fake_device *dev, uint8_t event);
+
+void
+fake_device_stop (struct fake_device *dev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
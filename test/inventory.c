@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <argp.h>
+#include <assert.h>
+#include <string.h>
+#include "../libcryptoauth.h"
+
+const char *argp_program_version =
+  "inventory 0.1";
+const char *argp_program_bug_address =
+  "<bugs@cryptotronix.com>";
+
+/* Program documentation. */
+static char doc[] =
+  "Builds a fleet inventory index from a key list.  Each line of the "
+  "list is: SERIAL SLOT PUBKEY, in hex, where PUBKEY is the 64 byte "
+  "X + Y or the 65 byte tagged point.  Lines starting with # are "
+  "ignored.";
+
+/* A description of the arguments we accept. */
+static char args_doc[] = "KEYLIST";
+
+/* Number of required args */
+#define NUM_ARGS 1
+
+/* The options we understand. */
+static struct argp_option options[] = {
+  {"verbose",  'v', 0,      0,  "Produce verbose output" },
+  {"output",   'o', "INDEX", 0, "The index file to write" },
+  {"lookup",   'l', "SERIAL", 0,
+   "Instead of building, print the keys of SERIAL from INDEX" },
+  { 0 }
+};
+
+/* Used by main to communicate with parse_opt. */
+struct arguments
+{
+    char *args[NUM_ARGS];
+    int verbose;
+    char *output_file, *lookup;
+};
+
+/* Parse a single option. */
+static error_t
+parse_opt (int key, char *arg, struct argp_state *state)
+{
+  struct arguments *arguments = state->input;
+
+  switch (key)
+    {
+    case 'v':
+      arguments->verbose = 1;
+      break;
+    case 'o':
+      arguments->output_file = arg;
+      break;
+    case 'l':
+      arguments->lookup = arg;
+      break;
+
+    case ARGP_KEY_ARG:
+      if (state->arg_num >= NUM_ARGS)
+        /* Too many arguments. */
+        argp_usage (state);
+
+      arguments->args[state->arg_num] = arg;
+
+      break;
+
+    case ARGP_KEY_END:
+      if (state->arg_num < NUM_ARGS && NULL == arguments->lookup)
+        /* Not enough arguments. */
+        argp_usage (state);
+      break;
+
+    default:
+      return ARGP_ERR_UNKNOWN;
+    }
+  return 0;
+}
+
+/* Our argp parser. */
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+static int
+parse_line (char *line, struct lca_inventory_entry *e)
+{
+  char *serial = strtok (line, " \t\r\n");
+  char *slot = strtok (NULL, " \t\r\n");
+  char *key = strtok (NULL, " \t\r\n");
+  size_t key_len;
+
+  if (NULL == serial || NULL == slot || NULL == key)
+    return -1;
+
+  if (2 * LCA_SERIAL_NUM_LEN != strlen (serial)
+      || 0 != lca_hex_decode (serial, strlen (serial), e->serial))
+    return -1;
+
+  e->slot = atoi (slot);
+  if (e->slot > 15)
+    return -1;
+
+  key_len = strlen (key);
+
+  if (2 * LCA_TAGGED_PUB_KEY_LEN == key_len)
+    return lca_hex_decode (key, key_len, e->pub_key);
+
+  if (2 * (LCA_TAGGED_PUB_KEY_LEN - 1) == key_len)
+    {
+      e->pub_key[0] = 0x04;
+      return lca_hex_decode (key, key_len, e->pub_key + 1);
+    }
+
+  return -1;
+}
+
+static int
+build (const char *list, const char *index, int verbose)
+{
+  struct lca_inventory_entry *entries = NULL;
+  size_t count = 0, cap = 0;
+  unsigned int line_no = 0;
+  char line[512];
+  int rc = -1;
+  FILE *fp;
+
+  if (NULL == (fp = fopen (list, "r")))
+    {
+      perror (list);
+      return -1;
+    }
+
+  while (NULL != fgets (line, sizeof (line), fp))
+    {
+      line_no++;
+
+      if ('#' == line[0] || '\n' == line[0])
+        continue;
+
+      if (count == cap)
+        {
+          cap = cap ? cap * 2 : 1024;
+          entries = realloc (entries, cap * sizeof (*entries));
+          assert (NULL != entries);
+        }
+
+      if (0 != parse_line (line, &entries[count]))
+        {
+          fprintf (stderr, "%s:%u: malformed entry\n", list, line_no);
+          goto OUT;
+        }
+
+      count++;
+    }
+
+  rc = lca_inventory_write (index, entries, count);
+
+  if (-2 == rc)
+    fprintf (stderr, "Duplicate serial number and slot in %s\n", list);
+  else if (0 != rc)
+    fprintf (stderr, "Failed to write %s\n", index);
+  else if (verbose)
+    printf ("Wrote %zu keys to %s\n", count, index);
+
+ OUT:
+  fclose (fp);
+  free (entries);
+
+  return rc;
+}
+
+static int
+lookup (const char *index, const char *serial_hex)
+{
+  uint8_t serial[LCA_SERIAL_NUM_LEN];
+  struct lca_inventory *inv;
+  const uint8_t *key;
+  char hex[2 * LCA_TAGGED_PUB_KEY_LEN + 1];
+  int slot, found = 0;
+
+  if (2 * LCA_SERIAL_NUM_LEN != strlen (serial_hex)
+      || 0 != lca_hex_decode (serial_hex, strlen (serial_hex), serial))
+    {
+      fprintf (stderr, "Bad serial number\n");
+      return -1;
+    }
+
+  if (NULL == (inv = lca_inventory_open (index)))
+    {
+      fprintf (stderr, "Failed to open %s\n", index);
+      return -1;
+    }
+
+  for (slot = 0; slot < 16; slot++)
+    if (NULL != (key = lca_inventory_lookup (inv, serial, slot)))
+      {
+        lca_hex_encode (key, LCA_TAGGED_PUB_KEY_LEN, hex);
+        hex[sizeof (hex) - 1] = '\0';
+        printf ("%d %s\n", slot, hex);
+        found = 1;
+      }
+
+  lca_inventory_close (inv);
+
+  return found ? 0 : 1;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct arguments arguments;
+  int rc = -1;
+
+  /* Default values. */
+  arguments.verbose = 0;
+  arguments.output_file = NULL;
+  arguments.lookup = NULL;
+
+  /* Parse our arguments; every option seen by parse_opt will
+     be reflected in arguments. */
+  argp_parse (&argp, argc, argv, 0, 0, &arguments);
+
+  if (NULL == arguments.output_file)
+    {
+      printf ("Need an index file\n");
+      exit (1);
+    }
+
+  if (NULL != arguments.lookup)
+    rc = lookup (arguments.output_file, arguments.lookup);
+  else
+    rc = build (arguments.args[0], arguments.output_file,
+                arguments.verbose);
+
+  exit (rc ? 1 : 0);
+}
@@ -0,0 +1,154 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../libcryptoauth.hpp"
+#include "fake_device.h"
+#include "test_binding.h"
+
+extern "C" {
+#include "../src/verify_cache.h"
+}
+
+/* Constant frames are assembled by the compiler */
+static constexpr auto random_frame = lca::frame::random (false);
+static_assert (7 == random_frame.bytes[1], "count covers the frame");
+static_assert (0x1B == random_frame.bytes[2], "Random opcode");
+static_assert (1 == random_frame.bytes[3], "no seed update");
+
+static bool
+same_as_serialized (const std::uint8_t *frame, std::size_t len,
+                    struct Command_ATSHA204 c)
+{
+    uint8_t *serialized;
+    const unsigned int serialized_len = lca_serialize_command (&c,
+                                                               &serialized);
+    const bool same = serialized_len == len
+        && 0 == memcmp (serialized, frame, len);
+
+    free (serialized);
+    return same;
+}
+
+START_TEST(t_frames)
+{
+    std::array<std::uint8_t, 32> d;
+    std::uint8_t buf[64];
+    unsigned int x;
+
+    for (x = 0; x < sizeof (buf); x++)
+        buf[x] = static_cast<std::uint8_t> (x * 37 + 11);
+
+    for (x = 0; x <= sizeof (buf); x++)
+        ck_assert (lca_calculate_crc16 (buf, x)
+                   == lca::frame::crc16 (buf, x));
+
+    ck_assert (same_as_serialized (random_frame.data (), random_frame.size (),
+                                   lca_build_random_cmd (false)));
+
+    const auto read = lca::frame::read32 (DATA_ZONE, 0x18);
+    ck_assert (same_as_serialized (read.data (), read.size (),
+                                   lca_build_read32_cmd (DATA_ZONE, 0x18)));
+
+    /* A pass through nonce carries the digest */
+    for (x = 0; x < d.size (); x++)
+        d[x] = buf[x];
+    const auto nonce = lca::frame::load_nonce (d);
+    struct Command_ATSHA204 c = lca_build_random_cmd (false);
+    c.opcode = 0x16;
+    c.param1 = 0x03;
+    c.data = buf;
+    c.data_len = 32;
+    ck_assert (same_as_serialized (nonce.data (), nonce.size (), c));
+}
+END_TEST
+
+START_TEST(t_device_hooks)
+{
+    char path[] = "/tmp/lca_binding_XXXXXX";
+    uint8_t config[FAKE_CONFIG_SIZE];
+    std::uint8_t status = 0xFF;
+    std::array<std::uint8_t, 32> x, y, known;
+    struct fake_device fake;
+    lca::digest d;
+    int fd;
+
+    fd = mkstemp (path);
+    ck_assert (fd >= 0);
+    close (fd);
+
+    fake_device_default_config (config, 0x21);
+    ck_assert (fake_device_start (&fake, config, NULL, NULL));
+    ck_assert (lca_devstore_open (path));
+    ck_assert (lca_devstore_attach (fake.fd));
+    ck_assert (lca_ecdh_cache_enable (4, 60));
+
+    {
+        lca::device dev = lca::device::adopt (fake.fd);
+
+        /* Public keys come from the store after the first GenKey */
+        const lca::public_key q1 = dev.get_public_key (2);
+        ck_assert (q1 == dev.get_public_key (2));
+        ck_assert (1 == fake_device_count (&fake, 0x40));
+
+        x.fill (0x01);
+        y.fill (0x02);
+        const auto s1 = dev.ecdh (2, x, y);
+        ck_assert (s1 == dev.ecdh (2, x, y));
+        ck_assert (1 == fake_device_count (&fake, 0x43));
+
+        /* A new key drops the slot's public key and ECDH secrets */
+        const lca::public_key q2 = dev.gen_key (2);
+        ck_assert (q1 != q2);
+        ck_assert (q2 == dev.get_public_key (2));
+        ck_assert (2 == fake_device_count (&fake, 0x40));
+        dev.ecdh (2, x, y);
+        ck_assert (2 == fake_device_count (&fake, 0x43));
+
+        /* As does a raw GenKey frame */
+        lca::public_key q3;
+        dev.execute (lca::frame::gen_private_key (2), q3.data (), q3.size ());
+        ck_assert (q3 == dev.get_public_key (2));
+        ck_assert (4 == fake_device_count (&fake, 0x40));
+
+        /* A pass through nonce records TempKey, anything else forgets */
+        d.fill (0x77);
+        dev.execute (lca::frame::load_nonce (d), &status, sizeof (status));
+        ck_assert (0 == status);
+        ck_assert (verify_cache_get_tempkey (fake.fd, known.data ()));
+        ck_assert (known == d);
+        dev.random ();
+        ck_assert (!verify_cache_get_tempkey (fake.fd, known.data ()));
+
+        verify_cache_set_tempkey (fake.fd, known.data ());
+        dev.sign (2, d);
+        ck_assert (!verify_cache_get_tempkey (fake.fd, known.data ()));
+        ck_assert (1 == fake_device_count (&fake, 0x41));
+    }
+
+    ck_assert (0 == fake.log->bad_frames);
+
+    lca_ecdh_cache_disable ();
+    lca_devstore_close ();
+    fake_device_stop (&fake);
+    unlink (path);
+}
+END_TEST
+
+Suite * binding_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Binding");
+
+    tc_core = tcase_create("Frame");
+    tcase_add_test(tc_core, t_frames);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Device");
+    tcase_add_test(tc_core, t_device_hooks);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
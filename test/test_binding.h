@@ -0,0 +1,16 @@
+#ifndef _TEST_BINDING_H_
+#define _TEST_BINDING_H_
+
+#include <check.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+Suite * binding_suite(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
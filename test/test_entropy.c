@@ -0,0 +1,387 @@
+#include <check.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../libcryptoauth.h"
+#include "../src/drbg.h"
+#include "../src/entropy.h"
+#include "../src/health.h"
+#include "fake_device.h"
+#include "test_entropy.h"
+
+START_TEST(t_drbg)
+{
+    /* From an independent HMAC_DRBG written from SP 800-90A */
+    static const uint8_t first[40] = {
+        0x47, 0x93, 0xfb, 0x89, 0xb2, 0xce, 0xac, 0x3d,
+        0x7b, 0x9e, 0xc8, 0x3f, 0xc4, 0x65, 0xdb, 0xb0,
+        0x40, 0xa8, 0x6b, 0x8e, 0xde, 0xdb, 0xb1, 0x3e,
+        0x1d, 0x0f, 0x12, 0x3c, 0x8b, 0x27, 0xeb, 0x41,
+        0x94, 0x4b, 0xf2, 0xde, 0xb8, 0xfe, 0x3b, 0x9d
+    };
+    static const uint8_t second[64] = {
+        0xa0, 0x38, 0xcb, 0xcc, 0xa4, 0xea, 0x12, 0x78,
+        0xde, 0xf6, 0x20, 0x4d, 0xc1, 0x99, 0x3e, 0x61,
+        0xb1, 0xc9, 0xcd, 0xd7, 0x56, 0xe0, 0x74, 0x8a,
+        0x88, 0x1e, 0x17, 0x19, 0x61, 0x6c, 0x5d, 0xfe,
+        0xb1, 0xcf, 0x2b, 0x37, 0x1b, 0x89, 0x2a, 0x8f,
+        0xf0, 0xeb, 0xcb, 0x1d, 0xe6, 0xae, 0xea, 0x6d,
+        0x9c, 0x61, 0x2e, 0x29, 0x2d, 0x00, 0x8a, 0x42,
+        0x78, 0x10, 0x06, 0x2b, 0x18, 0xc8, 0x3a, 0x22
+    };
+    static const uint8_t third[17] = {
+        0x67, 0xd2, 0x29, 0x6f, 0xc4, 0xe4, 0x94, 0x13,
+        0x4e, 0x1f, 0x72, 0x76, 0x87, 0x16, 0xe8, 0xf5,
+        0x47
+    };
+    static const char pers[] = "libcryptoauth test";
+    static const char add[] = "additional";
+    uint8_t entropy[32], nonce[16], reseed[32], out[64];
+    struct drbg d;
+    unsigned int x;
+
+    for (x = 0; x < sizeof (entropy); x++)
+    {
+        entropy[x] = x;
+        reseed[x] = 0x40 + x;
+    }
+    for (x = 0; x < sizeof (nonce); x++)
+        nonce[x] = 0x20 + x;
+
+    drbg_init (&d, entropy, sizeof (entropy), nonce, sizeof (nonce),
+               (const uint8_t *)pers, strlen (pers));
+
+    drbg_generate (&d, out, sizeof (first), NULL, 0);
+    ck_assert (0 == memcmp (out, first, sizeof (first)));
+
+    drbg_generate (&d, out, sizeof (second), (const uint8_t *)add,
+                   strlen (add));
+    ck_assert (0 == memcmp (out, second, sizeof (second)));
+
+    drbg_reseed (&d, reseed, sizeof (reseed), NULL, 0);
+    drbg_generate (&d, out, sizeof (third), NULL, 0);
+    ck_assert (0 == memcmp (out, third, sizeof (third)));
+
+    drbg_wipe (&d);
+}
+END_TEST
+
+/* Counts up, so raw output shows where it came from */
+static unsigned int
+counting_source (void *arg, uint8_t *buf, unsigned int blocks)
+{
+    unsigned int *next = arg, x;
+
+    for (x = 0; x < blocks * ENTROPY_BLOCK_LEN; x++)
+        buf[x] = (*next)++;
+
+    return blocks;
+}
+
+static unsigned int
+failing_source (void *arg, uint8_t *buf, unsigned int blocks)
+{
+    (void)arg; (void)buf; (void)blocks;
+
+    return 0;
+}
+
+static void *
+random_worker (void *arg)
+{
+    uint8_t buf[777];
+    unsigned int x;
+    bool ok = true;
+
+    for (x = 0; x < 50; x++)
+        ok &= lca_random_bytes (buf, sizeof (buf));
+
+    *(bool *)arg = ok;
+
+    return NULL;
+}
+
+START_TEST(t_entropy_pool)
+{
+    static uint8_t big[DRBG_MAX_REQUEST * 2 + 5], copy[sizeof (big)];
+    const size_t sizes[] = {0, 1, 31, 33, 1000};
+    uint8_t raw[100], a[64], b[64];
+    pthread_t threads[4];
+    bool ok[4];
+    unsigned int next = 0, x;
+
+    ck_assert (!lca_entropy_running ());
+    ck_assert (!lca_random_bytes (a, sizeof (a)));
+
+    ck_assert (entropy_start_source (counting_source, &next, 256, 4096));
+    ck_assert (lca_entropy_running ());
+    ck_assert (!entropy_start_source (counting_source, &next, 256, 4096));
+
+    /* Raw bytes come out of the ring in source order */
+    ck_assert (lca_random_bytes_mode (raw, sizeof (raw), LCA_RANDOM_RAW));
+    for (x = 0; x < sizeof (raw); x++)
+        ck_assert (x == raw[x]);
+
+    for (x = 0; x < sizeof (sizes) / sizeof (sizes[0]); x++)
+        ck_assert (lca_random_bytes (big, sizes[x]));
+
+    ck_assert (lca_random_bytes (a, sizeof (a)));
+    ck_assert (lca_random_bytes (b, sizeof (b)));
+    ck_assert (0 != memcmp (a, b, sizeof (a)));
+
+    /* Longer than one DRBG request, and across several reseeds */
+    memset (big, 0, sizeof (big));
+    ck_assert (lca_random_bytes (big, sizeof (big)));
+    memset (copy, 0, sizeof (copy));
+    ck_assert (0 != memcmp (big + sizeof (big) - 64, copy, 64));
+
+    for (x = 0; x < 4; x++)
+        ck_assert (0 == pthread_create (&threads[x], NULL, random_worker,
+                                        &ok[x]));
+    for (x = 0; x < 4; x++)
+    {
+        ck_assert (0 == pthread_join (threads[x], NULL));
+        ck_assert (ok[x]);
+    }
+
+    lca_entropy_stop ();
+    ck_assert (!lca_entropy_running ());
+    ck_assert (!lca_random_bytes (a, sizeof (a)));
+    lca_entropy_stop ();
+
+    /* A dead source fails readers rather than hanging them */
+    ck_assert (entropy_start_source (failing_source, NULL, 0, 0));
+    ck_assert (!lca_random_bytes (a, sizeof (a)));
+    ck_assert (!lca_random_bytes_mode (a, 1, LCA_RANDOM_RAW));
+    lca_entropy_stop ();
+}
+END_TEST
+
+/* Random bytes without the value v or any repeats */
+static void
+fill_without (uint8_t *buf, size_t len, uint8_t v)
+{
+    size_t x;
+
+    gcry_randomize (buf, len, GCRY_WEAK_RANDOM);
+    for (x = 0; x < len; x++)
+        while (v == buf[x] || (x > 0 && buf[x] == buf[x - 1]))
+            buf[x] = buf[x] * 7 + 1;
+}
+
+static bool
+health_passes (const uint8_t *buf, size_t nblocks,
+               struct lca_health_stats *stats)
+{
+    struct health h;
+
+    memset (stats, 0, sizeof (*stats));
+    health_init (&h);
+
+    return health_test (&h, buf, nblocks, stats);
+}
+
+START_TEST(t_health)
+{
+    static uint8_t buf[64 * 1024];
+    const enum HEALTH_IMPL impls[] = {HEALTH_SCALAR, HEALTH_AVX2};
+    struct lca_health_stats stats;
+    unsigned int i, x;
+
+    for (i = 0; i < sizeof (impls) / sizeof (impls[0]); i++)
+    {
+        if (!health_select (impls[i]))
+            continue;
+
+        fill_without (buf, sizeof (buf), 0x5A);
+        ck_assert (health_passes (buf, sizeof (buf) / 32, &stats));
+        ck_assert (sizeof (buf) / 32 == stats.blocks);
+
+        /* Five identical samples in a row pass, six fail, also across
+           a block boundary */
+        memset (buf + 100, 0x5A, 5);
+        ck_assert (health_passes (buf, 16, &stats));
+        memset (buf + 61, 0x5A, 6);
+        ck_assert (!health_passes (buf, 16, &stats));
+        ck_assert (1 == stats.repetition_failures);
+        ck_assert (0 == stats.stuck_failures);
+
+        fill_without (buf, 1024, 0x5A);
+        memset (buf + 32 * 5 - 3, 0x5A, 6);
+        ck_assert (!health_passes (buf, 32, &stats));
+        ck_assert (6 == stats.blocks);
+
+        /* The window's first sample 62 times in 512 fails, 61 passes */
+        fill_without (buf, 1024, 0x5A);
+        for (x = 0; x < 61; x++)
+            buf[x * 8] = 0x5A;
+        ck_assert (health_passes (buf, 32, &stats));
+        buf[61 * 8] = 0x5A;
+        ck_assert (!health_passes (buf, 32, &stats));
+        ck_assert (1 == stats.proportion_failures);
+        ck_assert (0 == stats.repetition_failures);
+
+        /* The second window starts over */
+        fill_without (buf, 1024, 0x5A);
+        for (x = 0; x < 61; x++)
+        {
+            buf[x * 8] = 0x5A;
+            buf[512 + x * 8] = 0x5A;
+        }
+        ck_assert (health_passes (buf, 32, &stats));
+
+        /* A repeated block, the unlocked pattern and all ones */
+        fill_without (buf, 1024, 0x5A);
+        memcpy (buf + 96, buf + 64, 32);
+        ck_assert (!health_passes (buf, 32, &stats));
+        ck_assert (1 == stats.stuck_failures);
+
+        fill_without (buf, 1024, 0x5A);
+        for (x = 0; x < 32; x++)
+            buf[64 + x] = x % 4 < 2 ? 0xFF : 0x00;
+        ck_assert (!health_passes (buf, 32, &stats));
+        ck_assert (1 == stats.stuck_failures);
+        ck_assert (0 == stats.repetition_failures);
+
+        memset (buf, 0xFF, 32);
+        ck_assert (!health_passes (buf, 1, &stats));
+        ck_assert (1 == stats.stuck_failures);
+    }
+
+    ck_assert (health_select (HEALTH_AUTO));
+}
+END_TEST
+
+/* The unlocked pattern while *arg is set, then counting */
+static unsigned int
+switching_source (void *arg, uint8_t *buf, unsigned int blocks)
+{
+    static unsigned int next = 0;
+    unsigned int x;
+
+    for (x = 0; x < blocks * ENTROPY_BLOCK_LEN; x++)
+        buf[x] = *(volatile bool *)arg ? (x % 4 < 2 ? 0xFF : 0x00) : next++;
+
+    return blocks;
+}
+
+START_TEST(t_entropy_breaker)
+{
+    static volatile bool bad = true;
+    struct lca_health_stats stats;
+    uint8_t a[64];
+    unsigned int x;
+
+    ck_assert (entropy_start_source (switching_source, (void *)&bad, 256, 0));
+
+    ck_assert (!lca_random_bytes (a, sizeof (a)));
+    ck_assert (!lca_random_bytes_mode (a, 1, LCA_RANDOM_RAW));
+
+    lca_entropy_get_health (&stats);
+    ck_assert (stats.tripped);
+    ck_assert (1 == stats.trips);
+    ck_assert (stats.stuck_failures >= 3);
+
+    /* The next refill after the retry delay closes it */
+    bad = false;
+    for (x = 0; x < 300 && stats.tripped; x++)
+    {
+        usleep (10000);
+        lca_entropy_get_health (&stats);
+    }
+    ck_assert (!stats.tripped);
+    ck_assert (lca_random_bytes (a, sizeof (a)));
+
+    lca_entropy_stop ();
+}
+END_TEST
+START_TEST(t_entropy_device)
+{
+    struct fake_device dev;
+    struct lca_health_stats stats;
+    uint8_t config[FAKE_CONFIG_SIZE], raw[ENTROPY_BLOCK_LEN], word[4];
+    unsigned int x, randoms = 0, reads = 0;
+    bool in_refill = false, in_session = false;
+
+    fake_device_default_config (config, 0x42);
+    ck_assert (fake_device_start (&dev, config, NULL, NULL));
+
+    /* Two blocks of ring, so each raw read starts a refill while this
+       thread runs a session of its own */
+    ck_assert (lca_entropy_start (dev.fd, 2 * ENTROPY_BLOCK_LEN, 0));
+
+    for (x = 0; x < 40; x++)
+    {
+        struct Command_ATSHA204 c = lca_build_read4_cmd (CONFIG_ZONE, 0);
+
+        ck_assert (lca_random_bytes_mode (raw, sizeof (raw), LCA_RANDOM_RAW));
+
+        lca_device_lock (dev.fd);
+        ck_assert (lca_wakeup (dev.fd));
+        ck_assert (RSP_SUCCESS == lca_process_command (dev.fd, &c, word,
+                                                       sizeof (word)));
+        ck_assert (lca_idle (dev.fd));
+        lca_device_unlock (dev.fd);
+    }
+
+    lca_entropy_get_health (&stats);
+    ck_assert (!stats.tripped);
+    lca_entropy_stop ();
+
+    /* Idle has no reply; a wake's reply orders it */
+    ck_assert (lca_wakeup (dev.fd));
+    ck_assert (0 == dev.log->bad_frames);
+    ck_assert (dev.log->count < FAKE_LOG_MAX);
+
+    /* Every wake starts a refill of only Randoms or a session of only
+       Reads */
+    for (x = 0; x < dev.log->count; x++)
+        switch (dev.log->events[x])
+        {
+        case FAKE_EVENT_WAKE:
+            in_refill = in_session = false;
+            break;
+        case 0x1B:
+            ck_assert (!in_session);
+            in_refill = true;
+            randoms++;
+            break;
+        case 0x02:
+            ck_assert (!in_refill);
+            in_session = true;
+            reads++;
+            break;
+        }
+
+    ck_assert (40 == reads);
+    ck_assert (randoms >= 40);
+
+    lca_idle (dev.fd);
+    fake_device_stop (&dev);
+}
+END_TEST
+
+Suite * entropy_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Entropy");
+
+    tc_core = tcase_create("DRBG");
+    tcase_add_test(tc_core, t_drbg);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Health");
+    tcase_add_test(tc_core, t_health);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Pool");
+    tcase_add_test(tc_core, t_entropy_pool);
+    tcase_add_test(tc_core, t_entropy_breaker);
+    tcase_add_test(tc_core, t_entropy_device);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
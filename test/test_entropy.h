@@ -0,0 +1,10 @@
+#ifndef _TEST_ENTROPY_H_
+#define _TEST_ENTROPY_H_
+
+#include <check.h>
+
+
+Suite * entropy_suite(void);
+
+
+#endif
@@ -2,8 +2,16 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include "../libcryptoauth.h"
 #include "../src/hash.h"
+#include "../src/merkle.h"
+#include "../src/sha256.h"
+#include "../src/sha256_mb.h"
 
 typedef enum SHAversion {
     SHA1, SHA224, SHA256, SHA384, SHA512
@@ -266,6 +274,184 @@ START_TEST(ecdsa_soft_key_pair)
 }
 END_TEST
 
+/* Signs a random digest with a fresh soft key, returning the tagged
+   public key and the 64 byte signature. */
+static void
+soft_sign_random (struct lca_octet_buffer digest,
+                  struct lca_octet_buffer *pub_key,
+                  struct lca_octet_buffer *signature)
+{
+    gcry_sexp_t ecc, sig, q;
+    const char *raw;
+    size_t raw_len;
+    int rc;
+
+    rc = lca_gen_soft_keypair (&ecc);
+    ck_assert (0 == rc);
+    rc = fill_random (digest.ptr, digest.len);
+    ck_assert_int_eq (rc, (int) digest.len);
+
+    /* R or S may have a leading zero, so sign until both are full */
+    do
+    {
+        rc = lca_soft_sign (&ecc, digest, &sig);
+        ck_assert (0 == rc);
+        *signature = lca_sig2buf (&sig);
+        gcry_sexp_release (sig);
+    } while (64 != signature->len);
+
+    q = gcry_sexp_find_token (ecc, "q", 0);
+    ck_assert (NULL != q);
+    raw = gcry_sexp_nth_data (q, 1, &raw_len);
+    ck_assert (65 == raw_len);
+    *pub_key = lca_make_buffer (raw_len);
+    memcpy (pub_key->ptr, raw, raw_len);
+
+    gcry_sexp_release (q);
+    gcry_sexp_release (ecc);
+}
+
+struct verify_job
+{
+    struct lca_octet_buffer pub_key, signature, digest;
+    unsigned int failures;
+};
+
+static void *
+verify_many (void *arg)
+{
+    struct verify_job *job = arg;
+    unsigned int x;
+
+    for (x = 0; x < 50; x++)
+        if (!lca_ecdsa_p256_verify (job->pub_key, job->signature, job->digest))
+            job->failures++;
+
+    return NULL;
+}
+
+START_TEST(ecdsa_verify_cache)
+{
+    struct verify_job jobs[4];
+    pthread_t threads[4];
+    unsigned int x;
+    struct lca_octet_buffer digest, pub_key, signature;
+    struct lca_verify_cache_stats st;
+    uint8_t hash[32];
+
+    digest.ptr = hash;
+    digest.len = sizeof(hash);
+
+    soft_sign_random (digest, &pub_key, &signature);
+
+    lca_verify_cache_flush ();
+    lca_verify_cache_get_stats (&st);
+    const uint64_t hits = st.hits, inserts = st.inserts;
+
+    ck_assert (lca_ecdsa_p256_verify (pub_key, signature, digest));
+    lca_verify_cache_get_stats (&st);
+    ck_assert (hits == st.hits);
+    ck_assert (inserts + 1 == st.inserts);
+
+    ck_assert (lca_ecdsa_p256_verify (pub_key, signature, digest));
+    lca_verify_cache_get_stats (&st);
+    ck_assert (hits + 1 == st.hits);
+
+    /* Failures are not cached */
+    signature.ptr[5] ^= 0x01;
+    ck_assert (!lca_ecdsa_p256_verify (pub_key, signature, digest));
+    ck_assert (!lca_ecdsa_p256_verify (pub_key, signature, digest));
+    lca_verify_cache_get_stats (&st);
+    ck_assert (hits + 1 == st.hits);
+    ck_assert (inserts + 1 == st.inserts);
+    signature.ptr[5] ^= 0x01;
+
+    lca_verify_cache_flush ();
+    ck_assert (lca_ecdsa_p256_verify (pub_key, signature, digest));
+    lca_verify_cache_get_stats (&st);
+    ck_assert (hits + 1 == st.hits);
+    ck_assert (inserts + 2 == st.inserts);
+
+    /* Verifies on many threads, with the cache resized under them */
+    for (x = 0; x < 4; x++)
+    {
+        jobs[x] = (struct verify_job){pub_key, signature, digest, 0};
+        ck_assert (0 == pthread_create (&threads[x], NULL, verify_many,
+                                        &jobs[x]));
+    }
+    for (x = 0; x < 20; x++)
+        lca_verify_cache_resize (x % 2 ? 64 : 8);
+    for (x = 0; x < 4; x++)
+    {
+        ck_assert (0 == pthread_join (threads[x], NULL));
+        ck_assert (0 == jobs[x].failures);
+    }
+
+    lca_free_octet_buffer (pub_key);
+    lca_free_octet_buffer (signature);
+}
+END_TEST
+
+START_TEST(ecdsa_inventory)
+{
+    char path[] = "/tmp/lca_inventory_XXXXXX";
+    struct lca_inventory_entry entries[3];
+    struct lca_octet_buffer digest, pub_key, signature;
+    struct lca_inventory *inv;
+    uint8_t serial[LCA_SERIAL_NUM_LEN];
+    uint8_t hash[32];
+    unsigned int x;
+    int fd;
+
+    digest.ptr = hash;
+    digest.len = sizeof(hash);
+
+    soft_sign_random (digest, &pub_key, &signature);
+
+    /* Written out of order, the index sorts them */
+    memset (entries, 0, sizeof (entries));
+    for (x = 0; x < 3; x++)
+    {
+        memset (entries[x].serial, 0x30 - x, sizeof (entries[x].serial));
+        entries[x].slot = x;
+        memcpy (entries[x].pub_key, pub_key.ptr, pub_key.len);
+    }
+    entries[0].pub_key[10] ^= 0xFF;
+
+    fd = mkstemp (path);
+    ck_assert (fd >= 0);
+    close (fd);
+
+    ck_assert (0 == lca_inventory_write (path, entries, 3));
+
+    inv = lca_inventory_open (path);
+    ck_assert (NULL != inv);
+    ck_assert (3 == lca_inventory_size (inv));
+
+    memset (serial, 0x2F, sizeof (serial));
+
+    ck_assert (NULL != lca_inventory_lookup (inv, serial, 1));
+    ck_assert (NULL == lca_inventory_lookup (inv, serial, 0));
+    ck_assert (lca_inventory_verify (inv, serial, 1, signature, digest));
+
+    /* Same signature against a different key */
+    memset (serial, 0x30, sizeof (serial));
+    ck_assert (!lca_inventory_verify (inv, serial, 0, signature, digest));
+
+    lca_inventory_close (inv);
+
+    /* Duplicates are refused */
+    entries[1] = entries[0];
+    ck_assert (-2 == lca_inventory_write (path, entries, 3));
+
+    ck_assert (NULL == lca_inventory_open ("/nonexistent/inventory"));
+
+    unlink (path);
+    lca_free_octet_buffer (pub_key);
+    lca_free_octet_buffer (signature);
+}
+END_TEST
+
 START_TEST(test_hmac_key_slot)
 {
 
@@ -502,6 +688,824 @@ START_TEST(t_hmac_vectors)
 }
 END_TEST
 
+START_TEST(t_hmac_ctx)
+{
+    /* RFC 4231 test case 2 */
+    const uint8_t kat[] = {0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e,
+                           0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+                           0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83,
+                           0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43};
+    const char *msg = "what do ya want for nothing?";
+    const unsigned int key_lens[] = {0, 4, 32, 64, 65, 131};
+    uint8_t key[131], data[200], mac[32], challenge[32], zeros[32];
+    uint8_t layout[DEFAULTS_MSG_LEN];
+    struct lca_hmac_ctx ctx;
+    unsigned int x, len;
+
+    lca_hmac_init (&ctx, (const uint8_t *)"Jefe", 4);
+    lca_hmac_compute (&ctx, (const uint8_t *)msg, strlen (msg), mac);
+    ck_assert (0 == memcmp (mac, kat, sizeof (kat)));
+    ck_assert (lca_hmac_verify (&ctx, (const uint8_t *)msg, strlen (msg), kat));
+    mac[31] ^= 1;
+    ck_assert (!lca_hmac_verify (&ctx, (const uint8_t *)msg, strlen (msg), mac));
+
+    /* The context agrees with gcrypt across block boundaries, and may be
+       reused */
+    fill_random (key, sizeof (key));
+    fill_random (data, sizeof (data));
+
+    for (x = 0; x < sizeof (key_lens) / sizeof (key_lens[0]); x++)
+    {
+        lca_hmac_init (&ctx, key, key_lens[x]);
+
+        for (len = 0; len < sizeof (data); len += 11)
+        {
+            struct lca_octet_buffer k = {key, key_lens[x]};
+            struct lca_octet_buffer d = {data, len};
+            struct lca_octet_buffer r;
+
+            if (0 == key_lens[x] || 0 == len)
+                continue;
+
+            r = hmac_buffer (d, k);
+            lca_hmac_compute (&ctx, data, len, mac);
+            ck_assert (0 == memcmp (mac, r.ptr, sizeof (mac)));
+            lca_free_octet_buffer (r);
+        }
+    }
+
+    /* The defaults path HMACs the device's message layout */
+    fill_random (challenge, sizeof (challenge));
+    memset (zeros, 0, sizeof (zeros));
+    defaults_message (layout, zeros, challenge, 0x11, 0x04, 3);
+    ck_assert (0x11 == layout[64] && 0x04 == layout[65]);
+    ck_assert (3 == layout[66] && 0 == layout[67]);
+    ck_assert (0xEE == layout[79]);
+
+    lca_hmac_init (&ctx, key, 32);
+    lca_hmac_compute (&ctx, layout, sizeof (layout), data);
+    lca_hmac_defaults (&ctx, challenge, 3, mac);
+    ck_assert (0 == memcmp (mac, data, sizeof (mac)));
+    ck_assert (lca_hmac_verify_defaults (&ctx, challenge, mac, 3));
+    ck_assert (!lca_hmac_verify_defaults (&ctx, challenge, mac, 4));
+
+    lca_hmac_wipe (&ctx);
+}
+END_TEST
+
+/* Returns the read end of a pipe a child fills with len bytes */
+static int
+pipe_from_child (const uint8_t *data, size_t len)
+{
+    int fds[2];
+
+    ck_assert (0 == pipe (fds));
+
+    if (0 == fork ())
+    {
+        close (fds[0]);
+        ck_assert (len == (size_t)write (fds[1], data, len));
+        _exit (0);
+    }
+
+    close (fds[1]);
+
+    return fds[0];
+}
+
+START_TEST(t_sha256_file)
+{
+#define FILE_LEN (3 * 1024 * 1024 + 123)
+    const enum LCA_HASH_FILE_MODE modes[] = {LCA_HASH_FILE_AUTO,
+                                             LCA_HASH_FILE_MMAP,
+                                             LCA_HASH_FILE_READ,
+                                             LCA_HASH_FILE_OVERLAP};
+    const size_t offsets[] = {0, 5000, FILE_LEN};
+    char path[] = "/tmp/lcafileXXXXXX";
+    uint8_t *data = malloc (FILE_LEN);
+    uint8_t digest[LCA_SHA256_DLEN], expected[LCA_SHA256_DLEN];
+    struct lca_octet_buffer r;
+    unsigned int x, y;
+    FILE *fp;
+    int fd;
+
+    ck_assert (NULL != data);
+    fill_random (data, FILE_LEN);
+
+    fd = mkstemp (path);
+    ck_assert (fd >= 0);
+    ck_assert (FILE_LEN == write (fd, data, FILE_LEN));
+
+    /* From the start, an unaligned offset and the end */
+    for (x = 0; x < sizeof (offsets) / sizeof (offsets[0]); x++)
+    {
+        sha256 (data + offsets[x], FILE_LEN - offsets[x], expected);
+
+        for (y = 0; y < sizeof (modes) / sizeof (modes[0]); y++)
+        {
+            ck_assert (offsets[x] == (size_t)lseek (fd, offsets[x], SEEK_SET));
+            ck_assert (lca_sha256_fd (fd, modes[y], digest));
+            ck_assert (0 == memcmp (digest, expected, sizeof (digest)));
+            ck_assert (FILE_LEN == lseek (fd, 0, SEEK_CUR));
+        }
+    }
+    close (fd);
+
+    /* Pipes are read, with or without the second thread */
+    sha256 (data, FILE_LEN, expected);
+
+    for (y = 0; y < sizeof (modes) / sizeof (modes[0]); y++)
+    {
+        fd = pipe_from_child (data, FILE_LEN);
+        ck_assert (lca_sha256_fd (fd, modes[y], digest));
+        ck_assert (0 == memcmp (digest, expected, sizeof (digest)));
+        close (fd);
+        wait (NULL);
+    }
+
+    /* Streams hash from their position, including what stdio buffered */
+    fp = fopen (path, "rb");
+    ck_assert (NULL != fp);
+    for (x = 0; x < 7; x++)
+        ck_assert ((int)data[x] == getc (fp));
+
+    sha256 (data + 7, FILE_LEN - 7, expected);
+    r = lca_sha256 (fp);
+    ck_assert (NULL != r.ptr);
+    ck_assert (0 == memcmp (r.ptr, expected, r.len));
+    ck_assert (EOF == getc (fp));
+    lca_free_octet_buffer (r);
+    fclose (fp);
+
+    fd = pipe_from_child (data, FILE_LEN);
+    fp = fdopen (fd, "rb");
+    ck_assert (NULL != fp);
+    ck_assert ((int)data[0] == getc (fp));
+    r = lca_sha256 (fp);
+    sha256 (data + 1, FILE_LEN - 1, expected);
+    ck_assert (0 == memcmp (r.ptr, expected, r.len));
+    lca_free_octet_buffer (r);
+    fclose (fp);
+    wait (NULL);
+
+    /* Many files on several threads, with one missing */
+    struct lca_file_digest files[9];
+    for (x = 0; x < 9; x++)
+        files[x].path = 4 == x ? "/nonexistent/file" : path;
+    ck_assert (8 == lca_sha256_files (files, 9, 3));
+    sha256 (data, FILE_LEN, expected);
+    for (x = 0; x < 9; x++)
+        ck_assert (4 == x ? !files[x].ok
+                   : files[x].ok && 0 == memcmp (files[x].digest, expected,
+                                                 sizeof (expected)));
+
+    unlink (path);
+    free (data);
+}
+END_TEST
+
+START_TEST(t_mac_batch)
+{
+#define BATCH_COUNT 37
+    const enum SHA256_MB_IMPL impls[] = {SHA256_MB_SCALAR, SHA256_MB_AVX2,
+                                         SHA256_MB_AVX512, SHA256_MB_AUTO};
+    static uint8_t keys[BATCH_COUNT][32], challenges[BATCH_COUNT][32];
+    static uint8_t macs[BATCH_COUNT][32], hmacs[BATCH_COUNT][32];
+    static struct lca_hmac_ctx ctxs[BATCH_COUNT];
+    struct lca_mac_item mac_items[BATCH_COUNT];
+    struct lca_hmac_item hmac_items[BATCH_COUNT];
+    uint8_t layout[DEFAULTS_MSG_LEN];
+    uint8_t results[(BATCH_COUNT + 7) / 8];
+    unsigned int x, i;
+
+    fill_random (keys[0], sizeof (keys));
+    fill_random (challenges[0], sizeof (challenges));
+    ck_assert (lca_sha256_select (LCA_SHA256_GCRYPT));
+
+    for (x = 0; x < BATCH_COUNT; x++)
+    {
+        struct lca_octet_buffer l = {layout, sizeof (layout)};
+        struct lca_octet_buffer c = {challenges[x], 32};
+        struct lca_octet_buffer k = {keys[x], 32};
+        struct lca_octet_buffer m;
+
+        /* References from gcrypt, checked against the single verifiers */
+        defaults_message (layout, keys[x], challenges[x], 0x08, 0, x % 16);
+        m = lca_sha256_buffer (l);
+        memcpy (macs[x], m.ptr, 32);
+        ck_assert (lca_verify_hash_defaults (c, m, k, x % 16));
+        lca_free_octet_buffer (m);
+
+        m = lca_soft_hmac256_defaults (c, k, x % 16);
+        memcpy (hmacs[x], m.ptr, 32);
+        lca_free_octet_buffer (m);
+
+        lca_hmac_init (&ctxs[x], keys[x], 32);
+
+        /* Every fifth response is wrong */
+        if (0 == x % 5)
+        {
+            macs[x][x % 32] ^= 0x40;
+            hmacs[x][x % 32] ^= 0x40;
+        }
+
+        mac_items[x] = (struct lca_mac_item){challenges[x], macs[x],
+                                             keys[x], x % 16};
+        hmac_items[x] = (struct lca_hmac_item){&ctxs[x], challenges[x],
+                                               hmacs[x], x % 16};
+    }
+
+    for (i = 0; i < sizeof (impls) / sizeof (impls[0]); i++)
+    {
+        if (!sha256_mb_select (impls[i]))
+            continue;
+
+        /* Every batch size up to a few chunks, to cover the tails */
+        for (unsigned int n = 0; n <= BATCH_COUNT; n += (n < 18 ? 1 : 19))
+        {
+            memset (results, 0xA5, sizeof (results));
+            ck_assert (n - (n + 4) / 5 ==
+                       lca_verify_mac_batch (mac_items, n, results));
+            for (x = 0; x < n; x++)
+                ck_assert (!(results[x / 8] & (1 << (x % 8))) == (0 == x % 5));
+
+            memset (results, 0xA5, sizeof (results));
+            ck_assert (n - (n + 4) / 5 ==
+                       lca_verify_hmac_batch (hmac_items, n, results));
+            for (x = 0; x < n; x++)
+                ck_assert (!(results[x / 8] & (1 << (x % 8))) == (0 == x % 5));
+        }
+    }
+
+    sha256_mb_select (SHA256_MB_AUTO);
+    lca_sha256_select (LCA_SHA256_AUTO);
+#undef BATCH_COUNT
+}
+END_TEST
+
+START_TEST(t_sha256_impls)
+{
+    const enum LCA_SHA256_IMPL impls[] = {LCA_SHA256_PORTABLE,
+                                          LCA_SHA256_NATIVE,
+                                          LCA_SHA256_CROSSCHECK,
+                                          LCA_SHA256_AUTO};
+    static uint8_t data[300];
+    uint8_t digest[32], expected[32];
+    unsigned int i, len;
+
+    fill_random (data, sizeof (data));
+
+    for (i = 0; i < sizeof (impls) / sizeof (impls[0]); i++)
+    {
+        if (!lca_sha256_select (impls[i]))
+            continue;
+
+        /* Every padding case up to several blocks */
+        for (len = 0; len <= sizeof (data); len++)
+        {
+            struct lca_octet_buffer d = {data, len};
+            struct lca_octet_buffer r;
+
+            gcry_md_hash_buffer (GCRY_MD_SHA256, expected, data, len);
+            sha256 (data, len, digest);
+            ck_assert (0 == memcmp (digest, expected, sizeof (digest)));
+
+            /* Empty updates, NULL ones included, change nothing */
+            struct sha256_ctx ctx;
+            sha256_init (&ctx);
+            sha256_update (&ctx, NULL, 0);
+            sha256_update (&ctx, data, len / 3);
+            sha256_update (&ctx, NULL, 0);
+            sha256_update (&ctx, data + len / 3, len - len / 3);
+            sha256_final (&ctx, digest);
+            ck_assert (0 == memcmp (digest, expected, sizeof (digest)));
+
+            if (len > 0)
+            {
+                r = lca_sha256_buffer (d);
+                ck_assert (0 == memcmp (r.ptr, expected, sizeof (expected)));
+                lca_free_octet_buffer (r);
+            }
+        }
+    }
+
+    lca_sha256_select (LCA_SHA256_AUTO);
+}
+END_TEST
+
+/* Lays out a MAC or HMAC message byte by byte from the datasheet */
+static void
+layout_message (uint8_t *msg, const uint8_t *first, const uint8_t *second,
+                uint8_t opcode, uint8_t mode, uint8_t slot,
+                const uint8_t *otp, const uint8_t *sn)
+{
+    memset (msg, 0, 88);
+    memcpy (msg, first, 32);
+    memcpy (msg + 32, second, 32);
+    msg[64] = opcode;
+    msg[65] = mode;
+    msg[66] = slot;
+    if (mode & 0x30)
+        memcpy (msg + 68, otp, 8);
+    if (mode & 0x10)
+        memcpy (msg + 76, otp + 8, 3);
+    msg[79] = sn[8];
+    if (mode & 0x40)
+        memcpy (msg + 80, sn + 4, 4);
+    msg[84] = sn[0];
+    msg[85] = sn[1];
+    if (mode & 0x40)
+        memcpy (msg + 86, sn + 2, 2);
+}
+
+START_TEST(t_mac_template)
+{
+    uint8_t key[32], challenge[32], tempkey[32], otp[11], zeros[32];
+    uint8_t sn[LCA_SERIAL_NUM_LEN], msg[88], mac[32], expected[32];
+    const uint8_t fixed_sn[LCA_SERIAL_NUM_LEN] = {0x01, 0x23, 0, 0, 0, 0,
+                                                  0, 0, 0xEE};
+    const uint8_t mac_modes[] = {0x00, 0x01, 0x02, 0x03, 0x10, 0x20, 0x30,
+                                 0x40, 0x51, 0x62, 0x74, 0x77};
+    const uint8_t hmac_modes[] = {0x00, 0x04, 0x10, 0x24, 0x40, 0x74};
+    struct lca_octet_buffer k = {key, sizeof (key)};
+    struct lca_octet_buffer c = {challenge, sizeof (challenge)};
+    struct lca_octet_buffer m = {msg, sizeof (msg)};
+    struct lca_octet_buffer r;
+    struct lca_mac_template t;
+    struct lca_hmac_ctx ctx;
+    unsigned int x;
+
+    fill_random (key, sizeof (key));
+    fill_random (challenge, sizeof (challenge));
+    fill_random (tempkey, sizeof (tempkey));
+    fill_random (otp, sizeof (otp));
+    fill_random (sn, sizeof (sn));
+    sn[0] = 0x01; sn[1] = 0x23; sn[8] = 0xEE;
+    memset (zeros, 0, sizeof (zeros));
+
+    /* The defaults are the zero OTP and serial number case */
+    ck_assert (lca_mac_template_init (&t, 0x08, 0, 5, key, NULL, NULL));
+    lca_mac_compute (&t, challenge, NULL, mac);
+    r = (struct lca_octet_buffer){mac, sizeof (mac)};
+    ck_assert (lca_verify_hash_defaults (c, r, k, 5));
+
+    ck_assert (lca_mac_template_init (&t, 0x11, 0x04, 5, key, NULL, NULL));
+    lca_hmac_init (&ctx, key, sizeof (key));
+    lca_hmac_defaults (&ctx, challenge, 5, expected);
+    ck_assert (lca_mac_verify (&t, NULL, challenge, expected));
+
+    /* Every input source against a hand laid out message */
+    for (x = 0; x < sizeof (mac_modes); x++)
+    {
+        const uint8_t mode = mac_modes[x];
+
+        ck_assert (lca_mac_template_init (&t, 0x08, mode, x, key, otp, sn));
+        layout_message (msg, (mode & 0x02) ? tempkey : key,
+                        (mode & 0x01) ? tempkey : challenge,
+                        0x08, mode, x, otp, sn);
+        gcry_md_hash_buffer (GCRY_MD_SHA256, expected, msg, sizeof (msg));
+        lca_mac_compute (&t, challenge, tempkey, mac);
+        ck_assert (0 == memcmp (mac, expected, sizeof (mac)));
+        ck_assert (lca_mac_verify (&t, challenge, tempkey, expected));
+        expected[0] ^= 1;
+        ck_assert (!lca_mac_verify (&t, challenge, tempkey, expected));
+    }
+
+    for (x = 0; x < sizeof (hmac_modes); x++)
+    {
+        const uint8_t mode = hmac_modes[x];
+
+        ck_assert (lca_mac_template_init (&t, 0x11, mode, x, key, otp, sn));
+        layout_message (msg, zeros, tempkey, 0x11, mode, x, otp, sn);
+        r = hmac_buffer (m, k);
+        lca_mac_compute (&t, NULL, tempkey, mac);
+        ck_assert (0 == memcmp (mac, r.ptr, sizeof (mac)));
+        lca_free_octet_buffer (r);
+    }
+
+    /* Without the serial number only its fixed bytes are used */
+    ck_assert (lca_mac_template_init (&t, 0x08, 0x10, 0, key, otp, NULL));
+    layout_message (msg, key, challenge, 0x08, 0x10, 0, otp, fixed_sn);
+    gcry_md_hash_buffer (GCRY_MD_SHA256, expected, msg, sizeof (msg));
+    ck_assert (lca_mac_verify (&t, challenge, NULL, expected));
+
+    /* Reserved bits, TempKey inputs to HMAC and missing inputs */
+    ck_assert (!lca_mac_template_init (&t, 0x08, 0x08, 0, key, otp, sn));
+    ck_assert (!lca_mac_template_init (&t, 0x08, 0x80, 0, key, otp, sn));
+    ck_assert (!lca_mac_template_init (&t, 0x11, 0x01, 0, key, otp, sn));
+    ck_assert (!lca_mac_template_init (&t, 0x11, 0x04, 0, NULL, otp, sn));
+    ck_assert (!lca_mac_template_init (&t, 0x08, 0x40, 0, key, otp, NULL));
+    ck_assert (!lca_mac_template_init (&t, 0x08, 0x20, 0, key, NULL, sn));
+    ck_assert (!lca_mac_template_init (&t, 0x08, 0x00, 16, key, otp, sn));
+    ck_assert (!lca_mac_template_init (&t, 0x12, 0x00, 0, key, otp, sn));
+    ck_assert (lca_mac_template_init (&t, 0x08, 0x03, 0, NULL, NULL, NULL));
+
+    lca_mac_template_wipe (&t);
+    lca_hmac_wipe (&ctx);
+}
+END_TEST
+
+START_TEST(t_backends)
+{
+    /* RFC 6979 A.2.5, the "sample" message with SHA-256 */
+    const uint8_t priv[] = {0xC9, 0xAF, 0xA9, 0xD8, 0x45, 0xBA, 0x75, 0x16,
+                            0x6B, 0x5C, 0x21, 0x57, 0x67, 0xB1, 0xD6, 0x93,
+                            0x4E, 0x50, 0xC3, 0xDB, 0x36, 0xE8, 0x9B, 0x12,
+                            0x7B, 0x8A, 0x62, 0x2B, 0x12, 0x0F, 0x67, 0x21};
+    const uint8_t pub[] = {0x60, 0xFE, 0xD4, 0xBA, 0x25, 0x5A, 0x9D, 0x31,
+                           0xC9, 0x61, 0xEB, 0x74, 0xC6, 0x35, 0x6D, 0x68,
+                           0xC0, 0x49, 0xB8, 0x92, 0x3B, 0x61, 0xFA, 0x6C,
+                           0xE6, 0x69, 0x62, 0x2E, 0x60, 0xF2, 0x9F, 0xB6,
+                           0x79, 0x03, 0xFE, 0x10, 0x08, 0xB8, 0xBC, 0x99,
+                           0xA4, 0x1A, 0xE9, 0xE9, 0x56, 0x28, 0xBC, 0x64,
+                           0xF2, 0xF1, 0xB2, 0x0C, 0x2D, 0x7E, 0x9F, 0x51,
+                           0x77, 0xA3, 0xC2, 0x94, 0xD4, 0x46, 0x22, 0x99};
+    const uint8_t sig[] = {0xEF, 0xD4, 0x8B, 0x2A, 0xAC, 0xB6, 0xA8, 0xFD,
+                           0x11, 0x40, 0xDD, 0x9C, 0xD4, 0x5E, 0x81, 0xD6,
+                           0x9D, 0x2C, 0x87, 0x7B, 0x56, 0xAA, 0xF9, 0x91,
+                           0xC3, 0x4D, 0x0E, 0xA8, 0x4E, 0xAF, 0x37, 0x16,
+                           0xF7, 0xCB, 0x1C, 0x94, 0x2D, 0x65, 0x7C, 0x41,
+                           0xD4, 0x36, 0xC7, 0xA1, 0xB6, 0xE2, 0x9F, 0x65,
+                           0xF3, 0xE9, 0x00, 0xDB, 0xB9, 0xAF, 0xF4, 0x06,
+                           0x4D, 0xC4, 0xAB, 0x2F, 0x84, 0x3A, 0xCD, 0xA8};
+    /* SHA-256 of "abc" and RFC 4231 test case 2 */
+    const uint8_t abc[] = {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+                           0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+                           0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+                           0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad};
+    const uint8_t jefe[] = {0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e,
+                            0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+                            0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83,
+                            0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43};
+    /* The group order n: it and zero are not private keys */
+    const uint8_t order[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+                             0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                             0xBC, 0xE6, 0xFA, 0xAD, 0xA7, 0x17, 0x9E, 0x84,
+                             0xF3, 0xB9, 0xCA, 0xC2, 0xFC, 0x63, 0x25, 0x51};
+    const uint8_t zero[32] = {0};
+    const char *msg = "what do ya want for nothing?";
+    const enum LCA_BACKEND all[] = {LCA_BACKEND_GCRYPT, LCA_BACKEND_OPENSSL,
+                                    LCA_BACKEND_BUILTIN};
+    const enum LCA_BACKEND orig = lca_backend_current ();
+    uint8_t digest[32], out[64], bad[64];
+    uint8_t privs[3][32], pubs[3][64], sigs[3][64];
+    uint8_t secret[32], peer_secret[32];
+    unsigned int x, y;
+
+    for (x = 0; x < 3; x++)
+    {
+        if (!lca_backend_available (all[x]))
+            continue;
+
+        ck_assert (lca_backend_select (all[x]));
+        ck_assert (all[x] == lca_backend_current ());
+        ck_assert (NULL != lca_backend_name (all[x]));
+
+        struct lca_octet_buffer in = {(uint8_t *)"abc", 3};
+        struct lca_octet_buffer r = lca_sha256_buffer (in);
+        ck_assert (0 == memcmp (r.ptr, abc, sizeof (abc)));
+        lca_free_octet_buffer (r);
+
+        struct lca_octet_buffer k = {(uint8_t *)"Jefe", 4};
+        struct lca_octet_buffer d = {(uint8_t *)msg, strlen (msg)};
+        r = hmac_buffer (d, k);
+        ck_assert (0 == memcmp (r.ptr, jefe, sizeof (jefe)));
+        lca_free_octet_buffer (r);
+
+        sha256 ((const uint8_t *)"sample", 6, digest);
+        ck_assert (lca_p256_verify (pub, digest, sig));
+
+        /* A bad signature, a bad digest and a point off the curve */
+        memcpy (bad, sig, sizeof (bad));
+        bad[40] ^= 0x01;
+        ck_assert (!lca_p256_verify (pub, digest, bad));
+        digest[0] ^= 0x01;
+        ck_assert (!lca_p256_verify (pub, digest, sig));
+        digest[0] ^= 0x01;
+        memcpy (bad, pub, sizeof (bad));
+        bad[63] ^= 0x01;
+        ck_assert (!lca_p256_verify (bad, digest, sig));
+        memset (bad, 0, sizeof (bad));
+        ck_assert (!lca_p256_verify (pub, digest, bad));
+
+        ck_assert (lca_p256_sign (priv, digest, sigs[x]));
+        ck_assert (!lca_p256_sign (zero, digest, out));
+        ck_assert (!lca_p256_sign (order, digest, out));
+        ck_assert (!lca_p256_ecdh (zero, pub, out));
+        ck_assert (!lca_p256_ecdh (order, pub, out));
+
+        ck_assert (lca_p256_keygen (privs[x], pubs[x]));
+        ck_assert (lca_p256_ecdh (privs[x], pub, out));
+        ck_assert (!lca_p256_ecdh (privs[x], bad, out));
+    }
+
+    /* The deterministic nonces reproduce the vector */
+    ck_assert (0 == memcmp (sigs[2], sig, sizeof (sig)));
+
+    /* Every backend accepts every other backend's signatures and agrees
+       on the shared secrets */
+    for (x = 0; x < 3; x++)
+    {
+        if (!lca_backend_available (all[x]))
+            continue;
+
+        ck_assert (lca_backend_select (all[x]));
+
+        for (y = 0; y < 3; y++)
+        {
+            if (!lca_backend_available (all[y]))
+                continue;
+
+            ck_assert (lca_p256_verify (pub, digest, sigs[y]));
+            ck_assert (lca_p256_ecdh (privs[x], pubs[y], secret));
+
+            ck_assert (lca_backend_select (all[y]));
+            ck_assert (lca_p256_ecdh (privs[y], pubs[x], peer_secret));
+            ck_assert (0 == memcmp (secret, peer_secret, sizeof (secret)));
+
+            ck_assert (lca_backend_select (all[x]));
+        }
+    }
+
+    ck_assert (lca_backend_select (orig));
+}
+END_TEST
+
+START_TEST(t_p256_key)
+{
+#define KEY_SIGS 45
+    static uint8_t digests[KEY_SIGS][32], sigs[KEY_SIGS][64];
+    struct lca_p256_sig_item items[KEY_SIGS];
+    uint8_t priv[32], pub[64], tagged[65], results[(KEY_SIGS + 7) / 8];
+    struct lca_p256_key *key;
+    const enum LCA_BACKEND orig = lca_backend_current ();
+    unsigned int x, valid = 0;
+
+    ck_assert (lca_backend_select (LCA_BACKEND_BUILTIN));
+    ck_assert (lca_p256_keygen (priv, pub));
+    tagged[0] = 0x04;
+    memcpy (tagged + 1, pub, sizeof (pub));
+
+    ck_assert (NULL != (key = lca_p256_key_import (tagged)));
+
+    fill_random ((uint8_t *)digests, sizeof (digests));
+
+    for (x = 0; x < KEY_SIGS; x++)
+    {
+        ck_assert (lca_p256_sign (priv, digests[x], sigs[x]));
+        ck_assert (lca_p256_key_verify (key, digests[x], sigs[x]));
+
+        /* Corrupt a digest, an r, an s, or zero a whole signature */
+        switch (x % 5)
+        {
+        case 1: digests[x][7] ^= 0x20; break;
+        case 2: sigs[x][3] ^= 0x01; break;
+        case 3: sigs[x][60] ^= 0x80; break;
+        case 4: if (x % 2) memset (sigs[x], 0, 64); break;
+        default: break;
+        }
+
+        items[x].digest = digests[x];
+        items[x].signature = sigs[x];
+    }
+
+    memset (results, 0xA5, sizeof (results));
+
+    for (x = 0; x < KEY_SIGS; x++)
+    {
+        const bool ok = lca_p256_verify (pub, digests[x], sigs[x]);
+
+        ck_assert (ok == (0 == x % 5 || (4 == x % 5 && 0 == x % 2)));
+        ck_assert (ok == lca_p256_key_verify (key, digests[x], sigs[x]));
+        valid += ok;
+    }
+
+    ck_assert (valid == lca_p256_key_verify_batch (key, items, KEY_SIGS,
+                                                   results));
+
+    for (x = 0; x < KEY_SIGS; x++)
+        ck_assert (lca_p256_verify (pub, digests[x], sigs[x])
+                   == (0 != (results[x / 8] & (1 << (x % 8)))));
+
+    lca_p256_key_free (key);
+
+    /* Off the curve, or without the tag */
+    tagged[64] ^= 0x01;
+    ck_assert (NULL == lca_p256_key_import (tagged));
+    tagged[64] ^= 0x01;
+    tagged[0] = 0x02;
+    ck_assert (NULL == lca_p256_key_import (tagged));
+
+    ck_assert (lca_backend_select (orig));
+}
+END_TEST
+
+START_TEST(t_verify_pool)
+{
+#define POOL_KEYS 3
+#define POOL_JOBS 301
+    static uint8_t digests[POOL_JOBS][32], sigs[POOL_JOBS][64];
+    static struct lca_verify_job jobs[POOL_JOBS];
+    static bool valid[POOL_JOBS];
+    uint8_t privs[POOL_KEYS][32], tagged[POOL_KEYS][65];
+    struct lca_p256_key *keys[POOL_KEYS];
+    const unsigned int workers[] = {1, 2, 5};
+    const enum LCA_BACKEND orig = lca_backend_current ();
+    unsigned int x, k, expected = 0;
+
+    ck_assert (lca_backend_select (LCA_BACKEND_BUILTIN));
+
+    for (k = 0; k < POOL_KEYS; k++)
+    {
+        tagged[k][0] = 0x04;
+        ck_assert (lca_p256_keygen (privs[k], tagged[k] + 1));
+        ck_assert (NULL != (keys[k] = lca_p256_key_import (tagged[k])));
+    }
+
+    fill_random ((uint8_t *)digests, sizeof (digests));
+
+    /* Runs of one key of varying length, with every seventh job bad */
+    for (x = 0; x < POOL_JOBS; x++)
+    {
+        k = (x / 5 + x / 37) % POOL_KEYS;
+        ck_assert (lca_p256_sign (privs[k], digests[x], sigs[x]));
+        if (0 == x % 7)
+            sigs[x][x % 64] ^= 0x04;
+        else
+            expected++;
+
+        jobs[x].key = keys[k];
+        jobs[x].digest = digests[x];
+        jobs[x].signature = sigs[x];
+    }
+
+    for (k = 0; k < sizeof (workers) / sizeof (workers[0]); k++)
+    {
+        struct lca_verify_pool *pool = lca_verify_pool_new (workers[k]);
+
+        ck_assert (NULL != pool);
+        ck_assert (workers[k] == lca_verify_pool_workers (pool));
+        ck_assert (0 == lca_verify_pool_run (pool, jobs, 0, valid));
+
+        /* Runs may repeat on the same pool */
+        for (x = 0; x < 2; x++)
+        {
+            memset (valid, x, sizeof (valid));
+            ck_assert (expected == lca_verify_pool_run (pool, jobs, POOL_JOBS,
+                                                        valid));
+        }
+
+        for (x = 0; x < POOL_JOBS; x++)
+            ck_assert (valid[x] == (0 != x % 7));
+
+        lca_verify_pool_free (pool);
+    }
+
+    for (k = 0; k < POOL_KEYS; k++)
+        lca_p256_key_free (keys[k]);
+
+    ck_assert (lca_backend_select (orig));
+}
+END_TEST
+
+/* Stands in for the device in the batching signer */
+static bool
+soft_sign (void *arg, const uint8_t *digest, uint8_t *signature)
+{
+    return lca_p256_sign (arg, digest, signature);
+}
+
+struct merkle_caller
+{
+    struct lca_merkle_signer *signer;
+    uint8_t digest[32];
+    struct lca_merkle_proof proof;
+    bool ok;
+};
+
+static void *
+merkle_call (void *arg)
+{
+    struct merkle_caller *c = arg;
+
+    c->ok = lca_merkle_sign (c->signer, c->digest, &c->proof);
+
+    return NULL;
+}
+
+START_TEST(t_merkle)
+{
+#define MERKLE_LEAVES 100
+#define MERKLE_CALLERS 12
+    static uint8_t digests[MERKLE_LEAVES][32];
+    static struct lca_merkle_proof proofs[MERKLE_LEAVES];
+    static struct merkle_caller callers[MERKLE_CALLERS];
+    const unsigned int counts[] = {1, 2, 3, 7, 8, MERKLE_LEAVES};
+    uint8_t root[32], again[32], leaf[33], node[65], priv[32], pub[64];
+    struct lca_merkle_proof bad;
+    struct lca_merkle_signer *signer;
+    pthread_t threads[MERKLE_CALLERS];
+    unsigned int x, k;
+
+    fill_random ((uint8_t *)digests, sizeof (digests));
+
+    ck_assert (!lca_merkle_build ((const uint8_t (*)[32])digests, 0, root,
+                                  NULL));
+
+    /* One leaf: the root is the leaf hash and the path is empty */
+    ck_assert (lca_merkle_build ((const uint8_t (*)[32])digests, 1, root,
+                                 proofs));
+    leaf[0] = 0x00;
+    memcpy (leaf + 1, digests[0], 32);
+    sha256 (leaf, sizeof (leaf), again);
+    ck_assert (0 == memcmp (root, again, 32));
+    ck_assert (0 == proofs[0].depth);
+
+    /* Three leaves: H (1 || H (1 || L0 || L1) || L2) */
+    ck_assert (lca_merkle_build ((const uint8_t (*)[32])digests, 3, root,
+                                 NULL));
+    node[0] = 0x01;
+    for (x = 0; x < 2; x++)
+    {
+        memcpy (leaf + 1, digests[x], 32);
+        sha256 (leaf, sizeof (leaf), node + 1 + 32 * x);
+    }
+    sha256 (node, sizeof (node), node + 1);
+    memcpy (leaf + 1, digests[2], 32);
+    sha256 (leaf, sizeof (leaf), node + 33);
+    sha256 (node, sizeof (node), again);
+    ck_assert (0 == memcmp (root, again, 32));
+
+    /* Every proof of every tree size leads back to its root */
+    for (k = 0; k < sizeof (counts) / sizeof (counts[0]); k++)
+    {
+        ck_assert (lca_merkle_build ((const uint8_t (*)[32])digests,
+                                     counts[k], root, proofs));
+
+        for (x = 0; x < counts[k]; x++)
+        {
+            ck_assert (lca_merkle_root (digests[x], &proofs[x], again));
+            ck_assert (0 == memcmp (root, again, 32));
+        }
+    }
+
+    ck_assert (lca_p256_keygen (priv, pub));
+    ck_assert (soft_sign (priv, root, proofs[0].signature));
+    for (x = 1; x < MERKLE_LEAVES; x++)
+        memcpy (proofs[x].signature, proofs[0].signature, 64);
+
+    for (x = 0; x < MERKLE_LEAVES; x++)
+        ck_assert (lca_merkle_verify (pub, digests[x], &proofs[x]));
+
+    /* Tampering with the digest, path, index or shape is caught */
+    ck_assert (!lca_merkle_verify (pub, digests[1], &proofs[0]));
+
+    bad = proofs[5];
+    bad.path[2][7] ^= 0x01;
+    ck_assert (!lca_merkle_verify (pub, digests[5], &bad));
+
+    bad = proofs[5];
+    bad.index = 4;
+    ck_assert (!lca_merkle_verify (pub, digests[5], &bad));
+
+    bad = proofs[5];
+    bad.index = MERKLE_LEAVES;
+    ck_assert (!lca_merkle_root (digests[5], &bad, again));
+
+    bad = proofs[5];
+    bad.depth--;
+    ck_assert (!lca_merkle_root (digests[5], &bad, again));
+
+    /* Concurrent callers share roots, and batches never exceed the cap */
+    signer = merkle_signer_new (soft_sign, priv, 20000, 5);
+    ck_assert (NULL != signer);
+
+    for (x = 0; x < MERKLE_CALLERS; x++)
+    {
+        callers[x].signer = signer;
+        memcpy (callers[x].digest, digests[x], 32);
+        ck_assert (0 == pthread_create (&threads[x], NULL, merkle_call,
+                                        &callers[x]));
+    }
+
+    for (x = 0; x < MERKLE_CALLERS; x++)
+    {
+        ck_assert (0 == pthread_join (threads[x], NULL));
+        ck_assert (callers[x].ok);
+        ck_assert (callers[x].proof.count >= 1);
+        ck_assert (callers[x].proof.count <= 5);
+        ck_assert (lca_merkle_verify (pub, callers[x].digest,
+                                      &callers[x].proof));
+    }
+
+    ck_assert (lca_merkle_sign (signer, digests[0], &bad));
+    ck_assert (1 == bad.count);
+    ck_assert (lca_merkle_verify (pub, digests[0], &bad));
+
+    lca_merkle_signer_free (signer);
+}
+END_TEST
+
 START_TEST(t_hkdf_extract)
 {
     int rc, testno, okm_len, L;
@@ -510,6 +1514,7 @@ START_TEST(t_hkdf_extract)
     unsigned char prk[LCA_SHA256_DLEN+1];
     unsigned char okm[MAX_OKM_LEN+1];
 
+    memset (prk, 0, sizeof(prk));
     memset (okm, 0, sizeof(okm));
 
 
@@ -550,7 +1555,7 @@ START_TEST(t_hkdf_extract)
 
     L = 42;
 
-    rc = lca_hkdf_256_expand(prk, sizeof(prk),
+    rc = lca_hkdf_256_expand(prk, LCA_SHA256_DLEN,
                              info, sizeof (info),
                              okm, L);
 
@@ -573,6 +1578,223 @@ START_TEST(t_hkdf_extract)
 }
 END_TEST
 
+START_TEST(t_hkdf_ctx)
+{
+    /* RFC 5869 test case 1 */
+    const uint8_t ikm[22] = {0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+                             0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b,
+                             0x0b, 0x0b, 0x0b, 0x0b, 0x0b, 0x0b};
+    const uint8_t salt[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                            0x08, 0x09, 0x0a, 0x0b, 0x0c};
+    const uint8_t info[] = {0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+                            0xf8, 0xf9};
+    const uint8_t okm_kat[] = {0x3c, 0xb2, 0x5f, 0x25, 0xfa, 0xac, 0xd5, 0x7a,
+                               0x90, 0x43, 0x4f, 0x64, 0xd0, 0x36, 0x2f, 0x2a,
+                               0x2d, 0x2d, 0x0a, 0x90, 0xcf, 0x1a, 0x5a, 0x4c,
+                               0x5d, 0xb0, 0x2d, 0x56, 0xec, 0xc4, 0xc5, 0xbf,
+                               0x34, 0x00, 0x72, 0x08, 0xd5, 0xb8, 0x87, 0x18,
+                               0x58, 0x65};
+    const unsigned int pieces[] = {1, 5, 26, 10};
+    const enum SHA256_MB_IMPL impls[] = {SHA256_MB_SCALAR, SHA256_MB_AVX2,
+                                         SHA256_MB_AVX512, SHA256_MB_AUTO};
+#define HKDF_ITEMS 41
+    static uint8_t labels[HKDF_ITEMS][40], outs[HKDF_ITEMS][200];
+    static uint8_t okm[1000], ref[1000];
+    struct lca_hkdf_item items[HKDF_ITEMS];
+    struct lca_hkdf_ctx ctx;
+    struct lca_hkdf_stream st;
+    uint8_t prk[LCA_SHA256_DLEN];
+    unsigned int x, y, off;
+
+    lca_hkdf_init (&ctx, salt, sizeof (salt), ikm, sizeof (ikm));
+
+    /* Reads across block boundaries */
+    lca_hkdf_start (&st, &ctx, info, sizeof (info));
+    for (x = 0, off = 0; x < sizeof (pieces) / sizeof (pieces[0]); x++)
+    {
+        ck_assert (lca_hkdf_read (&st, okm + off, pieces[x]));
+        off += pieces[x];
+    }
+    ck_assert (0 == memcmp (okm, okm_kat, sizeof (okm_kat)));
+
+    /* A longer stream matches the one shot expand */
+    ck_assert (0 == lca_hkdf_256_extract (salt, sizeof (salt), ikm,
+                                          sizeof (ikm), prk));
+    ck_assert (0 == lca_hkdf_256_expand (prk, sizeof (prk), info,
+                                         sizeof (info), ref, sizeof (ref)));
+    lca_hkdf_start (&st, &ctx, info, sizeof (info));
+    for (off = 0, x = 0; off < sizeof (okm); off += y, x++)
+    {
+        y = (x * 7) % 45;
+        if (y > sizeof (okm) - off)
+            y = sizeof (okm) - off;
+        ck_assert (lca_hkdf_read (&st, okm + off, y));
+    }
+    ck_assert (0 == memcmp (okm, ref, sizeof (ref)));
+
+    /* The stream ends at 255 blocks */
+    lca_hkdf_start (&st, &ctx, NULL, 0);
+    for (off = 0; off < LCA_HKDF_MAX_LEN - 3; off += y)
+    {
+        y = LCA_HKDF_MAX_LEN - 3 - off < sizeof (okm)
+            ? LCA_HKDF_MAX_LEN - 3 - off : sizeof (okm);
+        ck_assert (lca_hkdf_read (&st, okm, y));
+    }
+    ck_assert (!lca_hkdf_read (&st, okm, 4));
+    ck_assert (lca_hkdf_read (&st, okm, 3));
+    ck_assert (!lca_hkdf_read (&st, okm, 1));
+    ck_assert (lca_hkdf_read (&st, okm, 0));
+    lca_hkdf_stream_wipe (&st);
+
+    /* Batches of short and long labels and lengths */
+    fill_random ((uint8_t *)labels, sizeof (labels));
+
+    for (x = 0; x < HKDF_ITEMS; x++)
+    {
+        items[x].info = labels[x];
+        items[x].info_len = x % 40;
+        items[x].okm = outs[x];
+        items[x].len = 1 + (x * 37) % 200;
+    }
+
+    for (y = 0; y < sizeof (impls) / sizeof (impls[0]); y++)
+    {
+        if (!sha256_mb_select (impls[y]))
+            continue;
+
+        memset (outs, 0, sizeof (outs));
+        ck_assert (lca_hkdf_expand_batch (&ctx, items, HKDF_ITEMS));
+
+        for (x = 0; x < HKDF_ITEMS; x++)
+        {
+            ck_assert (0 == lca_hkdf_256_expand (prk, sizeof (prk),
+                                                 labels[x], items[x].info_len,
+                                                 ref, items[x].len));
+            ck_assert (0 == memcmp (outs[x], ref, items[x].len));
+        }
+    }
+
+    items[3].len = LCA_HKDF_MAX_LEN + 1;
+    ck_assert (!lca_hkdf_expand_batch (&ctx, items, HKDF_ITEMS));
+
+    lca_hkdf_wipe (&ctx);
+}
+END_TEST
+
+START_TEST(t_sym_commands)
+{
+    /* From hashlib over the datasheet message layouts */
+    static const uint8_t nonce[32] = {
+        0x56, 0x1b, 0xb4, 0xe3, 0x2f, 0xbe, 0xf5, 0xd0,
+        0xd4, 0x24, 0x2d, 0xc2, 0x2e, 0x5a, 0x78, 0xfb,
+        0x28, 0x21, 0x26, 0xfe, 0x73, 0x42, 0xbf, 0x85,
+        0xc9, 0xfd, 0x14, 0xc2, 0xf1, 0x0f, 0x5e, 0x7f
+    };
+    static const uint8_t gen_dig[32] = {
+        0x2f, 0x3c, 0x19, 0xf7, 0x92, 0xbc, 0x34, 0x5a,
+        0xef, 0x0c, 0xc5, 0xc7, 0xdb, 0xad, 0xeb, 0xfd,
+        0x1a, 0x89, 0x47, 0x7b, 0x5a, 0x71, 0x06, 0x6e,
+        0xcc, 0x6a, 0xd8, 0xe6, 0x2c, 0xbd, 0x7f, 0x67
+    };
+    static const uint8_t derived[32] = {
+        0x7f, 0x96, 0x83, 0xd8, 0x40, 0x44, 0x45, 0x65,
+        0xd0, 0xe4, 0xe7, 0x26, 0x33, 0xf2, 0x69, 0x65,
+        0xc5, 0xad, 0x0d, 0x9c, 0xfe, 0xc1, 0x84, 0x81,
+        0xc1, 0x48, 0x90, 0x2c, 0xac, 0x8a, 0x57, 0xb0
+    };
+    static const uint8_t derive_mac[32] = {
+        0xfc, 0x71, 0xd1, 0x1a, 0x86, 0xb3, 0x67, 0xdf,
+        0x18, 0x9b, 0x06, 0x7c, 0xee, 0xb2, 0x34, 0xaf,
+        0xab, 0xb8, 0x26, 0x27, 0xee, 0x11, 0x03, 0xaa,
+        0x22, 0x9f, 0xda, 0xcd, 0xc9, 0x0e, 0xd1, 0x58
+    };
+    const uint8_t sn[LCA_SERIAL_NUM_LEN] = {
+        0x01, 0x23, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0xEE
+    };
+    uint8_t key[32], tempkey[32], rand_out[32], num_in[LCA_NONCE_NUM_IN_LEN];
+    uint8_t challenge[32], otp[64], out[32], mac[32];
+    uint8_t data[LCA_CHECK_MAC_DATA_LEN];
+    uint8_t other[LCA_CHECK_MAC_OTHER_LEN];
+    struct lca_mac_template t;
+    struct Command_ATSHA204 c;
+    unsigned int x;
+
+    for (x = 0; x < sizeof (key); x++)
+    {
+        key[x] = x;
+        tempkey[x] = 0x80 + x;
+        rand_out[x] = 0x40 + x;
+    }
+    for (x = 0; x < sizeof (num_in); x++)
+        num_in[x] = 0xA0 + x;
+
+    lca_nonce_compute (rand_out, num_in, 0, out);
+    ck_assert (0 == memcmp (out, nonce, sizeof (out)));
+
+    lca_gen_dig_compute (key, DATA_ZONE, 3, NULL, tempkey, out);
+    ck_assert (0 == memcmp (out, gen_dig, sizeof (out)));
+    /* Only the fixed bytes of the serial number are hashed */
+    lca_gen_dig_compute (key, DATA_ZONE, 3, sn, tempkey, out);
+    ck_assert (0 == memcmp (out, gen_dig, sizeof (out)));
+
+    lca_derive_key_compute (key, LCA_DERIVE_KEY_MODE_RANDOM, 7, sn, tempkey,
+                            out);
+    ck_assert (0 == memcmp (out, derived, sizeof (out)));
+    lca_derive_key_mac (key, LCA_DERIVE_KEY_MODE_RANDOM, 7, sn, out);
+    ck_assert (0 == memcmp (out, derive_mac, sizeof (out)));
+
+    /* A CheckMac whose other data holds the MAC command bytes is the
+       MAC when the serial number bytes are left out */
+    fill_random (challenge, sizeof (challenge));
+    fill_random (otp, sizeof (otp));
+    memset (other, 0, sizeof (other));
+    other[0] = 0x08;
+    other[2] = 5;
+    for (x = 0; x < 2; x++)
+    {
+        const uint8_t mode = x ? LCA_MAC_MODE_OTP64 : 0;
+
+        other[1] = mode;
+        ck_assert (lca_mac_template_init (&t, 0x08, mode, 5, key, otp, sn));
+        lca_mac_compute (&t, challenge, NULL, mac);
+        lca_check_mac_compute (key, challenge, mode, other, otp, sn, out);
+        ck_assert (0 == memcmp (out, mac, sizeof (out)));
+    }
+    lca_mac_template_wipe (&t);
+
+    /* The builders */
+    c = lca_build_mac_cmd (0, 5, challenge);
+    ck_assert (0x08 == c.opcode); ck_assert (0 == c.param1);
+    ck_assert (5 == c.param2[0]); ck_assert (0 == c.param2[1]);
+    ck_assert (32 == c.data_len);
+    c = lca_build_mac_cmd (LCA_MAC_MODE_CHALLENGE_TEMPKEY, 5, NULL);
+    ck_assert (LCA_MAC_MODE_CHALLENGE_TEMPKEY == c.param1);
+    ck_assert (0 == c.data_len);
+
+    memset (data, 0, sizeof (data));
+    c = lca_build_check_mac_cmd (LCA_MAC_MODE_OTP64, 9, data);
+    ck_assert (0x28 == c.opcode);
+    ck_assert (LCA_MAC_MODE_OTP64 == c.param1); ck_assert (9 == c.param2[0]);
+    ck_assert (77 == c.data_len);
+
+    c = lca_build_hmac_cmd (LCA_MAC_MODE_SOURCE_FLAG, 2);
+    ck_assert (0x11 == c.opcode);
+    ck_assert (LCA_MAC_MODE_SOURCE_FLAG == c.param1);
+    ck_assert (2 == c.param2[0]); ck_assert (0 == c.data_len);
+
+    c = lca_build_gen_dig_cmd (OTP_ZONE, 1);
+    ck_assert (0x15 == c.opcode); ck_assert (1 == c.param1);
+    ck_assert (1 == c.param2[0]); ck_assert (0 == c.data_len);
+
+    c = lca_build_derive_key_cmd (LCA_DERIVE_KEY_MODE_RANDOM, 7, mac);
+    ck_assert (0x1C == c.opcode);
+    ck_assert (LCA_DERIVE_KEY_MODE_RANDOM == c.param1);
+    ck_assert (7 == c.param2[0]); ck_assert (32 == c.data_len);
+    c = lca_build_derive_key_cmd (0, 7, NULL);
+    ck_assert (0 == c.data_len);
+}
+END_TEST
+
 START_TEST(t_hkdf_tc2)
 {
     uint8_t ikm[]  = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
@@ -688,8 +1910,18 @@ Suite * hmac_suite(void)
     tcase_add_test(tc_core, test_hmac_key_slot);
     tcase_add_test(tc_core, t_hkdf_extract);
     tcase_add_test(tc_core, t_hmac_vectors);
+    tcase_add_test(tc_core, t_sha256_impls);
+    tcase_add_test(tc_core, t_sha256_file);
+    tcase_add_test(tc_core, t_hmac_ctx);
+    tcase_add_test(tc_core, t_mac_batch);
+    tcase_add_test(tc_core, t_mac_template);
     tcase_add_test(tc_core, t_hkdf_tc2);
     tcase_add_test(tc_core, t_hkdf_tc3);
+    tcase_add_test(tc_core, t_hkdf_ctx);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Commands");
+    tcase_add_test(tc_core, t_sym_commands);
     suite_add_tcase(s, tc_core);
 
     return s;
@@ -707,6 +1939,12 @@ Suite * ecdsa_suite(void)
 
     //tcase_add_test(tc_core, test_ecdsa_key_pair);
     tcase_add_test(tc_core, ecdsa_soft_key_pair);
+    tcase_add_test(tc_core, ecdsa_verify_cache);
+    tcase_add_test(tc_core, ecdsa_inventory);
+    tcase_add_test(tc_core, t_backends);
+    tcase_add_test(tc_core, t_p256_key);
+    tcase_add_test(tc_core, t_verify_pool);
+    tcase_add_test(tc_core, t_merkle);
     suite_add_tcase(s, tc_core);
 
     return s;
@@ -0,0 +1,632 @@
+#include <check.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../libcryptoauth.h"
+#include "test_util.h"
+#include "fake_device.h"
+#include "../src/devstore.h"
+#include "../src/ecdh_cache.h"
+#include "../src/zone_cache.h"
+#include "../src/zone_plan.h"
+
+START_TEST(test_hex_encode)
+{
+    uint8_t bin[300];
+    char hex[2 * sizeof(bin)];
+    char ref[2 * sizeof(bin) + 1];
+    unsigned int len, x;
+
+    for (x = 0; x < sizeof(bin); x++)
+        bin[x] = (uint8_t)(x * 37 + 11);
+
+    /* Cover the vector bodies and every scalar tail length */
+    for (len = 0; len <= sizeof(bin); len++)
+    {
+        lca_hex_encode (bin, len, hex);
+
+        for (x = 0; x < len; x++)
+            sprintf (ref + 2 * x, "%02X", bin[x]);
+
+        ck_assert (0 == memcmp (hex, ref, 2 * len));
+    }
+}
+END_TEST
+
+START_TEST(test_hex_decode)
+{
+    uint8_t bin[300];
+    uint8_t out[sizeof(bin)];
+    char hex[2 * sizeof(bin)];
+    unsigned int len, x;
+
+    for (x = 0; x < sizeof(bin); x++)
+        bin[x] = (uint8_t)(x * 53 + 7);
+
+    lca_hex_encode (bin, sizeof(bin), hex);
+
+    for (len = 0; len <= sizeof(bin); len++)
+    {
+        memset (out, 0, sizeof(out));
+        ck_assert (0 == lca_hex_decode (hex, 2 * len, out));
+        ck_assert (0 == memcmp (bin, out, len));
+    }
+
+    /* Lower case decodes the same */
+    for (x = 0; x < sizeof(hex); x++)
+        if (hex[x] >= 'A' && hex[x] <= 'F')
+            hex[x] += 'a' - 'A';
+
+    ck_assert (0 == lca_hex_decode (hex, sizeof(hex), out));
+    ck_assert (0 == memcmp (bin, out, sizeof(bin)));
+
+    /* Odd lengths are rejected */
+    ck_assert (0 != lca_hex_decode (hex, 3, out));
+}
+END_TEST
+
+START_TEST(test_hex_decode_invalid)
+{
+    static const char bad[] = "gG:/@`\x7f \xff";
+    uint8_t out[150];
+    char hex[300];
+    unsigned int pos, x;
+
+    /* A single bad character anywhere must be caught by both the
+       vector and the scalar paths */
+    for (x = 0; x < strlen (bad); x++)
+        for (pos = 0; pos < sizeof(hex); pos += 7)
+        {
+            memset (hex, '0', sizeof(hex));
+            hex[pos] = bad[x];
+            ck_assert (0 != lca_hex_decode (hex, sizeof(hex), out));
+        }
+}
+END_TEST
+
+START_TEST(test_ascii_hex_2_bin)
+{
+    struct lca_octet_buffer r;
+
+    r = lca_ascii_hex_2_bin ("0x0aFf", 10);
+    ck_assert (NULL != r.ptr);
+    ck_assert (2 == r.len);
+    ck_assert (0x0A == r.ptr[0] && 0xFF == r.ptr[1]);
+    lca_free_octet_buffer (r);
+
+    ck_assert (!lca_is_all_hex ("0aZf", 4));
+
+    ck_assert (0x0B == lca_c2b ('b'));
+    ck_assert (0x0F == lca_c2b ('f'));
+    ck_assert (UINT_MAX == lca_c2b ('g'));
+    ck_assert (UINT_MAX == lca_c2b ('z'));
+}
+END_TEST
+
+START_TEST(test_devstore_open)
+{
+    char path[] = "/tmp/lca_devstore_XXXXXX";
+    const char junk[] = "not a device store";
+    struct stat st;
+    off_t empty_size;
+    ino_t old_ino;
+    char *map;
+    int fd;
+
+    fd = mkstemp (path);
+    ck_assert (fd >= 0);
+
+    ck_assert (lca_devstore_open (path));
+    ck_assert (0 == stat (path, &st));
+    empty_size = st.st_size;
+    ck_assert (empty_size > 0);
+    lca_devstore_close ();
+
+    /* A valid store is reused as is */
+    ck_assert (lca_devstore_open (path));
+    ck_assert (0 == stat (path, &st));
+    ck_assert (empty_size == st.st_size);
+    lca_devstore_close ();
+
+    /* Anything else is rebuilt in a new file, so a mapping of the old
+       one, as another process would hold, stays readable */
+    close (fd);
+    fd = open (path, O_RDWR);
+    ck_assert (fd >= 0);
+    map = mmap (NULL, empty_size, PROT_READ, MAP_SHARED, fd, 0);
+    ck_assert (MAP_FAILED != map);
+    ck_assert ((ssize_t) sizeof (junk) == pwrite (fd, junk, sizeof (junk), 0));
+    ck_assert (0 == stat (path, &st));
+    old_ino = st.st_ino;
+    ck_assert (lca_devstore_open (path));
+    ck_assert (0 == stat (path, &st));
+    ck_assert (empty_size == st.st_size);
+    ck_assert (old_ino != st.st_ino);
+    ck_assert (0 == memcmp (map, junk, sizeof (junk)));
+    ck_assert (0 == map[empty_size - 1]);
+    munmap (map, empty_size);
+
+    /* Without a store a device can not be attached */
+    lca_devstore_close ();
+    ck_assert (!lca_devstore_attach (fd));
+
+    close (fd);
+    unlink (path);
+}
+END_TEST
+
+START_TEST(test_devstore_attach)
+{
+    char path[] = "/tmp/lca_devstore_XXXXXX";
+    uint8_t config[FAKE_CONFIG_SIZE], otp[FAKE_OTP_SIZE];
+    uint8_t key[64], out[64], image[FAKE_CONFIG_SIZE];
+    struct fake_device dev, unlocked;
+    unsigned int reads;
+    int fd, status;
+
+    fd = mkstemp (path);
+    ck_assert (fd >= 0);
+    close (fd);
+
+    fake_device_default_config (config, 0x42);
+    memset (otp, 0x5A, sizeof (otp));
+    memset (key, 0x33, sizeof (key));
+    ck_assert (fake_device_start (&dev, config, otp, NULL));
+
+    /* The first attach adds the record, the zones are then read from
+       the device and recorded */
+    ck_assert (lca_devstore_open (path));
+    ck_assert (lca_devstore_attach (dev.fd));
+    ck_assert (!zone_cache_peek (dev.fd, CONFIG_ZONE, image));
+    ck_assert (zone_cache_get_config (dev.fd, image));
+    ck_assert (zone_cache_get_otp (dev.fd, image));
+
+    ck_assert (!devstore_get_pub_key (dev.fd, 3, out));
+    devstore_record_pub_key (dev.fd, 3, key);
+    ck_assert (devstore_get_pub_key (dev.fd, 3, out));
+    ck_assert (0 == memcmp (out, key, sizeof (key)));
+
+    /* As a new process: the attach reads two blocks and seeds the
+       zone cache from the store */
+    lca_flush_zone_cache (dev.fd);
+    lca_devstore_close ();
+    ck_assert (lca_devstore_open (path));
+    reads = fake_device_count (&dev, 0x02);
+    ck_assert (lca_devstore_attach (dev.fd));
+    ck_assert (reads + 2 == fake_device_count (&dev, 0x02));
+    ck_assert (zone_cache_peek (dev.fd, CONFIG_ZONE, image));
+    ck_assert (0 == memcmp (image, config, sizeof (config)));
+    ck_assert (zone_cache_peek (dev.fd, OTP_ZONE, image));
+    ck_assert (0 == memcmp (image, otp, sizeof (otp)));
+    ck_assert (devstore_get_pub_key (dev.fd, 3, out));
+
+    /* Writing the slot drops its key */
+    zone_cache_invalidate (dev.fd, DATA_ZONE, 3 << 3);
+    ck_assert (!devstore_get_pub_key (dev.fd, 3, out));
+    devstore_record_pub_key (dev.fd, 4, key);
+    devstore_drop_pub_key (dev.fd, 4);
+    ck_assert (!devstore_get_pub_key (dev.fd, 4, out));
+    devstore_record_pub_key (dev.fd, 5, key);
+
+    /* A rebuild by another process detaches this one */
+    if (0 == fork ())
+    {
+        const char junk[] = "not a device store";
+
+        lca_devstore_close ();
+        fd = open (path, O_WRONLY);
+        if (fd < 0 || (ssize_t) sizeof (junk) != write (fd, junk,
+                                                        sizeof (junk)))
+            _exit (1);
+        _exit (lca_devstore_open (path) ? 0 : 1);
+    }
+    ck_assert (-1 != wait (&status));
+    ck_assert (WIFEXITED (status) && 0 == WEXITSTATUS (status));
+    ck_assert (!devstore_get_pub_key (dev.fd, 5, out));
+    devstore_record_pub_key (dev.fd, 5, key);
+    ck_assert (!devstore_get_pub_key (dev.fd, 5, out));
+    ck_assert (lca_devstore_attach (dev.fd));
+    devstore_record_pub_key (dev.fd, 5, key);
+    ck_assert (devstore_get_pub_key (dev.fd, 5, out));
+
+    /* A device whose lock bytes changed starts over */
+    lca_flush_zone_cache (dev.fd);
+    fake_device_stop (&dev);
+    config[87] = 0x55;
+    ck_assert (fake_device_start (&unlocked, config, otp, NULL));
+    ck_assert (lca_devstore_attach (unlocked.fd));
+    ck_assert (!zone_cache_peek (unlocked.fd, CONFIG_ZONE, image));
+    ck_assert (!devstore_get_pub_key (unlocked.fd, 5, out));
+
+    lca_flush_zone_cache (unlocked.fd);
+    lca_devstore_close ();
+    fake_device_stop (&unlocked);
+    unlink (path);
+}
+END_TEST
+
+struct store_reader
+{
+    int fd;
+    const uint8_t *key;
+    int stop;
+    unsigned int reads;
+    unsigned int misses;
+};
+
+/* Reads a stored key until told to stop */
+static void *
+read_store (void *arg)
+{
+    struct store_reader *r = arg;
+    uint8_t out[64];
+
+    while (!__atomic_load_n (&r->stop, __ATOMIC_ACQUIRE))
+    {
+        if (!devstore_get_pub_key (r->fd, 3, out)
+            || 0 != memcmp (out, r->key, sizeof (out)))
+            r->misses++;
+
+        devstore_record_pub_key (r->fd, 3, r->key);
+        r->reads++;
+    }
+
+    return NULL;
+}
+
+START_TEST(test_devstore_grow)
+{
+    enum { GROW_DEVICES = 16 };
+    char path[] = "/tmp/lca_devstore_XXXXXX";
+    uint8_t config[FAKE_CONFIG_SIZE], key[64];
+    struct fake_device devs[GROW_DEVICES];
+    struct store_reader reader;
+    struct stat st;
+    pthread_t thread;
+    off_t empty_size;
+    unsigned int x;
+    int fd;
+
+    fd = mkstemp (path);
+    ck_assert (fd >= 0);
+    close (fd);
+
+    for (x = 0; x < GROW_DEVICES; x++)
+    {
+        fake_device_default_config (config, 0x10 + x);
+        ck_assert (fake_device_start (&devs[x], config, NULL, NULL));
+    }
+
+    memset (key, 0x33, sizeof (key));
+    ck_assert (lca_devstore_open (path));
+    ck_assert (0 == stat (path, &st));
+    empty_size = st.st_size;
+    ck_assert (lca_devstore_attach (devs[0].fd));
+    devstore_record_pub_key (devs[0].fd, 3, key);
+
+    /* Every new serial appends a record and remaps the store under
+       the reader */
+    memset (&reader, 0, sizeof (reader));
+    reader.fd = devs[0].fd;
+    reader.key = key;
+    ck_assert (0 == pthread_create (&thread, NULL, read_store, &reader));
+
+    for (x = 1; x < GROW_DEVICES; x++)
+    {
+        ck_assert (lca_devstore_attach (devs[x].fd));
+        devstore_detach (devs[x].fd);
+    }
+
+    __atomic_store_n (&reader.stop, 1, __ATOMIC_RELEASE);
+    ck_assert (0 == pthread_join (thread, NULL));
+    ck_assert (reader.reads > 0);
+    ck_assert (0 == reader.misses);
+
+    ck_assert (0 == stat (path, &st));
+    ck_assert (st.st_size > empty_size);
+
+    lca_devstore_close ();
+
+    /* Each child holds the host ends of the devices started before
+       it, so they are stopped newest first */
+    for (x = GROW_DEVICES; x-- > 0;)
+    {
+        lca_flush_zone_cache (devs[x].fd);
+        fake_device_stop (&devs[x]);
+    }
+
+    unlink (path);
+}
+END_TEST
+
+START_TEST(test_sign_batch)
+{
+    struct fake_device dev;
+    struct lca_sign_item items[3];
+    uint8_t config[FAKE_CONFIG_SIZE], digests[3][32];
+    unsigned int x;
+
+    fake_device_default_config (config, 0x42);
+    config[20 + 2 * 7] = 0x00;  /* Slot 7 can not sign */
+    ck_assert (fake_device_start (&dev, config, NULL, NULL));
+
+    for (x = 0; x < 3; x++)
+    {
+        memset (digests[x], x, sizeof (digests[x]));
+        items[x].digest = digests[x];
+    }
+
+    /* The config zone is not cached, so the device is woken before
+       the preflight reads it */
+    ck_assert (3 == lca_ecc_sign_batch (dev.fd, 2, items, 3));
+    ck_assert (FAKE_EVENT_WAKE == dev.log->events[0]);
+    ck_assert (0x02 == dev.log->events[1]);
+    ck_assert (3 == fake_device_count (&dev, 0x41));
+    for (x = 0; x < 3; x++)
+        ck_assert (items[x].ok);
+
+    /* A refused slot sends nothing and leaves the device idle */
+    ck_assert (0 == lca_ecc_sign_batch (dev.fd, 7, items, 3));
+    ck_assert (3 == fake_device_count (&dev, 0x41));
+    /* Idle has no reply; a wake's reply orders it */
+    ck_assert (lca_wakeup (dev.fd));
+    ck_assert (FAKE_EVENT_IDLE == dev.log->events[dev.log->count - 2]);
+    lca_idle (dev.fd);
+    for (x = 0; x < 3; x++)
+        ck_assert (!items[x].ok);
+
+    lca_flush_zone_cache (dev.fd);
+    fake_device_stop (&dev);
+}
+END_TEST
+
+/* Seeds more devices than the zone cache holds, so entries are
+   evicted under the readers */
+static void *
+evict_zones (void *arg)
+{
+    uint8_t config[FAKE_CONFIG_SIZE];
+    unsigned int x;
+
+    (void)arg;
+    memset (config, 0x77, sizeof (config));
+
+    for (x = 0; x < 20000; x++)
+    {
+        zone_cache_seed (1000 + x % 16, CONFIG_ZONE, config);
+        if (0 == x % 7)
+            lca_flush_zone_cache (1000 + x % 16);
+    }
+
+    return NULL;
+}
+
+START_TEST(test_zone_cache_evict)
+{
+    uint8_t config[FAKE_CONFIG_SIZE], image[FAKE_CONFIG_SIZE];
+    struct lca_config_view view;
+    pthread_t evictor;
+    unsigned int x, copies = 0;
+
+    fake_device_default_config (config, 0x42);
+
+    ck_assert (0 == pthread_create (&evictor, NULL, evict_zones, NULL));
+
+    /* A copy is either the whole image or nothing, never an entry
+       that was wiped or reused part way through */
+    for (x = 0; x < 20000; x++)
+    {
+        if (0 == x % 4)
+            zone_cache_seed (900, CONFIG_ZONE, config);
+
+        if (zone_cache_peek (900, CONFIG_ZONE, image))
+        {
+            ck_assert (0 == memcmp (image, config, sizeof (config)));
+            copies++;
+        }
+    }
+
+    ck_assert (0 == pthread_join (evictor, NULL));
+    ck_assert (copies > 0);
+
+    zone_cache_seed (900, CONFIG_ZONE, config);
+    ck_assert (zone_cache_get_view (900, &view));
+    ck_assert (0x42 == view.serial[0]);
+    ck_assert (lca_slot_can_sign (&view, 3));
+
+    lca_flush_zone_cache (900);
+}
+END_TEST
+
+START_TEST(test_ecdh_cache)
+{
+    uint8_t x[32], y[32], secret[32], out[32];
+    const int fd = 3;
+
+    memset (x, 0x11, sizeof (x));
+    memset (y, 0x22, sizeof (y));
+    memset (secret, 0x5A, sizeof (secret));
+
+    /* Disabled, nothing is cached */
+    ecdh_cache_insert (fd, 0, x, y, secret);
+    ck_assert (!ecdh_cache_lookup (fd, 0, x, y, out));
+
+    ck_assert (lca_ecdh_cache_enable (2, 60));
+    ck_assert (!ecdh_cache_lookup (fd, 0, x, y, out));
+
+    ecdh_cache_insert (fd, 0, x, y, secret);
+    ck_assert (ecdh_cache_lookup (fd, 0, x, y, out));
+    ck_assert (0 == memcmp (out, secret, sizeof (secret)));
+
+    /* Keyed by device and slot as well as the point */
+    ck_assert (!ecdh_cache_lookup (fd, 1, x, y, out));
+    ck_assert (!ecdh_cache_lookup (fd + 1, 0, x, y, out));
+
+    /* Least recently used entry is evicted */
+    ecdh_cache_insert (fd, 1, x, y, secret);
+    ck_assert (ecdh_cache_lookup (fd, 0, x, y, out));
+    ecdh_cache_insert (fd, 2, x, y, secret);
+    ck_assert (!ecdh_cache_lookup (fd, 1, x, y, out));
+    ck_assert (ecdh_cache_lookup (fd, 0, x, y, out));
+    ck_assert (ecdh_cache_lookup (fd, 2, x, y, out));
+
+    /* A new key in the slot drops its secrets */
+    ecdh_cache_invalidate_slot (fd, 0);
+    ck_assert (!ecdh_cache_lookup (fd, 0, x, y, out));
+    ck_assert (ecdh_cache_lookup (fd, 2, x, y, out));
+
+    ecdh_cache_invalidate_device (fd);
+    ck_assert (!ecdh_cache_lookup (fd, 2, x, y, out));
+
+    /* Entries expire */
+    ck_assert (lca_ecdh_cache_enable (4, 0));
+    ecdh_cache_insert (fd, 0, x, y, secret);
+    ck_assert (!ecdh_cache_lookup (fd, 0, x, y, out));
+
+    lca_ecdh_cache_disable ();
+}
+END_TEST
+
+START_TEST(test_zone_plan)
+{
+    uint32_t words[WORD_MAP_LEN];
+    struct zone_plan *plan = malloc (sizeof (*plan));
+    unsigned int x;
+
+    ck_assert (NULL != plan);
+    ck_assert (DATA_ZONE_SIZE == lca_data_slot_offset (16));
+    ck_assert (8 == data_offset_to_slot (lca_data_slot_offset (8) + 415));
+    ck_assert (9 == data_offset_to_slot (lca_data_slot_offset (9)));
+
+    /* The whole config zone is four 32 byte reads */
+    memset (words, 0, sizeof (words));
+    word_map_mark (words, 0, CONFIG_ZONE_SIZE);
+    plan_reads (CONFIG_ZONE, words, plan);
+    ck_assert (4 == plan->count);
+    for (x = 0; x < 4; x++)
+    {
+        ck_assert (32 == plan->ops[x].len);
+        ck_assert (x * 8 == plan->ops[x].addr);
+        ck_assert (x * 32 == plan->ops[x].offset);
+    }
+
+    /* Two words are cheaper one at a time, three are not */
+    memset (words, 0, sizeof (words));
+    word_map_mark (words, 4, 5);
+    plan_reads (CONFIG_ZONE, words, plan);
+    ck_assert (2 == plan->count);
+    ck_assert (4 == plan->ops[0].len && 1 == plan->ops[0].addr);
+    ck_assert (4 == plan->ops[1].len && 2 == plan->ops[1].addr);
+
+    word_map_mark (words, 12, 1);
+    plan_reads (CONFIG_ZONE, words, plan);
+    ck_assert (1 == plan->count);
+    ck_assert (32 == plan->ops[0].len && 0 == plan->ops[0].addr);
+
+    /* Slot 1 and the first bytes of slot 2: the slot tails past the
+       first block are only reachable a word at a time */
+    memset (words, 0, sizeof (words));
+    word_map_mark (words, lca_data_slot_offset (1), 40);
+    plan_reads (DATA_ZONE, words, plan);
+    ck_assert (3 == plan->count);
+    ck_assert (32 == plan->ops[0].len && (1 << 3) == plan->ops[0].addr);
+    ck_assert (4 == plan->ops[1].len && 0x0108 == plan->ops[1].addr);
+    ck_assert (lca_data_slot_offset (1) + 32 == plan->ops[1].offset);
+    ck_assert (4 == plan->ops[2].len && (2 << 3) == plan->ops[2].addr);
+
+    /* Blocks past the first carry the block number in the high byte */
+    memset (words, 0, sizeof (words));
+    word_map_mark (words, lca_data_slot_offset (9), 72);
+    plan_reads (DATA_ZONE, words, plan);
+    ck_assert (4 == plan->count);
+    ck_assert (0x0048 == plan->ops[0].addr);
+    ck_assert (0x0148 == plan->ops[1].addr);
+    ck_assert (0x0248 == plan->ops[2].addr && 4 == plan->ops[2].len);
+    ck_assert (0x0249 == plan->ops[3].addr && 4 == plan->ops[3].len);
+
+    /* Writes only use 32 bytes for a fully covered block */
+    memset (words, 0, sizeof (words));
+    word_map_mark (words, lca_data_slot_offset (8) + 4, 60);
+    plan_writes (DATA_ZONE, words, plan);
+    ck_assert (8 == plan->count);
+    ck_assert (4 == plan->ops[0].len && 0x0041 == plan->ops[0].addr);
+    ck_assert (32 == plan->ops[7].len && 0x0140 == plan->ops[7].addr);
+
+    free (plan);
+}
+END_TEST
+
+START_TEST(test_plan_read_ranges)
+{
+    uint8_t serial[9], locks[2], config[CONFIG_ZONE_SIZE];
+    struct lca_read_request reqs[CONFIG_ZONE_SIZE / 4];
+    unsigned int x;
+
+    /* Serial number and lock bytes: one 32 byte and one 4 byte read */
+    reqs[0] = (struct lca_read_request){CONFIG_ZONE, 0, 4, serial};
+    reqs[1] = (struct lca_read_request){CONFIG_ZONE, 8, 5, serial + 4};
+    reqs[2] = (struct lca_read_request){CONFIG_ZONE, 86, 2, locks};
+    ck_assert (2 == lca_plan_read_ranges (reqs, 3));
+
+    /* Adding the first slot of the data zone costs one more command */
+    reqs[3] = (struct lca_read_request){DATA_ZONE, 0, 4, locks};
+    ck_assert (3 == lca_plan_read_ranges (reqs, 4));
+
+    /* The whole config zone a word at a time still takes four reads */
+    for (x = 0; x < CONFIG_ZONE_SIZE / 4; x++)
+        reqs[x] = (struct lca_read_request){CONFIG_ZONE, x * 4, 4,
+                                            config + x * 4};
+    ck_assert (4 == lca_plan_read_ranges (reqs, CONFIG_ZONE_SIZE / 4));
+
+    /* Ranges past the end of a zone are refused before any I/O */
+    reqs[0] = (struct lca_read_request){OTP_ZONE, OTP_ZONE_SIZE - 2, 4, locks};
+    ck_assert (!lca_read_ranges (-1, reqs, 1));
+}
+END_TEST
+
+Suite * util_suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create("Util");
+
+    /* Core test case */
+    tc_core = tcase_create("Hex");
+
+    tcase_add_test(tc_core, test_hex_encode);
+    tcase_add_test(tc_core, test_hex_decode);
+    tcase_add_test(tc_core, test_hex_decode_invalid);
+    tcase_add_test(tc_core, test_ascii_hex_2_bin);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Devstore");
+    tcase_add_test(tc_core, test_devstore_open);
+    tcase_add_test(tc_core, test_devstore_attach);
+    tcase_add_test(tc_core, test_devstore_grow);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Cache");
+    tcase_add_test(tc_core, test_ecdh_cache);
+    tcase_add_test(tc_core, test_zone_cache_evict);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Batch");
+    tcase_add_test(tc_core, test_sign_batch);
+    suite_add_tcase(s, tc_core);
+
+    tc_core = tcase_create("Plan");
+    tcase_add_test(tc_core, test_zone_plan);
+    tcase_add_test(tc_core, test_plan_read_ranges);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
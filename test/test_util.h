@@ -0,0 +1,10 @@
+#ifndef _TEST_UTIL_H_
+#define _TEST_UTIL_H_
+
+#include <check.h>
+
+
+Suite * util_suite(void);
+
+
+#endif
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include "../libcryptoauth.h"
 #include <libxml/parser.h>
 
@@ -59,6 +60,53 @@ START_TEST(test_build_otp)
 }
 END_TEST
 
+START_TEST(test_config_view)
+{
+    struct lca_octet_buffer cz = {ecc108, sizeof (ecc108)};
+    struct lca_config_view view;
+    const uint8_t serial[] = {0x01, 0x23, 0x53, 0x64,
+                              0x51, 0x2A, 0xCB, 0x1C, 0xEE};
+    uint8_t unlocked[sizeof (ecc108)];
+
+    ck_assert (lca_decode_config (cz, &view));
+    ck_assert (0 == memcmp (view.serial, serial, sizeof (serial)));
+    ck_assert (view.config_locked);
+    ck_assert (view.data_locked);
+    ck_assert (view.otp_read_only);
+
+    /* Slot 0: secret P256 private key, external signatures only */
+    ck_assert (0xA081 == view.slots[0].slot_config);
+    ck_assert (view.slots[0].is_private);
+    ck_assert (LCA_KEY_TYPE_P256 == view.slots[0].key_type);
+    ck_assert (lca_slot_can_sign (&view, 0));
+    ck_assert (!lca_slot_can_ecdh (&view, 0));
+    ck_assert (!lca_zone_can_read (&view, DATA_ZONE, 0 << 3));
+    ck_assert (!lca_zone_can_write (&view, DATA_ZONE, 0 << 3, false));
+
+    /* Slot 7 is not a private key */
+    ck_assert (!view.slots[7].is_private);
+    ck_assert (!lca_slot_can_sign (&view, 7));
+
+    ck_assert (lca_zone_can_read (&view, CONFIG_ZONE, 0));
+    ck_assert (!lca_zone_can_write (&view, CONFIG_ZONE, 8, false));
+    ck_assert (!lca_zone_can_write (&view, OTP_ZONE, 0, false));
+
+    /* Before the data zone is locked anything may be written */
+    memcpy (unlocked, ecc108, sizeof (ecc108));
+    unlocked[86] = 0x55;
+    cz.ptr = unlocked;
+
+    ck_assert (lca_decode_config (cz, &view));
+    ck_assert (!view.data_locked);
+    ck_assert (lca_zone_can_write (&view, DATA_ZONE, 0 << 3, false));
+    ck_assert (lca_zone_can_write (&view, OTP_ZONE, 0, false));
+    ck_assert (!lca_zone_can_read (&view, OTP_ZONE, 0));
+
+    cz.len = 64;
+    ck_assert (!lca_decode_config (cz, &view));
+}
+END_TEST
+
 Suite * xml_suite(void)
 {
     Suite *s;
@@ -72,6 +120,7 @@ Suite * xml_suite(void)
 
     tcase_add_test(tc_core, test_xml_parse);
     tcase_add_test(tc_core, test_build_otp);
+    tcase_add_test(tc_core, test_config_view);
     suite_add_tcase(s, tc_core);
 
 
@@ -1,4 +1,7 @@
 #include "test_hmac.h"
+#include "test_util.h"
+#include "test_binding.h"
+#include "test_entropy.h"
 #include <check.h>
 #include <assert.h>
 #include <errno.h>
@@ -8,7 +11,7 @@
 int main(void)
 {
     int number_failed;
-    Suite *s, *e, *x;
+    Suite *s, *e, *x, *u, *b, *r;
     SRunner *sr;
 
     assert (NULL != gcry_check_version (NULL));
@@ -20,10 +23,16 @@ int main(void)
     s = hmac_suite();
     e = ecdsa_suite();
     x = xml_suite();
+    u = util_suite();
+    b = binding_suite();
+    r = entropy_suite();
 
     sr = srunner_create(s);
     srunner_add_suite(sr, e);
     srunner_add_suite(sr, x);
+    srunner_add_suite(sr, u);
+    srunner_add_suite(sr, b);
+    srunner_add_suite(sr, r);
 
     srunner_run_all(sr, CK_NORMAL);
     number_failed = srunner_ntests_failed(sr);